@@ -0,0 +1,443 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    bypass.c
+//
+// The cache is a fixed size, 4 way set associative table.  Each bucket
+// keeps the hashes and last seen times of its entries together ahead of
+// the keys so a miss only touches the front of the bucket.  Keys are
+// canonical (lower endpoint first) so both directions of a flow share an
+// entry.  Nothing is ever allocated after startup: a full bucket gives up
+// its least recently seen entry.
+//
+// The parser only handles what is cheap to get exactly right: ethernet
+// with up to 2 vlan tags, linux cooked and raw ip, unfragmented ipv4 and
+// ipv6 without extension headers, tcp and udp.  Anything else returns
+// false and takes the normal path.  Flows are only added from packets
+// snort has decoded itself as not tunneled so the outer 5-tuple is the
+// flow that was whitelisted.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "bypass.h"
+#include "sfdaq.h"
+#include "snort.h"
+#include "util.h"
+#include "workers.h"
+
+#define BYPASS_WAYS 4
+
+#define TH_FIN  0x01
+#define TH_SYN  0x02
+#define TH_RST  0x04
+
+typedef struct _BypassKey
+{
+    uint32_t ip[2][4];
+    uint16_t port[2];
+    uint16_t vlan[2];
+    uint16_t asid;
+    uint8_t proto;
+    uint8_t family;
+} BypassKey;
+
+typedef struct _BypassBucket
+{
+    uint32_t hash[BYPASS_WAYS];  // 0 if unused
+    uint32_t last[BYPASS_WAYS];  // seconds
+    BypassKey key[BYPASS_WAYS];
+} BypassBucket;
+
+typedef struct _BypassStats
+{
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t adds;
+    uint64_t evictions;
+    uint64_t expired;
+    uint64_t closed;
+    uint64_t flushes;
+} BypassStats;
+
+static BypassBucket* table = NULL;
+static uint32_t mask = 0;
+static uint32_t timeout = FLOW_BYPASS_TIMEOUT;
+static int base_dlt = -1;
+
+static BypassStats stats;
+
+// the packet from the last lookup
+static BypassKey cur_key;
+static uint32_t cur_hash = 0;
+static uint32_t cur_time = 0;
+
+//-------------------------------------------------------------------------
+// parse
+//-------------------------------------------------------------------------
+
+static inline void SetEndpoint(
+    BypassKey* k, int i, const uint8_t* ip, unsigned n, const uint8_t* port)
+{
+    memcpy(k->ip[i], ip, n);
+    memcpy(k->port + i, port, 2);
+}
+
+// returns tcp flags + 1 (so udp is 1) or 0 if the packet can't be bypassed
+static int GetKey (
+    const DAQ_PktHdr_t* h, const uint8_t* pkt, BypassKey* k)
+{
+    uint32_t len = h->caplen, off = 0;
+    const uint8_t *src, *dst, *l4;
+    unsigned n, vlans = 0;
+    uint16_t type;
+
+    memset(k, 0, sizeof(*k));
+
+    switch ( base_dlt )
+    {
+    case DLT_EN10MB:
+        if ( len < 14 )
+            return 0;
+
+        type = (pkt[12] << 8) | pkt[13];
+        off = 14;
+
+        while ( type == 0x8100 || type == 0x88a8 || type == 0x9100 )
+        {
+            if ( vlans == 2 || off + 4 > len )
+                return 0;
+
+            k->vlan[vlans++] = ((pkt[off] << 8) | pkt[off+1]) & 0x0fff;
+            type = (pkt[off+2] << 8) | pkt[off+3];
+            off += 4;
+        }
+        break;
+
+#ifdef DLT_LINUX_SLL
+    case DLT_LINUX_SLL:
+        if ( len < 16 )
+            return 0;
+
+        type = (pkt[14] << 8) | pkt[15];
+        off = 16;
+        break;
+#endif
+
+    case DLT_RAW:
+#ifdef DLT_IPV4
+    case DLT_IPV4:
+#endif
+#ifdef DLT_IPV6
+    case DLT_IPV6:
+#endif
+        if ( len < 1 )
+            return 0;
+
+        type = ((pkt[0] >> 4) == 6) ? 0x86dd : 0x0800;
+        break;
+
+    default:
+        return 0;
+    }
+
+    pkt += off;
+    len -= off;
+
+    if ( type == 0x0800 )
+    {
+        unsigned hlen;
+
+        if ( len < 20 || (pkt[0] >> 4) != 4 )
+            return 0;
+
+        hlen = (pkt[0] & 0x0f) << 2;
+
+        // any fragment (MF or an offset)
+        if ( hlen < 20 || ((pkt[6] & 0x3f) | pkt[7]) )
+            return 0;
+
+        k->proto = pkt[9];
+        k->family = 4;
+        src = pkt + 12;
+        dst = pkt + 16;
+        n = 4;
+        off = hlen;
+    }
+    else if ( type == 0x86dd )
+    {
+        if ( len < 40 || (pkt[0] >> 4) != 6 )
+            return 0;
+
+        k->proto = pkt[6];
+        k->family = 6;
+        src = pkt + 8;
+        dst = pkt + 24;
+        n = 16;
+        off = 40;
+    }
+    else
+        return 0;
+
+    if ( k->proto == IPPROTO_TCP )
+    {
+        if ( off + 14 > len )
+            return 0;
+    }
+    else if ( k->proto == IPPROTO_UDP )
+    {
+        if ( off + 8 > len )
+            return 0;
+    }
+    else
+        return 0;
+
+    l4 = pkt + off;
+
+    {
+        int d = memcmp(src, dst, n);
+
+        if ( !d )
+            d = memcmp(l4, l4 + 2, 2);
+
+        if ( d <= 0 )
+        {
+            SetEndpoint(k, 0, src, n, l4);
+            SetEndpoint(k, 1, dst, n, l4 + 2);
+        }
+        else
+        {
+            SetEndpoint(k, 0, dst, n, l4 + 2);
+            SetEndpoint(k, 1, src, n, l4);
+        }
+    }
+#ifdef HAVE_DAQ_ADDRESS_SPACE_ID
+    k->asid = DAQ_GetAddressSpaceID(h);
+#endif
+
+    return (k->proto == IPPROTO_TCP) ? l4[13] + 1 : 1;
+}
+
+static inline uint32_t GetHash (const BypassKey* k)
+{
+    const uint32_t* w = (const uint32_t*)k;
+    unsigned i;
+    uint32_t h = 0;
+
+    for ( i = 0; i < sizeof(*k) / sizeof(*w); i++ )
+    {
+        h ^= w[i];
+        h *= 0x9e3779b1;
+        h = (h << 13) | (h >> 19);
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    // 0 marks an unused entry
+    return h ? h : 1;
+}
+
+//-------------------------------------------------------------------------
+// table
+//-------------------------------------------------------------------------
+
+static inline BypassBucket* GetBucket (uint32_t hash)
+{
+    return table + (hash & mask);
+}
+
+static inline int Find (BypassBucket* b, uint32_t hash, const BypassKey* k)
+{
+    int i;
+
+    for ( i = 0; i < BYPASS_WAYS; i++ )
+    {
+        if ( b->hash[i] == hash && !memcmp(b->key + i, k, sizeof(*k)) )
+            return i;
+    }
+    return -1;
+}
+
+static inline int Expired (const BypassBucket* b, int i, uint32_t now)
+{
+    // the clock can go backwards when reading files
+    return (now > b->last[i]) && (now - b->last[i] > timeout);
+}
+
+int FlowBypass_Lookup (const DAQ_PktHdr_t* h, const uint8_t* pkt)
+{
+    BypassBucket* b;
+    uint32_t hash;
+    int flags, i;
+
+    cur_hash = 0;
+
+    if ( !table )
+        return 0;
+
+    if ( !(flags = GetKey(h, pkt, &cur_key)) )
+        return 0;
+
+    stats.lookups++;
+    cur_time = (uint32_t)h->ts.tv_sec;
+    hash = GetHash(&cur_key);
+    b = GetBucket(hash);
+    i = Find(b, hash, &cur_key);
+
+    // setup and teardown go the long way and are never added
+    if ( (flags - 1) & (TH_SYN | TH_FIN | TH_RST) )
+    {
+        if ( i >= 0 )
+        {
+            b->hash[i] = 0;
+            stats.closed++;
+        }
+        return 0;
+    }
+    cur_hash = hash;
+
+    if ( i < 0 )
+        return 0;
+
+    if ( Expired(b, i, cur_time) )
+    {
+        b->hash[i] = 0;
+        stats.expired++;
+        return 0;
+    }
+    b->last[i] = cur_time;
+    stats.hits++;
+    return 1;
+}
+
+void FlowBypass_Add (void)
+{
+    BypassBucket* b;
+    int i, lru = 0;
+
+    if ( !cur_hash )
+        return;
+
+    b = GetBucket(cur_hash);
+
+    for ( i = 0; i < BYPASS_WAYS; i++ )
+    {
+        if ( !b->hash[i] )
+            break;
+
+        if ( b->hash[i] == cur_hash && !memcmp(b->key + i, &cur_key, sizeof(cur_key)) )
+        {
+            b->last[i] = cur_time;
+            cur_hash = 0;
+            return;
+        }
+        if ( b->last[i] < b->last[lru] )
+            lru = i;
+    }
+    if ( i == BYPASS_WAYS )
+    {
+        i = lru;
+
+        if ( Expired(b, i, cur_time) )
+            stats.expired++;
+        else
+            stats.evictions++;
+    }
+    b->hash[i] = cur_hash;
+    b->last[i] = cur_time;
+    b->key[i] = cur_key;
+
+    cur_hash = 0;
+    stats.adds++;
+}
+
+//-------------------------------------------------------------------------
+// setup
+//-------------------------------------------------------------------------
+
+void FlowBypass_Init (const SnortConfig* sc)
+{
+    uint32_t n = BYPASS_WAYS;
+
+    if ( table || !sc->flow_bypass_entries )
+        return;
+
+    if ( !Workers_IsRingWorker() && DAQ_CanWhitelist() )
+    {
+        LogMessage("Flow bypass: not needed since the DAQ whitelists flows.\n");
+        return;
+    }
+
+    while ( n < sc->flow_bypass_entries )
+        n <<= 1;
+
+    table = (BypassBucket*)SnortAlloc((n / BYPASS_WAYS) * sizeof(*table));
+    mask = (n / BYPASS_WAYS) - 1;
+    timeout = sc->flow_bypass_timeout;
+    base_dlt = DAQ_GetBaseProtocol();
+
+    LogMessage("Flow bypass: %u entries, %u second timeout.\n", n, timeout);
+}
+
+void FlowBypass_Term (void)
+{
+    if ( table )
+        free(table);
+
+    table = NULL;
+    mask = 0;
+    cur_hash = 0;
+}
+
+void FlowBypass_Flush (const SnortConfig* sc)
+{
+    if ( !table )
+        return;
+
+    memset(table, 0, (mask + 1) * sizeof(*table));
+    timeout = sc->flow_bypass_timeout;
+    cur_hash = 0;
+    stats.flushes++;
+}
+
+void FlowBypass_PrintStats (const char* separator)
+{
+    if ( !table )
+        return;
+
+    LogMessage("%s\n", separator);
+    LogMessage("Flow Bypass:\n");
+
+    LogMessage("%11s: " FMTu64("12") "\n", "Lookups", stats.lookups);
+    LogMessage("%11s: " FMTu64("12") "\n", "Hits", stats.hits);
+    LogMessage("%11s: " FMTu64("12") "\n", "Adds", stats.adds);
+    LogMessage("%11s: " FMTu64("12") "\n", "Evictions", stats.evictions);
+    LogMessage("%11s: " FMTu64("12") "\n", "Expired", stats.expired);
+    LogMessage("%11s: " FMTu64("12") "\n", "Closed", stats.closed);
+    LogMessage("%11s: " FMTu64("12") "\n", "Flushes", stats.flushes);
+}
+
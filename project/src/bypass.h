@@ -0,0 +1,59 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    bypass.h
+//
+// Flow bypass cache.  Once a flow gets a whitelist verdict the DAQ is
+// expected to stop sending it to us, but many DAQs can't (and in worker
+// mode the dispatcher never forwards verdicts) so every later packet of
+// the flow is fully decoded, preprocessed and looked up in stream5 only
+// to be passed again.  This cache remembers those flows by their raw
+// 5-tuple so the rest of the flow can be passed after a minimal L2-L4
+// parse.  Entries are aged out after an idle timeout and dropped on any
+// TCP SYN, FIN or RST so session setup and teardown still take the full
+// path.
+
+#ifndef __BYPASS_H__
+#define __BYPASS_H__
+
+#include <daq.h>
+
+struct _SnortConfig;
+
+#define FLOW_BYPASS_TIMEOUT 60  // default idle timeout in seconds
+
+// allocates the cache if configured; call once per packet process
+void FlowBypass_Init(const struct _SnortConfig*);
+void FlowBypass_Term(void);
+
+// returns true if the packet belongs to a bypassed flow
+int FlowBypass_Lookup(const DAQ_PktHdr_t*, const uint8_t* pkt);
+
+// adds the flow of the packet last given to FlowBypass_Lookup()
+void FlowBypass_Add(void);
+
+// forgets all flows, eg when verdicts may change after a reload
+void FlowBypass_Flush(const struct _SnortConfig*);
+
+void FlowBypass_PrintStats(const char* separator);
+
+#endif // __BYPASS_H__
+
@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    checksum.c
+//
+// Unfolded one's complement sums used by the in_chksum_*() routines in
+// checksum.h.  The sum of a buffer only has to be congruent mod 0xffff to
+// the sum of its 16 bit words so wider words can be added as is into a
+// 64 bit accumulator and folded once at the end (RFC 1071).  Native loads
+// are used throughout so the result is in the same byte order as the
+// checksum field in the packet.
+//
+// The implementation is picked once at startup by ChecksumInit().  Until
+// then (and on other architectures) the portable version is used.
+// ChecksumSelect() forces one by name for tools/bench/checksum_bench.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "sf_types.h"
+#include "checksum.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CKSUM_X86
+#include <immintrin.h>
+#endif
+
+//-------------------------------------------------------------------------
+// portable
+//-------------------------------------------------------------------------
+
+// the bytes left over from the wide loops
+static inline uint64_t cksum_tail(const uint8_t* b, uint32_t n, uint64_t sum)
+{
+    return sum + in_chksum_add_short(b, n);
+}
+
+static uint64_t cksum_add_scalar (const uint8_t* b, uint32_t n)
+{
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    uint32_t w[4];
+
+    while ( n >= 16 )
+    {
+        memcpy(w, b, sizeof(w));
+        s0 += w[0];
+        s1 += w[1];
+        s2 += w[2];
+        s3 += w[3];
+        b += 16;
+        n -= 16;
+    }
+    return cksum_tail(b, n, s0 + s1 + s2 + s3);
+}
+
+//-------------------------------------------------------------------------
+// x86
+// each 32 bit lane is widened to 64 bits before it is accumulated so
+// there is no carry to track regardless of length
+//-------------------------------------------------------------------------
+
+#ifdef CKSUM_X86
+__attribute__((target("sse2")))
+static uint64_t cksum_add_sse2 (const uint8_t* b, uint32_t n)
+{
+    const __m128i z = _mm_setzero_si128();
+    __m128i a0 = z, a1 = z;
+    uint64_t s[2];
+
+    while ( n >= 32 )
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)b);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(b + 16));
+
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v0, z));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v0, z));
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v1, z));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v1, z));
+        b += 32;
+        n -= 32;
+    }
+    _mm_storeu_si128((__m128i*)s, _mm_add_epi64(a0, a1));
+    return cksum_tail(b, n, s[0] + s[1]);
+}
+
+__attribute__((target("avx2")))
+static uint64_t cksum_add_avx2 (const uint8_t* b, uint32_t n)
+{
+    const __m256i z = _mm256_setzero_si256();
+    __m256i a0 = z, a1 = z;
+    uint64_t s[4];
+
+    while ( n >= 64 )
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)b);
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(b + 32));
+
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v0, z));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v0, z));
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v1, z));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v1, z));
+        b += 64;
+        n -= 64;
+    }
+    _mm256_storeu_si256((__m256i*)s, _mm256_add_epi64(a0, a1));
+    return cksum_tail(b, n, s[0] + s[1] + s[2] + s[3]);
+}
+#endif
+
+//-------------------------------------------------------------------------
+// dispatch
+//-------------------------------------------------------------------------
+
+ChecksumAddFunc cksum_add = cksum_add_scalar;
+static const char* cksum_impl = "scalar";
+
+void ChecksumInit (void)
+{
+#ifdef CKSUM_X86
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports("avx2") )
+    {
+        cksum_add = cksum_add_avx2;
+        cksum_impl = "avx2";
+    }
+    else if ( __builtin_cpu_supports("sse2") )
+    {
+        cksum_add = cksum_add_sse2;
+        cksum_impl = "sse2";
+    }
+#endif
+}
+
+int ChecksumSelect (const char* impl)
+{
+    if ( !strcmp(impl, "scalar") )
+    {
+        cksum_add = cksum_add_scalar;
+        cksum_impl = "scalar";
+        return 0;
+    }
+#ifdef CKSUM_X86
+    __builtin_cpu_init();
+
+    if ( !strcmp(impl, "avx2") && __builtin_cpu_supports("avx2") )
+    {
+        cksum_add = cksum_add_avx2;
+        cksum_impl = "avx2";
+        return 0;
+    }
+    if ( !strcmp(impl, "sse2") && __builtin_cpu_supports("sse2") )
+    {
+        cksum_add = cksum_add_sse2;
+        cksum_impl = "sse2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char* ChecksumImpl (void)
+{
+    return cksum_impl;
+}
+
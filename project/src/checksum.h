@@ -35,9 +35,12 @@
 #include "config.h"
 #endif
 
-#include "snort_debug.h"
+#include <string.h>
 #include <sys/types.h>
 
+#include "sf_types.h"
+#include "snort_debug.h"
+
 typedef struct
 {
     uint32_t sip[4], dip[4];
@@ -95,368 +98,169 @@ static inline unsigned short in_chksum_ip( unsigned short * w, int blen )
 }
 
 /*
-*  checksum tcp
-*
-*  h    - pseudo header - 12 bytes
-*  d    - tcp hdr + payload
-*  dlen - length of tcp hdr + payload in bytes
+*  unfolded one's complement sum of a buffer; see checksum.c
 *
+*  ChecksumInit() selects the fastest implementation for this cpu and
+*  must be called once before any packets are processed
 */
-static inline unsigned short in_chksum_tcp(pseudoheader *ph,
-    unsigned short * d, int dlen )
+typedef uint64_t (*ChecksumAddFunc)(const uint8_t* buf, uint32_t len);
+
+extern ChecksumAddFunc cksum_add;
+
+void ChecksumInit(void);
+const char* ChecksumImpl(void);
+
+/*
+*  force "scalar", "sse2" or "avx2"; returns -1 if that one isn't built
+*  in or the cpu doesn't have it
+*/
+int ChecksumSelect(const char* impl);
+
+/*
+*  fold a 64 bit sum to 16 bits with end around carry
+*/
+static inline uint16_t in_chksum_fold(uint64_t sum)
 {
-   uint16_t *h = (uint16_t *)ph;
-   unsigned int cksum;
-   unsigned short answer=0;
-
-   /* PseudoHeader must have 12 bytes */
-   cksum  = h[0];
-   cksum += h[1];
-   cksum += h[2];
-   cksum += h[3];
-   cksum += h[4];
-   cksum += h[5];
-
-   /* TCP hdr must have 20 hdr bytes */
-   cksum += d[0];
-   cksum += d[1];
-   cksum += d[2];
-   cksum += d[3];
-   cksum += d[4];
-   cksum += d[5];
-   cksum += d[6];
-   cksum += d[7];
-   cksum += d[8];
-   cksum += d[9];
-
-   dlen  -= 20; /* bytes   */
-   d     += 10; /* short's */
-
-   while(dlen >=32)
+   sum = (sum >> 32) + (sum & 0xffffffff);
+   sum = (sum >> 32) + (sum & 0xffffffff);
+   sum = (sum >> 16) + (sum & 0xffff);
+   sum = (sum >> 16) + (sum & 0xffff);
+
+   return (uint16_t)sum;
+}
+
+/*
+*  runs shorter than this are summed inline; for these the call through
+*  cksum_add costs more than the wide loads save
+*/
+#define CKSUM_INLINE_MAX 128
+
+/*
+*  unfolded sum of a short run; the odd byte goes in the first byte of
+*  a zero padded word
+*/
+static inline uint64_t in_chksum_add_short(const uint8_t* b, uint32_t n)
+{
+   uint64_t sum = 0, sum2 = 0;
+   uint32_t w[4];
+   uint16_t s;
+
+   // two chains so the adds overlap
+   while ( n >= 16 )
    {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     cksum += d[4];
-     cksum += d[5];
-     cksum += d[6];
-     cksum += d[7];
-     cksum += d[8];
-     cksum += d[9];
-     cksum += d[10];
-     cksum += d[11];
-     cksum += d[12];
-     cksum += d[13];
-     cksum += d[14];
-     cksum += d[15];
-     d     += 16;
-     dlen  -= 32;
+      memcpy(w, b, 16);
+      sum += (uint64_t)w[0] + w[1];
+      sum2 += (uint64_t)w[2] + w[3];
+      b += 16;
+      n -= 16;
    }
+   sum += sum2;
 
-   while(dlen >=8)
+   while ( n >= 4 )
    {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     d     += 4;
-     dlen  -= 8;
+      memcpy(w, b, 4);
+      sum += w[0];
+      b += 4;
+      n -= 4;
    }
-
-   while(dlen > 1)
+   if ( n >= 2 )
    {
-     cksum += *d++;
-     dlen  -= 2;
+      memcpy(&s, b, 2);
+      sum += s;
+      b += 2;
+      n -= 2;
    }
-
-   if( dlen == 1 )
+   if ( n )
    {
-    /* printf("new checksum odd byte-packet\n"); */
-    *(unsigned char*)(&answer) = (*(unsigned char*)d);
-
-    /* cksum += (uint16_t) (*(uint8_t*)d); */
-
-     cksum += answer;
+      s = 0;
+      *(uint8_t*)&s = *b;
+      sum += s;
    }
+   return sum;
+}
 
-   cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-   cksum += (cksum >> 16);
+static inline uint64_t in_chksum_add(const uint8_t* b, uint32_t n)
+{
+   if ( n < CKSUM_INLINE_MAX )
+      return in_chksum_add_short(b, n);
 
-   return (unsigned short)(~cksum);
+   return cksum_add(b, n);
 }
+
 /*
-*  checksum tcp for IPv6.
+*  checksum tcp
 *
 *  h    - pseudo header - 12 bytes
 *  d    - tcp hdr + payload
 *  dlen - length of tcp hdr + payload in bytes
 *
 */
-static inline unsigned short in_chksum_tcp6(pseudoheader6 *ph,
+static inline unsigned short in_chksum_tcp(pseudoheader *ph,
     unsigned short * d, int dlen )
 {
-   uint16_t *h = (uint16_t *)ph;
-   unsigned int cksum;
-   unsigned short answer=0;
-
-   /* PseudoHeader must have 36 bytes */
-   cksum  = h[0];
-   cksum += h[1];
-   cksum += h[2];
-   cksum += h[3];
-   cksum += h[4];
-   cksum += h[5];
-   cksum += h[6];
-   cksum += h[7];
-   cksum += h[8];
-   cksum += h[9];
-   cksum += h[10];
-   cksum += h[11];
-   cksum += h[12];
-   cksum += h[13];
-   cksum += h[14];
-   cksum += h[15];
-   cksum += h[16];
-   cksum += h[17];
-
-   /* TCP hdr must have 20 hdr bytes */
-   cksum += d[0];
-   cksum += d[1];
-   cksum += d[2];
-   cksum += d[3];
-   cksum += d[4];
-   cksum += d[5];
-   cksum += d[6];
-   cksum += d[7];
-   cksum += d[8];
-   cksum += d[9];
-
-   dlen  -= 20; /* bytes   */
-   d     += 10; /* short's */
-
-   while(dlen >=32)
-   {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     cksum += d[4];
-     cksum += d[5];
-     cksum += d[6];
-     cksum += d[7];
-     cksum += d[8];
-     cksum += d[9];
-     cksum += d[10];
-     cksum += d[11];
-     cksum += d[12];
-     cksum += d[13];
-     cksum += d[14];
-     cksum += d[15];
-     d     += 16;
-     dlen  -= 32;
-   }
+   uint64_t cksum;
 
-   while(dlen >=8)
-   {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     d     += 4;
-     dlen  -= 8;
-   }
-
-   while(dlen > 1)
-   {
-     cksum += *d++;
-     dlen  -= 2;
-   }
+   cksum  = in_chksum_add_short((const uint8_t*)ph, 12);
+   cksum += in_chksum_add((const uint8_t*)d, (uint32_t)dlen);
 
-   if( dlen == 1 )
-   {
-    /* printf("new checksum odd byte-packet\n"); */
-    *(unsigned char*)(&answer) = (*(unsigned char*)d);
-
-    /* cksum += (uint16_t) (*(uint8_t*)d); */
+   return (unsigned short)~in_chksum_fold(cksum);
+}
 
-     cksum += answer;
-   }
+/*
+*  checksum tcp for IPv6.
+*
+*  h    - pseudo header - 36 bytes
+*  d    - tcp hdr + payload
+*  dlen - length of tcp hdr + payload in bytes
+*
+*/
+static inline unsigned short in_chksum_tcp6(pseudoheader6 *ph,
+    unsigned short * d, int dlen )
+{
+   uint64_t cksum;
 
-   cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-   cksum += (cksum >> 16);
+   cksum  = in_chksum_add_short((const uint8_t*)ph, 36);
+   cksum += in_chksum_add((const uint8_t*)d, (uint32_t)dlen);
 
-   return (unsigned short)(~cksum);
+   return (unsigned short)~in_chksum_fold(cksum);
 }
 
 /*
-*  checksum udp
+*  checksum udp for IPv6.
 *
-*  h    - pseudo header - 12 bytes
+*  h    - pseudo header - 36 bytes
 *  d    - udp hdr + payload
-*  dlen - length of payload in bytes
+*  dlen - length of udp hdr + payload in bytes
 *
 */
 static inline unsigned short in_chksum_udp6(pseudoheader6 *ph,
     unsigned short * d, int dlen )
 {
-   uint16_t *h = (uint16_t *)ph;
-   unsigned int cksum;
-   unsigned short answer=0;
-
-   /* PseudoHeader must have  12 bytes */
-   cksum  = h[0];
-   cksum += h[1];
-   cksum += h[2];
-   cksum += h[3];
-   cksum += h[4];
-   cksum += h[5];
-   cksum += h[6];
-   cksum += h[7];
-   cksum += h[8];
-   cksum += h[9];
-   cksum += h[10];
-   cksum += h[11];
-   cksum += h[12];
-   cksum += h[13];
-   cksum += h[14];
-   cksum += h[15];
-   cksum += h[16];
-   cksum += h[17];
-
-   /* UDP must have 8 hdr bytes */
-   cksum += d[0];
-   cksum += d[1];
-   cksum += d[2];
-   cksum += d[3];
-
-   dlen  -= 8; /* bytes   */
-   d     += 4; /* short's */
-
-   while(dlen >=32)
-   {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     cksum += d[4];
-     cksum += d[5];
-     cksum += d[6];
-     cksum += d[7];
-     cksum += d[8];
-     cksum += d[9];
-     cksum += d[10];
-     cksum += d[11];
-     cksum += d[12];
-     cksum += d[13];
-     cksum += d[14];
-     cksum += d[15];
-     d     += 16;
-     dlen  -= 32;
-   }
+   uint64_t cksum;
 
-   while(dlen >=8)
-   {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     d     += 4;
-     dlen  -= 8;
-   }
-
-   while(dlen > 1)
-   {
-     cksum += *d++;
-     dlen  -= 2;
-   }
-
-   if( dlen == 1 )
-   {
-     *(unsigned char*)(&answer) = (*(unsigned char*)d);
-     cksum += answer;
-   }
-
-   cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-   cksum += (cksum >> 16);
+   cksum  = in_chksum_add_short((const uint8_t*)ph, 36);
+   cksum += in_chksum_add((const uint8_t*)d, (uint32_t)dlen);
 
-   return (unsigned short)(~cksum);
+   return (unsigned short)~in_chksum_fold(cksum);
 }
 
-
-
+/*
+*  checksum udp
+*
+*  h    - pseudo header - 12 bytes
+*  d    - udp hdr + payload
+*  dlen - length of udp hdr + payload in bytes
+*
+*/
 static inline unsigned short in_chksum_udp(pseudoheader *ph,
      unsigned short * d, int dlen )
 {
-   uint16_t *h = (uint16_t *)ph;
-   unsigned int cksum;
-   unsigned short answer=0;
-
-   /* PseudoHeader must have 36 bytes */
-   cksum  = h[0];
-   cksum += h[1];
-   cksum += h[2];
-   cksum += h[3];
-   cksum += h[4];
-   cksum += h[5];
-
-   /* UDP must have 8 hdr bytes */
-   cksum += d[0];
-   cksum += d[1];
-   cksum += d[2];
-   cksum += d[3];
-
-   dlen  -= 8; /* bytes   */
-   d     += 4; /* short's */
-
-   while(dlen >=32)
-   {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     cksum += d[4];
-     cksum += d[5];
-     cksum += d[6];
-     cksum += d[7];
-     cksum += d[8];
-     cksum += d[9];
-     cksum += d[10];
-     cksum += d[11];
-     cksum += d[12];
-     cksum += d[13];
-     cksum += d[14];
-     cksum += d[15];
-     d     += 16;
-     dlen  -= 32;
-   }
+   uint64_t cksum;
 
-   while(dlen >=8)
-   {
-     cksum += d[0];
-     cksum += d[1];
-     cksum += d[2];
-     cksum += d[3];
-     d     += 4;
-     dlen  -= 8;
-   }
+   cksum  = in_chksum_add_short((const uint8_t*)ph, 12);
+   cksum += in_chksum_add((const uint8_t*)d, (uint32_t)dlen);
 
-   while(dlen > 1)
-   {
-     cksum += *d++;
-     dlen  -= 2;
-   }
-
-   if( dlen == 1 )
-   {
-     *(unsigned char*)(&answer) = (*(unsigned char*)d);
-     cksum += answer;
-   }
-
-   cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-   cksum += (cksum >> 16);
-
-   return (unsigned short)(~cksum);
+   return (unsigned short)~in_chksum_fold(cksum);
 }
 
 /*
@@ -464,139 +268,78 @@ static inline unsigned short in_chksum_udp(pseudoheader *ph,
 */
 static inline unsigned short in_chksum_icmp( unsigned short * w, int blen )
 {
-  unsigned  short answer=0;
-  unsigned int cksum = 0;
+   return (unsigned short)~in_chksum_fold(
+       in_chksum_add((const uint8_t*)w, (uint32_t)blen));
+}
 
-  while(blen >=32)
-  {
-     cksum += w[0];
-     cksum += w[1];
-     cksum += w[2];
-     cksum += w[3];
-     cksum += w[4];
-     cksum += w[5];
-     cksum += w[6];
-     cksum += w[7];
-     cksum += w[8];
-     cksum += w[9];
-     cksum += w[10];
-     cksum += w[11];
-     cksum += w[12];
-     cksum += w[13];
-     cksum += w[14];
-     cksum += w[15];
-     w     += 16;
-     blen  -= 32;
-  }
-
-  while(blen >=8)
-  {
-     cksum += w[0];
-     cksum += w[1];
-     cksum += w[2];
-     cksum += w[3];
-     w     += 4;
-     blen  -= 8;
-  }
+/*
+*  checksum icmp6
+*/
+static inline unsigned short in_chksum_icmp6(pseudoheader6 *ph,
+     unsigned short *w, int blen )
+{
+   uint64_t cksum;
 
-  while(blen > 1)
-  {
-     cksum += *w++;
-     blen  -= 2;
-  }
+   cksum  = in_chksum_add_short((const uint8_t*)ph, 36);
+   cksum += in_chksum_add((const uint8_t*)w, (uint32_t)blen);
 
-  if( blen == 1 )
-  {
-    *(unsigned char*)(&answer) = (*(unsigned char*)w);
-    cksum += answer;
-  }
+   return (unsigned short)~in_chksum_fold(cksum);
+}
 
-  cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-  cksum += (cksum >> 16);
+/*
+*  incremental update per RFC 1624 eqn. 3:  HC' = ~(~HC + ~m + m')
+*
+*  these work on the checksum field as stored in the packet so the
+*  old and new values must be in network order too.
+*/
+static inline uint16_t in_chksum_adjust(uint16_t csum, uint16_t m, uint16_t n)
+{
+   uint32_t sum = (uint16_t)~csum;
 
+   sum += (uint16_t)~m;
+   sum += n;
+   sum  = (sum >> 16) + (sum & 0xffff);
+   sum += (sum >> 16);
 
-  return (unsigned short)(~cksum);
+   return (uint16_t)~sum;
 }
 
 /*
-*  checksum icmp6
+*  update for a 16 bit field changed from old to new
 */
-static inline unsigned short in_chksum_icmp6(pseudoheader6 *ph,
-     unsigned short *w, int blen )
+static inline uint16_t in_chksum_update16(uint16_t csum, uint16_t old_val, uint16_t new_val)
 {
-  uint16_t *h = (uint16_t *)ph;
-  unsigned  short answer=0;
-  unsigned int cksum = 0;
-
-  /* PseudoHeader must have 36 bytes */
-  cksum  = h[0];
-  cksum += h[1];
-  cksum += h[2];
-  cksum += h[3];
-  cksum += h[4];
-  cksum += h[5];
-  cksum += h[6];
-  cksum += h[7];
-  cksum += h[8];
-  cksum += h[9];
-  cksum += h[10];
-  cksum += h[11];
-  cksum += h[12];
-  cksum += h[13];
-  cksum += h[14];
-  cksum += h[15];
-  cksum += h[16];
-  cksum += h[17];
-
-  while(blen >=32)
-  {
-     cksum += w[0];
-     cksum += w[1];
-     cksum += w[2];
-     cksum += w[3];
-     cksum += w[4];
-     cksum += w[5];
-     cksum += w[6];
-     cksum += w[7];
-     cksum += w[8];
-     cksum += w[9];
-     cksum += w[10];
-     cksum += w[11];
-     cksum += w[12];
-     cksum += w[13];
-     cksum += w[14];
-     cksum += w[15];
-     w     += 16;
-     blen  -= 32;
-  }
-
-  while(blen >=8)
-  {
-     cksum += w[0];
-     cksum += w[1];
-     cksum += w[2];
-     cksum += w[3];
-     w     += 4;
-     blen  -= 8;
-  }
-
-  while(blen > 1)
-  {
-     cksum += *w++;
-     blen  -= 2;
-  }
-
-  if( blen == 1 )
-  {
-    *(unsigned char*)(&answer) = (*(unsigned char*)w);
-    cksum += answer;
-  }
+   return in_chksum_adjust(csum, old_val, new_val);
+}
 
-  cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
-  cksum += (cksum >> 16);
+/*
+*  update for a 32 bit field (eg an address) changed from old to new
+*/
+static inline uint16_t in_chksum_update32(uint16_t csum, uint32_t old_val, uint32_t new_val)
+{
+   return in_chksum_adjust(csum,
+       in_chksum_fold(old_val), in_chksum_fold(new_val));
+}
 
+/*
+*  update for a run of bytes rewritten in place
+*
+*  old_sum and new_sum are cksum_add() of the bytes before and after.
+*  odd is set if the run starts at an odd offset from the start of the
+*  checksummed data, in which case the bytes pair up the other way.
+*/
+static inline uint16_t in_chksum_update_sum(
+    uint16_t csum, uint64_t old_sum, uint64_t new_sum, int odd)
+{
+   uint16_t m = in_chksum_fold(old_sum);
+   uint16_t n = in_chksum_fold(new_sum);
 
-  return (unsigned short)(~cksum);
+   if ( odd )
+   {
+      m = (uint16_t)((m << 8) | (m >> 8));
+      n = (uint16_t)((n << 8) | (n >> 8));
+   }
+   return in_chksum_adjust(csum, m, n);
 }
 
 
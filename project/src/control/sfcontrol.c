@@ -499,11 +499,19 @@ static void *ControlSocketProcessThread(void *arg)
                 }
                 if (handler->oobpost)
                 {
-                    handler->oobpost(hdr.type, handler->old_context, t, ControlDataSend);
+                    // The post function can take a while (a live profile waits
+                    // for its report) so free the handler for the next request
+                    // first; that request's oobpre can then say it is busy.
+                    void *old_context = handler->old_context;
+
+                    pthread_mutex_unlock(&handler->mutex);
+                    handler->oobpost(hdr.type, old_context, t, ControlDataSend);
                     DEBUG_WRAP( DebugMessage(DEBUG_CONTROL, "Control Socket %d: oobpost finished\n", t->socket_fd););
                 }
-
-                pthread_mutex_unlock(&handler->mutex);
+                else
+                {
+                    pthread_mutex_unlock(&handler->mutex);
+                }
 
                 response.hdr.type = htons(CS_HEADER_SUCCESS);
                 response.hdr.length = 0;
@@ -643,7 +643,7 @@ struct enc_header {
 #define PKT_IPREP_SOURCE_TRIGGERED  0x08000000
 #define PKT_IPREP_DATA_SET          0x10000000
 #define PKT_FILE_EVENT_SET          0x20000000
-// 0x40000000 are available
+#define PKT_CKSUM_UPDATED           0x40000000  /* modified checksums already updated in place */
 
 #define PKT_PDU_FULL (PKT_PDU_HEAD | PKT_PDU_TAIL)
 
@@ -586,6 +586,21 @@ int add_detection_option(struct _SnortConfig *sc, option_type_t type, void *opti
     return DETECTION_OPTION_NOT_EQUAL;
 }
 
+/* Returns this configuration's copy of option data equal to the given
+ * option data, which may belong to another configuration */
+void * find_detection_option(struct _SnortConfig *sc, option_type_t type, void *option_data)
+{
+    detection_option_key_t key;
+
+    if ((sc == NULL) || (sc->detection_option_hash_table == NULL) || !option_data)
+        return NULL;
+
+    key.option_type = type;
+    key.option_data = option_data;
+
+    return sfxhash_find(sc->detection_option_hash_table, &key);
+}
+
 uint32_t detection_option_tree_hash(detection_option_tree_node_t *node)
 {
     uint32_t a,b,c;
@@ -825,8 +840,114 @@ int add_detection_option_tree(SnortConfig *sc, detection_option_tree_node_t *opt
 
 uint64_t rule_eval_pkt_count = 0;
 
-int detection_option_node_evaluate(detection_option_tree_node_t *node, detection_option_eval_data_t *eval_data)
+/* Fold the option type down to what the evaluator dispatches on */
+static uint8_t detection_option_op(const detection_option_tree_node_t *node)
+{
+    if (node->option_type == RULE_OPTION_TYPE_LEAF_NODE)
+        return DETECTION_OP_LEAF;
+
+    if (!node->evaluate)
+        return DETECTION_OP_NONE;
+
+    switch (node->option_type)
+    {
+        case RULE_OPTION_TYPE_CONTENT:
+            return DETECTION_OP_CONTENT;
+        case RULE_OPTION_TYPE_CONTENT_URI:
+            return DETECTION_OP_CONTENT_URI;
+        case RULE_OPTION_TYPE_PCRE:
+            return DETECTION_OP_PCRE;
+        case RULE_OPTION_TYPE_PKT_DATA:
+        case RULE_OPTION_TYPE_FILE_DATA:
+        case RULE_OPTION_TYPE_BASE64_DATA:
+            return DETECTION_OP_DATA;
+        case RULE_OPTION_TYPE_FLOWBIT:
+            return DETECTION_OP_FLOWBIT;
+        default:
+            break;
+    }
+    return DETECTION_OP_EVAL;
+}
+
+static uint32_t detection_option_tree_count(detection_option_tree_node_t *node)
+{
+    uint32_t n = 1;
+    int i;
+
+    for (i = 0; i < node->num_children; i++)
+        n += detection_option_tree_count(node->children[i]);
+
+    return n;
+}
+
+/* Lay out node and its subtree in pre-order starting at pc.  Returns the
+ * index past the subtree, which is the next sibling's. */
+static uint32_t detection_option_tree_flatten(detection_option_tree_node_t *node,
+                                              detection_option_insn_t *insns, uint32_t pc)
+{
+    detection_option_insn_t *insn = &insns[pc];
+    uint32_t next = pc + 1;
+    int i;
+
+    insn->node = node;
+    insn->option_data = node->option_data;
+    insn->evaluate = node->evaluate;
+    insn->op = detection_option_op(node);
+    insn->flags = 0;
+    insn->num_children = node->num_children;
+
+    if (((node->option_type == RULE_OPTION_TYPE_CONTENT)
+                || (node->option_type == RULE_OPTION_TYPE_PCRE))
+            && !node->last_check.is_relative)
+    {
+        /* Non-relative content or pcre - the offset doesn't move */
+        insn->flags |= DETECTION_INSN_FINAL_FAIL;
+    }
+    else if ((node->option_type == RULE_OPTION_TYPE_CONTENT)
+            && (((PatternMatchData *)node->option_data)->within == 0))
+    {
+        /* Unbounded relative search - it already looked everywhere */
+        insn->flags |= DETECTION_INSN_FINAL_FAIL;
+    }
+
+    for (i = 0; i < node->num_children; i++)
+        next = detection_option_tree_flatten(node->children[i], insns, next);
+
+    insn->next = next;
+    return next;
+}
+
+void detection_option_tree_compile(detection_option_tree_node_t *node)
+{
+    detection_option_plan_t *plan;
+
+    if (!node || node->plan)
+        return;
+
+    plan = (detection_option_plan_t *)SnortAlloc(sizeof(detection_option_plan_t));
+    plan->num_insns = detection_option_tree_count(node);
+    plan->insns = (detection_option_insn_t *)SnortAlloc(
+        plan->num_insns * sizeof(detection_option_insn_t));
+
+    detection_option_tree_flatten(node, plan->insns, 0);
+    node->plan = plan;
+}
+
+void detection_option_plan_free(detection_option_plan_t *plan)
+{
+    if (!plan)
+        return;
+
+    free(plan->insns);
+    free(plan);
+}
+
+static int detection_option_insn_evaluate(const detection_option_insn_t *plan, uint32_t pc,
+                                          detection_option_eval_data_t *eval_data,
+                                          uint64_t cur_eval_pkt_count)
 {
+    const detection_option_insn_t *insn = &plan[pc];
+    detection_option_tree_node_t *node = insn->node;
     int i, result = 0, prior_result = 0;
     int rval = DETECTION_OPTION_NO_MATCH;
     const uint8_t *orig_doe_ptr;
@@ -839,12 +960,8 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
     int loop_count = 0;
     uint32_t tmp_byte_extract_vars[NUM_BYTE_EXTRACT_VARS];
     uint16_t save_dflags = 0;
-    uint64_t cur_eval_pkt_count = (rule_eval_pkt_count + (GetRebuiltPktCount()));
     NODE_PROFILE_VARS;
 
-    if (!node || !eval_data || !eval_data->p || !eval_data->pomd)
-        return 0;
-
     save_dflags = Get_DetectFlags();
 
     /* see if evaluated it before ... */
@@ -879,10 +996,9 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
     /* Save some stuff off for repeated pattern tests */
     orig_doe_ptr = doe_ptr;
 
-    if ((node->option_type == RULE_OPTION_TYPE_CONTENT) ||
-            (node->option_type == RULE_OPTION_TYPE_CONTENT_URI))
+    if ((insn->op == DETECTION_OP_CONTENT) || (insn->op == DETECTION_OP_CONTENT_URI))
     {
-        PatternMatchDuplicatePmd(node->option_data, &dup_content_option_data);
+        PatternMatchDuplicatePmd(insn->option_data, &dup_content_option_data);
 
         if (dup_content_option_data.buffer_func == CHECK_URI_PATTERN_MATCH)
         {
@@ -907,10 +1023,10 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
             dp = eval_data->p->data;
         }
     }
-    else if (node->option_type == RULE_OPTION_TYPE_PCRE)
+    else if (insn->op == DETECTION_OP_PCRE)
     {
         unsigned hb_type;
-        PcreDuplicatePcreData(node->option_data, &dup_pcre_option_data);
+        PcreDuplicatePcreData(insn->option_data, &dup_pcre_option_data);
         hb_type = dup_pcre_option_data.options & SNORT_PCRE_HTTP_BUFS;
 
         if ( hb_type )
@@ -940,12 +1056,12 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
     /* No, haven't evaluated this one before... Check it. */
     do
     {
-        switch (node->option_type)
+        switch (insn->op)
         {
-            case RULE_OPTION_TYPE_LEAF_NODE:
+            case DETECTION_OP_LEAF:
                 /* Add the match for this otn to the queue. */
                 {
-                    OptTreeNode *otn = (OptTreeNode *)node->option_data;
+                    OptTreeNode *otn = (OptTreeNode *)insn->option_data;
                     PatternMatchData *pmd = (PatternMatchData *)eval_data->pmd;
                     int pattern_size = 0;
                     int check_ports = 1;
@@ -1004,109 +1120,53 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
                     }
                 }
                 break;
-            case RULE_OPTION_TYPE_CONTENT:
-                if (node->evaluate)
+            case DETECTION_OP_CONTENT:
+                /* This will be set in the fast pattern matcher if we found
+                 * a content and the rule option specifies not that
+                 * content. Essentially we've already evaluated this rule
+                 * option via the content option processing since only not
+                 * contents that are not relative in any way will have this
+                 * flag set */
+                if (dup_content_option_data.exception_flag)
                 {
-                    /* This will be set in the fast pattern matcher if we found
-                     * a content and the rule option specifies not that
-                     * content. Essentially we've already evaluated this rule
-                     * option via the content option processing since only not
-                     * contents that are not relative in any way will have this
-                     * flag set */
-                    if (dup_content_option_data.exception_flag)
+                    if ((dup_content_option_data.last_check.ts.tv_sec == eval_data->p->pkth->ts.tv_sec) &&
+                        (dup_content_option_data.last_check.ts.tv_usec == eval_data->p->pkth->ts.tv_usec) &&
+                        (dup_content_option_data.last_check.packet_number == cur_eval_pkt_count) &&
+                        (dup_content_option_data.last_check.rebuild_flag == (eval_data->p->packet_flags & PKT_REBUILT_STREAM)))
                     {
-                        if ((dup_content_option_data.last_check.ts.tv_sec == eval_data->p->pkth->ts.tv_sec) &&
-                            (dup_content_option_data.last_check.ts.tv_usec == eval_data->p->pkth->ts.tv_usec) &&
-                            (dup_content_option_data.last_check.packet_number == cur_eval_pkt_count) &&
-                            (dup_content_option_data.last_check.rebuild_flag == (eval_data->p->packet_flags & PKT_REBUILT_STREAM)))
-                        {
-                            rval = DETECTION_OPTION_NO_MATCH;
-                            break;
-                        }
+                        rval = DETECTION_OPTION_NO_MATCH;
+                        break;
                     }
-
-                    rval = node->evaluate(&dup_content_option_data, eval_data->p);
                 }
+
+                rval = insn->evaluate(&dup_content_option_data, eval_data->p);
                 break;
-            case RULE_OPTION_TYPE_CONTENT_URI:
-                if (node->evaluate)
-                {
-                    rval = node->evaluate(&dup_content_option_data, eval_data->p);
-                }
+            case DETECTION_OP_CONTENT_URI:
+                rval = insn->evaluate(&dup_content_option_data, eval_data->p);
                 break;
-            case RULE_OPTION_TYPE_PCRE:
-                if (node->evaluate)
-                {
-                    rval = node->evaluate(&dup_pcre_option_data, eval_data->p);
-                }
+            case DETECTION_OP_PCRE:
+                rval = insn->evaluate(&dup_pcre_option_data, eval_data->p);
+                break;
+            case DETECTION_OP_DATA:
+                save_dflags = Get_DetectFlags();
+                rval = insn->evaluate(insn->option_data, eval_data->p);
                 break;
-            case RULE_OPTION_TYPE_PKT_DATA:
-            case RULE_OPTION_TYPE_FILE_DATA:
-            case RULE_OPTION_TYPE_BASE64_DATA:
-                if (node->evaluate)
+            case DETECTION_OP_FLOWBIT:
+                flowbits_setoperation = FlowBits_SetOperation(insn->option_data);
+                if (!flowbits_setoperation)
                 {
-                    save_dflags = Get_DetectFlags();
-                    rval = node->evaluate(node->option_data, eval_data->p);
+                    rval = insn->evaluate(insn->option_data, eval_data->p);
                 }
-                break;
-            case RULE_OPTION_TYPE_FLOWBIT:
-                if (node->evaluate)
+                else
                 {
-                    flowbits_setoperation = FlowBits_SetOperation(node->option_data);
-                    if (!flowbits_setoperation)
-                    {
-                        rval = node->evaluate(node->option_data, eval_data->p);
-                    }
-                    else
-                    {
-                        /* set to match so we don't bail early.  */
-                        rval = DETECTION_OPTION_MATCH;
-                    }
+                    /* set to match so we don't bail early.  */
+                    rval = DETECTION_OPTION_MATCH;
                 }
                 break;
-            case RULE_OPTION_TYPE_ASN1:
-            case RULE_OPTION_TYPE_BYTE_TEST:
-            case RULE_OPTION_TYPE_BYTE_JUMP:
-            case RULE_OPTION_TYPE_BYTE_EXTRACT:
-            case RULE_OPTION_TYPE_FLOW:
-            case RULE_OPTION_TYPE_CVS:
-            case RULE_OPTION_TYPE_DSIZE:
-            case RULE_OPTION_TYPE_FTPBOUNCE:
-            case RULE_OPTION_TYPE_BASE64_DECODE:
-            case RULE_OPTION_TYPE_ICMP_CODE:
-            case RULE_OPTION_TYPE_ICMP_ID:
-            case RULE_OPTION_TYPE_ICMP_SEQ:
-            case RULE_OPTION_TYPE_ICMP_TYPE:
-            case RULE_OPTION_TYPE_IP_FRAGBITS:
-            case RULE_OPTION_TYPE_IP_FRAG_OFFSET:
-            case RULE_OPTION_TYPE_IP_ID:
-            case RULE_OPTION_TYPE_IP_OPTION:
-            case RULE_OPTION_TYPE_IP_PROTO:
-            case RULE_OPTION_TYPE_IP_SAME:
-            case RULE_OPTION_TYPE_IP_TOS:
-            case RULE_OPTION_TYPE_IS_DATA_AT:
-#ifdef ENABLE_REACT
-            case RULE_OPTION_TYPE_REACT:
-#endif
-#ifdef ENABLE_RESPOND
-            case RULE_OPTION_TYPE_RESPOND:
-#endif
-            case RULE_OPTION_TYPE_RPC_CHECK:
-            case RULE_OPTION_TYPE_SESSION:
-            case RULE_OPTION_TYPE_TCP_ACK:
-            case RULE_OPTION_TYPE_TCP_FLAG:
-            case RULE_OPTION_TYPE_TCP_SEQ:
-            case RULE_OPTION_TYPE_TCP_WIN:
-            case RULE_OPTION_TYPE_TTL:
-            case RULE_OPTION_TYPE_URILEN:
-            case RULE_OPTION_TYPE_HDR_OPT_CHECK:
-            case RULE_OPTION_TYPE_PREPROCESSOR:
-                if (node->evaluate)
-                    rval = node->evaluate(node->option_data, eval_data->p);
+            case DETECTION_OP_EVAL:
+                rval = insn->evaluate(insn->option_data, eval_data->p);
                 break;
-            case RULE_OPTION_TYPE_DYNAMIC:
-                if (node->evaluate)
-                    rval = node->evaluate(node->option_data, eval_data->p);
+            case DETECTION_OP_NONE:
                 break;
         }
 
@@ -1164,16 +1224,19 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
         /* Don't include children's time in this node */
         NODE_PROFILE_TMPEND(node);
 
-        /* Passed, check the children. */
-        if (node->num_children)
+        /* Passed, check the children.  The first child follows this
+         * insn and each child's next is its sibling. */
+        if (insn->num_children)
         {
             const uint8_t *tmp_doe_ptr = doe_ptr;
             const uint8_t tmp_doe_flags = doe_buf_flags;
+            uint32_t child_pc = pc + 1;
 
-            for (i=0;i<node->num_children; i++)
+            for (i = 0; i < insn->num_children; i++, child_pc = plan[child_pc].next)
             {
                 int j = 0;
-                detection_option_tree_node_t *child_node = node->children[i];
+                const detection_option_insn_t *child = &plan[child_pc];
+                detection_option_tree_node_t *child_node = child->node;
 
                 /* reset the DOE ptr for each child from here */
                 SetDoePtr(tmp_doe_ptr, tmp_doe_flags);
@@ -1187,41 +1250,22 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
                 {
                     if (child_node->result == DETECTION_OPTION_NO_MATCH)
                     {
-                        if (((child_node->option_type == RULE_OPTION_TYPE_CONTENT)
-                                    || (child_node->option_type == RULE_OPTION_TYPE_PCRE))
-                                && !child_node->last_check.is_relative)
+                        if (child->flags & DETECTION_INSN_FINAL_FAIL)
                         {
-                            /* If it's a non-relative content or pcre, no reason
-                             * to check again.  Only increment result once.
-                             * Should hit this condition on first loop iteration. */
+                            /* No reason to check again.  Only increment
+                             * result once.  Should hit this condition on
+                             * first loop iteration. */
                             if (loop_count == 1)
                                 result++;
                             continue;
                         }
-                        else if ((child_node->option_type == RULE_OPTION_TYPE_CONTENT)
-                                && child_node->last_check.is_relative)
-                        {
-                            PatternMatchData *pmd = (PatternMatchData *)child_node->option_data;
-
-                            /* Check for an unbounded relative search.  If this
-                             * failed before, it's going to fail again so don't
-                             * go down this path again */
-                            if (pmd->within == 0)
-                            {
-                                /* Only increment result once. Should hit this
-                                 * condition on first loop iteration. */
-                                if (loop_count == 1)
-                                    result++;
-                                continue;
-                            }
-                        }
                     }
-                    else if (child_node->option_type == RULE_OPTION_TYPE_LEAF_NODE)
+                    else if (child->op == DETECTION_OP_LEAF)
                     {
                         /* Leaf node matched, don't eval again */
                         continue;
                     }
-                    else if (child_node->result == child_node->num_children)
+                    else if (child_node->result == child->num_children)
                     {
                         /* This branch of the tree matched or has options that
                          * don't need to be evaluated again, so don't need to
@@ -1230,14 +1274,16 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
                     }
                 }
 
-                child_node->result = detection_option_node_evaluate(node->children[i], eval_data);
-                if (child_node->option_type == RULE_OPTION_TYPE_LEAF_NODE)
+                child_node->result = detection_option_insn_evaluate(
+                    plan, child_pc, eval_data, cur_eval_pkt_count);
+
+                if (child->op == DETECTION_OP_LEAF)
                 {
                     /* Leaf node won't have any children but will return success
                      * or failure */
                     result += child_node->result;
                 }
-                else if (child_node->result == child_node->num_children)
+                else if (child_node->result == child->num_children)
                 {
                     /* Indicate that the child's tree branches are done */
                     result++;
@@ -1264,20 +1310,14 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
              * Else, reset the DOE ptr to last eval for offset/depth,
              * distance/within adjustments for this same content/pcre
              * rule option */
-            if (result == node->num_children)
+            if (result == insn->num_children)
                 continue_loop = 0;
             else
                 SetDoePtr(tmp_doe_ptr, tmp_doe_flags);
-
-            /* Don't need to reset since it's only checked after we've gone
-             * through the loop at least once and the result will have
-             * been set again already */
-            //for (i = 0; i < node->num_children; i++)
-            //    node->children[i]->result;
         }
 
         if (result - prior_result > 0
-            && node->option_type == RULE_OPTION_TYPE_CONTENT
+            && insn->op == DETECTION_OP_CONTENT
             && Replace_OffsetStored(&dup_content_option_data) && ScInlineMode())
         {
             Replace_QueueChange(&dup_content_option_data);
@@ -1294,8 +1334,7 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
 
         if (continue_loop && (rval == DETECTION_OPTION_MATCH) && (node->relative_children))
         {
-            if ((node->option_type == RULE_OPTION_TYPE_CONTENT) ||
-                    (node->option_type == RULE_OPTION_TYPE_CONTENT_URI))
+            if ((insn->op == DETECTION_OP_CONTENT) || (insn->op == DETECTION_OP_CONTENT_URI))
             {
                 if (dup_content_option_data.exception_flag)
                 {
@@ -1310,11 +1349,11 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
                     else
                         orig_ptr = dp;
 
-                    continue_loop = PatternMatchAdjustRelativeOffsets((PatternMatchData *)node->option_data,
+                    continue_loop = PatternMatchAdjustRelativeOffsets((PatternMatchData *)insn->option_data,
                             &dup_content_option_data, doe_ptr, orig_ptr);
                 }
             }
-            else if (node->option_type == RULE_OPTION_TYPE_PCRE)
+            else if (insn->op == DETECTION_OP_PCRE)
             {
                 if (dup_pcre_option_data.options & SNORT_PCRE_INVERT)
                 {
@@ -1360,7 +1399,7 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
     {
         /* Do any setting/clearing/resetting/toggling of flowbits here
          * given that other rule options matched. */
-        rval = node->evaluate(node->option_data, eval_data->p);
+        rval = insn->evaluate(insn->option_data, eval_data->p);
         if (rval != DETECTION_OPTION_MATCH)
         {
             result = rval;
@@ -1388,6 +1427,20 @@ int detection_option_node_evaluate(detection_option_tree_node_t *node, detection
     return result;
 }
 
+int detection_option_node_evaluate(detection_option_tree_node_t *node, detection_option_eval_data_t *eval_data)
+{
+    if (!node || !eval_data || !eval_data->p || !eval_data->pomd)
+        return 0;
+
+    /* Trees are compiled as they are finalized; this only catches one
+     * that was evaluated without going through that. */
+    if (!node->plan)
+        detection_option_tree_compile(node);
+
+    return detection_option_insn_evaluate(node->plan->insns, 0, eval_data,
+        rule_eval_pkt_count + GetRebuiltPktCount());
+}
+
 #ifdef PERF_PROFILING
 typedef struct node_profile_stats
 {
@@ -1482,4 +1535,32 @@ void detection_option_tree_update_otn_stats(SFXHASH *doth)
         hashnode = sfxhash_findnext(doth);
     }
 }
+
+static void detection_option_node_reset_stats(detection_option_tree_node_t *node)
+{
+    int i;
+
+    node->ticks = 0;
+    node->ticks_match = 0;
+    node->ticks_no_match = 0;
+    node->checks = 0;
+
+    for (i=0;i<node->num_children; i++)
+        detection_option_node_reset_stats(node->children[i]);
+}
+
+void detection_option_tree_reset_otn_stats(SFXHASH *doth)
+{
+    SFXHASH_NODE *hashnode;
+
+    if (doth == NULL)
+        return;
+
+    for (hashnode = sfxhash_findfirst(doth);
+         hashnode;
+         hashnode = sfxhash_findnext(doth))
+    {
+        detection_option_node_reset_stats(hashnode->data);
+    }
+}
 #endif
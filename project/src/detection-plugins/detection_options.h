@@ -51,6 +51,8 @@
 
 typedef int (*eval_func_t)(void *option_data, Packet *p);
 
+struct _detection_option_plan;
+
 typedef struct _detection_option_tree_node
 {
     void *option_data;
@@ -80,8 +82,48 @@ typedef struct _detection_option_tree_node
     uint64_t ppm_disable_cnt; /*PPM */
     uint64_t ppm_enable_cnt; /*PPM */
 #endif
+    /* Set on the top node of each unique tree once it is finalized */
+    struct _detection_option_plan *plan;
 } detection_option_tree_node_t;
 
+/* Evaluation ops.  option_type is folded down to the handful of cases
+ * the evaluator actually treats differently. */
+typedef enum _detection_option_op
+{
+    DETECTION_OP_LEAF,          /* add the otn match */
+    DETECTION_OP_CONTENT,
+    DETECTION_OP_CONTENT_URI,
+    DETECTION_OP_PCRE,
+    DETECTION_OP_DATA,          /* pkt_data, file_data, base64_data */
+    DETECTION_OP_FLOWBIT,
+    DETECTION_OP_EVAL,          /* plain call to evaluate */
+    DETECTION_OP_NONE           /* no evaluate function, never matches */
+} detection_option_op_t;
+
+/* A failed option with this set is not retried when its parent moves to
+ * the next match of a relative content or pcre; it will fail again. */
+#define DETECTION_INSN_FINAL_FAIL 0x01
+
+typedef struct _detection_option_insn
+{
+    detection_option_tree_node_t *node; /* per packet state lives here */
+    void *option_data;
+    eval_func_t evaluate;
+    uint8_t op;
+    uint8_t flags;
+    uint16_t pad;
+    int num_children;           /* first child, if any, is the next insn */
+    uint32_t next;              /* next sibling, past this subtree */
+} detection_option_insn_t;
+
+/* A tree flattened in pre-order so a parent walks its children forward
+ * through one array instead of chasing node pointers. */
+typedef struct _detection_option_plan
+{
+    uint32_t num_insns;
+    detection_option_insn_t *insns;
+} detection_option_plan_t;
+
 typedef struct _detection_option_tree_root
 {
     int num_children;
@@ -104,8 +146,11 @@ typedef struct _detection_option_eval_data
 } detection_option_eval_data_t;
 
 int add_detection_option(struct _SnortConfig *, option_type_t type, void *option_data, void **existing_data);
+void * find_detection_option(struct _SnortConfig *, option_type_t type, void *option_data);
 int add_detection_option_tree(struct _SnortConfig *, detection_option_tree_node_t *option_tree, void **existing_data);
 int detection_option_node_evaluate(detection_option_tree_node_t *node, detection_option_eval_data_t *eval_data);
+void detection_option_tree_compile(detection_option_tree_node_t *node);
+void detection_option_plan_free(detection_option_plan_t *plan);
 void DetectionHashTableFree(SFXHASH *);
 void DetectionTreeHashTableFree(SFXHASH *);
 #ifdef DEBUG_OPTION_TREE
@@ -113,6 +158,7 @@ void print_option_tree(detection_option_tree_node_t *node, int level);
 #endif
 #ifdef PERF_PROFILING
 void detection_option_tree_update_otn_stats(SFXHASH *);
+void detection_option_tree_reset_otn_stats(SFXHASH *);
 #endif
 
 #endif /* DETECTION_OPTIONS_H_ */
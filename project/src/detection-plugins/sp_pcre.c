@@ -71,13 +71,157 @@ void SnortPcreParse(struct _SnortConfig *, char *, PcreData *, OptTreeNode *);
 void SnortPcreDump(PcreData *);
 int SnortPcre(void *option_data, Packet *p);
 
+#ifdef PCRE_STUDY_JIT_COMPILE
+/* JIT code runs on its own stack rather than the machine stack.  One
+ * is enough; each snort process runs a single packet thread. */
+#define PCRE_JIT_STACK_START  (32 * 1024)
+#define PCRE_JIT_STACK_MAX    (1024 * 1024)
+
+static pcre_jit_stack *jit_stack = NULL;
+static int pcre_jit_available = -1;
+
+static int PcreJitAvailable(void)
+{
+    if (pcre_jit_available < 0)
+    {
+        if (pcre_config(PCRE_CONFIG_JIT, &pcre_jit_available) != 0)
+            pcre_jit_available = 0;
+
+        if (!pcre_jit_available)
+            LogMessage("pcre: JIT not supported by libpcre, using the interpreter\n");
+    }
+    return pcre_jit_available;
+}
+#endif
+
+/* Study re and apply the configured match limits unless the rule
+ * overrides them.  The JIT is used where libpcre supports it; an
+ * expression the JIT can't handle silently falls back to the
+ * interpreter.  The JIT honors match_limit but not
+ * match_limit_recursion, since it doesn't recurse on the machine
+ * stack.  Used by both the pcre rule option and the dynamic engine. */
+pcre_extra *PcreStudy(const pcre *re, int override_limits, const char **error)
+{
+    pcre_extra *pe;
+    int study_options = 0;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (PcreJitAvailable())
+        study_options |= PCRE_STUDY_JIT_COMPILE;
+#endif
+
+    pe = pcre_study(re, study_options, error);
+
+    if (pe)
+    {
+        if ((ScPcreMatchLimit() != -1) && !override_limits)
+        {
+            pe->flags |= PCRE_EXTRA_MATCH_LIMIT;
+            pe->match_limit = ScPcreMatchLimit();
+        }
+
+#ifdef PCRE_EXTRA_MATCH_LIMIT_RECURSION
+        if ((ScPcreMatchLimitRecursion() != -1) && !override_limits)
+        {
+            pe->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+            pe->match_limit_recursion = ScPcreMatchLimitRecursion();
+        }
+#endif
+    }
+    else
+    {
+        if (!override_limits &&
+             ((ScPcreMatchLimit() != -1) || (ScPcreMatchLimitRecursion() != -1)))
+        {
+            pe = (pcre_extra *)SnortAlloc(sizeof(pcre_extra));
+            if (ScPcreMatchLimit() != -1)
+            {
+                pe->flags |= PCRE_EXTRA_MATCH_LIMIT;
+                pe->match_limit = ScPcreMatchLimit();
+            }
+
+#ifdef PCRE_EXTRA_MATCH_LIMIT_RECURSION
+            if (ScPcreMatchLimitRecursion() != -1)
+            {
+                pe->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+                pe->match_limit_recursion = ScPcreMatchLimitRecursion();
+            }
+#endif
+        }
+    }
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (PcreJitEnabled(pe))
+    {
+        if (jit_stack == NULL)
+            jit_stack = pcre_jit_stack_alloc(PCRE_JIT_STACK_START, PCRE_JIT_STACK_MAX);
+
+        /* NULL leaves the JIT on its default 32K machine stack */
+        pcre_assign_jit_stack(pe, NULL, jit_stack);
+    }
+#endif
+
+    return pe;
+}
+
+void PcreStudyFree(pcre_extra *pe)
+{
+    if (pe == NULL)
+        return;
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+    /* releases the JIT code too; pe may also be the SnortAlloc'd
+     * limits-only extra, which pcre_free handles */
+    pcre_free_study(pe);
+#else
+    free(pe);
+#endif
+}
+
+int PcreJitEnabled(const pcre_extra *pe)
+{
+#ifdef PCRE_STUDY_JIT_COMPILE
+    return (pe != NULL) && (pe->flags & PCRE_EXTRA_EXECUTABLE_JIT);
+#else
+    return 0;
+#endif
+}
+
+/* JIT status of a rule's pcre options for the rule profiler: "yes" or
+ * "no" if all or none of them run JIT code, "part" if some do, "-" if
+ * the rule has no pcre. */
+const char *PcreRuleJitStatus(const OptTreeNode *otn)
+{
+    const OptFpList *fpl;
+    int num = 0, jit = 0;
+
+    for (fpl = otn->opt_func; fpl != NULL; fpl = fpl->next)
+    {
+        if (fpl->type != RULE_OPTION_TYPE_PCRE)
+            continue;
+
+        num++;
+
+        if (PcreJitEnabled(((PcreData *)fpl->context)->pe))
+            jit++;
+    }
+
+    if (!num)
+        return "-";
+
+    if (jit == num)
+        return "yes";
+
+    return jit ? "part" : "no";
+}
+
 void PcreFree(void *d)
 {
     PcreData *data = (PcreData *)d;
 
     free(data->expression);
     free(data->re);
-    free(data->pe);
+    PcreStudyFree(data->pe);
     free(data);
 }
 
@@ -268,7 +412,7 @@ void SnortPcreInit(struct _SnortConfig *sc, char *data, OptTreeNode *otn, int pr
         if (pcre_data->expression)
             free(pcre_data->expression);
         if (pcre_data->pe)
-            free(pcre_data->pe);
+            PcreStudyFree(pcre_data->pe);
         if (pcre_data->re)
             free(pcre_data->re);
 
@@ -433,59 +577,8 @@ void SnortPcreParse(struct _SnortConfig *sc, char *data, PcreData *pcre_data, Op
 
 
     /* now study it... */
-    pcre_data->pe = pcre_study(pcre_data->re, 0, &error);
-
-    if (pcre_data->pe)
-    {
-        if ((ScPcreMatchLimit() != -1) && !(pcre_data->options & SNORT_OVERRIDE_MATCH_LIMIT))
-        {
-            if (pcre_data->pe->flags & PCRE_EXTRA_MATCH_LIMIT)
-            {
-                pcre_data->pe->match_limit = ScPcreMatchLimit();
-            }
-            else
-            {
-                pcre_data->pe->flags |= PCRE_EXTRA_MATCH_LIMIT;
-                pcre_data->pe->match_limit = ScPcreMatchLimit();
-            }
-        }
-
-#ifdef PCRE_EXTRA_MATCH_LIMIT_RECURSION
-        if ((ScPcreMatchLimitRecursion() != -1) && !(pcre_data->options & SNORT_OVERRIDE_MATCH_LIMIT))
-        {
-            if (pcre_data->pe->flags & PCRE_EXTRA_MATCH_LIMIT_RECURSION)
-            {
-                pcre_data->pe->match_limit_recursion = ScPcreMatchLimitRecursion();
-            }
-            else
-            {
-                pcre_data->pe->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-                pcre_data->pe->match_limit_recursion = ScPcreMatchLimitRecursion();
-            }
-        }
-#endif
-    }
-    else
-    {
-        if (!(pcre_data->options & SNORT_OVERRIDE_MATCH_LIMIT) &&
-             ((ScPcreMatchLimit() != -1) || (ScPcreMatchLimitRecursion() != -1)))
-        {
-            pcre_data->pe = (pcre_extra *)SnortAlloc(sizeof(pcre_extra));
-            if (ScPcreMatchLimit() != -1)
-            {
-                pcre_data->pe->flags |= PCRE_EXTRA_MATCH_LIMIT;
-                pcre_data->pe->match_limit = ScPcreMatchLimit();
-            }
-
-#ifdef PCRE_EXTRA_MATCH_LIMIT_RECURSION
-            if (ScPcreMatchLimitRecursion() != -1)
-            {
-                pcre_data->pe->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-                pcre_data->pe->match_limit_recursion = ScPcreMatchLimitRecursion();
-            }
-#endif
-        }
-    }
+    pcre_data->pe = PcreStudy(pcre_data->re,
+        pcre_data->options & SNORT_OVERRIDE_MATCH_LIMIT, &error);
 
     if(error != NULL)
     {
@@ -595,6 +688,7 @@ static int pcre_search(const PcreData *pcre_data,
 
     *found_offset = -1;
 
+    /* runs the JIT code if pcre_study() made any */
     result = pcre_exec(pcre_data->re,  /* result of pcre_compile() */
                        pcre_data->pe,  /* result of pcre_study()   */
                        buf,            /* the subject string */
@@ -58,6 +58,13 @@ typedef struct _PcreData
     uint32_t search_offset;
 } PcreData;
 
+struct _OptTreeNode;
+
+pcre_extra *PcreStudy(const pcre *re, int override_limits, const char **error);
+void PcreStudyFree(pcre_extra *pe);
+int PcreJitEnabled(const pcre_extra *pe);
+const char *PcreRuleJitStatus(const struct _OptTreeNode *otn);
+
 void PcreCapture(struct _SnortConfig *sc, const void *code, const void *extra);
 void PcreFree(void *d);
 uint32_t PcreHash(void *d);
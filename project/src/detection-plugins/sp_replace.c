@@ -32,6 +32,7 @@
 #include "snort_bounds.h"
 #include "snort_debug.h"
 #include "decode.h"
+#include "checksum.h"
 #include "parser.h"
 #include "sp_replace.h"
 #include "snort.h"
@@ -404,16 +405,20 @@ void Replace_QueueChange(PatternMatchData* pmd)
     r->depth = pmd->replace_depth;
 }
 
-static inline void Replace_ApplyChange(Packet *p, Replacement* r)
+static inline void Replace_ApplyChange(Packet *p, Replacement* r, uint16_t* csum)
 {
     int err;
     int rsize;
+    uint64_t sum = 0;
 
     if( (p->data + r->depth + r->size) >= (p->data + p->dsize))
         rsize = (p->dsize - r->depth);
     else
         rsize = r->size;
 
+    if ( csum )
+        sum = cksum_add(p->data + r->depth, rsize);
+
     err = SafeMemcpy(
         (void *)(p->data + r->depth), r->data,
         rsize, p->data, (p->data + p->dsize) );
@@ -424,18 +429,77 @@ static inline void Replace_ApplyChange(Packet *p, Replacement* r)
                 "Replace_Apply() => SafeMemcpy() failed\n"););
         return;
     }
+
+    // tcp and udp header lengths are even so the parity of the payload
+    // offset is the parity within the checksummed data
+    if ( csum )
+        *csum = in_chksum_update_sum(
+            *csum, sum, cksum_add(p->data + r->depth, rsize), r->depth & 1);
+}
+
+// returns the transport checksum if the replacements can be folded into
+// it incrementally (RFC 1624) or NULL if Encode_Update() must recompute
+// all checksums.  anything else that modified the packet (normalization,
+// trimming) has already set PKT_MODIFIED by the time we get here.
+static uint16_t* Replace_GetChecksum(Packet* p)
+{
+    Layer* lyr;
+    int i;
+
+    if ( (p->packet_flags & (PKT_MODIFIED | PKT_REBUILT_FRAG)) ||
+         PacketWasCooked(p) || p->frag_flag || !p->next_layer )
+        return NULL;
+
+    lyr = p->layers + p->next_layer - 1;
+
+    // an outer tunnel checksum (teredo, gtp) also covers the payload
+    for ( i = 0; i < p->next_layer - 1; i++ )
+    {
+        if ( p->layers[i].proto == PROTO_TCP || p->layers[i].proto == PROTO_UDP )
+            return NULL;
+    }
+
+    // only adjust a checksum that was verified on the way in; otherwise it
+    // may be bogus (offload) and the full recompute fixes it
+    if ( p->tcph && (lyr->start == (uint8_t*)p->tcph) )
+    {
+        if ( !ScTcpChecksums() || (p->error_flags & PKT_ERR_CKSUM_TCP) )
+            return NULL;
+
+        return &((TCPHdr*)lyr->start)->th_sum;
+    }
+    if ( p->udph && (lyr->start == (uint8_t*)p->udph) )
+    {
+        if ( !ScUdpChecksums() || (p->error_flags & PKT_ERR_CKSUM_UDP) ||
+             !p->udph->uh_chk )
+            return NULL;
+
+        return &((UDPHdr*)lyr->start)->uh_chk;
+    }
+    return NULL;
 }
 
 void Replace_ModifyPacket(Packet *p)
 {
+    uint16_t* csum;
     int n;
 
     if ( num_rpl == 0 )
         return;
 
+    csum = Replace_GetChecksum(p);
+
     for ( n = 0; n < num_rpl; n++ )
     {
-        Replace_ApplyChange(p, rpl+n);
+        Replace_ApplyChange(p, rpl+n, csum);
+    }
+    if ( csum )
+    {
+        // zero means no checksum for udp
+        if ( p->udph && !*csum )
+            *csum = 0xffff;
+
+        p->packet_flags |= PKT_CKSUM_UPDATED;
     }
     p->packet_flags |= PKT_MODIFIED;
     num_rpl = 0;
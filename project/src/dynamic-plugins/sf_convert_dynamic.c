@@ -430,6 +430,8 @@ static int ConvertPcreOption(SnortConfig *sc, Rule *rule, int index, OptTreeNode
 
     if (error)
     {
+        if (pcre_data->pe)
+            PcreStudyFree(pcre_data->pe);
         free(pcre_data->re);
         free(pcre_data);
         return -1;
@@ -466,7 +468,7 @@ static int ConvertPcreOption(SnortConfig *sc, Rule *rule, int index, OptTreeNode
         if (pcre_data->expression)
             free(pcre_data->expression);
         if (pcre_data->pe)
-            free(pcre_data->pe);
+            PcreStudyFree(pcre_data->pe);
         if (pcre_data->re)
             free(pcre_data->re);
 
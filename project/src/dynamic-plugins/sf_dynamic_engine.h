@@ -131,13 +131,20 @@ typedef void (*FreeRuleData)(void *);
  */
 #include "sf_dynamic_common.h"
 
-#define ENGINE_DATA_VERSION 9
+#define ENGINE_DATA_VERSION 11
 
 typedef void *(*PCRECompileFunc)(const char *, int, const char **, int *, const unsigned char *);
 typedef void *(*PCREStudyFunc)(const void *, int, const char **);
 typedef int (*PCREExecFunc)(const void *, const void *, const char *, int, int, int, int *, int);
 typedef void (*PCRECapture)(struct _SnortConfig *, const void *, const void *);
 typedef void(*PCREOvectorInfo)(int **, int *);
+typedef void (*PCREStudyFreeFunc)(void *);
+
+/* Decompression is done by snort so all of it shares one arena.  These are
+ * NULL if snort was built without zlib. */
+typedef void *(*InflateNewFunc)(int type, uint32_t depth);
+typedef int (*InflateRunFunc)(void *, const uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *);
+typedef void (*InflateFreeFunc)(void *);
 
 typedef struct _DynamicEngineData
 {
@@ -188,6 +195,12 @@ typedef struct _DynamicEngineData
     PCREOvectorInfo pcreOvectorInfo;
 
     GetHttpBufferFunc getHttpBuffer;
+
+    PCREStudyFreeFunc pcreStudyFree;
+
+    InflateNewFunc inflateNew;
+    InflateRunFunc inflateRun;
+    InflateFreeFunc inflateFree;
 } DynamicEngineData;
 
 extern DynamicEngineData _ded;
@@ -1188,64 +1188,13 @@ void *pcreCompile(const char *pattern, int options, const char **errptr, int *er
 
 void *pcreStudy(const void *code, int options, const char **errptr)
 {
-    pcre_extra *extra_extra;
-    int snort_options = options & SNORT_PCRE_OVERRIDE_MATCH_LIMIT;
-
-    extra_extra = pcre_study((const pcre*)code, 0, errptr);
-
-    if (extra_extra)
-    {
-        if ((ScPcreMatchLimit() != -1) && !(snort_options & SNORT_PCRE_OVERRIDE_MATCH_LIMIT))
-        {
-            if (extra_extra->flags & PCRE_EXTRA_MATCH_LIMIT)
-            {
-                extra_extra->match_limit = ScPcreMatchLimit();
-            }
-            else
-            {
-                extra_extra->flags |= PCRE_EXTRA_MATCH_LIMIT;
-                extra_extra->match_limit = ScPcreMatchLimit();
-            }
-        }
-
-#ifdef PCRE_EXTRA_MATCH_LIMIT_RECURSION
-        if ((ScPcreMatchLimitRecursion() != -1) && !(snort_options & SNORT_PCRE_OVERRIDE_MATCH_LIMIT))
-        {
-            if (extra_extra->flags & PCRE_EXTRA_MATCH_LIMIT_RECURSION)
-            {
-                extra_extra->match_limit_recursion = ScPcreMatchLimitRecursion();
-            }
-            else
-            {
-                extra_extra->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-                extra_extra->match_limit_recursion = ScPcreMatchLimitRecursion();
-            }
-        }
-#endif
-    }
-    else
-    {
-        if (!(snort_options & SNORT_PCRE_OVERRIDE_MATCH_LIMIT) &&
-            ((ScPcreMatchLimit() != -1) || (ScPcreMatchLimitRecursion() != -1)))
-        {
-            extra_extra = (pcre_extra *)SnortAlloc(sizeof(pcre_extra));
-            if (ScPcreMatchLimit() != -1)
-            {
-                extra_extra->flags |= PCRE_EXTRA_MATCH_LIMIT;
-                extra_extra->match_limit = ScPcreMatchLimit();
-            }
-
-#ifdef PCRE_EXTRA_MATCH_LIMIT_RECURSION
-            if (ScPcreMatchLimitRecursion() != -1)
-            {
-                extra_extra->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
-                extra_extra->match_limit_recursion = ScPcreMatchLimitRecursion();
-            }
-#endif
-        }
-    }
+    return PcreStudy((const pcre *)code,
+        options & SNORT_PCRE_OVERRIDE_MATCH_LIMIT, errptr);
+}
 
-    return extra_extra;
+void pcreStudyFree(void *extra)
+{
+    PcreStudyFree((pcre_extra *)extra);
 }
 
 /* pcreOvectorInfo
@@ -1337,9 +1286,20 @@ int InitDynamicEngines(char *dynamic_rules_path)
     engineData.flowbitUnregister = &DynamicFlowbitUnregister;
 
     engineData.pcreCapture = &PcreCapture;
+    engineData.pcreStudyFree = &pcreStudyFree;
     engineData.pcreOvectorInfo = &pcreOvectorInfo;
     engineData.getHttpBuffer = getHttpBuffer;
 
+#ifdef ZLIB
+    engineData.inflateNew = &DynamicInflateNew;
+    engineData.inflateRun = &DynamicInflateRun;
+    engineData.inflateFree = &DynamicInflateFree;
+#else
+    engineData.inflateNew = NULL;
+    engineData.inflateRun = NULL;
+    engineData.inflateFree = NULL;
+#endif
+
     return InitDynamicEnginePlugins(&engineData);
 }
 
@@ -1457,7 +1417,7 @@ void DynamicRegisterPreprocessorProfile(const char *keyword, void *stats, int la
 int DynamicProfilingPreprocs(void)
 {
 #ifdef PERF_PROFILING
-    return ScProfilePreprocs();
+    return PROFILING_PREPROCS;
 #else
     return 0;
 #endif
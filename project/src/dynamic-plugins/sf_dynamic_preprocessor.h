@@ -54,7 +54,7 @@
 #endif
 #endif
 
-#define PREPROCESSOR_DATA_VERSION 7
+#define PREPROCESSOR_DATA_VERSION 8
 
 #include "sf_dynamic_common.h"
 #include "sf_dynamic_engine.h"
@@ -34,198 +34,80 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <zlib.h>
+#include <string.h>
 
 #include "sf_decompression.h"
+#include "sf_inflate.h"
 #else
-#include <zlib.h>
-
 #include "sf_snort_plugin_api.h"
 #include "sf_decompression.h"
+#include "sf_dynamic_engine.h"
 #include "sf_types.h"
 #endif /* DECOMPRESS_UNIT_TEST */
 
-/* Implementation-Specific Defines */
-#define DEFLATE_RAW_WBITS -15
-#define DEFLATE_ZLIB_WBITS 15
-#define GZIP_ZLIB_WBITS 31
-
-/* Decompression state is defined here so that
-   dynamic plugins don't access it directly. */
-typedef struct decompress_state
-{
-    compression_type_t type;
-    uint32_t flags;
-    void *lib_info;
-    int lib_return;
-    bool deflate_initialized;
-} decompress_state_t;
-
-/* Decompression state flags */
-#define SNORT_ZLIB_INIT_NEEDED 0x00000001
+/* The decompression itself is done by snort (sfutil/sf_inflate.c) so the
+   memory for it comes from the same arena as http_inspect's.  The state
+   objects are snort's and opaque here. */
 
-/* Zlib-specific init function */
-static inline decompress_state_t * SnortDecompressInitZlib(compression_type_t type)
+#ifdef DECOMPRESS_UNIT_TEST
+/* Stand in for what snort passes to the engine. */
+static void * UnitInflateNew(int type, uint32_t depth)
 {
-    decompress_state_t *state = calloc(1, sizeof(decompress_state_t) );
-    z_stream *zlib_stream     = calloc(1, sizeof(z_stream) );
-
-    if (state == NULL || zlib_stream == NULL)
-        DynamicEngineFatalMessage("Unable to allocate memory in SnortDecompressInitZlib()\n");
-
-    /* Setup Zlib memory management callbacks */
-    zlib_stream->zalloc = NULL;
-    zlib_stream->zfree = NULL;
-    zlib_stream->opaque = NULL;
-
-    /* Fill out state object */
-    state->type = type;
-    state->lib_info = (void *) zlib_stream;
-
-    /* Can't call inflateInit() until there's some data */
-    state->flags |= SNORT_ZLIB_INIT_NEEDED;
-
-    return state;
+    return SFInflate_New((type == COMPRESSION_TYPE_GZIP) ?
+        SF_INFLATE_GZIP : SF_INFLATE_DEFLATE, depth);
 }
 
-/* Zlib-specific Destroy function */
-static inline int SnortDecompressDestroyZlib(decompress_state_t *state)
+static int UnitInflateRun(void *state, const uint8_t *input, uint32_t input_len,
+                          uint8_t *output, uint32_t output_bufsize, uint32_t *output_len)
 {
-    z_streamp zlib_stream = (z_streamp) state->lib_info;
-    int ret;
-
-    if (zlib_stream == NULL)
-        return SNORT_DECOMPRESS_BAD_ARGUMENT;
-
-    ret = inflateEnd(zlib_stream);
+    int ret = SFInflate_Run(state, input, input_len, output, output_bufsize, output_len);
 
-    free(zlib_stream);
-    free(state);
+    if (ret == SF_INFLATE_FULL)
+        return SNORT_DECOMPRESS_OUTPUT_TRUNC;
 
-    if (ret == Z_OK)
-        return SNORT_DECOMPRESS_OK;
+    if (ret == SF_INFLATE_ERROR)
+        return SNORT_DECOMPRESS_BAD_DATA;
 
-    /* XXX: Only other possibility is Z_STREAM_ERROR.
-            Can't set state->lib_ret because we just freed the state. */
-    return SNORT_DECOMPRESS_ERROR;
+    return (ret < 0) ? SNORT_DECOMPRESS_ERROR : SNORT_DECOMPRESS_OK;
 }
 
-/* Zlib-specific Decompression function. */
-static inline int SnortDecompressZlib(decompress_state_t *state, uint8_t *input, uint32_t input_len,
-                               uint8_t *output, uint32_t output_bufsize, uint32_t *output_len)
+static void UnitInflateFree(void *state)
 {
-    z_streamp zlib_stream = (z_streamp) state->lib_info;
-    int zlib_ret;
-    int snort_ret = SNORT_DECOMPRESS_OK;
-
-    if (zlib_stream == NULL)
-        return SNORT_DECOMPRESS_BAD_ARGUMENT; // Uninitialized state object.
-
-    /* The call to inflateInit() requires some data to be provided.
-       That's why the call isn't done in SnortDecompressInit(). */
-    if (state->flags & SNORT_ZLIB_INIT_NEEDED)
-    {
-        if (input == NULL)
-            return SNORT_DECOMPRESS_BAD_ARGUMENT;
-
-        zlib_stream->next_in = input;
-        zlib_stream->avail_in = input_len;
-
-        /* Deflate can be either raw or with a zlib header so we'll
-         * just use the normal inflateInit and if inflate fails, add
-         * a dummy zlib header.  Just like Chrome and Firefox do.
-         * gzip decompression requires adding 16 to zlibs MAX_WBITS 
-         */
-        if (state->type == COMPRESSION_TYPE_DEFLATE)
-            zlib_ret = inflateInit(zlib_stream);
-        else
-            zlib_ret = inflateInit2(zlib_stream, GZIP_ZLIB_WBITS);
-        state->lib_return = zlib_ret;
-
-        state->flags &= ~SNORT_ZLIB_INIT_NEEDED;
-    }
-    /* If input is NULL, just continue decompressing from the last spot.
-       This is how a caller would handle truncated output. */
-    else if (input)
-    {
-        zlib_stream->next_in = input;
-        zlib_stream->avail_in = input_len;
-    }
-
-    zlib_stream->next_out = output;
-    zlib_stream->avail_out = output_bufsize;
-
-    while (zlib_stream->avail_in > 0 && zlib_stream->avail_out > 0)
-    {
-        zlib_ret = inflate(zlib_stream, Z_SYNC_FLUSH);
-
-        if ((zlib_ret == Z_DATA_ERROR)
-                && (state->type == COMPRESSION_TYPE_DEFLATE)
-                && (!state->deflate_initialized))
-        {
-            /* Might not have zlib header - add one */
-            static char zlib_header[2] = { 0x78, 0x01 };
-
-            inflateReset(zlib_stream);
-            zlib_stream->next_in = (Bytef *)zlib_header;
-            zlib_stream->avail_in = sizeof(zlib_header);
-
-            zlib_ret = inflate(zlib_stream, Z_SYNC_FLUSH);
-            state->deflate_initialized = true;
-
-            if (input)
-            {
-                zlib_stream->next_in = input;
-                zlib_stream->avail_in = input_len;
-            }
-        }
-
-        state->lib_return = zlib_ret;
-
-        if (zlib_ret == Z_STREAM_END)
-            break; // Not an error, just hit the end of compressed data.
-
-        if (zlib_ret != Z_OK)
-        {
-            snort_ret = SNORT_DECOMPRESS_BAD_DATA;
-            break;
-        }
-    }
-
-    if ((zlib_stream->avail_in > 0 && zlib_stream->avail_out == 0) &&
-        (snort_ret != SNORT_DECOMPRESS_BAD_DATA))
-    {
-        snort_ret = SNORT_DECOMPRESS_OUTPUT_TRUNC;
-    }
-
-    *output_len = output_bufsize - zlib_stream->avail_out;
-
-    return snort_ret;
+    SFInflate_Free(state);
 }
 
+DynamicEngineData _ded = {
+    .inflateNew = UnitInflateNew,
+    .inflateRun = UnitInflateRun,
+    .inflateFree = UnitInflateFree
+};
+#endif /* DECOMPRESS_UNIT_TEST */
+
 /* This function initializes a Decompression API state object.
    It must be called first when using decompression.
 
    Arguments: type => Type of decompression to use (gzip, deflate)
-   Returns: void pointer to decompression state object
+   Returns: void pointer to decompression state object, NULL if snort was
+            built without zlib or decompress_memcap was reached
 */
 ENGINE_LINKAGE void * SnortDecompressInit(compression_type_t type)
 {
-    decompress_state_t *state = NULL;
+    if (_ded.inflateNew == NULL)
+        return NULL;
 
     switch (type)
     {
         case COMPRESSION_TYPE_DEFLATE:
         case COMPRESSION_TYPE_GZIP:
-            state = SnortDecompressInitZlib(type);
-            break;
+            /* Nothing more is allocated until there's data */
+            return _ded.inflateNew(type, 0);
         case COMPRESSION_TYPE_MAX:
         default:
             /* invalid type... */
-            return NULL;
+            break;
     }
 
-    return (void *) state;
+    return NULL;
 }
 
 /* This function destroys a Decompression API state object.
@@ -233,25 +115,14 @@ ENGINE_LINKAGE void * SnortDecompressInit(compression_type_t type)
    Arguments: void *s => state object allocated by SnortDecompressInit().
    Returns: SNORT_DECOMPRESS_OK on success, negative on error.
 */
-ENGINE_LINKAGE int SnortDecompressDestroy(void *s)
+ENGINE_LINKAGE int SnortDecompressDestroy(void *state)
 {
-    decompress_state_t *state = s;
-
     if (state == NULL)
         return SNORT_DECOMPRESS_BAD_ARGUMENT;
 
-    switch (state->type)
-    {
-        case COMPRESSION_TYPE_DEFLATE:
-        case COMPRESSION_TYPE_GZIP:
-            return SnortDecompressDestroyZlib(state);
-        case COMPRESSION_TYPE_MAX:
-        default:
-            break;
-    }
+    _ded.inflateFree(state);
 
-    /* Bad type. Was this constructed outside of SnortDecompressInit()? */
-    return SNORT_DECOMPRESS_BAD_ARGUMENT;
+    return SNORT_DECOMPRESS_OK;
 }
 
 /* This is the function that decompresses data.
@@ -274,38 +145,25 @@ ENGINE_LINKAGE int SnortDecompressDestroy(void *s)
      SNORT_DECOMPRESS_OUTPUT_TRUNC: Decompression was successful, but the output
                                     buffer filled up. Call SnortDecompress() again
                                     with NULL input after consuming the output.
+     SNORT_DECOMPRESS_ERROR:        decompress_memcap was reached.
 */
 ENGINE_LINKAGE int SnortDecompress(void *state, uint8_t *input, uint32_t input_len,
                     uint8_t *output, uint32_t output_bufsize, uint32_t *output_len)
 {
-    decompress_state_t *internal_state;
-
     /* NULL "input" ptr is OK, it signals that we should continue decompressing the
        last input. The caller should have consumed output and made more space. */
     if (state == NULL || output == NULL || output_len == NULL)
         return SNORT_DECOMPRESS_BAD_ARGUMENT;
 
-    internal_state = (decompress_state_t *) state;
-
-    switch (internal_state->type)
-    {
-        case COMPRESSION_TYPE_DEFLATE:
-        case COMPRESSION_TYPE_GZIP:
-            return SnortDecompressZlib(internal_state, input, input_len,
-                                       output, output_bufsize, output_len);
-        case COMPRESSION_TYPE_MAX:
-        default:
-            break;
-    }
-
-    return SNORT_DECOMPRESS_BAD_ARGUMENT;
+    return _ded.inflateRun(state, input, input_len, output, output_bufsize, output_len);
 }
 
 
 
 /* This section is a unit test meant to independently test the Decompression API.
    Compile like so:
-   gcc -DDECOMPRESS_UNIT_TEST sf_decompression.c -o decompression_unit_test -lz
+   gcc -DDECOMPRESS_UNIT_TEST -DZLIB -I../../sfutil sf_decompression.c \
+       ../../sfutil/sf_inflate.c -o decompression_unit_test -lz
  */
 #ifdef DECOMPRESS_UNIT_TEST
 /* Driver program uses the Snort decompression API to read from a file and
@@ -54,7 +54,8 @@ typedef enum compression_type
    It must be called first when using decompression.
 
    Arguments: type => Type of decompression to use (gzip, deflate)
-   Returns: void pointer to decompression state object
+   Returns: void pointer to decompression state object, NULL if snort was
+            built without zlib or decompress_memcap was reached
 */
 ENGINE_LINKAGE void * SnortDecompressInit(compression_type_t type);
 
@@ -85,6 +86,7 @@ ENGINE_LINKAGE int SnortDecompressDestroy(void *state);
      SNORT_DECOMPRESS_OUTPUT_TRUNC: Decompression was successful, but the output
                                     buffer filled up. Call SnortDecompress() again
                                     with NULL input after consuming the output.
+     SNORT_DECOMPRESS_ERROR:        decompress_memcap was reached.
 */
 ENGINE_LINKAGE int SnortDecompress(void *state, uint8_t *input, uint32_t input_len, 
                     uint8_t *output, uint32_t output_bufsize, uint32_t *output_len);
@@ -1027,7 +1027,7 @@ static void FreeOneRule(void *data)
 
                     if (pcre->compiled_extra != NULL)
                     {
-                        free(pcre->compiled_extra);
+                        _ded.pcreStudyFree(pcre->compiled_extra);
                         pcre->compiled_extra = NULL;
                     }
                 }
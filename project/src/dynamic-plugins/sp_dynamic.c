@@ -74,6 +74,10 @@
 #include "sfhashfcn.h"
 #include "sp_preprocopt.h"
 #include "sfutil/sf_base64decode.h"
+#ifdef ZLIB
+#include "sfutil/sf_inflate.h"
+#include "dynamic-plugins/sf_engine/sf_decompression.h"
+#endif
 #include "detection_util.h"
 #include "stream_api.h"
 
@@ -700,6 +704,47 @@ int Dynamicsfbase64decode(uint8_t *inbuf, uint32_t insize, uint8_t *outbuf, uint
     return sf_base64decode(inbuf, insize, outbuf, outsize, read);
 }
 
+#ifdef ZLIB
+void *DynamicInflateNew(int type, uint32_t depth)
+{
+    switch (type)
+    {
+        case COMPRESSION_TYPE_DEFLATE:
+            return SFInflate_New(SF_INFLATE_DEFLATE, depth);
+        case COMPRESSION_TYPE_GZIP:
+            return SFInflate_New(SF_INFLATE_GZIP, depth);
+        default:
+            break;
+    }
+    return NULL;
+}
+
+/* Returns the engine's SNORT_DECOMPRESS_* codes */
+int DynamicInflateRun(void *state, const uint8_t *input, uint32_t input_len,
+        uint8_t *output, uint32_t output_bufsize, uint32_t *output_len)
+{
+    switch (SFInflate_Run((SFInflate *)state, input, input_len,
+                output, output_bufsize, output_len))
+    {
+        case SF_INFLATE_OK:
+        case SF_INFLATE_END:
+            return SNORT_DECOMPRESS_OK;
+        case SF_INFLATE_FULL:
+            return SNORT_DECOMPRESS_OUTPUT_TRUNC;
+        case SF_INFLATE_ERROR:
+            return SNORT_DECOMPRESS_BAD_DATA;
+        default:
+            break;
+    }
+    return SNORT_DECOMPRESS_ERROR;
+}
+
+void DynamicInflateFree(void *state)
+{
+    SFInflate_Free((SFInflate *)state);
+}
+#endif
+
 int DynamicGetAltDetect(uint8_t **bufPtr, uint16_t *altLenPtr)
 {
     return GetAltDetect(bufPtr, altLenPtr);
@@ -88,6 +88,11 @@ int DynamicFlowbitCheck(void *pkt, void *);
 int DynamicAsn1Detect(void *pkt, void *ctxt, const uint8_t *cursor);
 int DynamicsfUnfold(const uint8_t *, uint32_t , uint8_t *, uint32_t , uint32_t *);
 int Dynamicsfbase64decode(uint8_t *, uint32_t , uint8_t *, uint32_t , uint32_t *);
+#ifdef ZLIB
+void *DynamicInflateNew(int, uint32_t);
+int DynamicInflateRun(void *, const uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *);
+void DynamicInflateFree(void *);
+#endif
 int DynamicGetAltDetect(uint8_t **, uint16_t *);
 void DynamicSetAltDetect(uint8_t *, uint16_t );
 int DynamicIsDetectFlag(SFDetectFlagType);
@@ -2958,7 +2958,7 @@ static DCE2_Ret DCE2_ScAddToRoutingTable(DCE2_Config *config,
 
         if (config->sconfigs == NULL)
         {
-            config->sconfigs = sfrt_new(DIR_16_4x4_16x5_4x4, IPv6, 100, 20);
+            config->sconfigs = sfrt_new(POPTRIE, IPv6, 100, 20);
             if (config->sconfigs == NULL)
             {
                 DCE2_Log(DCE2_LOG_TYPE__ERROR,
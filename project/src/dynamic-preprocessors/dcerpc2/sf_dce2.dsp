@@ -182,6 +182,10 @@ SOURCE=..\include\sfrt_dir.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\include\sfrt_poptrie.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\snort_dce2.c
 # End Source File
 # Begin Source File
@@ -357,9 +357,12 @@ static int DCE2_CheckConfigPolicy(
     DCE2_PafRegisterService(sc, dce2_proto_ids.dcerpc, policyId, DCE2_TRANS_TYPE__TCP);
 #endif
 
-    /* Register routing table memory */
+    /* Compile and register routing table memory */
     if (pPolicyConfig->sconfigs != NULL)
+    {
+        sfrt_compile(pPolicyConfig->sconfigs);
         DCE2_RegMem(sfrt_usage(pPolicyConfig->sconfigs), DCE2_MEM_TYPE__RT);
+    }
 
     return 0;
 }
@@ -1060,9 +1063,12 @@ static int DCE2_ReloadVerifyPolicy(
     DCE2_PafRegisterService(sc, dce2_proto_ids.dcerpc, policyId, DCE2_TRANS_TYPE__TCP);
 #endif
 
-    /* Register routing table memory */
+    /* Compile and register routing table memory */
     if (swap_config->sconfigs != NULL)
+    {
+        sfrt_compile(swap_config->sconfigs);
         DCE2_RegMem(sfrt_usage(swap_config->sconfigs), DCE2_MEM_TYPE__RT);
+    }
 
     if (current_config == NULL)
         return 0;
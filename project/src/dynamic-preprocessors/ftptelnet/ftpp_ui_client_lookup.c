@@ -68,7 +68,7 @@ static void clientConfFree(void *pData);
 #define FTPP_UI_CONFIG_MAX_CLIENTS 20
 int ftpp_ui_client_lookup_init(CLIENT_LOOKUP **ClientLookup)
 {
-    *ClientLookup =  sfrt_new(DIR_16_4x4_16x5_4x4, IPv6, FTPP_UI_CONFIG_MAX_CLIENTS, 20);
+    *ClientLookup =  sfrt_new(POPTRIE, IPv6, FTPP_UI_CONFIG_MAX_CLIENTS, 20);
 
     if(*ClientLookup == NULL)
     {
@@ -153,6 +153,30 @@ int ftpp_ui_client_lookup_add(
     return FTPP_SUCCESS;
 }
 
+/*
+ * Function: ftpp_ui_client_lookup_compile(CLIENT_LOOKUP *ClientLookup)
+ *
+ * Purpose: Prepare the client lookup for packet processing.
+ *          This is called once all the client configurations have
+ *          been added so the table is compiled at configuration
+ *          time instead of on a lookup.
+ *
+ * Arguments: ClientLookup => a pointer to the lookup structure
+ *
+ * Returns: int => return code indicating error or success; lookups
+ *                 still work if the compile fails
+ *
+ */
+int ftpp_ui_client_lookup_compile(CLIENT_LOOKUP *ClientLookup)
+{
+    if (sfrt_compile(ClientLookup))
+    {
+        return FTPP_MEM_ALLOC_FAIL;
+    }
+
+    return FTPP_SUCCESS;
+}
+
 /*
  * Function: ftpp_ui_client_lookup_find(CLIENT_LOOKUP *ClientLookup,
  *                                  snort_ip_p ip, int *iError)
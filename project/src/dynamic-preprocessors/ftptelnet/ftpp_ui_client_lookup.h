@@ -40,6 +40,7 @@ int ftpp_ui_client_lookup_init(CLIENT_LOOKUP **ClientLookup);
 int ftpp_ui_client_lookup_cleanup(CLIENT_LOOKUP **ClientLookup);
 int ftpp_ui_client_lookup_add(CLIENT_LOOKUP *ClientLookup, sfip_t * IP,
                             FTP_CLIENT_PROTO_CONF *ClientConf);
+int ftpp_ui_client_lookup_compile(CLIENT_LOOKUP *ClientLookup);
 
 FTP_CLIENT_PROTO_CONF *ftpp_ui_client_lookup_find(CLIENT_LOOKUP *ClientLookup, 
                                             snort_ip_p Ip, int *iError);
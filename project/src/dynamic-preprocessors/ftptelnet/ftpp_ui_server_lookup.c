@@ -65,7 +65,7 @@ static void serverConfFree(void *pData);
 #define FTPP_UI_CONFIG_MAX_SERVERS 20
 int ftpp_ui_server_lookup_init(SERVER_LOOKUP **ServerLookup)
 {
-    *ServerLookup =  sfrt_new(DIR_16_4x4_16x5_4x4, IPv6, FTPP_UI_CONFIG_MAX_SERVERS, 20);
+    *ServerLookup =  sfrt_new(POPTRIE, IPv6, FTPP_UI_CONFIG_MAX_SERVERS, 20);
 
     if(*ServerLookup == NULL)
     {
@@ -139,6 +139,30 @@ int ftpp_ui_server_lookup_add(
     return FTPP_SUCCESS;
 }
 
+/*
+ * Function: ftpp_ui_server_lookup_compile(SERVER_LOOKUP *ServerLookup)
+ *
+ * Purpose: Prepare the server lookup for packet processing.
+ *          This is called once all the server configurations have
+ *          been added so the table is compiled at configuration
+ *          time instead of on a lookup.
+ *
+ * Arguments: ServerLookup => a pointer to the lookup structure
+ *
+ * Returns: int => return code indicating error or success; lookups
+ *                 still work if the compile fails
+ *
+ */
+int ftpp_ui_server_lookup_compile(SERVER_LOOKUP *ServerLookup)
+{
+    if (sfrt_compile(ServerLookup))
+    {
+        return FTPP_MEM_ALLOC_FAIL;
+    }
+
+    return FTPP_SUCCESS;
+}
+
 /*
  * Function: ftpp_ui_server_lookup_find(SERVER_LOOKUP *ServerLookup,
  *                                  snort_ip_p ip, int *iError)
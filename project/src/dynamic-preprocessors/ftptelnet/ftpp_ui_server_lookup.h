@@ -38,6 +38,7 @@ int ftpp_ui_server_lookup_init(SERVER_LOOKUP **ServerLookup);
 int ftpp_ui_server_lookup_cleanup(SERVER_LOOKUP **ServerLookup);
 int ftpp_ui_server_lookup_add(SERVER_LOOKUP *ServerLookup, sfip_t *IP,
                             FTP_SERVER_PROTO_CONF *ServerConf);
+int ftpp_ui_server_lookup_compile(SERVER_LOOKUP *ServerLookup);
 
 FTP_SERVER_PROTO_CONF *ftpp_ui_server_lookup_find(SERVER_LOOKUP *ServerLookup,
                                             snort_ip_p Ip, int *iError);
@@ -166,6 +166,10 @@ SOURCE=..\include\sfrt_dir.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\include\sfrt_poptrie.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\snort_ftptelnet.c
 # End Source File
 # Begin Source File
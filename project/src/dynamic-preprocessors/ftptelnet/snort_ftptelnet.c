@@ -3664,6 +3664,9 @@ int FTPTelnetCheckConfigs(struct _SnortConfig *sc, void* pData, tSfPolicyId poli
     _FTPTelnetAddService(sc, ftp_app_id, policyId);
 #endif
 
+    ftpp_ui_client_lookup_compile(pPolicyConfig->client_lookup);
+    ftpp_ui_server_lookup_compile(pPolicyConfig->server_lookup);
+
     return 0;
 
 }
@@ -38,6 +38,7 @@
 #include "spp_reputation.h"
 #include "reputation_debug.h"
 #include "reputation_utils.h"
+#include "reputation_table.h"
 #ifdef SHARED_REP
 #include "./shmem/shmem_mgmt.h"
 #include <sys/stat.h>
@@ -82,6 +83,8 @@ enum
 #define REPUTATION_SHAREMEM_KEYWORD      "shared_mem"
 #define REPUTATION_SHAREDREFRESH_KEYWORD "shared_refresh"
 #define REPUTATION_WHITEACTION_KEYWORD   "white"
+#define REPUTATION_LOADTABLE_KEYWORD     "load_table"
+#define REPUTATION_SAVETABLE_KEYWORD     "save_table"
 
 #define REPUTATION_CONFIG_SECTION_SEPERATORS     ",;"
 #define REPUTATION_CONFIG_VALUE_SEPERATORS       " "
@@ -123,6 +126,8 @@ table_flat_t *emptyIPtables;
  */
 static void IpListInit(uint32_t,ReputationConfig *config);
 static void LoadListFile(char *filename, INFO info, ReputationConfig *config);
+static void LoadTableFile(ReputationConfig *config);
+static void SaveTableFile(ReputationConfig *config, char *filename);
 static void DisplayIPlistStats(ReputationConfig *);
 static void DisplayReputationConfig(ReputationConfig *);
 
@@ -193,6 +198,83 @@ static int CheckIPlistDir(char *path)
     return 1;
 }
 
+/* ********************************************************************
+ * Function: FindTableInFileList
+ *
+ * A prebuilt table already holds all of its lists so it is used by itself.
+ *
+ * Arguments:
+ *
+ * ShmemDataFileList** file_list: the list of whitelist/blacklist files
+ * int num_files: number of files
+ *
+ * RETURNS:
+ *     index of the first table file, -1 if none
+ *********************************************************************/
+static int FindTableInFileList(ShmemDataFileList** file_list, int num_files)
+{
+    int i;
+
+    for (i = 0; i < num_files; i++)
+    {
+        if (TABLE_LIST == file_list[i]->filetype)
+            return i;
+    }
+    return -1;
+}
+
+/* ********************************************************************
+ * Function: LoadTableIntoShmem
+ *
+ * Copy a prebuilt table into the shared memory segment as is.
+ *
+ * Arguments:
+ *
+ * void* ptrSegment: start of shared memory segment.
+ * char *filename: the table file
+ *
+ * RETURNS:
+ *     0: success
+ *     other value fails
+ *********************************************************************/
+static int LoadTableIntoShmem(void* ptrSegment, char *filename)
+{
+    table_flat_t *table;
+    uint32_t size;
+    uint8_t *base;
+
+    _dpd.logMsg("    Processing reputation table %s\n", filename);
+
+    if ((table = ReputationTable_Map(filename, &size)) == NULL)
+        return -1;
+
+    /* The file was replaced after the segment was sized */
+    if (size != reputation_shmem_config->memsize)
+    {
+        _dpd.errMsg("Reputation table %s: Table changed while loading.\n", filename);
+        ReputationTable_Unmap(table, size);
+        return -1;
+    }
+
+    memcpy(ptrSegment, table, size);
+    ReputationTable_Unmap(table, size);
+
+    segment_meminit((uint8_t*)ptrSegment, 0);
+    base = (uint8_t *)ptrSegment;
+
+    reputation_shmem_config->iplist = (table_flat_t *)ptrSegment;
+    reputation_shmem_config->listInfo =
+        (ListInfo *)&base[reputation_shmem_config->iplist->list_info];
+    reputation_shmem_config->memCapReached = false;
+
+    total_duplicates = 0;
+    total_invalids = 0;
+
+    _dpd.logMsg("Reputation Preprocessor shared memory summary:\n");
+    DisplayIPlistStats(reputation_shmem_config);
+    return 0;
+}
+
 /* ********************************************************************
  * Function: LoadFileIntoShmem
  *
@@ -225,6 +307,9 @@ int LoadFileIntoShmem(void* ptrSegment, ShmemDataFileList** file_list, int num_f
         num_files = MAX_IPLIST_FILES;
     }
 
+    if ((i = FindTableInFileList(file_list, num_files)) >= 0)
+        return LoadTableIntoShmem(ptrSegment, file_list[i]->filename);
+
     segment_meminit((uint8_t*)ptrSegment, reputation_shmem_config->memsize);
 
     /*DIR_16x7_4x4 for performance, but memory usage is high
@@ -297,6 +382,27 @@ uint32_t GetSegmentSizeFromFileList(ShmemDataFileList** file_list, int file_coun
     {
         return ZEROSEG;
     }
+
+    if ((i = FindTableInFileList(file_list, file_count)) >= 0)
+    {
+        uint32_t size;
+
+        if (file_count > 1)
+        {
+            _dpd.logMsg("WARNING: Reputation preprocessor: Using table %s, "
+                    "the other %d list files are not loaded.\n",
+                    file_list[i]->filename, file_count - 1);
+        }
+
+        if ((size = ReputationTable_GetSize(file_list[i]->filename)) == 0)
+        {
+            DynamicPreprocessorFatalMessage("Unable to load reputation table %s\n",
+                    file_list[i]->filename);
+        }
+        reputation_shmem_config->memsize = size;
+        return size;
+    }
+
     for (i = 0; i < file_count; i++)
     {
         errno = 0;
@@ -540,6 +646,7 @@ static void IpListInit(uint32_t maxEntries, ReputationConfig *config)
 
         segment_meminit((uint8_t*)config->localSegment,mem_size);
         base = (uint8_t *)config->localSegment;
+        config->memsize = mem_size;
 
         /*DIR_16x7_4x4 for performance, but memory usage is high
          *Use  DIR_8x16 worst case IPV4 5K, IPV6 15K (bytes)
@@ -1357,6 +1464,78 @@ static void LoadListFile(char *filename, INFO info, ReputationConfig *config)
     fclose(fp);
 }
 
+/********************************************************************
+ * Function: LoadTableFile
+ *
+ * Map a prebuilt table instead of loading list files.  The table is
+ * used in place, read only; nothing is parsed or allocated.
+ *
+ * Arguments:
+ *  ReputationConfig *:  The configuration to be update.
+ *
+ * Returns:
+ *  None
+ *
+ ********************************************************************/
+
+static void LoadTableFile(ReputationConfig *config)
+{
+    table_flat_t *table;
+
+    _dpd.logMsg("    Mapping reputation table %s\n", config->tableFile);
+
+    table = ReputationTable_Map(config->tableFile, &config->tableSize);
+
+    if (table == NULL)
+    {
+        DynamicPreprocessorFatalMessage("%s(%d) => Unable to load reputation table %s.\n",
+                *(_dpd.config_file), *(_dpd.config_line), config->tableFile);
+    }
+
+    /* The table stats are found through the segment base */
+    segment_meminit((uint8_t *)table, 0);
+
+    config->localSegment = table;
+    config->iplist = table;
+    config->memsize = config->tableSize;
+}
+
+/********************************************************************
+ * Function: SaveTableFile
+ *
+ * Save the table built from the list files so it can be loaded later
+ * with load_table.  Configuring save_table and running snort -T is how
+ * tables are compiled offline.
+ *
+ * Arguments:
+ *  ReputationConfig *:  The configuration with the table to save.
+ *  filename: the table file
+ *
+ * Returns:
+ *  None
+ *
+ ********************************************************************/
+
+static void SaveTableFile(ReputationConfig *config, char *filename)
+{
+    if (config->iplist == NULL)
+        return;
+
+    if (config->memCapReached)
+    {
+        DynamicPreprocessorFatalMessage("%s(%d) => Reputation table %s not saved "
+                "since memcap was reached.\n",
+                *(_dpd.config_file), *(_dpd.config_line), filename);
+    }
+
+    if (ReputationTable_Save(filename, config->iplist,
+            config->memsize - (uint32_t)segment_unusedmem()))
+    {
+        DynamicPreprocessorFatalMessage("%s(%d) => Unable to save reputation table %s.\n",
+                *(_dpd.config_file), *(_dpd.config_line), filename);
+    }
+}
+
 /********************************************************************
  * Function: Reputation_FreeConfig
  *
@@ -1375,11 +1554,18 @@ void Reputation_FreeConfig (ReputationConfig *config)
     if (config == NULL)
         return;
 
-    if (config->localSegment != NULL)
+    if (config->tableSize)
+    {
+        ReputationTable_Unmap((table_flat_t *)config->localSegment, config->tableSize);
+    }
+    else if (config->localSegment != NULL)
     {
         free(config->localSegment);
     }
 
+    if (config->tableFile)
+        free(config->tableFile);
+
     if(config->sharedMem.path)
         free(config->sharedMem.path);
     free(config);
@@ -1500,6 +1686,28 @@ int EstimateNumEntries(ReputationConfig *config, u_char* argp)
             totalLines += numlines;
 
         }
+        else if ( !strcasecmp( cur_tokenp, REPUTATION_LOADTABLE_KEYWORD ))
+        {
+            char full_path_filename[PATH_MAX+1];
+            cur_tokenp = strtok_r( next_tokenp, REPUTATION_CONFIG_VALUE_SEPERATORS, &next_tokenp);
+            if(cur_tokenp == NULL)
+            {
+                DynamicPreprocessorFatalMessage("%s(%d) => Bad table filename for %s.\n",
+                        *(_dpd.config_file), *(_dpd.config_line), REPUTATION_LOADTABLE_KEYWORD);
+            }
+            if (config->tableFile)
+            {
+                DynamicPreprocessorFatalMessage("%s(%d) => Only one %s is allowed.\n",
+                        *(_dpd.config_file), *(_dpd.config_line), REPUTATION_LOADTABLE_KEYWORD);
+            }
+            UpdatePathToFile(full_path_filename, PATH_MAX, cur_tokenp);
+            config->tableFile = strdup(full_path_filename);
+
+            if ( !config->tableFile )
+            {
+                DynamicPreprocessorFatalMessage("Could not allocate memory to parse Reputation options.\n");
+            }
+        }
         else if ( !strcasecmp( cur_tokenp, REPUTATION_WHITEACTION_KEYWORD ))
         {
             int i = 0;
@@ -1586,6 +1794,7 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
     char* cur_sectionp = NULL;
     char* next_sectionp = NULL;
     char* argcpyp = NULL;
+    char saveFile[PATH_MAX+1];
 
     if (config == NULL)
         return;
@@ -1599,8 +1808,11 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
     config->whiteAction = UNBLACK;
     config->localSegment = NULL;
     config->emptySegment = NULL;
+    config->tableFile = NULL;
+    config->tableSize = 0;
     config->memsize = 0;
     config->memCapReached = false;
+    saveFile[0] = '\0';
 
     /* Sanity check(s) */
     if ( !argp )
@@ -1626,14 +1838,24 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
 
     DEBUG_WRAP(DebugMessage(DEBUG_REPUTATION, "Estimated number of entries: %d\n",config->numEntries ););
 
-    if ((config->numEntries <= 0) && (!config->sharedMem.path))
+    if (config->tableFile)
+    {
+        if (config->sharedMem.path)
+        {
+            DynamicPreprocessorFatalMessage("%s(%d) => Option '%s' can't be used with option '%s'.\n",
+                    *(_dpd.config_file), *(_dpd.config_line),
+                    REPUTATION_LOADTABLE_KEYWORD, REPUTATION_SHAREMEM_KEYWORD);
+        }
+        LoadTableFile(config);
+    }
+    else if ((config->numEntries <= 0) && (!config->sharedMem.path))
     {
         _dpd.logMsg("WARNING: Can't find any whitelist/blacklist entries. "
                 "Reputation Preprocessor disabled.\n");
         free(argcpyp);
         return;
     }
-    if (!config->sharedMem.path)
+    if (!config->sharedMem.path && !config->tableFile)
         IpListInit(config->numEntries + 1,config);
 
     cur_sectionp = strtok_r( argcpyp, REPUTATION_CONFIG_SECTION_SEPERATORS, &next_sectionp);
@@ -1671,7 +1893,13 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
                 DynamicPreprocessorFatalMessage("%s(%d) => Bad list filename in IP List.\n",
                         *(_dpd.config_file), *(_dpd.config_line));
             }
-            if (!config->sharedMem.path)
+            if (config->tableFile)
+            {
+                DynamicPreprocessorFatalMessage("%s(%d) => List file %s can't be used with option '%s'.\n",
+                        *(_dpd.config_file), *(_dpd.config_line), cur_tokenp,
+                        REPUTATION_LOADTABLE_KEYWORD);
+            }
+            else if (!config->sharedMem.path)
                 LoadListFile(cur_tokenp, config->local_black_ptr, config);
             else
             {
@@ -1691,7 +1919,13 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
                         *(_dpd.config_file), *(_dpd.config_line));
             }
 
-            if (!config->sharedMem.path)
+            if (config->tableFile)
+            {
+                DynamicPreprocessorFatalMessage("%s(%d) => List file %s can't be used with option '%s'.\n",
+                        *(_dpd.config_file), *(_dpd.config_line), cur_tokenp,
+                        REPUTATION_LOADTABLE_KEYWORD);
+            }
+            else if (!config->sharedMem.path)
                 LoadListFile(cur_tokenp, config->local_white_ptr, config);
             else
             {
@@ -1778,6 +2012,27 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
             /* processed before */
 
         }
+        else if ( !strcasecmp( cur_tokenp, REPUTATION_LOADTABLE_KEYWORD ))
+        {
+            cur_tokenp = strtok( NULL, REPUTATION_CONFIG_VALUE_SEPERATORS);
+            /* processed before */
+        }
+        else if ( !strcasecmp( cur_tokenp, REPUTATION_SAVETABLE_KEYWORD ))
+        {
+            cur_tokenp = strtok( NULL, REPUTATION_CONFIG_VALUE_SEPERATORS);
+            if(cur_tokenp == NULL)
+            {
+                DynamicPreprocessorFatalMessage("%s(%d) => Bad table filename for %s.\n",
+                        *(_dpd.config_file), *(_dpd.config_line), REPUTATION_SAVETABLE_KEYWORD);
+            }
+            if (config->sharedMem.path || config->tableFile)
+            {
+                DynamicPreprocessorFatalMessage("%s(%d) => Option '%s' can only be used "
+                        "with list files.\n", *(_dpd.config_file), *(_dpd.config_line),
+                        REPUTATION_SAVETABLE_KEYWORD);
+            }
+            UpdatePathToFile(saveFile, PATH_MAX, cur_tokenp);
+        }
 #ifdef SHARED_REP
         else if ( !strcasecmp( cur_tokenp, REPUTATION_SHAREMEM_KEYWORD ))
         {
@@ -1844,6 +2099,8 @@ void ParseReputationArgs(ReputationConfig *config, u_char* argp)
         cur_sectionp = strtok_r( next_sectionp, REPUTATION_CONFIG_SECTION_SEPERATORS, &next_sectionp);
         DEBUG_WRAP(DebugMessage(DEBUG_REPUTATION, "Arguments token: %s\n",cur_sectionp ););
     }
+    if (*saveFile)
+        SaveTableFile(config, saveFile);
     DisplayIPlistStats(config);
     DisplayReputationConfig(config);
     free(argcpyp);
@@ -87,6 +87,8 @@ typedef struct _ListInfo{
  * prioirity: the priority of whitelist, blacklist
  * nestedIP: which IP address to use when IP encapsulation
  * iplist: the IP table
+ * tableFile: prebuilt table to map instead of loading list files
+ * tableSize: size of the mapped table, 0 if localSegment was allocated
  * ref_count: reference account
  */
 typedef struct _reputationConfig
@@ -101,6 +103,8 @@ typedef struct _reputationConfig
     MEM_OFFSET local_white_ptr;
     void *emptySegment;
     void *localSegment;
+    char *tableFile;
+    uint32_t tableSize;
     SharedMem sharedMem;
     int segment_version;
     uint32_t memsize;
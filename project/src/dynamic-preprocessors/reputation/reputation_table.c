@@ -0,0 +1,404 @@
+/****************************************************************************
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************
+ * Prebuilt reputation tables.
+ *
+ * Tables are mapped read only and shared so every snort process using the
+ * same file shares the same page cache pages.  A new table is always
+ * written to a new file and renamed into place; the file is never changed
+ * under a running snort that still has the old one mapped.
+ *
+ ****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <io.h>
+#endif
+
+#include "sf_types.h"
+#include "sf_dynamic_preprocessor.h"
+#include "reputation_config.h"
+#include "reputation_table.h"
+
+#define REPUTATION_TABLE_BYTE_ORDER 0x01020304
+
+/********************************************************************
+ * Function: TableChecksum
+ *
+ * Fletcher style sum of the table, 32 bits at a time.  This is only
+ * meant to catch truncated or damaged files and is cheap enough to run
+ * on every load.
+ *
+ ********************************************************************/
+static uint32_t TableChecksum(const uint8_t *data, uint32_t len)
+{
+    uint64_t a = 1, b = 0;
+    uint32_t w;
+
+    while (len >= 4)
+    {
+        memcpy(&w, data, 4);
+        a += w;
+        b += a;
+        data += 4;
+        len -= 4;
+    }
+    while (len--)
+    {
+        a += *data++;
+        b += a;
+    }
+    return (uint32_t)(a ^ b ^ (b >> 32));
+}
+
+static int ReadFully(int fd, void *buf, size_t len)
+{
+    uint8_t *p = (uint8_t *)buf;
+
+    while (len > 0)
+    {
+        ssize_t n = read(fd, p, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+            return -1;
+
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static uint32_t PageSize(void)
+{
+#ifndef WIN32
+    long n = sysconf(_SC_PAGESIZE);
+    return (n > 0) ? (uint32_t)n : 4096;
+#else
+    /* the table is read in, not mapped */
+    return 1;
+#endif
+}
+
+/********************************************************************
+ * Function: ReadHeader
+ *
+ * Read and check the header of a table file.
+ *
+ * Returns:
+ *  the open file descriptor, positioned after the header
+ *  -1 on error (already reported)
+ *
+ ********************************************************************/
+static int ReadHeader(const char *filename, ReputationTableHeader *hdr)
+{
+    struct stat st;
+    int fd;
+#ifdef WIN32
+    int flags = O_RDONLY | O_BINARY;
+#else
+    int flags = O_RDONLY;
+#endif
+
+    if ((fd = open(filename, flags)) < 0)
+    {
+        _dpd.errMsg("Reputation table %s: Unable to open: %s\n",
+                filename, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) || ReadFully(fd, hdr, sizeof(*hdr)))
+    {
+        _dpd.errMsg("Reputation table %s: Unable to read header.\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    if (memcmp(hdr->magic, REPUTATION_TABLE_MAGIC, sizeof(REPUTATION_TABLE_MAGIC)))
+    {
+        _dpd.errMsg("Reputation table %s: Not a reputation table.\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    if ((hdr->version != REPUTATION_TABLE_VERSION) ||
+        (hdr->byteOrder != REPUTATION_TABLE_BYTE_ORDER) ||
+        (hdr->listInfoSize != sizeof(ListInfo)))
+    {
+        _dpd.errMsg("Reputation table %s: Built by an incompatible version "
+                "of snort, please rebuild it.\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    if ((hdr->tableOffset < sizeof(*hdr)) || (hdr->tableOffset % PageSize()))
+    {
+        _dpd.errMsg("Reputation table %s: Table offset %u is not a multiple "
+                "of the page size, please rebuild it.\n", filename, hdr->tableOffset);
+        close(fd);
+        return -1;
+    }
+
+    if ((hdr->tableSize < sizeof(table_flat_t)) ||
+        ((uint64_t)st.st_size < (uint64_t)hdr->tableOffset + hdr->tableSize))
+    {
+        _dpd.errMsg("Reputation table %s: File is truncated.\n", filename);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/********************************************************************
+ * Function: CheckTable
+ *
+ * Make sure the table is intact and everything the lookups start from
+ * is inside of it.
+ *
+ ********************************************************************/
+static int CheckTable(const char *filename, const ReputationTableHeader *hdr,
+        const table_flat_t *table)
+{
+    if (TableChecksum((const uint8_t *)table, hdr->tableSize) != hdr->checksum)
+    {
+        _dpd.errMsg("Reputation table %s: Checksum mismatch.\n", filename);
+        return -1;
+    }
+
+    if (!table->rt || (table->rt >= hdr->tableSize) ||
+        (table->rt6 >= hdr->tableSize) ||
+        (table->data >= hdr->tableSize) ||
+        !table->list_info || (table->list_info >= hdr->tableSize))
+    {
+        _dpd.errMsg("Reputation table %s: Table is invalid.\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+/********************************************************************
+ * Function: ReputationTable_Save
+ *
+ * Write the used part of a table segment to a table file.
+ *
+ * Arguments:
+ *  filename: the table file
+ *  table: the table, at the start of its segment
+ *  tableSize: the number of bytes of the segment in use
+ *
+ * Returns:
+ *  0 on success, -1 on error (already reported)
+ *
+ ********************************************************************/
+int ReputationTable_Save(const char *filename, table_flat_t *table, uint32_t tableSize)
+{
+    ReputationTableHeader hdr;
+    uint8_t *head;
+    char tmpname[PATH_MAX];
+    FILE *fp;
+    int ret = -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, REPUTATION_TABLE_MAGIC, sizeof(REPUTATION_TABLE_MAGIC));
+    hdr.version = REPUTATION_TABLE_VERSION;
+    hdr.byteOrder = REPUTATION_TABLE_BYTE_ORDER;
+    hdr.listInfoSize = sizeof(ListInfo);
+    hdr.tableOffset = REPUTATION_TABLE_OFFSET;
+    hdr.tableSize = tableSize;
+    hdr.numEntries = sfrt_flat_num_entries(table);
+    hdr.checksum = TableChecksum((const uint8_t *)table, tableSize);
+
+    /* Too big for the stack; the rest of the header region is zeros */
+    if ((head = (uint8_t *)calloc(1, hdr.tableOffset)) == NULL)
+    {
+        _dpd.errMsg("Reputation table %s: Unable to allocate %u bytes.\n",
+                filename, hdr.tableOffset);
+        return -1;
+    }
+    memcpy(head, &hdr, sizeof(hdr));
+
+    /* Running snorts may have the old file mapped so never write over it */
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+
+    if ((fp = fopen(tmpname, "wb")) == NULL)
+    {
+        _dpd.errMsg("Reputation table %s: Unable to create: %s\n",
+                tmpname, strerror(errno));
+        free(head);
+        return -1;
+    }
+
+    if ((fwrite(head, hdr.tableOffset, 1, fp) == 1) &&
+        (fwrite(table, tableSize, 1, fp) == 1))
+        ret = 0;
+
+    if (fclose(fp))
+        ret = -1;
+
+    free(head);
+
+    if (ret)
+    {
+        _dpd.errMsg("Reputation table %s: Unable to write: %s\n",
+                tmpname, strerror(errno));
+        unlink(tmpname);
+        return -1;
+    }
+
+#ifdef WIN32
+    remove(filename);
+#endif
+    if (rename(tmpname, filename))
+    {
+        _dpd.errMsg("Reputation table %s: Unable to rename %s: %s\n",
+                filename, tmpname, strerror(errno));
+        unlink(tmpname);
+        return -1;
+    }
+
+    _dpd.logMsg("    Reputation table saved to %s: %u entries, %u bytes\n",
+            filename, hdr.numEntries, tableSize);
+    return 0;
+}
+
+/********************************************************************
+ * Function: ReputationTable_GetSize
+ *
+ * Returns:
+ *  the size of the table in a table file, 0 if it can't be used
+ *
+ ********************************************************************/
+uint32_t ReputationTable_GetSize(const char *filename)
+{
+    ReputationTableHeader hdr;
+    int fd;
+
+    if ((fd = ReadHeader(filename, &hdr)) < 0)
+        return 0;
+
+    close(fd);
+    return hdr.tableSize;
+}
+
+/********************************************************************
+ * Function: ReputationTable_Map
+ *
+ * Map a table file read only.  Nothing is parsed or copied; the returned
+ * table can be used for lookups as is.
+ *
+ * Arguments:
+ *  filename: the table file
+ *  tableSize: (output) the size of the table, needed to unmap it
+ *
+ * Returns:
+ *  the table or NULL on error (already reported)
+ *
+ ********************************************************************/
+table_flat_t *ReputationTable_Map(const char *filename, uint32_t *tableSize)
+{
+    ReputationTableHeader hdr;
+    table_flat_t *table;
+    int fd;
+
+    if ((fd = ReadHeader(filename, &hdr)) < 0)
+        return NULL;
+
+#ifndef WIN32
+    table = (table_flat_t *)mmap(NULL, hdr.tableSize, PROT_READ, MAP_SHARED,
+            fd, hdr.tableOffset);
+
+    close(fd);
+
+    if (table == (table_flat_t *)MAP_FAILED)
+    {
+        _dpd.errMsg("Reputation table %s: Unable to map: %s\n",
+                filename, strerror(errno));
+        return NULL;
+    }
+#else
+    if ((table = (table_flat_t *)malloc(hdr.tableSize)) == NULL)
+    {
+        _dpd.errMsg("Reputation table %s: Unable to allocate %u bytes.\n",
+                filename, hdr.tableSize);
+        close(fd);
+        return NULL;
+    }
+
+    if ((lseek(fd, hdr.tableOffset, SEEK_SET) < 0) ||
+        ReadFully(fd, table, hdr.tableSize))
+    {
+        _dpd.errMsg("Reputation table %s: Unable to read table.\n", filename);
+        free(table);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+#endif
+
+    if (CheckTable(filename, &hdr, table))
+    {
+        ReputationTable_Unmap(table, hdr.tableSize);
+        return NULL;
+    }
+
+    *tableSize = hdr.tableSize;
+    return table;
+}
+
+void ReputationTable_Unmap(table_flat_t *table, uint32_t tableSize)
+{
+    if (table == NULL)
+        return;
+
+#ifndef WIN32
+    munmap((void *)table, tableSize);
+#else
+    free(table);
+#endif
+}
+
+/********************************************************************
+ * Function: ReputationTable_IsTableFile
+ *
+ * Returns:
+ *  1 if the file name has the table file extension, 0 otherwise
+ *
+ ********************************************************************/
+int ReputationTable_IsTableFile(const char *filename)
+{
+    const char *ext = strrchr(filename, '.');
+
+    return ext && !strcasecmp(ext, REPUTATION_TABLE_EXTENSION);
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************
+ * Prebuilt reputation tables.
+ *
+ * An IP list table lives in one segment and only refers to itself through
+ * offsets from the start of the segment, so the used part of a segment can
+ * be written to a file as is and used again straight from an mmap of that
+ * file.  The file is a 64K header region followed by the segment:
+ *
+ *   header:  magic, version, byte order, ListInfo size, table offset,
+ *            table size, number of entries and a checksum of the table
+ *   table:   the segment bytes, starting with the table_flat_t
+ *
+ * Tables only load on builds with the same byte order and ListInfo layout
+ * (ie with or without shared memory support) as the one that wrote them.
+ *
+ ****************************************************************************/
+
+#ifndef _REPUTATION_TABLE_H_
+#define _REPUTATION_TABLE_H_
+
+#include "sf_types.h"
+#include "sfrt_flat.h"
+
+#define REPUTATION_TABLE_MAGIC      "SFIPREP"
+#define REPUTATION_TABLE_VERSION    2
+#define REPUTATION_TABLE_EXTENSION  ".rpt"
+
+/* The table starts this far into the file so it can be mapped directly.
+ * This is a multiple of every page size snort runs with (up to 64K on
+ * some arm64 and ppc64 kernels); it is recorded in the header and
+ * checked against the page size on load. */
+#define REPUTATION_TABLE_OFFSET     (64 * 1024)
+
+typedef struct _ReputationTableHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t listInfoSize;
+    uint32_t tableOffset;
+    uint32_t tableSize;
+    uint32_t numEntries;
+    uint32_t checksum;
+
+} ReputationTableHeader;
+
+/********************************************************************
+ * Public function prototypes
+ ********************************************************************/
+int ReputationTable_Save(const char *filename, table_flat_t *table, uint32_t tableSize);
+uint32_t ReputationTable_GetSize(const char *filename);
+table_flat_t *ReputationTable_Map(const char *filename, uint32_t *tableSize);
+void ReputationTable_Unmap(table_flat_t *table, uint32_t tableSize);
+int ReputationTable_IsTableFile(const char *filename);
+#endif /* _REPUTATION_TABLE_H_ */
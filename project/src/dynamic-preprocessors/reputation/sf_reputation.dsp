@@ -106,6 +106,10 @@ SOURCE=.\reputation_config.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\reputation_table.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\reputation_utils.c
 # End Source File
 # Begin Source File
@@ -142,6 +146,10 @@ SOURCE=..\include\sfrt_flat_dir.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\include\sfrt_poptrie.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\spp_reputation.c
 # End Source File
 # Begin Source File
@@ -162,6 +170,10 @@ SOURCE=.\reputation_debug.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\reputation_table.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\reputation_utils.h
 # End Source File
 # Begin Source File
@@ -35,6 +35,7 @@
 #define MONITOR_LIST    1
 #define BLACK_LIST      2
 #define WHITE_LIST      3
+#define TABLE_LIST      4   /* prebuilt table, replaces all other lists */
 
 #define VERSION_FILENAME "IPRVersion.dat"
 #define MANIFEST_FILENAME "zone.info"
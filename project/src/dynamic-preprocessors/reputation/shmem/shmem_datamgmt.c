@@ -32,6 +32,7 @@
 
 #include "shmem_config.h"
 #include "shmem_common.h"
+#include "../reputation_table.h"
 
 #define MANIFEST_SEPARATORS         ",\r\n"
 #define MIN_MANIFEST_COLUMNS         3
@@ -39,6 +40,7 @@
 #define WHITE_TYPE_KEYWORD       "white"
 #define BLACK_TYPE_KEYWORD        "block"
 #define MONITOR_TYPE_KEYWORD      "monitor"
+#define TABLE_TYPE_KEYWORD        "table"
 
 
 static const char* const MODULE_NAME = "ShmemFileMgmt";
@@ -151,6 +153,8 @@ static int ReadShmemDataFilesWithoutManifest()
             type = BLACK_LIST;
         else if ( strcasecmp(ext, ".wlf") == 0 )
             type = WHITE_LIST;
+        else if ( strcasecmp(ext, REPUTATION_TABLE_EXTENSION) == 0 )
+            type = TABLE_LIST;
         else 
             continue;
 
@@ -243,6 +247,11 @@ static int getFileTypeFromName (char *typeName)
         type = MONITOR_LIST;
         typeName += strlen(MONITOR_TYPE_KEYWORD);
     }
+    else if (strncasecmp(typeName, TABLE_TYPE_KEYWORD, strlen(TABLE_TYPE_KEYWORD)) == 0)
+    {
+        type = TABLE_LIST;
+        typeName += strlen(TABLE_TYPE_KEYWORD);
+    }
 
     if (UNKNOWN_LIST != type )
     {
@@ -339,8 +348,9 @@ static ShmemDataFileList* processLineInManifest(char *manifest, char *line, int
             if (UNKNOWN_LIST == listItem->filetype)
             {
                 DynamicPreprocessorFatalMessage(" %s(%d) => Unknown action specified (%s)."
-                        " Please specify a value: %s | %s | %s.\n", manifest, linenumber, token,
-                        WHITE_TYPE_KEYWORD, BLACK_TYPE_KEYWORD, MONITOR_TYPE_KEYWORD);
+                        " Please specify a value: %s | %s | %s | %s.\n", manifest, linenumber, token,
+                        WHITE_TYPE_KEYWORD, BLACK_TYPE_KEYWORD, MONITOR_TYPE_KEYWORD,
+                        TABLE_TYPE_KEYWORD);
             }
             break;
 
@@ -40,6 +40,7 @@ typedef struct _fileConfig
 {
     IdentifierNode *identifier_root; /*Root of magic tries*/
     IdentifierMemoryBlock *id_memory_root; /*root of memory used*/
+    IdentifierTable *identifier_table; /*Compiled magic tries*/
     RuleInfo *FileRules[FILE_ID_MAX + 1];
     int64_t file_type_depth;
     int64_t file_signature_depth;
@@ -39,6 +39,18 @@
 #include "sfghash.h"
 #include "file_config.h"
 
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define POPCOUNT(x) __builtin_popcount(x)
+#else
+static inline int POPCOUNT(uint32_t x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0f0f0f0f;
+    return (int)((x * 0x01010101) >> 24);
+}
+#endif
+
 uint32_t memory_used = 0; /*Track memory usage*/
 
 static SFGHASH *identifier_merge_hash = NULL;
@@ -402,7 +414,6 @@ void insert_file_rule(RuleInfo *rule, void *conf)
     new = create_trie_from_magic(&(rule->magics), rule->id);
 
     update_trie(file_config->identifier_root, new);
-    DEBUG_WRAP(test_find_file_type(file_config););
 }
 
 
@@ -419,6 +430,196 @@ uint32_t memory_usage_identifiers(void)
     return memory_used;
 }
 
+/*Assign state numbers to the trie nodes, shared nodes get one number*/
+static uint32_t number_nodes(SFGHASH *numbers, IdentifierNode *node)
+{
+    uintptr_t number;
+    int i;
+
+    if ((number = (uintptr_t)sfghash_find(numbers, &node)))
+        return (uint32_t)number;
+
+    number = numbers->count + 1;
+
+    if (sfghash_add(numbers, &node, (void *)number) != SFGHASH_OK)
+    {
+        FatalError("%s(%d) Could not number file identifier nodes.\n",
+                __FILE__, __LINE__);
+    }
+
+    for(i = 0; i < MAX_BRANCH; i++)
+    {
+        if (node->next[i])
+            number_nodes(numbers, node->next[i]);
+    }
+    return (uint32_t)number;
+}
+
+static int compare_states(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*The most common next state becomes the default, the rest are exceptions*/
+static uint32_t default_next_state(const uint32_t *next)
+{
+    uint32_t sorted[MAX_BRANCH];
+    uint32_t best = 0, best_run = 0, run = 0;
+    int i;
+
+    memcpy(sorted, next, sizeof(sorted));
+    qsort(sorted, MAX_BRANCH, sizeof(sorted[0]), compare_states);
+
+    for(i = 0; i < MAX_BRANCH; i++)
+    {
+        if (i && (sorted[i] == sorted[i - 1]))
+            run++;
+        else
+            run = 1;
+
+        if (run > best_run)
+        {
+            best_run = run;
+            best = sorted[i];
+        }
+    }
+    return best;
+}
+
+static void free_identifier_table(IdentifierTable *table)
+{
+    if (!table)
+        return;
+
+    free(table->states);
+    free(table->exceptions);
+    free(table);
+}
+
+/*
+ * Build the compact table from the tries once all file rules have been
+ * inserted.  The tries are released afterwards since only the table is
+ * used to find file types.
+ */
+void compile_file_identifiers(void *conf)
+{
+    FileConfig *file_config = (FileConfig *)conf;
+    IdentifierTable *table;
+    IdentifierNode **nodes;
+    uint32_t *next;
+    SFGHASH *numbers;
+    SFGHASH_NODE *hnode;
+    uint32_t num_states, n, e;
+    int i;
+
+    if (!file_config || !file_config->identifier_root)
+        return;
+
+    numbers = sfghash_new(1000, sizeof(IdentifierNode *), 0, NULL);
+    if (numbers == NULL)
+    {
+        FatalError("%s(%d) Could not create file identifier number hash.\n",
+                __FILE__, __LINE__);
+    }
+
+    number_nodes(numbers, file_config->identifier_root);
+    num_states = numbers->count;
+
+    nodes = (IdentifierNode **)SnortAlloc((num_states + 1) * sizeof(*nodes));
+    for (hnode = sfghash_findfirst(numbers); hnode; hnode = sfghash_findnext(numbers))
+        nodes[(uintptr_t)hnode->data] = *(IdentifierNode **)hnode->key;
+
+    /*Next state numbers of each node, then count the exceptions*/
+    next = (uint32_t *)SnortAlloc((num_states + 1) * MAX_BRANCH * sizeof(*next));
+    table = (IdentifierTable *)SnortAlloc(sizeof(*table));
+    table->num_states = num_states;
+    table->states = (IdentifierState *)SnortAlloc((num_states + 1) * sizeof(*table->states));
+
+    for (n = 1; n <= num_states; n++)
+    {
+        uint32_t *node_next = next + n * MAX_BRANCH;
+        IdentifierState *state = &table->states[n];
+
+        for(i = 0; i < MAX_BRANCH; i++)
+        {
+            if (nodes[n]->next[i])
+                node_next[i] = (uint32_t)(uintptr_t)sfghash_find(numbers, &nodes[n]->next[i]);
+        }
+
+        state->type_id = nodes[n]->type_id;
+        state->offset = nodes[n]->offset;
+        state->shared = (nodes[n]->state == ID_NODE_SHARED);
+        state->next = default_next_state(node_next);
+
+        for(i = 0; i < MAX_BRANCH; i++)
+        {
+            if (node_next[i] != state->next)
+                table->num_exceptions++;
+        }
+    }
+
+    if (table->num_exceptions)
+        table->exceptions = (uint32_t *)SnortAlloc(table->num_exceptions * sizeof(*table->exceptions));
+
+    for (n = 1, e = 0; n <= num_states; n++)
+    {
+        uint32_t *node_next = next + n * MAX_BRANCH;
+        IdentifierState *state = &table->states[n];
+
+        state->base = e;
+
+        for(i = 0; i < MAX_BRANCH; i++)
+        {
+            if ((i % 32) == 0)
+                state->rank[i / 32] = (uint8_t)(e - state->base);
+
+            if (node_next[i] != state->next)
+            {
+                state->bitmap[i / 32] |= 1U << (i % 32);
+                table->exceptions[e++] = node_next[i];
+            }
+        }
+    }
+
+    free(next);
+    free(nodes);
+    sfghash_delete(numbers);
+
+    DEBUG_WRAP(DebugMessage(DEBUG_FILE,"Identifier tries: %u bytes, %u states.\n",
+            memory_usage_identifiers(), num_states););
+
+    /*The tries are no longer needed*/
+    free_file_identifiers(file_config);
+    init_file_identifers();
+
+    file_config->identifier_table = table;
+    file_config->identifier_root = NULL;
+    memory_used = sizeof(*table) + (num_states + 1) * sizeof(*table->states) +
+        table->num_exceptions * sizeof(*table->exceptions);
+
+    DEBUG_WRAP(DebugMessage(DEBUG_FILE,"Identifier table: %u bytes, %u exceptions.\n",
+            memory_usage_identifiers(), table->num_exceptions););
+    DEBUG_WRAP(test_find_file_type(file_config););
+}
+
+static inline IdentifierState *next_identifier_state(IdentifierTable *table,
+        IdentifierState *state, uint8_t c)
+{
+    uint32_t word = state->bitmap[c >> 5];
+    uint32_t bit = 1U << (c & 31);
+    uint32_t next;
+
+    if (word & bit)
+        next = table->exceptions[state->base + state->rank[c >> 5] + POPCOUNT(word & (bit - 1))];
+    else
+        next = state->next;
+
+    return next ? &table->states[next] : NULL;
+}
+
 /*
  * This is the main function to find file type
  * Find file type is to traverse the tries.
@@ -427,18 +628,20 @@ uint32_t memory_usage_identifiers(void)
 uint32_t find_file_type_id(uint8_t *buf, uint16_t len, FileContext *context)
 {
     FileConfig *file_config;
-    IdentifierNode* current;
+    IdentifierTable *table;
+    IdentifierState* current;
     uint64_t end;
 
     if ((!context)||(!buf))
         return 0;
 
     file_config = (FileConfig *)context->file_config;
+    table = file_config->identifier_table;
 
-    if (!(context->file_type_context))
-        context->file_type_context = (void *)(file_config->identifier_root);
+    if (!(context->file_type_context) && table)
+        context->file_type_context = (void *)(&table->states[1]);
 
-    current = (IdentifierNode*) context->file_type_context;
+    current = (IdentifierState*) context->file_type_context;
 
     end = context->processed_bytes + len;
 
@@ -451,7 +654,8 @@ uint32_t find_file_type_id(uint8_t *buf, uint16_t len, FileContext *context)
         }
 
         /*Move to the next level*/
-        current = current->next[buf[current->offset - context->processed_bytes ]];
+        current = next_identifier_state(table, current,
+                buf[current->offset - context->processed_bytes ]);
         len--;
     }
 
@@ -464,7 +668,7 @@ uint32_t find_file_type_id(uint8_t *buf, uint16_t len, FileContext *context)
         else
             return SNORT_FILE_TYPE_UNKNOWN;
     }
-    else if ((context->file_type_id) && (current->state == ID_NODE_SHARED))
+    else if ((context->file_type_id) && (current->shared))
         return context->file_type_id;
     else if (current->offset >= end)
     {
@@ -496,6 +700,9 @@ void free_file_identifiers(void *conf)
 
     file_config->id_memory_root = NULL;
     identifierMergeHashFree();
+
+    free_identifier_table(file_config->identifier_table);
+    file_config->identifier_table = NULL;
 }
 
 #ifdef DEBUG_MSGS
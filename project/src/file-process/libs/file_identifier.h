@@ -46,6 +46,30 @@ typedef struct _IdentifierNode
 
 } IdentifierNode;
 
+/* Compiled form of the tries, built once all file rules are in.  Each
+ * state takes the default next state for most bytes; the bytes that go
+ * elsewhere are set in the bitmap and their next states are found in
+ * the exception array with a popcount, so a step is at most two reads.
+ * State 0 is unused so that 0 means no next state. */
+typedef struct _IdentifierState
+{
+    uint32_t type_id;
+    uint32_t offset;             /* offset from file start */
+    uint32_t next;               /* next state for bytes not in bitmap */
+    uint32_t base;               /* first exception of this state */
+    uint32_t bitmap[MAX_BRANCH / 32];  /* bytes with their own next state */
+    uint8_t rank[MAX_BRANCH / 32];     /* exceptions before each word */
+    uint8_t shared;
+} IdentifierState;
+
+typedef struct _IdentifierTable
+{
+    IdentifierState *states;
+    uint32_t *exceptions;
+    uint32_t num_states;
+    uint32_t num_exceptions;
+} IdentifierTable;
+
 typedef struct _IdentifierNodeHead
 {
     int offset;            /* offset from file start */
@@ -56,6 +80,7 @@ typedef struct _IdentifierNodeHead
 
 void init_file_identifers(void);
 void insert_file_rule(RuleInfo *rule, void *conf);
+void compile_file_identifiers(void *conf);
 uint32_t memory_usage_identifiers(void);
 
 uint32_t find_file_type_id(uint8_t *buf, uint16_t len, FileContext *context);
@@ -31,6 +31,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SHA256_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /*
  * Some helper macros for processing 32-bit values, while
  * being careful about 32-bit vs 64-bit system differences.
@@ -153,6 +160,152 @@ static void ProcessBlock(Sha256Context *sha, const unsigned char *block)
 
 }
 
+/*
+ * Process consecutive blocks with the portable code.
+ */
+static void ProcessBlocks(Sha256Context *sha, const unsigned char *data, unsigned long blocks)
+{
+    while(blocks--)
+    {
+        ProcessBlock(sha, data);
+        data += 64;
+    }
+}
+
+#ifdef SHA256_SHA_NI
+/*
+ * Process consecutive blocks with the x86 SHA extensions.  The state is
+ * kept as ABEF/CDGH as sha256rnds2 wants it for the whole run.  Each
+ * group of 4 rounds adds the round constants to one of the 4 message
+ * registers, which are rotated through the schedule with msg1/msg2.
+ */
+#define SHA_NI_ROUNDS(m, t) \
+    do { \
+        msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *)(K + (t)))); \
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg); \
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0E)); \
+    } while(0)
+
+/* next += W[t-7] terms from cur:prev, then finish it with cur */
+#define SHA_NI_MSG2(next, cur, prev) \
+    do { \
+        next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)); \
+        next = _mm_sha256msg2_epu32(next, cur); \
+    } while(0)
+
+#define SHA_NI_MSG1(prev, cur) \
+    prev = _mm_sha256msg1_epu32(prev, cur)
+
+__attribute__((target("sha,sse4.1")))
+static void ProcessBlocksShaNi(Sha256Context *sha, const unsigned char *data, unsigned long blocks)
+{
+    const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i abef, cdgh, abef_save, cdgh_save, msg, tmp;
+    __m128i m0, m1, m2, m3;
+
+    /* A..H -> ABEF, CDGH */
+    tmp = _mm_set_epi32(sha->A, sha->B, sha->C, sha->D);
+    cdgh = _mm_set_epi32(sha->E, sha->F, sha->G, sha->H);
+    abef = _mm_unpackhi_epi64(cdgh, tmp);
+    cdgh = _mm_unpacklo_epi64(cdgh, tmp);
+
+    while(blocks--)
+    {
+        abef_save = abef;
+        cdgh_save = cdgh;
+
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data +  0)), swap);
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), swap);
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), swap);
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), swap);
+
+        SHA_NI_ROUNDS(m0,  0);
+        SHA_NI_ROUNDS(m1,  4); SHA_NI_MSG1(m0, m1);
+        SHA_NI_ROUNDS(m2,  8); SHA_NI_MSG1(m1, m2);
+        SHA_NI_ROUNDS(m3, 12); SHA_NI_MSG2(m0, m3, m2); SHA_NI_MSG1(m2, m3);
+        SHA_NI_ROUNDS(m0, 16); SHA_NI_MSG2(m1, m0, m3); SHA_NI_MSG1(m3, m0);
+        SHA_NI_ROUNDS(m1, 20); SHA_NI_MSG2(m2, m1, m0); SHA_NI_MSG1(m0, m1);
+        SHA_NI_ROUNDS(m2, 24); SHA_NI_MSG2(m3, m2, m1); SHA_NI_MSG1(m1, m2);
+        SHA_NI_ROUNDS(m3, 28); SHA_NI_MSG2(m0, m3, m2); SHA_NI_MSG1(m2, m3);
+        SHA_NI_ROUNDS(m0, 32); SHA_NI_MSG2(m1, m0, m3); SHA_NI_MSG1(m3, m0);
+        SHA_NI_ROUNDS(m1, 36); SHA_NI_MSG2(m2, m1, m0); SHA_NI_MSG1(m0, m1);
+        SHA_NI_ROUNDS(m2, 40); SHA_NI_MSG2(m3, m2, m1); SHA_NI_MSG1(m1, m2);
+        SHA_NI_ROUNDS(m3, 44); SHA_NI_MSG2(m0, m3, m2); SHA_NI_MSG1(m2, m3);
+        SHA_NI_ROUNDS(m0, 48); SHA_NI_MSG2(m1, m0, m3); SHA_NI_MSG1(m3, m0);
+        SHA_NI_ROUNDS(m1, 52); SHA_NI_MSG2(m2, m1, m0);
+        SHA_NI_ROUNDS(m2, 56); SHA_NI_MSG2(m3, m2, m1);
+        SHA_NI_ROUNDS(m3, 60);
+
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+        data += 64;
+    }
+
+    sha->A = (uint32_t)_mm_extract_epi32(abef, 3);
+    sha->B = (uint32_t)_mm_extract_epi32(abef, 2);
+    sha->E = (uint32_t)_mm_extract_epi32(abef, 1);
+    sha->F = (uint32_t)_mm_extract_epi32(abef, 0);
+    sha->C = (uint32_t)_mm_extract_epi32(cdgh, 3);
+    sha->D = (uint32_t)_mm_extract_epi32(cdgh, 2);
+    sha->G = (uint32_t)_mm_extract_epi32(cdgh, 1);
+    sha->H = (uint32_t)_mm_extract_epi32(cdgh, 0);
+}
+
+static int HaveShaNi(void)
+{
+    unsigned int a, b, c, d;
+
+    __builtin_cpu_init();
+
+    if(!__builtin_cpu_supports("sse4.1"))
+        return 0;
+
+    if(__get_cpuid_max(0, NULL) < 7)
+        return 0;
+
+    __cpuid_count(7, 0, a, b, c, d);
+
+    /* CPUID.(EAX=07H,ECX=0):EBX.SHA[bit 29] */
+    return (b >> 29) & 1;
+}
+#endif
+
+typedef void (*Sha256BlocksFunc)(Sha256Context *, const unsigned char *, unsigned long);
+
+static void ProcessBlocksFirst(Sha256Context *, const unsigned char *, unsigned long);
+
+static Sha256BlocksFunc processBlocks = ProcessBlocksFirst;
+
+/*
+ * Pick the implementation on first use and hand off to it.
+ */
+static void ProcessBlocksFirst(Sha256Context *sha, const unsigned char *data, unsigned long blocks)
+{
+    processBlocks = ProcessBlocks;
+#ifdef SHA256_SHA_NI
+    if(HaveShaNi())
+        processBlocks = ProcessBlocksShaNi;
+#endif
+    processBlocks(sha, data, blocks);
+}
+
+int SHA256Select(const char *impl)
+{
+    if(!strcmp(impl, "c"))
+    {
+        processBlocks = ProcessBlocks;
+        return 0;
+    }
+#ifdef SHA256_SHA_NI
+    if(!strcmp(impl, "sha-ni") && HaveShaNi())
+    {
+        processBlocks = ProcessBlocksShaNi;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
 void SHA256ProcessData(Sha256Context *sha, const void *buffer, unsigned long len)
 {
     unsigned long templen;
@@ -166,9 +319,10 @@ void SHA256ProcessData(Sha256Context *sha, const void *buffer, unsigned long len
         if(!(sha->inputLen) && len >= 64)
         {
             /* Short cut: no point copying the data twice */
-            ProcessBlock(sha, (const unsigned char *)buffer);
-            buffer = (const void *)(((const unsigned char *)buffer) + 64);
-            len -= 64;
+            templen = len & ~63UL;
+            processBlocks(sha, (const unsigned char *)buffer, templen / 64);
+            buffer = (const void *)(((const unsigned char *)buffer) + templen);
+            len -= templen;
         }
         else
         {
@@ -180,7 +334,7 @@ void SHA256ProcessData(Sha256Context *sha, const void *buffer, unsigned long len
             memcpy(sha->input + sha->inputLen, buffer, templen);
             if((sha->inputLen += templen) >= 64)
             {
-                ProcessBlock(sha, sha->input);
+                processBlocks(sha, sha->input, 1);
                 sha->inputLen = 0;
             }
             buffer = (const void *)(((const unsigned char *)buffer) + templen);
@@ -216,7 +370,7 @@ void SHA256Final(unsigned char *hash, Sha256Context *sha)
             {
                 sha->input[(sha->inputLen)++] = (unsigned char)0x00;
             }
-            ProcessBlock(sha, sha->input);
+            processBlocks(sha, sha->input, 1);
             sha->inputLen = 0;
         }
         else
@@ -231,7 +385,7 @@ void SHA256Final(unsigned char *hash, Sha256Context *sha)
         totalBits = (sha->totalLen << 3);
         WriteLong(sha->input + 56, (uint32_t)(totalBits >> 32));
         WriteLong(sha->input + 60, (uint32_t)totalBits);
-        ProcessBlock(sha, sha->input);
+        processBlocks(sha, sha->input, 1);
 
         /* Write the final hash value to the supplied buffer */
         WriteLong(hash,      sha->A);
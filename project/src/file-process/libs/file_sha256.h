@@ -47,6 +47,12 @@ void SHA256Init(Sha256Context *sha);
 void SHA256ProcessData(Sha256Context *sha, const void *buffer, unsigned long len);
 void SHA256Final(unsigned char *hash, Sha256Context *sha);
 
+/*
+ * Force "c" or "sha-ni" for tools/bench/sha256_bench; returns -1 if that
+ * one isn't built in or the cpu doesn't have it.
+ */
+int SHA256Select(const char *impl);
+
 #define SHA256CONTEXT Sha256Context
 #define SHA256INIT    SHA256Init
 #define SHA256UPDATE  SHA256ProcessData
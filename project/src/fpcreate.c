@@ -34,6 +34,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -58,6 +64,8 @@
 #include "parser.h"
 #include "target-based/sftarget_reader.h"
 #include "mpse.h"
+#include "mpse_cache.h"
+#include "ac_prefilter.h"
 #include "bitop_funcs.h"
 
 #ifdef INTEL_SOFT_CPM
@@ -89,6 +97,7 @@ static void fpRegIpProto(uint8_t *, OptTreeNode *);
 static int fpCreatePortGroups(SnortConfig *, rule_port_tables_t *);
 static void fpDeletePortGroup(void *);
 static void fpDeletePMX(void *data);
+static void fpPortGroupAppend(void ***, int *, int *, void *);
 static int fpGetFinalPattern(FastPatternConfig *fp, PatternMatchData *pmd,
         char **ret_pattern, int *ret_bytes);
 static FPContentInfo * GetLongestDynamicContent(FPContentInfo *content_list);
@@ -485,6 +494,7 @@ void free_detection_option_tree(detection_option_tree_node_t *node)
     {
         free_detection_option_tree(node->children[i]);
     }
+    detection_option_plan_free(node->plan);
     free(node->children);
     free(node);
 }
@@ -515,6 +525,9 @@ int finalize_detection_option_tree(SnortConfig *sc, detection_option_tree_root_t
         {
             //num_trees++;
         }
+
+        /* Flatten for evaluation; a duplicate was done when first added */
+        detection_option_tree_compile(root->children[i]);
 #ifdef DEBUG_OPTION_TREE
         print_option_tree(root->children[i], 0);
 #endif
@@ -764,6 +777,13 @@ int pmx_create_tree(struct _SnortConfig *sc, void *id, void **existing_tree)
     if (!*existing_tree)
     {
         *existing_tree = SnortAlloc(sizeof(detection_option_tree_root_t));
+
+        /* Remember the matcher's roots so the group can be shared on reload */
+        if (id && ((PMX *)id)->PortGroup)
+        {
+            PORT_GROUP *pg = (PORT_GROUP *)((PMX *)id)->PortGroup;
+            fpPortGroupAppend(&pg->pgTrees, &pg->pgTreeCount, &pg->pgTreeMax, *existing_tree);
+        }
     }
 
     if (!id)
@@ -804,6 +824,9 @@ void fpSetDefaults(FastPatternConfig *fp)
     if (fp == NULL)
         return;
 
+    if (fp->mpse_cache_file != NULL)
+        free(fp->mpse_cache_file);
+
     memset(fp, 0, sizeof(FastPatternConfig));
 
     fp->inspect_stream_insert = 1;
@@ -817,6 +840,9 @@ void FastPatternConfigFree(FastPatternConfig *fp)
     if (fp == NULL)
         return;
 
+    if (fp->mpse_cache_file != NULL)
+        free(fp->mpse_cache_file);
+
     free(fp);
 }
 
@@ -853,6 +879,10 @@ int fpDetectGetDebugPrintFastPatterns(FastPatternConfig *fp)
 {
     return fp->debug_print_fast_pattern;
 }
+int fpDetectGetDebugPrintMpseFootprint(FastPatternConfig *fp)
+{
+    return fp->debug_print_mpse_footprint;
+}
 int fpDetectSplitAnyAny(FastPatternConfig *fp)
 {
     return fp->split_any_any;
@@ -889,6 +919,10 @@ void fpDetectSetDebugPrintFastPatterns(FastPatternConfig *fp, int flag)
 {
     fp->debug_print_fast_pattern = flag;
 }
+void fpDetectSetDebugPrintMpseFootprint(FastPatternConfig *fp, int flag)
+{
+    fp->debug_print_mpse_footprint = flag;
+}
 void fpSetDetectSearchOpt(FastPatternConfig *fp, int flag)
 {
     fp->search_opt = flag;
@@ -915,6 +949,12 @@ int fpSetDetectSearchMethod(FastPatternConfig *fp, char *method)
        fp->search_method = MPSE_AC_BNFA_Q;
        LogMessage("   Search-Method = AC-BNFA-Q\n");
     }
+    else if( !strcasecmp(method,"ac-bnfa-compact") )
+    {
+       fp->search_method = MPSE_AC_BNFA_Q;
+       fp->compact_states = 1;
+       LogMessage("   Search-Method = AC-BNFA-Compact\n");
+    }
     else if( !strcasecmp(method,"ac-bnfa-nq") )
     {
        fp->search_method = MPSE_AC_BNFA;
@@ -933,6 +973,11 @@ int fpSetDetectSearchMethod(FastPatternConfig *fp, char *method)
         LogMessage("   Search-Method = AC-Full-Q\n");
         LogMessage("    Split Any/Any group = enabled\n");
     }
+    else if( !strcasecmp(method,"ac-simd") )
+    {
+       fp->search_method = MPSE_ACF_Q_SIMD;
+       LogMessage("   Search-Method = AC-Full-Q-SIMD (%s)\n", acPrefilterKernel());
+    }
     else if( !strcasecmp(method,"ac-nq") )
     {
        fp->search_method = MPSE_ACF;
@@ -1038,6 +1083,20 @@ void fpSetMaxPatternLen(FastPatternConfig *fp, unsigned int max_len)
     LogMessage("    Maximum pattern length = %u\n", max_len);
 }
 
+/*
+**  Sets the number of threads used to compile the pattern matchers.
+**  Zero uses one per online cpu.
+*/
+void fpSetCompileThreads(FastPatternConfig *fp, unsigned int threads)
+{
+    fp->compile_threads = threads;
+
+    if (threads)
+        LogMessage("    Compile threads = %u\n", threads);
+    else
+        LogMessage("    Compile threads = one per cpu\n");
+}
+
 /* FLP_Trim
   *
   * Trim zero byte prefixes, this increases uniqueness
@@ -1498,6 +1557,8 @@ static int fpFinishPortGroupRule(SnortConfig *sc, PORT_GROUP *pg, PmType pm_type
         pmx = (PMX *)SnortAlloc(sizeof(PMX));
         pmx->RuleNode = rn;
         pmx->PatternMatchData = pmd;
+        pmx->PortGroup = pg;
+        fpPortGroupAppend(&pg->pgPmx, &pg->pgPmxCount, &pg->pgPmxMax, pmx);
 
         if (fpDetectGetDebugPrintFastPatterns(fp))
             PrintFastPatternInfo(otn, pmd, pattern, pattern_length, pm_type);
@@ -1519,6 +1580,11 @@ static int fpFinishPortGroupRule(SnortConfig *sc, PORT_GROUP *pg, PmType pm_type
     return 0;
 }
 
+/* Groups waiting for fpCompilePortGroups() */
+static PORT_GROUP **pg_compile = NULL;
+static int pg_compile_count = 0;
+static int pg_compile_max = 0;
+
 static int fpFinishPortGroup(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig *fp)
 {
     PmType i;
@@ -1533,15 +1599,6 @@ static int fpFinishPortGroup(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig
         {
             if (mpseGetPatternCount(pg->pgPms[i]) != 0)
             {
-                if (mpsePrepPatternsWithSnortConf(sc, pg->pgPms[i], pmx_create_tree,
-                            add_patrn_to_neg_list) != 0)
-                {
-                    FatalError("%s(%d) Failed to compile port group "
-                            "patterns.\n", __FILE__, __LINE__);
-                }
-
-                if (fp->debug)
-                    mpsePrintInfo(pg->pgPms[i]);
                 rules = 1;
             }
             else
@@ -1552,6 +1609,153 @@ static int fpFinishPortGroup(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig
         }
     }
 
+    if (pg->pgHeadNC != NULL)
+        rules = 1;
+
+    if (!rules)
+    {
+        /* Nothing in the port group so we can just free it */
+        free(pg);
+        return -1;
+    }
+
+    /* The matchers and trees are built later by fpCompilePortGroups() */
+    fpPortGroupAppend((void ***)&pg_compile, &pg_compile_count, &pg_compile_max, pg);
+
+    return 0;
+}
+
+/*
+ *  Building the state machines is most of the startup time and each one
+ *  depends only on its own patterns, so the matchers of all the groups
+ *  finished since the last call are compiled on a pool of threads.  The
+ *  detection option trees are shared between groups through the tree
+ *  hash, so they are then built here, one group at a time in the order
+ *  the groups were finished.  The result is the same for any number of
+ *  threads.
+ */
+typedef struct _MpseCompileJobs
+{
+    void **mpse;
+    int *status;
+    unsigned num;
+    unsigned next;
+
+} MpseCompileJobs;
+
+static void fpCompileMpses(MpseCompileJobs *jobs)
+{
+    while (1)
+    {
+        unsigned i;
+
+#ifndef WIN32
+        i = __sync_fetch_and_add(&jobs->next, 1);
+#else
+        i = jobs->next++;
+#endif
+        if (i >= jobs->num)
+            break;
+
+        jobs->status[i] = mpseCompile(jobs->mpse[i]);
+    }
+}
+
+#ifndef WIN32
+static void * fpCompileThread(void *arg)
+{
+    fpCompileMpses((MpseCompileJobs *)arg);
+    return NULL;
+}
+#endif
+
+static unsigned fpCompileThreadCount(FastPatternConfig *fp, unsigned jobs)
+{
+    unsigned n = 1;
+
+#ifndef WIN32
+    n = fp->compile_threads;
+
+    if (n == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = (cpus > 0) ? (unsigned)cpus : 1;
+    }
+#endif
+
+    if (n > jobs)
+        n = jobs;
+
+    return n ? n : 1;
+}
+
+static void fpRunCompileJobs(MpseCompileJobs *jobs, unsigned threads)
+{
+#ifndef WIN32
+    pthread_t *tid = NULL;
+    unsigned i, started = 0;
+
+    if (threads > 1)
+    {
+        sigset_t mask, old_mask;
+
+        tid = (pthread_t *)SnortAlloc((threads - 1) * sizeof(*tid));
+
+        /* the compile threads must not handle any of our signals */
+        sigfillset(&mask);
+        pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+
+        for (i = 1; i < threads; i++)
+        {
+            if (pthread_create(&tid[started], NULL, fpCompileThread, jobs))
+                break;
+            started++;
+        }
+        pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    }
+#endif
+
+    /* this thread takes jobs too, or does them all if there are no others */
+    fpCompileMpses(jobs);
+
+#ifndef WIN32
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+
+    if (tid != NULL)
+        free(tid);
+#endif
+}
+
+/* Largest first so that a big matcher isn't the last one started */
+static int fpMpseSizeCompare(const void *a, const void *b)
+{
+    int na = mpseGetPatternCount(*(void * const *)a);
+    int nb = mpseGetPatternCount(*(void * const *)b);
+
+    return (na < nb) - (na > nb);
+}
+
+static void fpBuildPortGroupTrees(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig *fp)
+{
+    PmType i;
+
+    for (i = PM_TYPE__CONTENT; i < PM_TYPE__MAX; i++)
+    {
+        if (pg->pgPms[i] == NULL)
+            continue;
+
+        if (mpsePrepPatternsWithSnortConf(sc, pg->pgPms[i], pmx_create_tree,
+                    add_patrn_to_neg_list) != 0)
+        {
+            FatalError("%s(%d) Failed to compile port group "
+                    "patterns.\n", __FILE__, __LINE__);
+        }
+
+        if (fp->debug)
+            mpsePrintInfo(pg->pgPms[i]);
+    }
+
     if (pg->pgHeadNC != NULL)
     {
         RULE_NODE *ruleNode;
@@ -1563,17 +1767,65 @@ static int fpFinishPortGroup(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig
         }
 
         finalize_detection_option_tree(sc, (detection_option_tree_root_t*)pg->pgNonContentTree);
-        rules = 1;
     }
+}
 
-    if (!rules)
+static void fpCompilePortGroups(SnortConfig *sc)
+{
+    FastPatternConfig *fp = sc->fast_pattern_config;
+    MpseCompileJobs jobs;
+    unsigned threads, k;
+    PmType j;
+    int i;
+
+    if (pg_compile_count == 0)
+        return;
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.mpse = (void **)SnortAlloc(pg_compile_count * PM_TYPE__MAX * sizeof(void *));
+
+    for (i = 0; i < pg_compile_count; i++)
     {
-        /* Nothing in the port group so we can just free it */
-        free(pg);
-        return -1;
+        for (j = PM_TYPE__CONTENT; j < PM_TYPE__MAX; j++)
+        {
+            if (pg_compile[i]->pgPms[j] != NULL)
+                jobs.mpse[jobs.num++] = pg_compile[i]->pgPms[j];
+        }
     }
 
-    return 0;
+    if (jobs.num > 0)
+    {
+        jobs.status = (int *)SnortAlloc(jobs.num * sizeof(int));
+        qsort(jobs.mpse, jobs.num, sizeof(void *), fpMpseSizeCompare);
+
+        threads = fpCompileThreadCount(fp, jobs.num);
+        fpRunCompileJobs(&jobs, threads);
+
+        for (k = 0; k < jobs.num; k++)
+        {
+            if (jobs.status[k] < 0)
+            {
+                FatalError("%s(%d) Failed to compile port group "
+                        "patterns.\n", __FILE__, __LINE__);
+            }
+        }
+
+        if (fpDetectGetDebugPrintRuleGroupBuildDetails(fp))
+        {
+            LogMessage("Compiled %u pattern matchers for %d port groups "
+                    "with %u threads\n", jobs.num, pg_compile_count, threads);
+        }
+        free(jobs.status);
+    }
+    free(jobs.mpse);
+
+    /* Build the detection option trees now that the matchers are done */
+    for (i = 0; i < pg_compile_count; i++)
+        fpBuildPortGroupTrees(sc, pg_compile[i], fp);
+
+    free(pg_compile);
+    pg_compile = NULL;
+    pg_compile_count = pg_compile_max = 0;
 }
 
 static int fpAllocPms(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig *fp)
@@ -1607,6 +1859,12 @@ static int fpAllocPms(SnortConfig *sc, PORT_GROUP *pg, FastPatternConfig *fp)
 
         if (fp->search_opt)
             mpseSetOpt(pg->pgPms[i], 1);
+
+        if (fp->compact_states)
+            mpseSetCompact(pg->pgPms[i], 1);
+
+        if (fp->mpse_cache != NULL)
+            mpseSetCache(pg->pgPms[i], fp->mpse_cache);
     }
 
     return 0;
@@ -2246,6 +2504,13 @@ static void fpDeletePortGroup(void *data)
     RULE_NODE *rn, *tmpRn;
     PmType i;
 
+    /* Still used by another configuration */
+    if (pg->pgRefs > 0)
+    {
+        pg->pgRefs--;
+        return;
+    }
+
     rn = pg->pgHead;
     while (rn)
     {
@@ -2284,9 +2549,673 @@ static void fpDeletePortGroup(void *data)
 
     free_detection_option_root(&pg->pgNonContentTree);
 
+    if (pg->pgPmx != NULL)
+        free(pg->pgPmx);
+
+    if (pg->pgTrees != NULL)
+        free(pg->pgTrees);
+
     free(pg);
 }
 
+/*
+ *  Reload
+ *
+ *  A port group is built from its rules alone so if the new configuration
+ *  has a port object with the same rules (gid:sid:rev) as one of the
+ *  running groups, and those rules have the same options, the running
+ *  group is shared instead of being built again.  Its matchers and option
+ *  trees point to the running configuration's rules and option data, so
+ *  in the reload thread we:
+ *
+ *    - find our rule and option data for each of the group's rules
+ *    - copy the group's option trees onto our option data and add them to
+ *      our tree table
+ *    - record what each rule node, PMX and tree root must point to
+ *
+ *  and the packet thread repoints them in fpAdoptPortGroups() after the
+ *  swap.  Until then the running configuration is untouched.  A group is
+ *  freed when the last configuration using it is freed.
+ */
+typedef struct _PortGroupAdopt
+{
+    PORT_GROUP *pg;
+    void **otns;        /* for pgHead, pgUriHead then pgHeadNC rule nodes */
+    void **pmx_data;    /* rule and pattern for each of pgPmx */
+    detection_option_tree_node_t ***children;   /* for each tree root */
+    int num_trees;
+    struct _PortGroupAdopt *next;
+
+} PortGroupAdopt;
+
+typedef struct
+{
+    PORT_GROUP *pg;
+    PortGroupAdopt *adopt;
+    int failed;
+
+} PortGroupReuseEntry;
+
+typedef struct
+{
+    SnortConfig *sc;    /* the configuration being built */
+    SFXHASH *groups;    /* running groups by rule key */
+    SFXHASH *map;       /* running rules, option data and trees to ours */
+    unsigned reused;
+    unsigned built;
+
+} PortGroupReuse;
+
+/* Only set while building a configuration on reload */
+static PortGroupReuse *pg_reuse = NULL;
+
+static void fpPortGroupAppend(void ***list, int *count, int *max, void *p)
+{
+    if (*count == *max)
+    {
+        int n = *max ? 2 * *max : 8;
+        void **tmp = (void **)SnortAlloc(n * sizeof(*tmp));
+
+        if (*list != NULL)
+        {
+            memcpy(tmp, *list, *count * sizeof(*tmp));
+            free(*list);
+        }
+        *list = tmp;
+        *max = n;
+    }
+    (*list)[(*count)++] = p;
+}
+
+static inline detection_option_tree_root_t * fpPortGroupTree(PORT_GROUP *pg, int i)
+{
+    if (i < pg->pgTreeCount)
+        return (detection_option_tree_root_t *)pg->pgTrees[i];
+
+    return (detection_option_tree_root_t *)pg->pgNonContentTree;
+}
+
+static inline int fpIpProtoOnlyRule(OptTreeNode *otn)
+{
+    return (otn->proto == ETHERNET_TYPE_IP) &&
+        (otn->ds_list[PLUGIN_IP_PROTO_CHECK] != NULL) &&
+        (otn->num_detection_opts == 1);
+}
+
+static OptTreeNode * fpPortObjectRule(SnortConfig *sc, SFGHASH_NODE *node)
+{
+    int *prindex = (int *)node->data;
+
+    if (prindex == NULL)
+        return NULL;
+
+    return OtnLookup(sc->otn_map, RuleIndexMapGid(ruleIndexMap, *prindex),
+            RuleIndexMapSid(ruleIndexMap, *prindex));
+}
+
+static int fpRuleRevCompare(const void *a, const void *b)
+{
+    const uint32_t *x = (const uint32_t *)a;
+    const uint32_t *y = (const uint32_t *)b;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (x[i] != y[i])
+            return (x[i] < y[i]) ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ *  Digest of the gid:sid:rev of the rules that will be added to the group
+ *  for these port objects
+ */
+static void fpPortGroupRuleKey(SnortConfig *sc, PortObject2 *po, PortObject2 *poaa,
+        uint64_t *key)
+{
+    PortObject2 *pox;
+    SFGHASH_NODE *node;
+    OptTreeNode *otn;
+    MpseCacheKey k;
+    uint32_t *revs;
+    unsigned n = 0, max = 0;
+
+    for (pox = po; pox != NULL; pox = (pox == poaa) ? NULL : poaa)
+    {
+        if (pox->rule_hash != NULL)
+            max += pox->rule_hash->count;
+    }
+    revs = (uint32_t *)SnortAlloc((max ? max : 1) * 3 * sizeof(*revs));
+
+    for (pox = po; pox != NULL; pox = (pox == poaa) ? NULL : poaa)
+    {
+        if (pox->rule_hash == NULL)
+            continue;
+
+        for (node = sfghash_findfirst(pox->rule_hash);
+                node && (n < max);
+                node = sfghash_findnext(pox->rule_hash))
+        {
+            otn = fpPortObjectRule(sc, node);
+
+            /* Same as what fpAddPortGroupRule() will take */
+            if ((otn == NULL) || fpIpProtoOnlyRule(otn) ||
+                    (otn->sigInfo.rule_type != SI_RULE_TYPE_DETECT) ||
+                    (otn->rule_state != RULE_STATE_ENABLED))
+            {
+                continue;
+            }
+            revs[3*n] = otn->sigInfo.generator;
+            revs[3*n+1] = otn->sigInfo.id;
+            revs[3*n+2] = otn->sigInfo.rev;
+            n++;
+        }
+    }
+    qsort(revs, n, 3 * sizeof(*revs), fpRuleRevCompare);
+
+    mpseCacheKeyInit(&k);
+    mpseCacheKeyUpdateInt(&k, n);
+    mpseCacheKeyUpdate(&k, revs, n * 3 * sizeof(*revs));
+    free(revs);
+
+    key[0] = k.h1;
+    key[1] = k.h2;
+}
+
+/*
+ *  The ip proto registration fpCreatePortObject2PortGroup() does while
+ *  adding rules, for a shared group
+ */
+static void fpRegPortObjectRules(SnortConfig *sc, PortObject2 *po, PortObject2 *poaa)
+{
+    PortObject2 *pox;
+    SFGHASH_NODE *node;
+    OptTreeNode *otn;
+
+    for (pox = po; pox != NULL; pox = (pox == poaa) ? NULL : poaa)
+    {
+        if (pox->rule_hash == NULL)
+            continue;
+
+        for (node = sfghash_findfirst(pox->rule_hash);
+                node;
+                node = sfghash_findnext(pox->rule_hash))
+        {
+            otn = fpPortObjectRule(sc, node);
+
+            if ((otn == NULL) || (otn->proto != ETHERNET_TYPE_IP))
+                continue;
+
+            if (fpIpProtoOnlyRule(otn))
+                fpAddIpProtoOnlyRule(sc->ip_proto_only_lists, otn);
+            else
+                fpRegIpProto(sc->ip_proto_array, otn);
+        }
+    }
+}
+
+static inline void * fpReloadMap(PortGroupReuse *r, void *old)
+{
+    return sfxhash_find(r->map, &old);
+}
+
+static inline void fpReloadMapAdd(PortGroupReuse *r, void *old, void *data)
+{
+    sfxhash_add(r->map, &old, data);
+}
+
+/*
+ *  Our rule for a running rule - it must have the same gid:sid:rev and
+ *  its options must be ours for the same option data
+ */
+static OptTreeNode * fpReloadRule(PortGroupReuse *r, OptTreeNode *old)
+{
+    OptTreeNode *otn = (OptTreeNode *)fpReloadMap(r, old);
+    OptFpList *ofl, *nfl;
+
+    if (otn != NULL)
+        return otn;
+
+    otn = OtnLookup(r->sc->otn_map, old->sigInfo.generator, old->sigInfo.id);
+
+    if ((otn == NULL) || (otn->sigInfo.rev != old->sigInfo.rev) ||
+            (otn->sigInfo.rule_type != SI_RULE_TYPE_DETECT) ||
+            (otn->rule_state != RULE_STATE_ENABLED))
+    {
+        return NULL;
+    }
+
+    for (ofl = old->opt_func, nfl = otn->opt_func;
+            (ofl != NULL) && (nfl != NULL);
+            ofl = ofl->next, nfl = nfl->next)
+    {
+        void *data;
+
+        if ((ofl->type != nfl->type) || (ofl->OptTestFunc != nfl->OptTestFunc) ||
+                (ofl->isRelative != nfl->isRelative))
+        {
+            return NULL;
+        }
+
+        if ((ofl->type == RULE_OPTION_TYPE_LEAF_NODE) || (ofl->context == NULL))
+        {
+            if ((ofl->type != RULE_OPTION_TYPE_LEAF_NODE) && (nfl->context != NULL))
+                return NULL;
+            continue;
+        }
+
+        data = fpReloadMap(r, ofl->context);
+
+        if (data == NULL)
+        {
+            data = find_detection_option(r->sc, ofl->type, ofl->context);
+
+            if (data != NULL)
+                fpReloadMapAdd(r, ofl->context, data);
+        }
+
+        if ((data == NULL) || (data != nfl->context))
+            return NULL;
+    }
+
+    if ((ofl != NULL) || (nfl != NULL))
+        return NULL;
+
+    /* Normally set while adding the rule to a group */
+    if (old->longestPatternLen > otn->longestPatternLen)
+        otn->longestPatternLen = old->longestPatternLen;
+
+    fpReloadMapAdd(r, old, otn);
+    return otn;
+}
+
+/* Copy a running option tree onto our rules and option data */
+static detection_option_tree_node_t * fpReloadTree(PortGroupReuse *r,
+        detection_option_tree_node_t *old)
+{
+    detection_option_tree_node_t *node;
+    int i;
+
+    node = (detection_option_tree_node_t *)SnortAlloc(sizeof(*node));
+    node->option_type = old->option_type;
+    node->evaluate = old->evaluate;
+    node->relative_children = old->relative_children;
+    node->last_check.is_relative = old->last_check.is_relative;
+
+    if (old->option_type == RULE_OPTION_TYPE_LEAF_NODE)
+        node->option_data = fpReloadRule(r, (OptTreeNode *)old->option_data);
+    else if (old->option_data != NULL)
+        node->option_data = fpReloadMap(r, old->option_data);
+
+    if ((old->option_data != NULL) && (node->option_data == NULL))
+    {
+        free(node);
+        return NULL;
+    }
+
+    if (old->num_children == 0)
+        return node;
+
+    node->children = (detection_option_tree_node_t **)SnortAlloc(
+            old->num_children * sizeof(*node->children));
+
+    for (i = 0; i < old->num_children; i++)
+    {
+        node->children[i] = fpReloadTree(r, old->children[i]);
+
+        if (node->children[i] == NULL)
+        {
+            free_detection_option_tree(node);
+            return NULL;
+        }
+        node->num_children++;
+    }
+
+    return node;
+}
+
+static detection_option_tree_node_t * fpReloadTopTree(PortGroupReuse *r,
+        detection_option_tree_node_t *old)
+{
+    detection_option_tree_node_t *node = fpReloadMap(r, old);
+    void *dup_node = NULL;
+
+    if (node != NULL)
+        return node;
+
+    node = fpReloadTree(r, old);
+
+    if (node == NULL)
+        return NULL;
+
+    if (add_detection_option_tree(r->sc, node, &dup_node) == DETECTION_OPTION_EQUAL)
+    {
+        free_detection_option_tree(node);
+        node = (detection_option_tree_node_t *)dup_node;
+    }
+    detection_option_tree_compile(node);
+
+    fpReloadMapAdd(r, old, node);
+    return node;
+}
+
+static void fpPortGroupAdoptFree(PortGroupAdopt *pa)
+{
+    int i;
+
+    if (pa->children != NULL)
+    {
+        for (i = 0; i < pa->num_trees; i++)
+        {
+            if (pa->children[i] != NULL)
+                free(pa->children[i]);
+        }
+        free(pa->children);
+    }
+
+    if (pa->otns != NULL)
+        free(pa->otns);
+
+    if (pa->pmx_data != NULL)
+        free(pa->pmx_data);
+
+    free(pa);
+}
+
+/* Everything the running group will point to once it is adopted */
+static PortGroupAdopt * fpPortGroupAdoptNew(PortGroupReuse *r, PORT_GROUP *pg)
+{
+    PortGroupAdopt *pa = (PortGroupAdopt *)SnortAlloc(sizeof(*pa));
+    RULE_NODE *lists[3];
+    RULE_NODE *rn;
+    int i, j, n = 0;
+
+    pa->pg = pg;
+
+    lists[0] = pg->pgHead;
+    lists[1] = pg->pgUriHead;
+    lists[2] = pg->pgHeadNC;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (rn = lists[i]; rn != NULL; rn = rn->rnNext)
+            n++;
+    }
+
+    if (n > 0)
+        pa->otns = (void **)SnortAlloc(n * sizeof(*pa->otns));
+
+    /* Rules first so their option data is mapped for the trees */
+    for (i = 0, n = 0; i < 3; i++)
+    {
+        for (rn = lists[i]; rn != NULL; rn = rn->rnNext)
+        {
+            pa->otns[n] = fpReloadRule(r, (OptTreeNode *)rn->rnRuleData);
+
+            if (pa->otns[n++] == NULL)
+                goto fail;
+        }
+    }
+
+    if (pg->pgPmxCount > 0)
+    {
+        pa->pmx_data = (void **)SnortAlloc(
+                2 * pg->pgPmxCount * sizeof(*pa->pmx_data));
+    }
+
+    for (i = 0; i < pg->pgPmxCount; i++)
+    {
+        PMX *pmx = (PMX *)pg->pgPmx[i];
+        RULE_NODE *prn = (RULE_NODE *)pmx->RuleNode;
+
+        /* Fast patterns that aren't rule options (so rules and
+         * preprocessor options) are owned by the running rule */
+        pa->pmx_data[2*i] = fpReloadRule(r, (OptTreeNode *)prn->rnRuleData);
+        pa->pmx_data[2*i+1] = fpReloadMap(r, pmx->PatternMatchData);
+
+        if ((pa->pmx_data[2*i] == NULL) || (pa->pmx_data[2*i+1] == NULL))
+            goto fail;
+    }
+
+    pa->num_trees = pg->pgTreeCount + (pg->pgNonContentTree ? 1 : 0);
+
+    if (pa->num_trees > 0)
+    {
+        pa->children = (detection_option_tree_node_t ***)SnortAlloc(
+                pa->num_trees * sizeof(*pa->children));
+    }
+
+    for (i = 0; i < pa->num_trees; i++)
+    {
+        detection_option_tree_root_t *root = fpPortGroupTree(pg, i);
+
+        if (root->num_children == 0)
+            continue;
+
+        pa->children[i] = (detection_option_tree_node_t **)SnortAlloc(
+                root->num_children * sizeof(*pa->children[i]));
+
+        for (j = 0; j < root->num_children; j++)
+        {
+            pa->children[i][j] = fpReloadTopTree(r, root->children[j]);
+
+            if (pa->children[i][j] == NULL)
+                goto fail;
+        }
+    }
+
+    return pa;
+
+fail:
+    fpPortGroupAdoptFree(pa);
+    return NULL;
+}
+
+/* A running group with these rules that can be shared, if any */
+static PORT_GROUP * fpReusePortGroup(PortGroupReuse *r, uint64_t *key)
+{
+    PortGroupReuseEntry *e = (PortGroupReuseEntry *)sfxhash_find(r->groups, key);
+
+    if ((e == NULL) || e->failed)
+        return NULL;
+
+    if (e->adopt == NULL)
+    {
+        e->adopt = fpPortGroupAdoptNew(r, e->pg);
+
+        if (e->adopt == NULL)
+        {
+            e->failed = 1;
+            return NULL;
+        }
+        e->adopt->next = r->sc->port_group_adopt;
+        r->sc->port_group_adopt = e->adopt;
+        r->reused++;
+    }
+    e->pg->pgRefs++;
+
+    return e->pg;
+}
+
+void fpAdoptPortGroups(SnortConfig *sc)
+{
+    PortGroupAdopt *pa;
+
+    if (sc == NULL)
+        return;
+
+    while ((pa = sc->port_group_adopt) != NULL)
+    {
+        PORT_GROUP *pg = pa->pg;
+        RULE_NODE *lists[3];
+        RULE_NODE *rn;
+        int i, n = 0;
+
+        lists[0] = pg->pgHead;
+        lists[1] = pg->pgUriHead;
+        lists[2] = pg->pgHeadNC;
+
+        for (i = 0; i < 3; i++)
+        {
+            for (rn = lists[i]; rn != NULL; rn = rn->rnNext)
+                rn->rnRuleData = pa->otns[n++];
+        }
+
+        for (i = 0; i < pg->pgPmxCount; i++)
+        {
+            PMX *pmx = (PMX *)pg->pgPmx[i];
+
+            ((RULE_NODE *)pmx->RuleNode)->rnRuleData = pa->pmx_data[2*i];
+            pmx->PatternMatchData = pa->pmx_data[2*i+1];
+        }
+
+        /* The old children go with the record; the nodes are freed with
+         * the old configuration's tree table */
+        for (i = 0; i < pa->num_trees; i++)
+        {
+            detection_option_tree_root_t *root = fpPortGroupTree(pg, i);
+            detection_option_tree_node_t **tmp = root->children;
+
+            if (pa->children[i] == NULL)
+                continue;
+
+            root->children = pa->children[i];
+            pa->children[i] = tmp;
+        }
+
+        sc->port_group_adopt = pa->next;
+        fpPortGroupAdoptFree(pa);
+    }
+}
+
+static void fpPortGroupAdoptFreeAll(SnortConfig *sc)
+{
+    PortGroupAdopt *pa;
+
+    while ((pa = sc->port_group_adopt) != NULL)
+    {
+        sc->port_group_adopt = pa->next;
+        fpPortGroupAdoptFree(pa);
+    }
+}
+
+static void fpReloadAddPortGroup(PortGroupReuse *r, PORT_GROUP *pg)
+{
+    PortGroupReuseEntry e;
+
+    if ((pg == NULL) || (!pg->pgRuleKey[0] && !pg->pgRuleKey[1]))
+        return;
+
+    memset(&e, 0, sizeof(e));
+    e.pg = pg;
+
+    /* Identical groups - the first one will do */
+    sfxhash_add(r->groups, pg->pgRuleKey, &e);
+}
+
+static void fpReloadAddPortTable(PortGroupReuse *r, PortTable *pt)
+{
+    SFGHASH_NODE *node;
+
+    if (pt == NULL)
+        return;
+
+    for (node = sfghash_findfirst(pt->pt_mpo_hash);
+            node;
+            node = sfghash_findnext(pt->pt_mpo_hash))
+    {
+        PortObject2 *po = (PortObject2 *)node->data;
+
+        if (po != NULL)
+            fpReloadAddPortGroup(r, (PORT_GROUP *)po->data);
+    }
+}
+
+static void fpReloadBegin(SnortConfig *sc)
+{
+    SnortConfig *running = snort_conf;
+    FastPatternConfig *fp = sc->fast_pattern_config;
+    FastPatternConfig *rfp;
+    rule_port_tables_t *p;
+    PortGroupReuse *r;
+
+    /* Starting up or nothing to share */
+    if ((running == NULL) || (running == sc) || (running->port_tables == NULL) ||
+            (running->fast_pattern_config == NULL))
+    {
+        return;
+    }
+
+    rfp = running->fast_pattern_config;
+
+    /* Anything that changes what goes into a group's matchers */
+    if ((fp->search_method != rfp->search_method) ||
+            (fp->search_opt != rfp->search_opt) ||
+            (fp->split_any_any != rfp->split_any_any) ||
+            (fp->max_pattern_len != rfp->max_pattern_len) ||
+            (fp->compact_states != rfp->compact_states))
+    {
+        return;
+    }
+
+#ifdef INTEL_SOFT_CPM
+    /* Patterns are compiled into the global instance */
+    if (fp->search_method == MPSE_INTEL_CPM)
+        return;
+#endif
+
+    r = (PortGroupReuse *)SnortAlloc(sizeof(*r));
+    r->sc = sc;
+
+    r->groups = sfxhash_new(1024, sizeof(((PORT_GROUP *)0)->pgRuleKey),
+            sizeof(PortGroupReuseEntry), 0, 0, NULL, NULL, 1);
+    r->map = sfxhash_new(16384, sizeof(void *), 0, 0, 0, NULL, NULL, 1);
+
+    if ((r->groups == NULL) || (r->map == NULL))
+        FatalError("%s(%d) Could not allocate port group reload tables.\n",
+                __FILE__, __LINE__);
+
+    p = running->port_tables;
+
+    fpReloadAddPortTable(r, p->tcp_src);
+    fpReloadAddPortTable(r, p->tcp_dst);
+    fpReloadAddPortGroup(r, (PORT_GROUP *)p->tcp_anyany->data);
+    fpReloadAddPortTable(r, p->udp_src);
+    fpReloadAddPortTable(r, p->udp_dst);
+    fpReloadAddPortGroup(r, (PORT_GROUP *)p->udp_anyany->data);
+    fpReloadAddPortTable(r, p->icmp_src);
+    fpReloadAddPortTable(r, p->icmp_dst);
+    fpReloadAddPortGroup(r, (PORT_GROUP *)p->icmp_anyany->data);
+    fpReloadAddPortTable(r, p->ip_src);
+    fpReloadAddPortTable(r, p->ip_dst);
+    fpReloadAddPortGroup(r, (PORT_GROUP *)p->ip_anyany->data);
+
+    pg_reuse = r;
+}
+
+static void fpReloadEnd(SnortConfig *sc)
+{
+    PortGroupReuse *r = pg_reuse;
+    FastPatternConfig *fp = sc->fast_pattern_config;
+
+    if (r == NULL)
+        return;
+
+    LogMessage("Port groups shared with the running configuration: %u, built: %u\n",
+            r->reused, r->built);
+
+    /* The shared matchers don't look up their cache entries */
+    if (r->reused && (fp->mpse_cache != NULL))
+        mpseCacheKeep(fp->mpse_cache);
+
+    sfxhash_delete(r->groups);
+    sfxhash_delete(r->map);
+    free(r);
+
+    pg_reuse = NULL;
+}
+
 /*
  *  Create the PortGroup for these PortObject2 entitiies
  *
@@ -2302,6 +3231,7 @@ static int fpCreatePortObject2PortGroup(SnortConfig *sc, PortObject2 *po, PortOb
     PORT_GROUP * pg;
     PortObject2 *pox;
     FastPatternConfig *fp = sc->fast_pattern_config;
+    uint64_t key[2];
 
     /* verify we have a port object */
     if (po == NULL)
@@ -2316,6 +3246,23 @@ static int fpCreatePortObject2PortGroup(SnortConfig *sc, PortObject2 *po, PortOb
     if (po->rule_hash == NULL)
         return 0;
 
+    fpPortGroupRuleKey(sc, po, poaa, key);
+
+    if (pg_reuse != NULL)
+    {
+        pg = fpReusePortGroup(pg_reuse, key);
+
+        if (pg != NULL)
+        {
+            fpRegPortObjectRules(sc, po, poaa);
+
+            po->data = pg;
+            po->data_free = fpDeletePortGroup;
+            return 0;
+        }
+        pg_reuse->built++;
+    }
+
     /* create a port_group */
     pg = (PORT_GROUP *)SnortAlloc(sizeof(PORT_GROUP));
 
@@ -2325,6 +3272,9 @@ static int fpCreatePortObject2PortGroup(SnortConfig *sc, PortObject2 *po, PortOb
         return -1;
     }
 
+    pg->pgRuleKey[0] = key[0];
+    pg->pgRuleKey[1] = key[1];
+
     /*
      * Walk the rules in the PortObject and add to
      * the PORT_GROUP pattern state machine
@@ -2448,6 +3398,112 @@ static int fpCreatePortTablePortGroups(SnortConfig *sc, PortTable *p, PortObject
    return 0;
 }
 
+/*
+ *  Per group state table footprint - a port group whose hot lines don't
+ *  fit in L2 will miss on most packets.  Only methods that report a
+ *  footprint (ac-bnfa) show sizes.
+ */
+typedef struct
+{
+    unsigned groups;
+    unsigned bytes;
+    unsigned lines;
+    unsigned hot_lines;
+} FootprintTotals;
+
+static void fpPrintPortGroupFootprint(const char *table, int id, int rules,
+        PORT_GROUP *pg, FootprintTotals *tot)
+{
+    PmType i;
+
+    if (pg == NULL)
+        return;
+
+    tot->groups++;
+
+    for (i = PM_TYPE__CONTENT; i < PM_TYPE__MAX; i++)
+    {
+        MpseFootprint f;
+
+        if (pg->pgPms[i] == NULL)
+            continue;
+
+        if (mpseGetFootprint(pg->pgPms[i], &f) != 0)
+        {
+            LogMessage("| %-11s %5d %6d %-26s %8d %10s %8s %8s\n",
+                    table, id, rules, pm_type_strings[i],
+                    mpseGetPatternCount(pg->pgPms[i]), "-", "-", "-");
+            continue;
+        }
+        LogMessage("| %-11s %5d %6d %-26s %8d %10.1f %8u %8u\n",
+                table, id, rules, pm_type_strings[i],
+                mpseGetPatternCount(pg->pgPms[i]),
+                (double)f.bytes/1024, f.lines, f.hot_lines);
+
+        tot->bytes += f.bytes;
+        tot->lines += f.lines;
+        tot->hot_lines += f.hot_lines;
+    }
+}
+
+static void fpPrintPortTableFootprint(const char *table, PortTable *pt,
+        FootprintTotals *tot)
+{
+    SFGHASH_NODE *node;
+
+    for (node = sfghash_findfirst(pt->pt_mpo_hash);
+         node;
+         node = sfghash_findnext(pt->pt_mpo_hash))
+    {
+        PortObject2 *po = (PortObject2 *)node->data;
+
+        if ((po == NULL) || (po->data == NULL))
+            continue;
+
+        fpPrintPortGroupFootprint(table, po->id,
+                po->rule_hash ? (int)po->rule_hash->count : 0,
+                (PORT_GROUP *)po->data, tot);
+    }
+}
+
+static void fpPrintAnyAnyFootprint(const char *table, PortObject *po,
+        FootprintTotals *tot)
+{
+    fpPrintPortGroupFootprint(table, po->id,
+            po->rule_list ? (int)po->rule_list->count : 0,
+            (PORT_GROUP *)po->data, tot);
+}
+
+static void fpPrintMpseFootprint(rule_port_tables_t *p)
+{
+    FootprintTotals tot;
+
+    memset(&tot, 0, sizeof(tot));
+
+    LogMessage("\n");
+    LogMessage("+-[ Fast Pattern Matcher Footprint ]-----------------------------------------------------\n");
+    LogMessage("| %-11s %5s %6s %-26s %8s %10s %8s %8s\n",
+            "Group", "Id", "Rules", "Matcher", "Patterns", "KB", "Lines", "Hot");
+
+    fpPrintPortTableFootprint("tcp-src", p->tcp_src, &tot);
+    fpPrintPortTableFootprint("tcp-dst", p->tcp_dst, &tot);
+    fpPrintAnyAnyFootprint("tcp-any", p->tcp_anyany, &tot);
+    fpPrintPortTableFootprint("udp-src", p->udp_src, &tot);
+    fpPrintPortTableFootprint("udp-dst", p->udp_dst, &tot);
+    fpPrintAnyAnyFootprint("udp-any", p->udp_anyany, &tot);
+    fpPrintPortTableFootprint("icmp-src", p->icmp_src, &tot);
+    fpPrintPortTableFootprint("icmp-dst", p->icmp_dst, &tot);
+    fpPrintAnyAnyFootprint("icmp-any", p->icmp_anyany, &tot);
+    fpPrintPortTableFootprint("ip-src", p->ip_src, &tot);
+    fpPrintPortTableFootprint("ip-dst", p->ip_dst, &tot);
+    fpPrintAnyAnyFootprint("ip-any", p->ip_anyany, &tot);
+
+    LogMessage("| Groups: %u  State tables: %.1f KB in %u lines, %u hot lines (%.1f KB)\n",
+            tot.groups, (double)tot.bytes/1024, tot.lines, tot.hot_lines,
+            (double)tot.hot_lines*64/1024);
+    LogMessage("+----------------------------------------------------------------------------------------\n");
+}
+
 /*
  *  Create port group objects for all port tables
  *
@@ -3099,16 +4155,27 @@ int fpCreateFastPacketDetection(SnortConfig *sc)
         IntelPmStartInstance();
 #endif
 
+    if (fp->mpse_cache_file != NULL)
+        fp->mpse_cache = mpseCacheOpen(fp->mpse_cache_file);
+
     /* Use PortObjects to create PORT_GROUPs */
     if (fpDetectGetDebugPrintRuleGroupBuildDetails(fp))
         LogMessage("Creating Port Groups....\n");
 
+    fpReloadBegin(sc);
+
     if (fpCreatePortGroups(sc, port_tables))
         FatalError("Could not create PortGroup objects for PortObjects\n");
 
+    fpCompilePortGroups(sc);
+    fpReloadEnd(sc);
+
     if (fpDetectGetDebugPrintRuleGroupBuildDetails(fp))
         LogMessage("Port Groups Done....\n");
 
+    if (fpDetectGetDebugPrintMpseFootprint(fp))
+        fpPrintMpseFootprint(port_tables);
+
     /* Create rule_maps */
     if (fpDetectGetDebugPrintRuleGroupBuildDetails(fp))
         LogMessage("Creating Rule Maps....\n");
@@ -3148,6 +4215,8 @@ int fpCreateFastPacketDetection(SnortConfig *sc)
         if (fpCreateServicePortGroups(sc))
             FatalError("Could not create service based port groups\n");
 
+        fpCompilePortGroups(sc);
+
         if (fpDetectGetDebugPrintRuleGroupBuildDetails(fp))
             LogMessage("Service Based Rule Maps Done....\n");
 
@@ -3178,6 +4247,12 @@ int fpCreateFastPacketDetection(SnortConfig *sc)
         IntelPmCompile(sc);
 #endif
 
+    if (fp->mpse_cache != NULL)
+    {
+        mpseCacheClose(fp->mpse_cache);
+        fp->mpse_cache = NULL;
+    }
+
     return 0;
 }
 
@@ -3191,6 +4266,7 @@ void fpDeleteFastPacketDetection(SnortConfig *sc)
     DetectionTreeHashTableFree(sc->detection_option_tree_hash_table);
 
     fpFreeRuleMaps(sc);
+    fpPortGroupAdoptFreeAll(sc);
 
 #ifdef TARGET_BASED
     ServiceMapFree(sc->srmmTable);
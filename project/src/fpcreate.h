@@ -70,6 +70,7 @@ typedef struct _pmx_
 
    void * RuleNode;
    void * PatternMatchData;
+   void * PortGroup;
 
 } PMX;
 
@@ -101,6 +102,11 @@ typedef struct _FastPatternConfig
     int num_patterns_truncated;  /* due to max_pattern_len */
     int num_patterns_trimmed;    /* due to zero byte prefix */
     int debug_print_fast_pattern;
+    int debug_print_mpse_footprint;
+    int compact_states;                 /* ac-bnfa compact state layout */
+    char *mpse_cache_file;              /* compiled matcher cache */
+    struct _MpseCache *mpse_cache;      /* only open during build */
+    unsigned int compile_threads;       /* 0 = one per cpu */
 
 } FastPatternConfig;
 
@@ -157,6 +163,14 @@ int fpInitDetectionEngine(void);
 */
 int fpCreateFastPacketDetection(struct _SnortConfig *);
 
+/*
+**  On reload, port groups whose rules are unchanged are shared with the
+**  running configuration.  They still point to its rules until the new
+**  configuration is swapped in - call this from the packet thread right
+**  after the swap.
+*/
+void fpAdoptPortGroups(struct _SnortConfig *);
+
 FastPatternConfig * FastPatternConfigNew(void);
 void fpSetDefaults(FastPatternConfig *);
 void FastPatternConfigFree(FastPatternConfig *);
@@ -177,6 +191,7 @@ void fpSetStreamInsert(FastPatternConfig *);
 void fpSetMaxQueueEvents(FastPatternConfig *, unsigned int);
 void fpDetectSetSplitAnyAny(FastPatternConfig *, int);
 void fpSetMaxPatternLen(FastPatternConfig *, unsigned int);
+void fpSetCompileThreads(FastPatternConfig *, unsigned int);
 
 void fpDetectSetSingleRuleGroup(FastPatternConfig *);
 void fpDetectSetBleedOverPortLimit(FastPatternConfig *, unsigned int);
@@ -186,6 +201,7 @@ void fpDetectSetDebugPrintRuleGroupBuildDetails(FastPatternConfig *);
 void fpDetectSetDebugPrintRuleGroupsCompiled(FastPatternConfig *);
 void fpDetectSetDebugPrintRuleGroupsUnCompiled(FastPatternConfig *);
 void fpDetectSetDebugPrintFastPatterns(FastPatternConfig *, int);
+void fpDetectSetDebugPrintMpseFootprint(FastPatternConfig *, int);
 
 int  fpDetectGetSingleRuleGroup(FastPatternConfig *);
 int  fpDetectGetBleedOverPortLimit(FastPatternConfig *);
@@ -196,6 +212,7 @@ int  fpDetectGetDebugPrintRuleGroupsCompiled(FastPatternConfig *);
 int  fpDetectGetDebugPrintRuleGroupsUnCompiled(FastPatternConfig *);
 int  fpDetectSplitAnyAny(FastPatternConfig *);
 int  fpDetectGetDebugPrintFastPatterns(FastPatternConfig *);
+int  fpDetectGetDebugPrintMpseFootprint(FastPatternConfig *);
 
 void fpDeleteFastPacketDetection(struct _SnortConfig *);
 void free_detection_option_tree(detection_option_tree_node_t *node);
@@ -1048,6 +1048,16 @@ void printRuleFmt1( SnortConfig *sc, OptTreeNode * otn )
 }
 #endif
 
+/* queue one buffer for the batched fast pattern search */
+static inline void fpAddBatch(MpseBatchItem *batch, int *nb, void *so,
+        const uint8_t *buf, int len)
+{
+    batch[*nb].so = so;
+    batch[*nb].T = buf;
+    batch[*nb].n = len;
+    (*nb)++;
+}
+
 /*
 **
 **  NAME
@@ -1073,7 +1083,8 @@ static inline int fpEvalHeaderSW(PORT_GROUP *port_group, Packet *p,
         int check_ports, char ip_rule, OTNX_MATCH_DATA *omd)
 {
     void * so;
-    int start_state;
+    MpseBatchItem batch[MPSE_MAX_BATCH];
+    int nb = 0;
     const uint8_t *tmp_payload;
     uint16_t tmp_dsize;
     void *tmp_iph;
@@ -1175,51 +1186,21 @@ static inline int fpEvalHeaderSW(PORT_GROUP *port_group, Packet *p,
                     so = (void *)port_group->pgPms[PM_TYPE__HTTP_URI_CONTENT];
 
                     if ( so && mpseGetPatternCount(so) > 0 )
-                    {
-                        start_state = 0;
-
-                        mpseSearch(so, hb->buf, hb->length,
-                            rule_tree_match, omd, &start_state);
-#ifdef PPM_MGR
-                        /* Bail if we spent too much time already */
-                        if (PPM_PACKET_ABORT_FLAG())
-                            goto fp_eval_header_sw_reset_ip;
-#endif
-                    }
+                        fpAddBatch(batch, &nb, so, hb->buf, hb->length);
                 }
                 if ( (hb = GetHttpBuffer(HTTP_BUFFER_HEADER)) )
                 {
                     so = (void *)port_group->pgPms[PM_TYPE__HTTP_HEADER_CONTENT];
 
                     if ( so && mpseGetPatternCount(so) > 0 )
-                    {
-                        start_state = 0;
-
-                        mpseSearch(so, hb->buf, hb->length,
-                            rule_tree_match, omd, &start_state);
-#ifdef PPM_MGR
-                        /* Bail if we spent too much time already */
-                        if (PPM_PACKET_ABORT_FLAG())
-                            goto fp_eval_header_sw_reset_ip;
-#endif
-                    }
+                        fpAddBatch(batch, &nb, so, hb->buf, hb->length);
                 }
                 if ( (hb = GetHttpBuffer(HTTP_BUFFER_CLIENT_BODY)) )
                 {
                     so = (void *)port_group->pgPms[PM_TYPE__HTTP_CLIENT_BODY_CONTENT];
 
                     if ( so && mpseGetPatternCount(so) > 0 )
-                    {
-                        start_state = 0;
-
-                        mpseSearch(so, hb->buf, hb->length,
-                            rule_tree_match, omd, &start_state);
-#ifdef PPM_MGR
-                        /* Bail if we spent too much time already */
-                        if (PPM_PACKET_ABORT_FLAG())
-                            goto fp_eval_header_sw_reset_ip;
-#endif
-                    }
+                        fpAddBatch(batch, &nb, so, hb->buf, hb->length);
                 }
             }
             /*
@@ -1236,29 +1217,11 @@ static inline int fpEvalHeaderSW(PORT_GROUP *port_group, Packet *p,
             if ((so != NULL) && (mpseGetPatternCount(so) > 0))
             {
                 if (Is_DetectFlag(FLAG_ALT_DECODE) && DecodeBuffer.len)
-                {
-                    start_state = 0;
-                    mpseSearch(so, DecodeBuffer.data, DecodeBuffer.len,
-                            rule_tree_match, omd, &start_state);
-#ifdef PPM_MGR
-                    /* Bail if we spent too much time already */
-                    if (PPM_PACKET_ABORT_FLAG())
-                        goto fp_eval_header_sw_reset_ip;
-#endif
-                }
+                    fpAddBatch(batch, &nb, so, DecodeBuffer.data, DecodeBuffer.len);
 
                 /* Adding this extra search on file data since we no more use DecodeBuffer to decode now*/
                 if(file_data_ptr.len)
-                {
-                    start_state = 0;
-                    mpseSearch(so, file_data_ptr.data, file_data_ptr.len,
-                        rule_tree_match, omd, &start_state);
-#ifdef PPM_MGR
-                    /* Bail if we spent too much time already */
-                    if (PPM_PACKET_ABORT_FLAG())
-                        goto fp_eval_header_sw_reset_ip;
-#endif
-                }
+                    fpAddBatch(batch, &nb, so, file_data_ptr.data, file_data_ptr.len);
 
                  /*
                  **  Content-Match - If no Uri-Content matches, than do a Content search
@@ -1274,15 +1237,24 @@ static inline int fpEvalHeaderSW(PORT_GROUP *port_group, Packet *p,
                     if ( IsLimitedDetect(p) && (p->alt_dsize < p->dsize) )
                         pattern_match_size = p->alt_dsize;
 
-                    start_state = 0;
-                    mpseSearch(so, p->data, pattern_match_size,
-                            rule_tree_match, omd, &start_state);
+                    fpAddBatch(batch, &nb, so, p->data, pattern_match_size);
+                }
+            }
+
+            /*
+             **  Search all of the buffers in one go.  The matchers walk
+             **  their buffers interleaved so the state table misses
+             **  overlap, and queued matches are evaluated once for the
+             **  whole batch rather than once per buffer.
+             */
+            if ( nb )
+            {
+                mpseSearchBatch(batch, nb, rule_tree_match, omd);
 #ifdef PPM_MGR
-                    /* Bail if we spent too much time already */
-                    if (PPM_PACKET_ABORT_FLAG())
-                        goto fp_eval_header_sw_reset_ip;
+                /* Bail if we spent too much time already */
+                if (PPM_PACKET_ABORT_FLAG())
+                    goto fp_eval_header_sw_reset_ip;
 #endif
-                }
             }
         }
     }
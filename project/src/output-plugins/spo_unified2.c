@@ -38,6 +38,14 @@
 #include <errno.h>
 #include <time.h>
 
+#ifndef WIN32
+#define UNIFIED2_ASYNC
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
 #include "sfutil/Unified2_common.h"
 #include "spo_unified2.h"
 #include "decode.h"
@@ -67,6 +75,53 @@
 
 
 /* ------------------ Data structures --------------------------*/
+#ifdef UNIFIED2_ASYNC
+/* Records are copied into a single producer, single consumer ring by the
+ * packet thread and written out in batches by a writer thread.  head and
+ * tail count bytes queued and written since start; each side only writes
+ * its own counter.  Rotations are queued as stream positions so the
+ * writer starts the new file between the same records the packet thread
+ * did. */
+#define U2_ASYNC_ROTATIONS  16
+#define U2_ASYNC_DEFAULT_KB 4096
+#define U2_ASYNC_FLUSH_MS   5    /* longest a record waits in the ring */
+#define U2_ASYNC_WAIT_MS    10   /* longest the packet thread waits for room */
+
+typedef struct _Unified2Async
+{
+    uint8_t *ring;
+    uint32_t size;                  /* power of 2 */
+    volatile uint64_t head;         /* packet thread */
+    volatile uint64_t tail;         /* writer thread */
+
+    uint64_t rotate_at[U2_ASYNC_ROTATIONS];
+    volatile uint32_t rotate_head;  /* packet thread */
+    volatile uint32_t rotate_tail;  /* writer thread */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;            /* writer waits for data */
+    pthread_cond_t room;            /* packet thread waits for space */
+    volatile int waiting;
+    volatile int stop;
+    int started;
+
+    /* packet thread */
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t stalls;                /* had to wait for the writer */
+    uint64_t drops;                 /* ... and gave up */
+
+    /* writer thread */
+    uint64_t writes;
+    uint64_t rotations;
+
+    struct _Unified2Async *next;
+    const char *name;
+
+} Unified2Async;
+#endif
+
 typedef struct _Unified2Config
 {
     char *base_filename;
@@ -81,6 +136,10 @@ typedef struct _Unified2Config
 #endif
     int vlan_event_types;
     int base_proto;
+#ifdef UNIFIED2_ASYNC
+    unsigned int async_kb;      /* 0 unless async is configured */
+    Unified2Async *async;
+#endif
 } Unified2Config;
 
 typedef struct _Unified2LogCallbackData
@@ -157,6 +216,14 @@ static void _Unified2LogPacketAlert(Packet *, char *, Unified2Config *, Event *)
 static void _Unified2LogStreamAlert(Packet *, char *, Unified2Config *, Event *);
 static int Unified2LogStreamCallback(DAQ_PktHdr_t *, uint8_t *, void *);
 static void Unified2Write(uint8_t *, uint32_t, Unified2Config *);
+#ifdef UNIFIED2_ASYNC
+static void Unified2AsyncInit(Unified2Config *);
+static void Unified2AsyncWrite(uint8_t *, uint32_t, Unified2Config *);
+static void Unified2AsyncRotate(Unified2Config *);
+static void Unified2AsyncStop(Unified2Config *);
+static void Unified2AsyncPrintStats(int);
+static Unified2Async *async_list = NULL;
+#endif
 
 static void _AlertIP4_v2(Packet *, char *, Unified2Config *, Event *);
 static void _AlertIP6_v2(Packet *, char *, Unified2Config *, Event *);
@@ -267,6 +334,11 @@ static void Unified2PostConfig(struct _SnortConfig *sc, int unused, void *data)
 
     Unified2InitFile(config);
 
+#ifdef UNIFIED2_ASYNC
+    if (config->async_kb && (config->stream != NULL))
+        Unified2AsyncInit(config);
+#endif
+
     if(stream_api)
     {
         stream_api->reg_xtra_data_log(AlertExtraData, (void *)config);
@@ -344,6 +416,15 @@ static void Unified2InitFile(Unified2Config *config)
 
 static inline void Unified2RotateFile(Unified2Config *config)
 {
+#ifdef UNIFIED2_ASYNC
+    /* the writer owns the file; just mark where the new one starts */
+    if (config->async != NULL)
+    {
+        Unified2AsyncRotate(config);
+        config->current = 0;
+        return;
+    }
+#endif
     fclose(config->stream);
     config->current = 0;
     Unified2InitFile(config);
@@ -1319,6 +1400,29 @@ static Unified2Config * Unified2ParseArgs(char *args, char *default_filename)
             {
                 config->vlan_event_types = 1;
             }
+            else if(strcasecmp("async", stoks[0]) == 0)
+            {
+#ifdef UNIFIED2_ASYNC
+                char *end;
+
+                config->async_kb = U2_ASYNC_DEFAULT_KB;
+
+                if (num_stoks > 1)
+                {
+                    config->async_kb = SnortStrtoul(stoks[1], &end, 10);
+                    if ((stoks[1] == end) || (*end != '\0') || (errno == ERANGE) ||
+                        (config->async_kb < 64) || (config->async_kb > 1024*1024))
+                    {
+                        FatalError("Argument Error in %s(%i): %s. The async "
+                                   "buffer must be 64 to 1048576 KB.\n",
+                                   file_name, file_line, index);
+                    }
+                }
+#else
+                ParseWarning("unified2 async output is not supported on "
+                             "this platform, ignoring.");
+#endif
+            }
             else
             {
                 FatalError("Argument Error in %s(%i): %s\n",
@@ -1370,6 +1474,10 @@ static void Unified2CleanExit(int signal, void *arg)
     /* free up initialized memory */
     if (config != NULL)
     {
+#ifdef UNIFIED2_ASYNC
+        /* drains the ring before the file is closed */
+        Unified2AsyncStop(config);
+#endif
         if (config->stream != NULL)
             fclose(config->stream);
 
@@ -1505,6 +1613,15 @@ static void Unified2Write(uint8_t *buf, uint32_t buf_len, Unified2Config *config
     size_t fwcount = 0;
     int ffstatus = 0;
 
+#ifdef UNIFIED2_ASYNC
+    if ((config != NULL) && (config->async != NULL))
+    {
+        if (buf != NULL)
+            Unified2AsyncWrite(buf, buf_len, config);
+        return;
+    }
+#endif
+
     /* Nothing to write or nothing to write to */
     if ((buf == NULL) || (config == NULL) || (config->stream == NULL))
         return;
@@ -1652,3 +1769,388 @@ static void Unified2Write(uint8_t *buf, uint32_t buf_len, Unified2Config *config
     config->current += buf_len;
 }
 
+#ifdef UNIFIED2_ASYNC
+/******************************************************************************
+ * Asynchronous output
+ *
+ * The packet thread only copies records into the ring.  The writer thread
+ * hands everything queued to a single writev(), so an alert storm costs a
+ * few large writes instead of a write and flush per record, and disk
+ * stalls hold up the writer rather than packet processing.  If the ring
+ * fills, the packet thread waits up to U2_ASYNC_WAIT_MS for the writer and
+ * then drops the record; both are counted.
+ *
+ * The thread is started by the first write rather than at configuration
+ * time so it is created in the process that does the logging, after any
+ * daemonizing fork.
+ ******************************************************************************/
+static void Unified2AsyncInit(Unified2Config *config)
+{
+    Unified2Async *ua = (Unified2Async *)SnortAlloc(sizeof(Unified2Async));
+    uint32_t size = 64 * 1024;
+
+    while (size < (config->async_kb << 10))
+        size <<= 1;
+
+    ua->ring = (uint8_t *)SnortAlloc(size);
+    ua->size = size;
+    ua->name = config->filepath;
+
+    pthread_mutex_init(&ua->lock, NULL);
+    pthread_cond_init(&ua->wake, NULL);
+    pthread_cond_init(&ua->room, NULL);
+
+    if (async_list == NULL)
+        RegisterPreprocStats("unified2", Unified2AsyncPrintStats);
+
+    ua->next = async_list;
+    async_list = ua;
+
+    config->async = ua;
+}
+
+static void Unified2AsyncNewFile(Unified2Config *config)
+{
+    if (config->stream != NULL)
+        fclose(config->stream);
+
+    config->async->rotations++;
+    Unified2InitFile(config);
+}
+
+/* Write out ring bytes up to end.  Error handling follows Unified2Write():
+ * interrupts are retried, EIO starts a new file, the rest are fatal. */
+static void Unified2AsyncFlush(Unified2Config *config, uint64_t end)
+{
+    Unified2Async *ua = config->async;
+    int retries = 3;
+
+    while (ua->tail < end)
+    {
+        uint32_t mask = ua->size - 1;
+        uint32_t off = (uint32_t)(ua->tail & mask);
+        uint64_t len = end - ua->tail;
+        struct iovec iov[2];
+        int iovcnt = 1;
+        ssize_t n;
+
+        if (config->stream == NULL)
+        {
+            /* test mode or no file; nothing to write to */
+            ua->tail = end;
+            break;
+        }
+
+        iov[0].iov_base = ua->ring + off;
+        iov[0].iov_len = len;
+
+        if (off + len > ua->size)
+        {
+            iov[0].iov_len = ua->size - off;
+            iov[1].iov_base = ua->ring;
+            iov[1].iov_len = len - iov[0].iov_len;
+            iovcnt = 2;
+        }
+
+        n = writev(fileno(config->stream), iov, iovcnt);
+
+        if (n > 0)
+        {
+            ua->writes++;
+            __sync_synchronize();
+            ua->tail += n;
+            retries = 3;
+            continue;
+        }
+
+        if ((n < 0) && (errno == EINTR) && (retries-- > 0))
+            continue;
+
+        ErrorMessage("%s(%d) Failed to write to unified2 file (%s): %s\n",
+                     __FILE__, __LINE__, config->filepath, strerror(errno));
+
+        if ((n < 0) && (errno == EIO))
+        {
+            ErrorMessage("%s(%d) Unified2 file is possibly corrupt. "
+                         "Closing this unified2 file and creating "
+                         "a new one.\n", __FILE__, __LINE__);
+
+            Unified2AsyncNewFile(config);
+            continue;
+        }
+
+        FatalError("%s(%d) Cannot write to device.\n", __FILE__, __LINE__);
+    }
+
+    pthread_mutex_lock(&ua->lock);
+    if (ua->waiting)
+        pthread_cond_broadcast(&ua->room);
+    pthread_mutex_unlock(&ua->lock);
+}
+
+static void *Unified2AsyncWriter(void *arg)
+{
+    Unified2Config *config = (Unified2Config *)arg;
+    Unified2Async *ua = config->async;
+
+    for (;;)
+    {
+        uint64_t head = ua->head;
+        uint64_t end = head;
+        int rotate = 0;
+
+        __sync_synchronize();
+
+        if (ua->rotate_tail != ua->rotate_head)
+        {
+            uint64_t at = ua->rotate_at[ua->rotate_tail % U2_ASYNC_ROTATIONS];
+
+            if (at <= end)
+            {
+                end = at;
+                rotate = 1;
+            }
+        }
+
+        if (end > ua->tail)
+            Unified2AsyncFlush(config, end);
+
+        if (rotate)
+        {
+            Unified2AsyncNewFile(config);
+            __sync_synchronize();
+            ua->rotate_tail++;
+            continue;
+        }
+
+        if (ua->tail != ua->head)
+            continue;
+
+        pthread_mutex_lock(&ua->lock);
+
+        if (ua->stop && (ua->tail == ua->head) &&
+            (ua->rotate_tail == ua->rotate_head))
+        {
+            pthread_mutex_unlock(&ua->lock);
+            break;
+        }
+
+        if (!ua->stop && (ua->tail == ua->head))
+        {
+            struct timespec ts;
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += U2_ASYNC_FLUSH_MS * 1000000L;
+
+            if (ts.tv_nsec >= 1000000000L)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&ua->wake, &ua->lock, &ts);
+        }
+        pthread_mutex_unlock(&ua->lock);
+    }
+    return NULL;
+}
+
+static void Unified2AsyncStart(Unified2Config *config)
+{
+    Unified2Async *ua = config->async;
+    sigset_t mask, old;
+    int rval;
+
+    ua->started = 1;
+
+    /* signals are for the packet thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old);
+
+    rval = pthread_create(&ua->thread, NULL, Unified2AsyncWriter, config);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rval != 0)
+    {
+        ErrorMessage("%s(%d) Could not start unified2 writer thread: %s. "
+                     "Writing %s synchronously.\n",
+                     __FILE__, __LINE__, strerror(rval), config->filepath);
+        ua->started = 0;
+        Unified2AsyncStop(config);
+    }
+}
+
+/* Wait for the writer to free at least len bytes, or a rotation slot if
+ * len is 0.  Returns 0 if it didn't within U2_ASYNC_WAIT_MS. */
+static int Unified2AsyncWait(Unified2Async *ua, uint32_t len)
+{
+    struct timespec ts;
+    int ok;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += U2_ASYNC_WAIT_MS * 1000000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ua->lock);
+    ua->waiting = 1;
+    pthread_cond_signal(&ua->wake);
+
+    for (;;)
+    {
+        if (len)
+            ok = (ua->size - (ua->head - ua->tail) >= len);
+        else
+            ok = (ua->rotate_head - ua->rotate_tail < U2_ASYNC_ROTATIONS);
+
+        if (ok || (pthread_cond_timedwait(&ua->room, &ua->lock, &ts) == ETIMEDOUT))
+            break;
+    }
+
+    if (!ok)
+    {
+        if (len)
+            ok = (ua->size - (ua->head - ua->tail) >= len);
+        else
+            ok = (ua->rotate_head - ua->rotate_tail < U2_ASYNC_ROTATIONS);
+    }
+
+    ua->waiting = 0;
+    pthread_mutex_unlock(&ua->lock);
+    return ok;
+}
+
+static void Unified2AsyncWrite(uint8_t *buf, uint32_t buf_len, Unified2Config *config)
+{
+    Unified2Async *ua = config->async;
+    uint32_t mask = ua->size - 1;
+    uint32_t off, n;
+    uint64_t head;
+
+    if (!ua->started)
+    {
+        Unified2AsyncStart(config);
+
+        if (config->async == NULL)
+        {
+            Unified2Write(buf, buf_len, config);
+            return;
+        }
+    }
+
+    head = ua->head;
+
+    if (ua->size - (head - ua->tail) < buf_len)
+    {
+        ua->stalls++;
+
+        if ((buf_len > ua->size) || !Unified2AsyncWait(ua, buf_len))
+        {
+            ua->drops++;
+            return;
+        }
+    }
+
+    off = (uint32_t)(head & mask);
+    n = ua->size - off;
+
+    if (n >= buf_len)
+    {
+        memcpy(ua->ring + off, buf, buf_len);
+    }
+    else
+    {
+        memcpy(ua->ring + off, buf, n);
+        memcpy(ua->ring, buf + n, buf_len - n);
+    }
+
+    /* record contents before the new head */
+    __sync_synchronize();
+    ua->head = head + buf_len;
+
+    ua->records++;
+    ua->bytes += buf_len;
+    config->current += buf_len;
+
+    /* don't let the writer sleep through a filling ring */
+    if ((ua->head - ua->tail) > (ua->size >> 1))
+    {
+        pthread_mutex_lock(&ua->lock);
+        pthread_cond_signal(&ua->wake);
+        pthread_mutex_unlock(&ua->lock);
+    }
+}
+
+static void Unified2AsyncRotate(Unified2Config *config)
+{
+    Unified2Async *ua = config->async;
+
+    /* rotations are rare; one can't be dropped without breaking the
+     * limit, so wait as long as it takes */
+    while ((ua->rotate_head - ua->rotate_tail >= U2_ASYNC_ROTATIONS) &&
+           !Unified2AsyncWait(ua, 0))
+    {
+        ua->stalls++;
+    }
+
+    ua->rotate_at[ua->rotate_head % U2_ASYNC_ROTATIONS] = ua->head;
+    __sync_synchronize();
+    ua->rotate_head++;
+}
+
+static void Unified2AsyncStop(Unified2Config *config)
+{
+    Unified2Async *ua = config->async;
+    Unified2Async **pp;
+
+    if (ua == NULL)
+        return;
+
+    if (ua->started)
+    {
+        pthread_mutex_lock(&ua->lock);
+        ua->stop = 1;
+        pthread_cond_signal(&ua->wake);
+        pthread_mutex_unlock(&ua->lock);
+
+        pthread_join(ua->thread, NULL);
+    }
+
+    for (pp = &async_list; *pp != NULL; pp = &(*pp)->next)
+    {
+        if (*pp == ua)
+        {
+            *pp = ua->next;
+            break;
+        }
+    }
+
+    pthread_mutex_destroy(&ua->lock);
+    pthread_cond_destroy(&ua->wake);
+    pthread_cond_destroy(&ua->room);
+
+    free(ua->ring);
+    free(ua);
+    config->async = NULL;
+}
+
+static void Unified2AsyncPrintStats(int exiting)
+{
+    Unified2Async *ua;
+
+    for (ua = async_list; ua != NULL; ua = ua->next)
+    {
+        LogMessage("Unified2 async output (%s):\n", ua->name);
+        LogMessage("                   Records: " STDu64 "\n", ua->records);
+        LogMessage("                     Bytes: " STDu64 "\n", ua->bytes);
+        LogMessage("                    Writes: " STDu64 "\n", ua->writes);
+        LogMessage("                 Rotations: " STDu64 "\n", ua->rotations);
+        LogMessage("                    Stalls: " STDu64 "\n", ua->stalls);
+        LogMessage("                   Dropped: " STDu64 "\n", ua->drops);
+    }
+}
+#endif
@@ -233,6 +233,9 @@
 #define DETECTION_OPT__SPLIT_ANY_ANY                         "split-any-any"
 #define DETECTION_OPT__MAX_PATTERN_LEN                       "max-pattern-len"
 #define DETECTION_OPT__DEBUG_PRINT_FAST_PATTERN              "debug-print-fast-pattern"
+#define DETECTION_OPT__MPSE_CACHE                            "mpse-cache"
+#define DETECTION_OPT__DEBUG_PRINT_MPSE_FOOTPRINT            "debug-print-mpse-footprint"
+#define DETECTION_OPT__COMPILE_THREADS                       "compile-threads"
 
 #define EVENT_QUEUE_OPT__LOG                 "log"
 #define EVENT_QUEUE_OPT__MAX_QUEUE           "max_queue"
@@ -617,6 +620,9 @@ static const ConfigFunc config_opts[] =
     { CONFIG_OPT__DAEMON, 0, 1, 1, ConfigDaemon },
     { CONFIG_OPT__DECODE_DATA_LINK, 0, 1, 1, ConfigDecodeDataLink },
     { CONFIG_OPT__DECODE_ESP, 0, 1, 1, ConfigEnableEspDecoding },
+#ifdef ZLIB
+    { CONFIG_OPT__DECOMPRESS_MEMCAP, 1, 1, 1, ConfigDecompressMemcap },
+#endif
     { CONFIG_OPT__DEFAULT_RULE_STATE, 0, 1, 1, ConfigDefaultRuleState },
     { CONFIG_OPT__DETECTION, 1, 0, 1, ConfigDetection },  /* This is reconfigurable */
     { CONFIG_OPT__DETECTION_FILTER, 1, 1, 1, ConfigDetectionFilter },
@@ -668,6 +674,7 @@ static const ConfigFunc config_opts[] =
     { CONFIG_OPT__RESPONSE, 1, 1, 1, ConfigResponse },
 #endif
     { CONFIG_OPT__FLOWBITS_SIZE, 1, 1, 1, ConfigFlowbitsSize },
+    { CONFIG_OPT__FLOW_BYPASS, 1, 1, 1, ConfigFlowBypass },
     { CONFIG_OPT__IGNORE_PORTS, 1, 0, 1, ConfigIgnorePorts },
     { CONFIG_OPT__ALERT_VLAN, 0, 1, 1, ConfigIncludeVlanInAlert },
     { CONFIG_OPT__INTERFACE, 1, 1, 1, ConfigInterface },
@@ -1004,6 +1011,12 @@ SnortConfig * ParseSnortConf(void)
      * defined rules */
     sc->omd = OtnXMatchDataNew(sc->num_rule_types);
 
+    /* All file rules are in so the file magics can be compiled */
+    compile_file_identifiers(sc->file_config);
+
+    /* All config bindings are in so the lookup table can be compiled */
+    sfNetworkCompileBindings(sc->policy_config);
+
     /* Reset these.  The only issue in not reseting would be if we were
      * parsing a command line again, but do it anyway */
     file_name = NULL;
@@ -6557,6 +6570,24 @@ void ConfigDecodeDataLink(SnortConfig *sc, char *args)
     sc->output_flags |= OUTPUT_FLAG__SHOW_DATA_LINK;
 }
 
+#ifdef ZLIB
+/* config decompress_memcap: <bytes> */
+void ConfigDecompressMemcap(SnortConfig *sc, char *args)
+{
+    char *endptr;
+
+    if ((sc == NULL) || (args == NULL))
+        return;
+
+    sc->decompress_memcap = SnortStrtoul(args, &endptr, 0);
+    if ((errno == ERANGE) || (*endptr != '\0'))
+    {
+        ParseError("Invalid decompress memcap: %s.  Memcap must be between "
+                   "0 and %u inclusive.", args, UINT32_MAX);
+    }
+}
+#endif
+
 void ConfigDefaultRuleState(SnortConfig *sc, char *args)
 {
     if (sc == NULL)
@@ -6732,10 +6763,50 @@ void ConfigDetection(SnortConfig *sc, char *args)
                 ParseError("Missing argument to 'max-pattern-len'.");
             }
         }
+        else if (strcasecmp(toks[i], DETECTION_OPT__COMPILE_THREADS) == 0)
+        {
+            i++;
+            if (i < num_toks)
+            {
+                char *endptr;
+                int n = SnortStrtol(toks[i], &endptr, 0);
+
+                if ((errno == ERANGE) || (*endptr != '\0') || (n < 0))
+                {
+                    ParseError("Invalid argument for compile-threads: %s.  "
+                               "Need a non-negative integer.", toks[i]);
+                }
+
+                fpSetCompileThreads(fp, n);
+            }
+            else
+            {
+                ParseError("Missing argument to 'compile-threads'.");
+            }
+        }
         else if (strcasecmp(toks[i], DETECTION_OPT__DEBUG_PRINT_FAST_PATTERN) == 0)
         {
             fpDetectSetDebugPrintFastPatterns(fp, 1);
         }
+        else if (strcasecmp(toks[i], DETECTION_OPT__DEBUG_PRINT_MPSE_FOOTPRINT) == 0)
+        {
+            fpDetectSetDebugPrintMpseFootprint(fp, 1);
+        }
+        else if (strcasecmp(toks[i], DETECTION_OPT__MPSE_CACHE) == 0)
+        {
+            i++;
+            if (i < num_toks)
+            {
+                if (fp->mpse_cache_file != NULL)
+                    free(fp->mpse_cache_file);
+
+                fp->mpse_cache_file = SnortStrdup(toks[i]);
+            }
+            else
+            {
+                ParseError("Missing file name argument to 'mpse-cache'.");
+            }
+        }
         else
         {
             ParseError("'%s' is an invalid option to the 'config detection' "
@@ -7417,6 +7488,62 @@ void ConfigFlowbitsSize(SnortConfig *sc, char *args)
     sc->flowbit_size = (uint16_t)getFlowbitSizeInBytes();
 }
 
+/* config flow_bypass: entries <n> [, timeout <secs>] */
+void ConfigFlowBypass(SnortConfig *sc, char *args)
+{
+    char **toks;
+    int num_toks;
+    int i;
+
+    if ((sc == NULL) || (args == NULL))
+        return;
+
+    toks = mSplit(args, ", ", 0, &num_toks, 0);
+
+    for (i = 0; i < num_toks; i++)
+    {
+        unsigned long value;
+        char *endptr;
+
+        if ((strcasecmp(toks[i], "entries") != 0) &&
+            (strcasecmp(toks[i], "timeout") != 0))
+        {
+            ParseError("Invalid argument to '%s': %s.  Options are "
+                       "'entries' and 'timeout'.", CONFIG_OPT__FLOW_BYPASS,
+                       toks[i]);
+        }
+
+        if (i + 1 >= num_toks)
+        {
+            ParseError("No argument to '%s %s'.  Argument must be a "
+                       "positive integer.", CONFIG_OPT__FLOW_BYPASS, toks[i]);
+        }
+
+        value = SnortStrtoulRange(toks[i + 1], &endptr, 0, 1, 0x1000000);
+
+        if ((errno == ERANGE) || (*endptr != '\0'))
+        {
+            ParseError("Invalid argument to '%s %s': %s.  Must be between "
+                       "1 and %u.", CONFIG_OPT__FLOW_BYPASS, toks[i],
+                       toks[i + 1], 0x1000000);
+        }
+
+        if (strcasecmp(toks[i], "entries") == 0)
+            sc->flow_bypass_entries = (uint32_t)value;
+        else
+            sc->flow_bypass_timeout = (uint32_t)value;
+
+        i++;
+    }
+
+    if (sc->flow_bypass_entries == 0)
+    {
+        ParseError("'%s' requires 'entries'.", CONFIG_OPT__FLOW_BYPASS);
+    }
+
+    mSplitFree(&toks, num_toks);
+}
+
 /****************************************************************************
  *
  * Purpose: Parses a protocol plus a list of ports.
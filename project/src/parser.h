@@ -94,6 +94,7 @@
 #define CONFIG_OPT__DAEMON                          "daemon"
 #define CONFIG_OPT__DECODE_DATA_LINK                "decode_data_link"
 #define CONFIG_OPT__DECODE_ESP                      "decode_esp"
+#define CONFIG_OPT__DECOMPRESS_MEMCAP               "decompress_memcap"
 #define CONFIG_OPT__DEFAULT_RULE_STATE              "default_rule_state"
 #define CONFIG_OPT__DETECTION                       "detection"
 #define CONFIG_OPT__DETECTION_FILTER                "detection_filter"
@@ -145,6 +146,7 @@
 # define CONFIG_OPT__RESPONSE                       "response"
 #endif
 #define CONFIG_OPT__FLOWBITS_SIZE                   "flowbits_size"
+#define CONFIG_OPT__FLOW_BYPASS                     "flow_bypass"
 #define CONFIG_OPT__IGNORE_PORTS                    "ignore_ports"
 #define CONFIG_OPT__ALERT_VLAN                      "include_vlan_in_alerts"
 #define CONFIG_OPT__INTERFACE                       "interface"
@@ -263,6 +265,9 @@ void ConfigClassification(SnortConfig *, char *);
 void ConfigCreatePidFile(SnortConfig *, char *);
 void ConfigDaemon(SnortConfig *, char *);
 void ConfigDecodeDataLink(SnortConfig *, char *);
+#ifdef ZLIB
+void ConfigDecompressMemcap(SnortConfig *, char *);
+#endif
 void ConfigDefaultRuleState(SnortConfig *, char *);
 void ConfigDetection(SnortConfig *, char *);
 void ConfigDetectionFilter(SnortConfig *, char *);
@@ -313,6 +318,7 @@ void ConfigResponse(SnortConfig*, char*);
 #endif
 void ConfigReact(SnortConfig*, char*);
 void ConfigFlowbitsSize(SnortConfig *, char *);
+void ConfigFlowBypass(SnortConfig *, char *);
 void ConfigIgnorePorts(SnortConfig *, char *);
 void ConfigIncludeVlanInAlert(SnortConfig *, char *);
 void ConfigInterface(SnortConfig *, char *);
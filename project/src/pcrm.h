@@ -118,6 +118,17 @@ typedef struct {
 
   int pgNQEvents;
   int pgQEvents;
+
+  /*
+  **  Reload support - a group whose rules are unchanged is shared
+  **  with the new configuration instead of being rebuilt (fpcreate.c)
+  */
+  int pgRefs;               /* other configurations using this group */
+  uint64_t pgRuleKey[2];    /* digest of the gid:sid:rev of its rules */
+  void **pgPmx;             /* pattern matcher user data (PMX) */
+  int pgPmxCount, pgPmxMax;
+  void **pgTrees;           /* option tree roots built by the matchers */
+  int pgTreeCount, pgTreeMax;
  
 }PORT_GROUP;
 
@@ -61,6 +61,7 @@
 #include "hi_eo_log.h"
 #include "hi_util.h"
 #include "hi_util_hbm.h"
+#include "hi_util_scan.h"
 #include "hi_return_codes.h"
 #include "util.h"
 #include "mstring.h"
@@ -1584,6 +1585,31 @@ static inline int unfold_http_uri(HTTPINSPECT_CONF *ServerConf, const u_char *en
 }
 
 
+/*
+**  Builds the set of bytes the URI loop has to stop on.  The lookup
+**  table is global and the whitespace is per server so this is done
+**  once per server configuration.
+*/
+static inline const HI_SCAN_SET *GetUriScanSet(HTTPINSPECT_CONF *ServerConf)
+{
+    HI_SCAN_SET *set = &ServerConf->uri_scan;
+    int iCtr;
+
+    if(set->ready)
+        return set;
+
+    hi_util_scan_clear(set);
+
+    for(iCtr = 0; iCtr < 256; iCtr++)
+    {
+        if(lookup_table[iCtr] || ServerConf->whitespace[iCtr])
+            hi_util_scan_add(set, (u_char)iCtr);
+    }
+    set->ready = 1;
+
+    return set;
+}
+
 static inline int hi_client_extract_uri(
     HI_SESSION *Session, HTTPINSPECT_CONF *ServerConf,
     HI_CLIENT * Client, const u_char *start, const u_char *end,
@@ -1592,6 +1618,7 @@ static inline int hi_client_extract_uri(
     int iRet = HI_SUCCESS;
     const u_char *tmp;
     int uri_copied = 0;
+    const HI_SCAN_SET *uri_scan = GetUriScanSet(ServerConf);
 
     Session->norm_flags &= ~HI_BODY;
 
@@ -1600,8 +1627,10 @@ static inline int hi_client_extract_uri(
     **  This loop compares each char to an array of functions
     **  (one for each char) and calling that function if there is one.
     **
-    **  If there is no function, then we just increment the char ptr and
-    **  continue processing.
+    **  If there is no function, then we skip ahead to the next char that
+    **  has one (or is whitespace) and continue processing.  Non-ASCII
+    **  chars all have a function so the extended ASCII check still sees
+    **  every one of them.
     **
     **  If there is a function, we call that function and process.  It's
     **  important to note that the function that is called is responsible
@@ -1723,7 +1752,7 @@ static inline int hi_client_extract_uri(
             }
         }
 
-        ptr++;
+        ptr = hi_util_scan(uri_scan, ptr + 1, end);
     }
     return iRet;
 }
@@ -1765,10 +1794,10 @@ const u_char *extract_http_cookie(const u_char *p, const u_char *end, HEADER_PTR
     header_field_ptr->cookie->cookie = p;
 
     {
-        crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
+        crlf = (u_char *)hi_util_find_lf(p, end);
 
         /* find a \n  */
-        if (crlf) /* && hi_util_in_bounds(start, end, crlf+1)) bounds is checked in SnortStrnStr */
+        if (crlf) /* && hi_util_in_bounds(start, end, crlf+1)) bounds is checked in hi_util_find_lf */
         {
             if(*(crlf -1) == '\r')
                 header_field_ptr->cookie->cookie_end = crlf - 1;
@@ -2112,7 +2141,7 @@ const u_char *extract_http_content_length(HI_SESSION *Session,
                                 header_field_ptr->content_len->cont_len_end = NULL;
                             header_field_ptr->content_len->len = 0;
 
-                            crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
+                            crlf = (u_char *)hi_util_find_lf(p, end);
                             if (crlf)
                             {
                                 return p;
@@ -2143,7 +2172,7 @@ const u_char *extract_http_content_length(HI_SESSION *Session,
                                 header_field_ptr->content_len->cont_len_start =
                                     header_field_ptr->content_len->cont_len_end = NULL;
                                 header_field_ptr->content_len->len = 0;
-                                crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
+                                crlf = (u_char *)hi_util_find_lf(p, end);
                                 if (crlf)
                                 {
                                     p = crlf;
@@ -2172,7 +2201,7 @@ const u_char *extract_http_content_length(HI_SESSION *Session,
     {
         if(hi_util_in_bounds(start, end, p))
         {
-            crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
+            crlf = (u_char *)hi_util_find_lf(p, end);
             if(crlf)
             {
                 p = crlf;
@@ -2365,6 +2394,8 @@ static inline const u_char *hi_client_extract_header(
     /* This is to skip past the HTTP/1.0 (or 1.1) version string */
     if (IsHttpVersion(&p, end))
     {
+        const HI_SCAN_SET *version_scan = GetUriScanSet(ServerConf);
+
         memset(&version_string, 0, sizeof(URI_PTR));
         version_string.uri = p;
 
@@ -2413,7 +2444,7 @@ static inline const u_char *hi_client_extract_header(
                     return p;
                 }
             }
-            p++;
+            p = hi_util_scan(version_scan, p + 1, end);
         }
         if (iRet == URI_END)
         {
@@ -2434,7 +2465,7 @@ static inline const u_char *hi_client_extract_header(
         }
         if(p < end)
         {
-            crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
+            crlf = (u_char *)hi_util_find_lf(p, end);
             if(crlf)
             {
                 p = crlf;
@@ -2532,7 +2563,8 @@ static inline const u_char *hi_client_extract_header(
             return end;
         }
         if ( *p == '\n') continue;
-        p++;
+        /* nothing else in a header line needs a look until the next LF */
+        p = hi_util_scan_eol(p + 1, end);
     }
 
     /* Never observed an end-of-field.  Maybe it's not there, but the header is long anyway: */
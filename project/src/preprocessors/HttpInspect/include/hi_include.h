@@ -55,6 +55,8 @@ typedef struct _hi_stats {
     uint64_t total;
 #ifdef ZLIB
     uint64_t gzip_pkts;
+    uint64_t gzip_no_state;        /* Responses not decompressed, max_gzip_mem reached */
+    uint64_t gzip_no_mem;          /* Responses not decompressed, decompress_memcap reached */
     uint64_t compr_bytes_read;
     uint64_t decompr_bytes_read;
 #endif
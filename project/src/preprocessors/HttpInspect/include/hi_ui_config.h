@@ -38,6 +38,7 @@
 #include "hi_include.h"
 #include "snort_bounds.h"
 #include "sfrt.h"
+#include "hi_util_scan.h"
 #include "ipv6_port.h"
 #include "sf_ip.h"
 #include "sfPolicy.h"
@@ -205,6 +206,12 @@ typedef struct s_HTTPINSPECT_CONF
     */
     char whitespace[256];
 
+    /*
+    **  Bytes the URI tokenizer has to stop on, which is the client
+    **  lookup table plus the whitespace above.  Built on first use.
+    */
+    HI_SCAN_SET uri_scan;
+
     /*
     **  These are the URI encoding configurations
     */
@@ -28,6 +28,7 @@
 int hi_ui_server_lookup_init(SERVER_LOOKUP **ServerLookup);
 int hi_ui_server_lookup_add(SERVER_LOOKUP *ServerLookup, sfip_t *Ip,
                             HTTPINSPECT_CONF *ServerConf);
+int hi_ui_server_lookup_compile(SERVER_LOOKUP *ServerLookup);
 
 HTTPINSPECT_CONF *hi_ui_server_lookup_find(SERVER_LOOKUP *ServerLookup,
                                             snort_ip_p Ip, int *iError);
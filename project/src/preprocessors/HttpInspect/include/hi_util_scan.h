@@ -0,0 +1,105 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/**
+**  @file       hi_util_scan.h
+**
+**  @brief      Byte class scanning for the HttpInspect tokenizers.
+**
+**  The URI and header loops spend most of their time stepping over
+**  bytes that need no processing.  A scan set holds the bytes that do
+**  and hi_util_scan() returns the first of them, 16 or 32 bytes at a
+**  time when the cpu supports it.
+*/
+
+#ifndef __HI_UTIL_SCAN_H__
+#define __HI_UTIL_SCAN_H__
+
+#include <string.h>
+#include <sys/types.h>
+
+#include "sf_types.h"
+
+/*
+**  Runs shorter than this are not worth the kernel call.
+*/
+#define HI_SCAN_MIN 16
+
+typedef struct s_HI_SCAN_SET
+{
+    /*
+    **  Nibble tables for the kernels.  The first pair covers bytes
+    **  0x00-0x7f and the second 0x80-0xff so any set can be encoded.
+    */
+    uint8_t lo[2][16];
+    uint8_t hi[2][16];
+
+    /*
+    **  Membership for the short runs and the scalar fallback.
+    */
+    uint8_t in[256];
+
+    int ready;
+
+}  HI_SCAN_SET;
+
+void hi_util_scan_clear(HI_SCAN_SET *set);
+void hi_util_scan_add(HI_SCAN_SET *set, u_char c);
+const char *hi_util_scan_kernel(void);
+
+const u_char *hi_util_scan_long(
+    const HI_SCAN_SET *set, const u_char *p, const u_char *end);
+
+const u_char *hi_util_find_lf(const u_char *p, const u_char *end);
+
+/*
+**  Returns the first byte in [p, end) that is in the set or end if
+**  there is none.  p may already be at or past end.
+*/
+static inline const u_char *hi_util_scan(
+    const HI_SCAN_SET *set, const u_char *p, const u_char *end)
+{
+    if ( end - p >= HI_SCAN_MIN )
+        return hi_util_scan_long(set, p, end);
+
+    while ( p < end && !set->in[*p] )
+        p++;
+
+    return p;
+}
+
+/*
+**  Returns the next line feed in [p, end) or end if there is none.
+**  libc memchr is already vectorized so there is no table for this.
+*/
+static inline const u_char *hi_util_scan_eol(const u_char *p, const u_char *end)
+{
+    const u_char *eol;
+
+    if ( p >= end )
+        return p;
+
+    eol = (const u_char *)memchr(p, '\n', end - p);
+
+    return eol ? eol : end;
+}
+
+#endif
@@ -43,7 +43,7 @@
 #include <stdio.h>
 #include <string.h>
 #ifdef ZLIB
-#include <zlib.h>
+#include "sf_inflate.h"
 #include "mempool.h"
 #include "hi_paf.h"
 extern MemPool *hi_gzip_mempool;
@@ -57,6 +57,7 @@ static bool simple_response = false;
 #include "hi_ui_config.h"
 #include "hi_return_codes.h"
 #include "hi_si.h"
+#include "hi_util_scan.h"
 #include "hi_eo_log.h"
 #include "snort_bounds.h"
 #include "detection_util.h"
@@ -278,7 +279,7 @@ static inline int hi_server_extract_status_msg( const u_char *start, const u_cha
 
     if (  hi_util_in_bounds(start, end, ptr) )
     {
-        const u_char *crlf = (u_char *)SnortStrnStr((const char *)ptr, end - ptr, "\n");
+        const u_char *crlf = hi_util_find_lf(ptr, end);
         result->uri = ptr;
         if (crlf)
         {
@@ -421,6 +422,30 @@ static inline const u_char *extract_http_content_type_charset(HI_SESSION *Sessio
 }
 
 #ifdef ZLIB
+/*
+**  The bytes that can end a content-encoding value or start one of the
+**  encodings we decompress.
+*/
+static inline const HI_SCAN_SET *GetEncodingScanSet(void)
+{
+    static HI_SCAN_SET set;
+
+    if(set.ready)
+        return &set;
+
+    hi_util_scan_clear(&set);
+    hi_util_scan_add(&set, '\n');
+    hi_util_scan_add(&set, 'g');
+    hi_util_scan_add(&set, 'G');
+    hi_util_scan_add(&set, 'x');
+    hi_util_scan_add(&set, 'X');
+    hi_util_scan_add(&set, 'd');
+    hi_util_scan_add(&set, 'D');
+    set.ready = 1;
+
+    return &set;
+}
+
 static inline const u_char *extract_http_content_encoding(HTTPINSPECT_CONF *ServerConf,
         const u_char *p, const u_char *start, const u_char *end, HEADER_PTR *header_ptr,
         HEADER_FIELD_PTR *header_field_ptr)
@@ -513,7 +538,7 @@ static inline const u_char *extract_http_content_encoding(HTTPINSPECT_CONF *Serv
                             continue;
                         }
                         else
-                            p++;
+                            p = hi_util_scan(GetEncodingScanSet(), p + 1, end);
                     }
 
                     /*crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
@@ -541,7 +566,7 @@ static inline const u_char *extract_http_content_encoding(HTTPINSPECT_CONF *Serv
     {
         if(hi_util_in_bounds(start, end, p))
         {
-            crlf = (u_char *)SnortStrnStr((const char *)p, end - p, "\n");
+            crlf = hi_util_find_lf(p, end);
             if(crlf)
             {
                 p = crlf;
@@ -741,7 +766,8 @@ static inline const u_char *hi_server_extract_header(
             return end;
         }
         if ( *p == '\n') continue;
-        p++;
+        /* nothing else in a header line needs a look until the next LF */
+        p = hi_util_scan_eol(p + 1, end);
     }
 
     header_ptr->header.uri_end = p;
@@ -860,11 +886,12 @@ static void SetGzipBuffers(HttpSessionData *hsd, HI_SESSION *session)
                 hsd->decomp_state->compr_depth = session->global_conf->compr_depth;
                 hsd->decomp_state->decompr_depth = session->global_conf->decompr_depth;
             }
-            hsd->decomp_state->inflate_init = 0;
+            hsd->decomp_state->inflater = NULL;
         }
         else
         {
-            mempool_free(hi_gzip_mempool, bkt);
+            /* This response won't be decompressed */
+            hi_stats.gzip_no_state++;
         }
     }
 }
@@ -872,92 +899,43 @@ static void SetGzipBuffers(HttpSessionData *hsd, HI_SESSION *session)
 int uncompress_gzip ( u_char *dest, int destLen, const u_char *source,
         int sourceLen, HttpSessionData *sd, int *total_bytes_read, int compr_fmt)
 {
-    z_stream stream;
-    int err;
-    int iRet = HI_SUCCESS;
+    DECOMPRESS_STATE *ds = sd->decomp_state;
+    uint32_t produced = 0;
+    int ret;
+
+    if ((destLen < 0) || (sourceLen < 0))
+        return HI_FATAL_ERR;
+
+    if (ds->inflater == NULL)
+    {
+        /* Unlimited decompression doesn't add up the depth so there is no
+         * limit on how far into the stream it goes */
+        uint32_t depth = (ds->decompr_depth < MAX_GZIP_DEPTH) ? ds->decompr_depth : 0;
+
+        ds->inflater = SFInflate_New((compr_fmt & HTTP_RESP_COMPRESS_TYPE__DEFLATE) ?
+                SF_INFLATE_DEFLATE : SF_INFLATE_GZIP, depth);
 
-   stream = sd->decomp_state->d_stream;
-
-   stream.next_in = (Bytef*)source;
-   stream.avail_in = (uInt)sourceLen;
-   if ((uLong)stream.avail_in != (uLong)sourceLen)
-   {
-       sd->decomp_state->d_stream = stream;
-       return HI_FATAL_ERR;
-   }
-
-   stream.next_out = dest;
-   stream.avail_out = (uInt)destLen;
-   if ((uLong)stream.avail_out != (uLong)destLen)
-   {
-       sd->decomp_state->d_stream = stream;
-       return HI_FATAL_ERR;
-   }
-
-
-   if(!sd->decomp_state->inflate_init)
-   {
-       sd->decomp_state->inflate_init = 1;
-       stream.zalloc = (alloc_func)0;
-       stream.zfree = (free_func)0;
-       if(compr_fmt & HTTP_RESP_COMPRESS_TYPE__DEFLATE)
-           err = inflateInit(&stream);
-       else
-           err = inflateInit2(&stream, GZIP_WBITS);
-       if (err != Z_OK)
-       {
-           sd->decomp_state->d_stream = stream;
-           return HI_FATAL_ERR;
-       }
-   }
-   else
-   {
-       stream.total_in = 0;
-       stream.total_out =0;
-   }
-
-   err = inflate(&stream, Z_SYNC_FLUSH);
-   if ((!sd->decomp_state->deflate_initialized)
-           && (err == Z_DATA_ERROR)
-           && (compr_fmt & HTTP_RESP_COMPRESS_TYPE__DEFLATE))
-   {
-       /* Might not have zlib header - add one */
-       static char zlib_header[2] = { 0x78, 0x01 };
-
-       inflateReset(&stream);
-       stream.next_in = (Bytef *)zlib_header;
-       stream.avail_in = sizeof(zlib_header);
-
-       sd->decomp_state->deflate_initialized = true;
-
-       err = inflate(&stream, Z_SYNC_FLUSH);
-       if (err == Z_OK)
-       {
-           stream.next_in = (Bytef*)source;
-           stream.avail_in = (uInt)sourceLen;
-
-           err = inflate(&stream, Z_SYNC_FLUSH);
-       }
-   }
-
-   if ((err != Z_STREAM_END) && (err !=Z_OK))
-   {
-
-       /* If some of the compressed data is decompressed we need to provide that for detection */
-       if( stream.total_out > 0)
-       {
-           *total_bytes_read = stream.total_out;
-           iRet = HI_NONFATAL_ERR;
-       }
-       else
-           iRet = HI_FATAL_ERR;
-       inflateEnd(&stream);
-       sd->decomp_state->d_stream = stream;
-       return iRet;
-   }
-   *total_bytes_read = stream.total_out;
-   sd->decomp_state->d_stream = stream;
-   return HI_SUCCESS;
+        if (ds->inflater == NULL)
+        {
+            hi_stats.gzip_no_mem++;
+            return HI_FATAL_ERR;
+        }
+    }
+
+    ret = SFInflate_Run(ds->inflater, source, (uint32_t)sourceLen,
+            dest, (uint32_t)destLen, &produced);
+
+    *total_bytes_read = (int)produced;
+
+    if (ret == SF_INFLATE_NOMEM)
+        hi_stats.gzip_no_mem++;
+
+    if (ret < 0)
+    {
+        /* If some of the compressed data is decompressed we need to provide that for detection */
+        return produced ? HI_NONFATAL_ERR : HI_FATAL_ERR;
+    }
+    return HI_SUCCESS;
 }
 
 static inline int hi_server_decompress(HI_SESSION *Session, HttpSessionData *sd, const u_char *ptr,
@@ -72,7 +72,7 @@ static void serverConfFree(void *pData);
 */
 int hi_ui_server_lookup_init(SERVER_LOOKUP **ServerLookup)
 {
-    *ServerLookup =  sfrt_new(DIR_16_4x4_16x5_4x4, IPv6, HI_UI_CONFIG_MAX_SERVERS, 20);
+    *ServerLookup =  sfrt_new(POPTRIE, IPv6, HI_UI_CONFIG_MAX_SERVERS, 20);
     if(*ServerLookup == NULL)
     {
         return HI_MEM_ALLOC_FAIL;
@@ -124,6 +124,33 @@ int hi_ui_server_lookup_add(SERVER_LOOKUP *ServerLookup, sfip_t *Ip,
     return HI_SUCCESS;
 }
 
+/*
+**  NAME
+**    hi_ui_server_lookup_compile::
+*/
+/**
+**  Prepare the server lookup for packet processing.
+**
+**  This is called once all the server configurations have been added so
+**  the table is compiled at configuration time instead of on a lookup.
+**
+**  @param ServerLookup a pointer to the lookup structure
+**
+**  @return integer
+**
+**  @retval HI_SUCCESS        function successful
+**  @retval HI_MEM_ALLOC_FAIL memory allocation failed; lookups still work
+*/
+int hi_ui_server_lookup_compile(SERVER_LOOKUP *ServerLookup)
+{
+    if (sfrt_compile(ServerLookup))
+    {
+        return HI_MEM_ALLOC_FAIL;
+    }
+
+    return HI_SUCCESS;
+}
+
 /*
 **  NAME
 **    hi_ui_server_lookup_find::
@@ -0,0 +1,235 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/**
+**  @file       hi_util_scan.c
+**
+**  @brief      Byte class scanning for the HttpInspect tokenizers.
+**
+**  A byte b is in the set if
+**
+**    (lo[0][b & 0xf] & hi[0][b >> 4]) | (lo[1][b & 0xf] & hi[1][b >> 4])
+**
+**  is non-zero.  hi[0] maps high nibbles 0-7 to a single bit and hi[1]
+**  does the same for 8-15, so each lo entry is the bit mask of the high
+**  nibbles that complete a member.  That is 4 pshufb per 16 (ssse3) or
+**  32 (avx2) bytes.  The kernels are compiled with function level target
+**  attributes and selected at runtime as in the ac prefilter.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "hi_util_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HI_SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+typedef const u_char *(*ScanFunc)(const HI_SCAN_SET *, const u_char *, const u_char *);
+
+static const u_char *ScanScalar(
+    const HI_SCAN_SET *set, const u_char *p, const u_char *end)
+{
+    while ( p < end && !set->in[*p] )
+        p++;
+
+    return p;
+}
+
+#ifdef HI_SCAN_SIMD
+
+#define HI_SCAN_128(lo, hi) \
+    _mm_or_si128( \
+        _mm_and_si128(_mm_shuffle_epi8(lo0, lo), _mm_shuffle_epi8(hi0, hi)), \
+        _mm_and_si128(_mm_shuffle_epi8(lo1, lo), _mm_shuffle_epi8(hi1, hi)))
+
+__attribute__((target("ssse3")))
+static const u_char *ScanSsse3(
+    const HI_SCAN_SET *set, const u_char *p, const u_char *end)
+{
+    const __m128i nib = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    const __m128i lo0 = _mm_loadu_si128((const __m128i *)set->lo[0]);
+    const __m128i hi0 = _mm_loadu_si128((const __m128i *)set->hi[0]);
+    const __m128i lo1 = _mm_loadu_si128((const __m128i *)set->lo[1]);
+    const __m128i hi1 = _mm_loadu_si128((const __m128i *)set->hi[1]);
+
+    while ( p + 16 <= end )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i lo = _mm_and_si128(v, nib);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+        __m128i m = HI_SCAN_128(lo, hi);
+
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) & 0xffff;
+
+        if ( mask )
+            return p + __builtin_ctz(mask);
+
+        p += 16;
+    }
+    return ScanScalar(set, p, end);
+}
+
+#define HI_SCAN_256(lo, hi) \
+    _mm256_or_si256( \
+        _mm256_and_si256(_mm256_shuffle_epi8(lo0, lo), _mm256_shuffle_epi8(hi0, hi)), \
+        _mm256_and_si256(_mm256_shuffle_epi8(lo1, lo), _mm256_shuffle_epi8(hi1, hi)))
+
+__attribute__((target("avx2")))
+static const u_char *ScanAvx2(
+    const HI_SCAN_SET *set, const u_char *p, const u_char *end)
+{
+    const __m256i nib = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    /* vpshufb works within 128 bit lanes so both lanes get the table */
+    const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->lo[0]));
+    const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->hi[0]));
+    const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->lo[1]));
+    const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->hi[1]));
+
+    while ( p + 32 <= end )
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i lo = _mm256_and_si256(v, nib);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nib);
+        __m256i m = HI_SCAN_256(lo, hi);
+
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(m, zero));
+
+        if ( mask )
+            return p + __builtin_ctz(mask);
+
+        p += 32;
+    }
+    return ScanSsse3(set, p, end);
+}
+
+static ScanFunc SelectKernel(const char **name)
+{
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports("avx2") )
+    {
+        *name = "avx2";
+        return ScanAvx2;
+    }
+    if ( __builtin_cpu_supports("ssse3") )
+    {
+        *name = "ssse3";
+        return ScanSsse3;
+    }
+    *name = "none";
+    return ScanScalar;
+}
+
+#else
+
+static ScanFunc SelectKernel(const char **name)
+{
+    *name = "none";
+    return ScanScalar;
+}
+
+#endif
+
+static const char *s_kernel = NULL;
+static ScanFunc s_scan = ScanScalar;
+
+const char *hi_util_scan_kernel(void)
+{
+    if ( !s_kernel )
+        s_scan = SelectKernel(&s_kernel);
+
+    return s_kernel;
+}
+
+/*
+**  Empties the set.  The kernel is picked on the first call so this
+**  must come before any scan.
+*/
+void hi_util_scan_clear(HI_SCAN_SET *set)
+{
+    int h;
+
+    hi_util_scan_kernel();
+
+    memset(set, 0, sizeof(*set));
+
+    for ( h = 0; h < 8; h++ )
+    {
+        set->hi[0][h] = (uint8_t)(1 << h);
+        set->hi[1][h + 8] = (uint8_t)(1 << h);
+    }
+}
+
+void hi_util_scan_add(HI_SCAN_SET *set, u_char c)
+{
+    int h = c >> 4;
+
+    set->in[c] = 1;
+
+    if ( h < 8 )
+        set->lo[0][c & 0xf] |= (uint8_t)(1 << h);
+    else
+        set->lo[1][c & 0xf] |= (uint8_t)(1 << (h - 8));
+}
+
+const u_char *hi_util_scan_long(
+    const HI_SCAN_SET *set, const u_char *p, const u_char *end)
+{
+    return s_scan(set, p, end);
+}
+
+/*
+**  The header loops used SnortStrnStr(p, end - p, "\n") to find the end
+**  of a field.  That stops at a NUL and never returns the last byte, so
+**  this does the same with a {LF, NUL} set instead of memchr.  Returns
+**  the line feed or NULL.
+*/
+const u_char *hi_util_find_lf(const u_char *p, const u_char *end)
+{
+    static HI_SCAN_SET lf_set;
+    const u_char *last = end - 1;
+
+    if ( p >= last )
+        return NULL;
+
+    if ( !lf_set.ready )
+    {
+        hi_util_scan_clear(&lf_set);
+        hi_util_scan_add(&lf_set, '\n');
+        hi_util_scan_add(&lf_set, '\0');
+        lf_set.ready = 1;
+    }
+
+    p = hi_util_scan(&lf_set, p, last);
+
+    return (p < last && *p == '\n') ? p : NULL;
+}
@@ -39,6 +39,8 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
+
 #include "active.h"
 #include "decode.h"
 #include "sf_types.h"
@@ -96,7 +98,7 @@ void PrintSessionKey(SessionKey *skey)
 int GetLWSessionCount(Stream5SessionCache *sessionCache)
 {
     if (sessionCache && sessionCache->hashTable)
-        return sessionCache->hashTable->count;
+        return sfohash_count(sessionCache->hashTable);
     else
         return 0;
 }
@@ -464,8 +466,7 @@ void GetLWPacketDirection(Packet *p, Stream5LWSession *ssn)
 
 Stream5LWSession *GetLWSession(Stream5SessionCache *sessionCache, Packet *p, SessionKey *key)
 {
-    Stream5LWSession *returned = NULL;
-    SFXHASH_NODE *hnode;
+    Stream5LWSession *returned;
 
     if (!sessionCache)
         return NULL;
@@ -475,40 +476,21 @@ Stream5LWSession *GetLWSession(Stream5SessionCache *sessionCache, Packet *p, Ses
         return NULL;
     }
 
-    hnode = sfxhash_find_node(sessionCache->hashTable, key);
+    returned = (Stream5LWSession *)sfohash_find(sessionCache->hashTable, key);
 
-    if (hnode && hnode->data)
+    if (returned && (returned->last_data_seen < p->pkth->ts.tv_sec))
     {
-        /* This is a unique hnode, since the sfxhash finds the
-         * same key before returning this node.
-         */
-        returned = (Stream5LWSession *)hnode->data;
-        if (returned && (returned->last_data_seen < p->pkth->ts.tv_sec))
-        {
-            returned->last_data_seen = p->pkth->ts.tv_sec;
-        }
+        returned->last_data_seen = p->pkth->ts.tv_sec;
     }
     return returned;
 }
 
 Stream5LWSession *GetLWSessionFromKey(Stream5SessionCache *sessionCache, const SessionKey *key)
 {
-    Stream5LWSession *returned = NULL;
-    SFXHASH_NODE *hnode;
-
     if (!sessionCache)
         return NULL;
 
-    hnode = sfxhash_find_node(sessionCache->hashTable, key);
-
-    if (hnode && hnode->data)
-    {
-        /* This is a unique hnode, since the sfxhash finds the
-         * same key before returning this node.
-         */
-        returned = (Stream5LWSession *)hnode->data;
-    }
-    return returned;
+    return (Stream5LWSession *)sfohash_find(sessionCache->hashTable, key);
 }
 
 void FreeLWApplicationData(Stream5LWSession *ssn)
@@ -529,11 +511,50 @@ void FreeLWApplicationData(Stream5LWSession *ssn)
     ssn->appDataList = NULL;
 }
 
+/*
+ * Idle timer of a session.  It is armed timeoutNominal past the first
+ * packet and, rather than being moved on every packet, pushed out when
+ * it finds the session has seen traffic since.
+ */
+static void LWSessionIdleExpire(SFTW_TIMER *t, uint32_t now)
+{
+    Stream5SessionCache *sessionCache = (Stream5SessionCache *)t->data;
+    Stream5LWSession *lwssn = (Stream5LWSession *)
+        ((char *)t - offsetof(Stream5LWSession, idle_timer));
+    uint32_t idle_at = (uint32_t)lwssn->last_data_seen + sessionCache->timeoutNominal;
+
+    if ((int32_t)(idle_at - now) > 0)
+    {
+        sftw_schedule(&snort_timers, t, idle_at);
+        return;
+    }
+
+#ifdef ENABLE_HA
+    if (lwssn->ha_flags & HA_FLAG_STANDBY)
+    {
+        sftw_schedule(&snort_timers, t, now + sessionCache->timeoutNominal);
+        return;
+    }
+#endif
+
+    DEBUG_WRAP(DebugMessage(DEBUG_STREAM, "retiring stale session\n"););
+    lwssn->ha_state.session_flags |= SSNFLAG_TIMEDOUT;
+
+    Active_Suspend();
+
+    if ( !Stream5SetRuntimeConfiguration(lwssn, lwssn->protocol) )
+        DeleteLWSession(sessionCache, lwssn, "stale/timeout");
+    else
+        sftw_schedule(&snort_timers, t, now + sessionCache->timeoutNominal);
+
+    Active_Resume();
+}
+
 static int RemoveLWSession(Stream5SessionCache *sessionCache, Stream5LWSession *ssn)
 {
-    SFXHASH_NODE *hnode;
     Stream5Config *pPolicyConfig = NULL;
     tSfPolicyId policy_id = ssn->policy_id;
+    sftw_cancel(&snort_timers, &ssn->idle_timer);
     mempool_free(&s5FlowMempool, ssn->flowdata);
     ssn->flowdata = NULL;
 
@@ -552,13 +573,7 @@ static int RemoveLWSession(Stream5SessionCache *sessionCache, Stream5LWSession *
         }
     }
 
-    hnode = sfxhash_find_node(sessionCache->hashTable, ssn->key);
-    if (!hnode)
-        return SFXHASH_ERR;
-    if (sessionCache->nextTimeoutEvalNode == hnode)
-        sessionCache->nextTimeoutEvalNode = NULL;
-
-    return sfxhash_free_node(sessionCache->hashTable, hnode);
+    return sfohash_remove(sessionCache->hashTable, ssn);
 }
 
 int DeleteLWSession(Stream5SessionCache *sessionCache,
@@ -652,30 +667,29 @@ int PurgeLWSessionCache(Stream5SessionCache *sessionCache)
 {
     int retCount = 0;
     Stream5LWSession *idx;
-    SFXHASH_NODE *hnode;
+    unsigned cursor = 0;
+    unsigned n;
 
     if (!sessionCache)
         return 0;
 
     sessionCache->flags |= SESSION_CACHE_FLAG_PURGING;
 
-    /* Remove all sessions from the hash table. */
-    hnode = sfxhash_mru_node(sessionCache->hashTable);
-    while (hnode)
+    /* Remove all sessions from the hash table.  A session whose
+     * configuration is gone is skipped, so visit each one once. */
+    for (n = sfohash_count(sessionCache->hashTable); n > 0; n--)
     {
-        idx = (Stream5LWSession *)hnode->data;
+        idx = (Stream5LWSession *)sfohash_walk(sessionCache->hashTable,
+            &cursor, sessionCache->max_sessions);
+
         if (!idx)
-        {
-            sfxhash_free_node(sessionCache->hashTable, hnode);
-        }
-        else
-        {
-            idx->ha_state.session_flags |= SSNFLAG_PRUNED;
+            break;
+
+        idx->ha_state.session_flags |= SSNFLAG_PRUNED;
+
+        if ( !Stream5SetRuntimeConfiguration(idx, idx->protocol) )
+            DeleteLWSession(sessionCache, idx, "purge whole cache");
 
-            if ( !Stream5SetRuntimeConfiguration(idx, idx->protocol) )
-                DeleteLWSession(sessionCache, idx, "purge whole cache");
-        }
-        hnode = sfxhash_mru_node(sessionCache->hashTable);
         retCount++;
     }
 
@@ -687,13 +701,27 @@ int PurgeLWSessionCache(Stream5SessionCache *sessionCache)
 int DeleteLWSessionCache(Stream5SessionCache *sessionCache)
 {
     int retCount = 0;
+    unsigned cursor = 0;
+    unsigned n;
 
     if (!sessionCache)
         return 0;
 
     retCount = PurgeLWSessionCache(sessionCache);
 
-    sfxhash_delete(sessionCache->hashTable);
+    /* Sessions the purge had to skip are still on the timer wheel */
+    for (n = sfohash_count(sessionCache->hashTable); n > 0; n--)
+    {
+        Stream5LWSession *idx = (Stream5LWSession *)sfohash_walk(
+            sessionCache->hashTable, &cursor, sessionCache->max_sessions);
+
+        if (!idx)
+            break;
+
+        sftw_cancel(&snort_timers, &idx->idle_timer);
+    }
+
+    sfohash_delete(sessionCache->hashTable);
     free(sessionCache);
 
     return retCount;
@@ -704,6 +732,9 @@ static inline int SessionWasBlocked (Stream5LWSession* ssn)
     return (ssn->ha_state.session_flags & (SSNFLAG_DROP_CLIENT|SSNFLAG_DROP_SERVER)) != 0;
 }
 
+/* Sessions the stale sweep looks at for each one it may remove */
+#define S5_PRUNE_SCAN_FACTOR 4
+
 int PruneLWSessionCache(Stream5SessionCache *sessionCache,
                    uint32_t thetime,
                    Stream5LWSession *save_me,
@@ -711,70 +742,41 @@ int PruneLWSessionCache(Stream5SessionCache *sessionCache,
 {
     Stream5LWSession *idx;
     uint32_t pruned = 0;
+    int ref;
     Active_Suspend();
 
     if (thetime != 0)
     {
-        /* Pruning, look for sessions that have time'd out */
-        char got_one;
-        idx = (Stream5LWSession *) sfxhash_lru(sessionCache->hashTable);
-
-        if(idx == NULL)
-        {
-            Active_Resume();
-            return 0;
-        }
-
-        do
+        /* Pruning, look for sessions that have time'd out.  The table
+         * isn't kept in age order, so look at a bounded number of
+         * sessions under the clock hand instead of stopping at the
+         * first live one. */
+        unsigned int examined = 0;
+        unsigned int limit = S5_PRUNE_SCAN_FACTOR * (sessionCache->cleanup_sessions + 1);
+
+        while ((examined++ < limit) &&
+               (idx = (Stream5LWSession *)
+                    sfohash_clock_next(sessionCache->hashTable, &ref, 0)))
         {
-            got_one = 0;
-            if(idx == save_me)
-            {
-                SFXHASH_NODE *lastNode = sfxhash_lru_node(sessionCache->hashTable);
-                sfxhash_gmovetofront(sessionCache->hashTable, lastNode);
-                lastNode = sfxhash_lru_node(sessionCache->hashTable);
-                if ((lastNode) && (lastNode->data != idx))
-                {
-                    idx = (Stream5LWSession *)lastNode->data;
-                    continue;
-                }
-                else
-                {
-                    sessionCache->prunes += pruned;
-                    Active_Resume();
-                    return pruned;
-                }
-            }
+            if (idx == save_me)
+                continue;
 
-            if((idx->last_data_seen+sessionCache->timeoutAggressive) < thetime)
-            {
-                Stream5LWSession *savidx = idx;
+            if ((idx->last_data_seen+sessionCache->timeoutAggressive) >= thetime)
+                continue;
 
-                if(sfxhash_count(sessionCache->hashTable) > 1)
-                {
-                    DEBUG_WRAP(DebugMessage(DEBUG_STREAM, "pruning stale session\n"););
-                    savidx->ha_state.session_flags |= SSNFLAG_TIMEDOUT;
-                    DeleteLWSession(sessionCache, savidx, "stale/timeout");
+            idx->ha_state.session_flags |= SSNFLAG_TIMEDOUT;
 
-                    idx = (Stream5LWSession *) sfxhash_lru(sessionCache->hashTable);
-                    pruned++;
-                    got_one = 1;
-                }
-                else
-                {
-                    savidx->ha_state.session_flags |= SSNFLAG_TIMEDOUT;
-                    DeleteLWSession(sessionCache, savidx, "stale/timeout/last ssn");
-                    pruned++;
-                    sessionCache->prunes += pruned;
-                    Active_Resume();
-                    return pruned;
-                }
+            if (sfohash_count(sessionCache->hashTable) > 1)
+            {
+                DEBUG_WRAP(DebugMessage(DEBUG_STREAM, "pruning stale session\n"););
+                DeleteLWSession(sessionCache, idx, "stale/timeout");
+                pruned++;
             }
             else
             {
-                sessionCache->prunes += pruned;
-                Active_Resume();
-                return pruned;
+                DeleteLWSession(sessionCache, idx, "stale/timeout/last ssn");
+                pruned++;
+                break;
             }
 
             if (pruned > sessionCache->cleanup_sessions)
@@ -782,7 +784,7 @@ int PruneLWSessionCache(Stream5SessionCache *sessionCache,
                 /* Don't bother cleaning more than 'n' at a time */
                 break;
             }
-        } while ((idx != NULL) && (got_one == 1));
+        }
 
         sessionCache->prunes += pruned;
         Active_Resume();
@@ -792,11 +794,19 @@ int PruneLWSessionCache(Stream5SessionCache *sessionCache,
     {
         /* Free up 'n' sessions at a time until we get under the
          * memcap or free enough sessions to be able to create
-         * new ones.
+         * new ones.  Victims come from the clock hand; a session
+         * used since the hand last passed it gets a second chance.
+         * The hand stays where it stopped for the next call, and
+         * each call looks at no more than 'limit' sessions so this
+         * doesn't sweep the whole table in the packet path.  Past
+         * half of that the reference bits are ignored, so a table
+         * full of recently used sessions still gives up victims.
          */
          unsigned int session_count;
+         unsigned int examined = 0;
+         unsigned int limit = 2 * S5_PRUNE_SCAN_FACTOR * (sessionCache->cleanup_sessions + 1);
 #define s5_sessions_in_table() \
-     ((session_count = sfxhash_count(sessionCache->hashTable)) > 1)
+     ((session_count = sfohash_count(sessionCache->hashTable)) > 1)
 #define s5_over_session_limit() \
      (session_count > (sessionCache->max_sessions - sessionCache->cleanup_sessions))
 #define s5_havent_pruned_yet() \
@@ -808,8 +818,8 @@ int PruneLWSessionCache(Stream5SessionCache *sessionCache,
                ((!memCheck && (s5_over_session_limit() || s5_havent_pruned_yet())) ||
                (memCheck && s5_over_memcap() )))
         {
-            unsigned int i;
-            unsigned int blocks = 0;
+            unsigned int i = 0;
+            uint32_t pruned_before = pruned;
             DEBUG_WRAP(
                 DebugMessage(DEBUG_STREAM,
                     "S5: Pruning session cache by %d ssns for %s: %d/%d\n",
@@ -818,41 +828,29 @@ int PruneLWSessionCache(Stream5SessionCache *sessionCache,
                     mem_in_use,
                     s5_global_eval_config->memcap););
 
-            idx = (Stream5LWSession *) sfxhash_lru(sessionCache->hashTable);
-
-            for (i=0;i<sessionCache->cleanup_sessions &&
-                     (sfxhash_count(sessionCache->hashTable) >= blocks+1); i++)
+            while ((i < sessionCache->cleanup_sessions) &&
+                   (examined++ < limit) &&
+                   (idx = (Stream5LWSession *)
+                        sfohash_clock_next(sessionCache->hashTable, &ref, 1)))
             {
-                if ( (idx != save_me) && (!memCheck || !SessionWasBlocked(idx)) )
-                {
-                    idx->ha_state.session_flags |= SSNFLAG_PRUNED;
-                    DeleteLWSession(sessionCache, idx, memCheck ? "memcap/check" : "memcap/stale");
-                    pruned++;
-                    idx = (Stream5LWSession *) sfxhash_lru(sessionCache->hashTable);
-                }
-                else
-                {
-                    SFXHASH_NODE* lastNode;
-
-                    if ( SessionWasBlocked(idx) )
-                        blocks++;
-
-                    lastNode = sfxhash_lru_node(sessionCache->hashTable);
-                    sfxhash_gmovetofront(sessionCache->hashTable, lastNode);
-                    lastNode = sfxhash_lru_node(sessionCache->hashTable);
-                    if ((lastNode) && (lastNode->data == idx))
-                    {
-                        /* Okay, this session is the only one left */
-                        break;
-                    }
-                    idx = (Stream5LWSession *) sfxhash_lru(sessionCache->hashTable);
-                    i--; /* Didn't clean this one */
-                }
+                if ((idx == save_me) || (memCheck && SessionWasBlocked(idx)))
+                    continue;
+
+                if (ref && (examined <= limit / 2))
+                    continue;
+
+                idx->ha_state.session_flags |= SSNFLAG_PRUNED;
+                DeleteLWSession(sessionCache, idx, memCheck ? "memcap/check" : "memcap/stale");
+                pruned++;
+                i++;
+
+                if (sfohash_count(sessionCache->hashTable) <= 1)
+                    break;
             }
 
             /* Nothing (or the one we're working with) in table, couldn't
              * kill it */
-            if (!memCheck && (pruned == 0))
+            if (pruned == pruned_before)
             {
                 break;
             }
@@ -861,11 +859,11 @@ int PruneLWSessionCache(Stream5SessionCache *sessionCache,
     if (memCheck && pruned)
     {
         LogMessage("S5: Pruned %d sessions from cache for memcap. %d ssns remain.  memcap: %d/%d\n",
-            pruned, sfxhash_count(sessionCache->hashTable),
+            pruned, sfohash_count(sessionCache->hashTable),
             mem_in_use,
             s5_global_eval_config->memcap);
         DEBUG_WRAP(
-            if (sfxhash_count(sessionCache->hashTable) == 1)
+            if (sfohash_count(sessionCache->hashTable) == 1)
             {
                 DebugMessage(DEBUG_STREAM, "S5: Pruned, one session remains\n");
             }
@@ -881,12 +879,12 @@ Stream5LWSession *NewLWSession(Stream5SessionCache *sessionCache, Packet *p,
 {
     Stream5LWSession *retSsn = NULL;
     Stream5Config *pLWSPolicyConfig;
-    SFXHASH_NODE *hnode;
     StreamFlowData *flowdata;
     time_t timestamp = p ? p->pkth->ts.tv_sec : packet_time();
+    int added;
 
-    hnode = sfxhash_get_node(sessionCache->hashTable, key);
-    if (!hnode)
+    retSsn = (Stream5LWSession *)sfohash_get(sessionCache->hashTable, key, &added);
+    if (!retSsn)
     {
         DEBUG_WRAP(DebugMessage(DEBUG_STREAM, "HashTable full, clean it\n"););
         if (!PruneLWSessionCache(sessionCache, timestamp, NULL, 0))
@@ -896,27 +894,32 @@ Stream5LWSession *NewLWSession(Stream5SessionCache *sessionCache, Packet *p,
         }
 
         /* Should have some freed nodes now */
-        hnode = sfxhash_get_node(sessionCache->hashTable, key);
+        retSsn = (Stream5LWSession *)sfohash_get(sessionCache->hashTable, key, &added);
 #ifdef DEBUG_MSGS
-        if (!hnode)
+        if (!retSsn)
         {
             LogMessage("%s(%d) Problem, no freed nodes\n", __FILE__,
             __LINE__);
         }
 #endif
     }
-    if (hnode && hnode->data)
+    if (retSsn)
     {
-        retSsn = hnode->data;
+        if (!added)
+            sftw_cancel(&snort_timers, &retSsn->idle_timer);
 
         /* Zero everything out */
         memset(retSsn, 0, sizeof(Stream5LWSession));
 
         /* Save the session key for future use */
-        retSsn->key = hnode->key;
+        retSsn->key = (SessionKey *)sfohash_key(sessionCache->hashTable, retSsn);
 
         retSsn->protocol = key->protocol;
         retSsn->last_data_seen = timestamp;
+
+        sftw_init_timer(&retSsn->idle_timer, LWSessionIdleExpire, sessionCache);
+        sftw_schedule(&snort_timers, &retSsn->idle_timer,
+            (uint32_t)timestamp + sessionCache->timeoutNominal);
         retSsn->flowdata = mempool_alloc(&s5FlowMempool);
         flowdata = retSsn->flowdata->data;
         boInitStaticBITOP(&(flowdata->boFlowbits), getFlowbitSizeInBytes(),
@@ -1124,23 +1127,6 @@ Stream5SessionCache *InitLWSessionCache(int max_sessions,
                                         Stream5SessionCleanup cleanup_fcn)
 {
     Stream5SessionCache *sessionCache = NULL;
-    /* Rule of thumb, size should be 1.4 times max to avoid
-     * collisions.
-     */
-
-    int hashTableSize = max_sessions;
-//    int hashTableSize = sfxhash_calcrows((int) (max_sessions * 1.4));
-
-    /* Memory required for 1 node: LW Session + Session Key +
-     * Node + NodePtr.
-     */
-    //int maxSessionMem = max_sessions * (
-    //                        sizeof(Stream5LWSession) +
-    //                        sizeof(SFXHASH_NODE) +
-    //                        sizeof(SessionKey) +
-    //                        sizeof(SFXHASH_NODE *));
-    /* Memory required for table entries */
-    //int tableMem = (hashTableSize +1) * sizeof(SFXHASH_NODE*);
 
     sessionCache = SnortAlloc(sizeof(Stream5SessionCache));
     if (sessionCache)
@@ -1162,16 +1148,20 @@ Stream5SessionCache *InitLWSessionCache(int max_sessions,
         }
         sessionCache->cleanup_fcn = cleanup_fcn;
 
-        /* Okay, now create the table */
-        sessionCache->hashTable = sfxhash_new(
-            hashTableSize,
+        /* Okay, now create the table.  The session memory is reserved
+         * up front but only faulted in as sessions are first used. */
+        sessionCache->hashTable = sfohash_new(
+            max_sessions,
             sizeof(SessionKey),
-            sizeof(Stream5LWSession),
-            //maxSessionMem + tableMem, 0, NULL, NULL, 1);
-            0, 0, NULL, NULL, 1);
+            sizeof(Stream5LWSession));
+
+        if (!sessionCache->hashTable)
+        {
+            free(sessionCache);
+            return NULL;
+        }
 
-        sfxhash_set_max_nodes(sessionCache->hashTable, max_sessions);
-        sfxhash_set_keyops(sessionCache->hashTable, HashFunc, HashKeyCmp);
+        sfohash_set_keyops(sessionCache->hashTable, HashFunc, HashKeyCmp);
     }
 
     return sessionCache;
@@ -1180,7 +1170,7 @@ Stream5SessionCache *InitLWSessionCache(int max_sessions,
 void PrintLWSessionCache(Stream5SessionCache *sessionCache)
 {
     DEBUG_WRAP(DebugMessage(DEBUG_STREAM, "%lu sessions active\n",
-                            sfxhash_count(sessionCache->hashTable)););
+                            sfohash_count(sessionCache->hashTable)););
 }
 
 int
@@ -1244,56 +1234,5 @@ Stream5SetRuntimeConfiguration(
     return 0;
 }
 
-static void checkCacheFlowTimeout(uint32_t flowCount, time_t cur_time, Stream5SessionCache *cache)
-{
-    uint32_t flowRetiredCount = 0, flowExaminedCount = 0;
-    Stream5LWSession *lwssn;
-    SFXHASH_NODE *hnode, *hnode_next;
-
-    if (!cache)
-        return;
-
-    hnode_next = cache->nextTimeoutEvalNode;
-    while (flowRetiredCount < flowCount && flowExaminedCount < (2 * flowCount))
-    {
-        if (!(hnode = hnode_next) && !(hnode = sfxhash_lru_node(cache->hashTable)))
-            break;
-
-        lwssn = (Stream5LWSession *) hnode->data;
-        if ((time_t)(lwssn->last_data_seen + cache->timeoutNominal) > cur_time)
-           break;
-
-        hnode_next = hnode->gnext;
-        flowExaminedCount++;
-
-#ifdef ENABLE_HA
-        if (lwssn->ha_flags & HA_FLAG_STANDBY)
-            continue;
-#endif
-
-        DEBUG_WRAP(DebugMessage(DEBUG_STREAM, "retiring stale session\n"););
-        lwssn->ha_state.session_flags |= SSNFLAG_TIMEDOUT;
-
-        if ( !Stream5SetRuntimeConfiguration(lwssn, lwssn->protocol) )
-            DeleteLWSession(cache, lwssn, "stale/timeout");
-
-        flowRetiredCount++;
-    }
-
-    cache->nextTimeoutEvalNode = hnode_next;
-}
-
-extern Stream5SessionCache *tcp_lws_cache, *udp_lws_cache;
-
-/*get next flow from session cache. */
-void checkLWSessionTimeout(uint32_t flowCount, time_t cur_time)
-{
-    Active_Suspend();
-    checkCacheFlowTimeout(flowCount, cur_time, tcp_lws_cache);
-    checkCacheFlowTimeout(flowCount, cur_time, udp_lws_cache);
-    //icmp_lws_cache does not need cleaning
-    Active_Resume();
-
-}
 
 
@@ -22,7 +22,7 @@
 #ifndef SNORT_STREAM5_SESSION_H_
 #define SNORT_STREAM5_SESSION_H_
 
-#include "sfxhash.h"
+#include "sfohash.h"
 #include "stream5_common.h"
 #include "rules.h"
 #include "treenodes.h"
@@ -34,8 +34,7 @@ typedef void(*Stream5SessionCleanup)(Stream5LWSession *ssn);
 
 typedef struct _Stream5SessionCache
 {
-    SFXHASH *hashTable;
-    SFXHASH_NODE *nextTimeoutEvalNode;
+    SFOHASH *hashTable;
     uint32_t timeoutAggressive;
     uint32_t timeoutNominal;
     uint32_t max_sessions;
@@ -47,6 +47,7 @@
 
 #include <errno.h>
 #include <assert.h>
+#include <stddef.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -79,6 +80,7 @@
 #include "snort_stream5_session.h"
 #include "stream_expect.h"
 #include "stream5_paf.h"
+#include "stream5_segpool.h"
 #include "stream5_ha.h"
 
 #ifdef TARGET_BASED
@@ -531,8 +533,9 @@ static inline int CheckFlushPolicyOnAck(
     TcpDataBlock *, Packet *);
 static void Stream5SeglistAddNode(StreamTracker *, StreamSegment *,
                 StreamSegment *);
+static int Stream5SeglistUnlinkNode(StreamTracker*, StreamSegment*);
 static int Stream5SeglistDeleteNode(StreamTracker*, StreamSegment*);
-static int Stream5SeglistDeleteNodeTrim(StreamTracker*, StreamSegment*, uint32_t flush_seq);
+static int Stream5SeglistTrimNode(StreamTracker*, StreamSegment*, uint32_t flush_seq);
 static int AddStreamNode(StreamTracker *st, Packet *p,
                   TcpDataBlock*,
                   TcpSession *tcpssn,
@@ -2286,6 +2289,9 @@ void Stream5CleanTcp(void)
     DeleteLWSessionCache(tcp_lws_cache);
     tcp_lws_cache = NULL;
 
+    /* Return the pooled segments to the heap */
+    s5_seg_trim(0);
+
     /* Cleanup the rebuilt packet */
     if (s5_pkt)
     {
@@ -3502,39 +3508,86 @@ static inline void SetupTcpDataBlock(TcpDataBlock *tdb, Packet *p)
     return;
 }
 
+static inline unsigned SegmentSize (const StreamSegment *seg)
+{
+    unsigned size = sizeof(StreamSegment);
+
+    if ( seg->caplen > 0 )
+        size += seg->caplen - 1;  // seg contains 1st byte
+
+    return s5_seg_size(size);
+}
+
+/* Released segments are kept for reuse only while the segments in
+ * use plus the pool stay within the memcap; the rest go back to the
+ * heap. */
+static inline unsigned SegmentPoolRoom (void)
+{
+    uint32_t held;
+
+    if ( !s5_global_eval_config || s5_tcp_cleanup )
+        return 0;
+
+    held = mem_in_use + s5_seg_cached();
+
+    if ( held >= s5_global_eval_config->memcap )
+        return 0;
+
+    return s5_global_eval_config->memcap - held;
+}
+
 static void SegmentFree (StreamSegment *seg)
 {
-    unsigned dropped = sizeof(StreamSegment);
+    unsigned dropped = SegmentSize(seg);
 
     STREAM5_DEBUG_WRAP( DebugMessage(DEBUG_STREAM_STATE,
         "Dumping segment at seq %X, size %d, caplen %d\n",
         seg->seq, seg->size, seg->caplen););
 
-    if ( seg->caplen > 0 )
-        dropped += seg->caplen - 1;  // seg contains 1st byte
-
     mem_in_use -= dropped;
-    free(seg);
+    s5_seg_free(seg, dropped, SegmentPoolRoom() >= dropped);
     s5stats.tcp_streamsegs_released++;
 
     STREAM5_DEBUG_WRAP( DebugMessage(DEBUG_STREAM_STATE,
         "SegmentFree dropped %d bytes\n", dropped););
 }
 
+/* Frees a list of segments linked by next.  The whole list is
+ * uncharged first so the pool room is checked once for the batch. */
 static void DeleteSeglist(StreamSegment *listhead)
 {
     StreamSegment *idx = listhead;
     StreamSegment *dump_me;
+    unsigned room;
     int i = 0;
 
     STREAM5_DEBUG_WRAP( DebugMessage(DEBUG_STREAM_STATE,
                 "In DeleteSeglist\n"););
+
+    for ( ; idx; idx = idx->next )
+        mem_in_use -= SegmentSize(idx);
+
+    room = SegmentPoolRoom();
+    idx = listhead;
+
     while(idx)
     {
+        unsigned size;
+
         i++;
         dump_me = idx;
         idx = idx->next;
-        SegmentFree(dump_me);
+        size = SegmentSize(dump_me);
+
+        if ( room >= size )
+        {
+            s5_seg_free(dump_me, size, 1);
+            room -= size;
+        }
+        else
+            s5_seg_free(dump_me, size, 0);
+
+        s5stats.tcp_streamsegs_released++;
     }
 
     STREAM5_DEBUG_WRAP( DebugMessage(DEBUG_STREAM_STATE,
@@ -3579,6 +3632,7 @@ static inline int purge_to_seq(TcpSession *tcpssn, StreamTracker *st, uint32_t f
 {
     StreamSegment *ss = NULL;
     StreamSegment *dump_me = NULL;
+    StreamSegment *purged = NULL;
     int purged_bytes = 0;
     uint32_t last_ts = 0;
 
@@ -3611,12 +3665,21 @@ static inline int purge_to_seq(TcpSession *tcpssn, StreamTracker *st, uint32_t f
             {
                 last_ts = dump_me->ts;
             }
-            purged_bytes += Stream5SeglistDeleteNodeTrim(st, dump_me, flush_seq);
+            if ( Stream5SeglistTrimNode(st, dump_me, flush_seq) )
+                continue;
+
+            /* unlinked segments are freed together below */
+            purged_bytes += Stream5SeglistUnlinkNode(st, dump_me);
+            dump_me->next = purged;
+            purged = dump_me;
         }
         else
             break;
     }
 
+    if ( purged )
+        DeleteSeglist(purged);
+
     if ( SEQ_LT(st->seglist_base_seq, flush_seq) )
     {
         STREAM5_DEBUG_WRAP(DebugMessage(DEBUG_STREAM_STATE,
@@ -4842,7 +4905,7 @@ int Stream5ProcessTcp(Packet *p, Stream5LWSession *lwssn,
                 p->dp,
                 flagbuf,
                 ntohl(p->tcph->th_seq), ntohl(p->tcph->th_ack), p->dsize,
-                sfxhash_count(tcp_lws_cache->hashTable));
+                GetLWSessionCount(tcp_lws_cache));
             );
 
     PREPROC_PROFILE_START(s5TcpPerfStats);
@@ -5518,8 +5581,20 @@ static inline StreamSegment* SegmentAlloc (
     if ( caplen > 0 )
         size += caplen - 1;  // ss contains 1st byte
 
+    size = s5_seg_size(size);  // charge the whole block
     mem_in_use += size;
 
+    /* Blocks held for reuse count against the memcap too; give them
+     * back to the heap before any sessions are pruned for room. */
+    if ( !s5_seg_available(size) &&
+        (mem_in_use + s5_seg_cached() > s5_global_eval_config->memcap) )
+    {
+        if ( mem_in_use < s5_global_eval_config->memcap )
+            s5_seg_trim(s5_global_eval_config->memcap - mem_in_use);
+        else
+            s5_seg_trim(0);
+    }
+
     if ( mem_in_use > s5_global_eval_config->memcap )
     {
         pc.str_mem_faults++;
@@ -5541,7 +5616,8 @@ static inline StreamSegment* SegmentAlloc (
         }
     }
 
-    ss = SnortAlloc(size);
+    ss = s5_seg_alloc(size);
+    memset(ss, 0, offsetof(StreamSegment, pkt));
 
     ss->tv.tv_sec = tv->tv_sec;
     ss->tv.tv_usec = tv->tv_usec;
@@ -9080,7 +9156,9 @@ static void Stream5SeglistAddNode(StreamTracker *st, StreamSegment *prev,
 #endif
 }
 
-static int Stream5SeglistDeleteNode (StreamTracker* st, StreamSegment* seg)
+/* Takes seg off the list and fixes up the tracker; returns the bytes
+ * of captured data it held.  The caller frees seg. */
+static int Stream5SeglistUnlinkNode (StreamTracker* st, StreamSegment* seg)
 {
     int ret;
     assert(st && seg);
@@ -9113,13 +9191,21 @@ static int Stream5SeglistDeleteNode (StreamTracker* st, StreamSegment* seg)
     if ( st->seglist_next == seg )
         st->seglist_next = NULL;
 
-    SegmentFree(seg);
     st->seg_count--;
 
     return ret;
 }
 
-static int Stream5SeglistDeleteNodeTrim (
+static int Stream5SeglistDeleteNode (StreamTracker* st, StreamSegment* seg)
+{
+    int ret = Stream5SeglistUnlinkNode(st, seg);
+    SegmentFree(seg);
+    return ret;
+}
+
+/* Left-trims a segment that straddles flush_seq when paf is active;
+ * returns nonzero if seg was trimmed rather than fully flushed. */
+static int Stream5SeglistTrimNode (
     StreamTracker* st, StreamSegment* seg, uint32_t flush_seq)
 {
     assert(st && seg);
@@ -9139,10 +9225,10 @@ static int Stream5SeglistDeleteNodeTrim (
             seg->size -= (uint16_t)delta;
 
             st->seg_bytes_logical -= delta;
-            return 0;
+            return 1;
         }
     }
-    return Stream5SeglistDeleteNode(st, seg);
+    return 0;
 }
 
 void TcpUpdateDirection(Stream5LWSession *ssn, char dir,
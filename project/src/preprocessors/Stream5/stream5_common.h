@@ -29,6 +29,7 @@
 
 #include "sfutil/bitop_funcs.h"
 #include "sfutil/sfActionQueue.h"
+#include "sfutil/sftimerwheel.h"
 #include "parser/IpAddrSet.h"
 
 #include "stream_api.h"
@@ -172,6 +173,8 @@ typedef struct _Stream5LWSession
     long       last_data_seen;
     uint64_t   expire_time;
 
+    SFTW_TIMER idle_timer;  /* retires the session once it goes idle */
+
     tSfPolicyUserContextId config;
     tSfPolicyId policy_id;
 
@@ -502,11 +505,6 @@ static inline void Stream5SetHABit(Stream5LWSession *lwssn, unsigned int ha_func
 }
 #endif
 
-void checkLWSessionTimeout(
-        uint32_t flowCount,
-        time_t cur_time
-        );
-
 // shared stream state
 extern Stream5Stats s5stats;
 extern uint32_t firstPacketTime;
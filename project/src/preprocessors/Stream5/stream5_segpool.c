@@ -0,0 +1,171 @@
+/* $Id$ */
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+//--------------------------------------------------------------------
+// s5 tcp segment pool
+//
+// @file    stream5_segpool.c
+//--------------------------------------------------------------------
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "sf_types.h"
+#include "util.h"
+#include "stream5_segpool.h"
+
+//--------------------------------------------------------------------
+// private state
+//--------------------------------------------------------------------
+
+// a free block links to the next through its first bytes
+typedef struct _S5FreeSeg
+{
+    struct _S5FreeSeg* next;
+} S5FreeSeg;
+
+typedef struct
+{
+    S5FreeSeg* head;
+    unsigned count;
+} S5SegClass;
+
+static S5SegClass seg_class[S5_SEG_CLASSES];
+static unsigned seg_cached = 0;
+static S5SegPoolStats seg_stats;
+
+// free list index for a block of s5_seg_size() bytes
+static inline int s5_seg_class (unsigned size)
+{
+    unsigned s, b = S5_SEG_MIN_SHIFT;
+
+    if ( size <= (1 << S5_SEG_MIN_SHIFT) )
+        return 0;
+
+    if ( size > S5_SEG_MAX_SIZE )
+        return -1;
+
+    s = size - 1;
+
+    while ( (s >> b) > 1 )
+        b++;
+
+    return 4 * (b - S5_SEG_MIN_SHIFT) + (s >> (b - 2)) - 3;
+}
+
+//--------------------------------------------------------------------
+// public methods
+//--------------------------------------------------------------------
+
+void* s5_seg_alloc (unsigned size)
+{
+    int c = s5_seg_class(size);
+
+    seg_stats.allocs++;
+
+    if ( c >= 0 && seg_class[c].head )
+    {
+        S5FreeSeg* fs = seg_class[c].head;
+
+        seg_class[c].head = fs->next;
+        seg_class[c].count--;
+        seg_cached -= s5_seg_size(size);
+
+        seg_stats.reuses++;
+        return fs;
+    }
+    return SnortAlloc(s5_seg_size(size));
+}
+
+void s5_seg_free (void* pv, unsigned size, int keep)
+{
+    int c = s5_seg_class(size);
+
+    if ( c < 0 || !keep )
+    {
+        seg_stats.releases++;
+        free(pv);
+        return;
+    }
+    ((S5FreeSeg*)pv)->next = seg_class[c].head;
+    seg_class[c].head = (S5FreeSeg*)pv;
+    seg_class[c].count++;
+    seg_cached += s5_seg_size(size);
+}
+
+unsigned s5_seg_cached (void)
+{
+    return seg_cached;
+}
+
+int s5_seg_available (unsigned size)
+{
+    int c = s5_seg_class(size);
+    return ( c >= 0 && seg_class[c].head != NULL );
+}
+
+// block size of free list c
+static inline unsigned s5_seg_class_size (int c)
+{
+    unsigned b;
+
+    if ( !c )
+        return (1 << S5_SEG_MIN_SHIFT);
+
+    b = S5_SEG_MIN_SHIFT + (c + 3) / 4 - 1;
+    return (5 + (c - 1) % 4) << (b - 2);
+}
+
+// largest classes go first; they free the most for the fewest calls
+unsigned s5_seg_trim (unsigned keep)
+{
+    unsigned released = 0;
+    int c = S5_SEG_CLASSES - 1;
+
+    while ( seg_cached > keep && c >= 0 )
+    {
+        S5FreeSeg* fs = seg_class[c].head;
+
+        if ( !fs )
+        {
+            c--;
+            continue;
+        }
+        seg_class[c].head = fs->next;
+        seg_class[c].count--;
+        seg_cached -= s5_seg_class_size(c);
+        released += s5_seg_class_size(c);
+
+        seg_stats.releases++;
+        free(fs);
+    }
+    return released;
+}
+
+const S5SegPoolStats* s5_seg_stats (void)
+{
+    return &seg_stats;
+}
+
@@ -0,0 +1,96 @@
+/* $Id$ */
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+//--------------------------------------------------------------------
+// s5 tcp segment pool
+//
+// segments are rounded up to one of a set of size classes, 4 per
+// power of 2 so no more than 1/4 of a block is slack.  released
+// blocks are kept on a free list per class and handed out again
+// instead of going back to malloc.  blocks larger than the largest
+// class are not pooled.
+//
+// the pool only tracks the bytes held on its free lists; the caller
+// charges blocks in use against its memcap and decides whether a
+// released block is kept or returned to the heap.
+//
+// @file    stream5_segpool.h
+//--------------------------------------------------------------------
+
+#ifndef __STREAM5_SEGPOOL_H__
+#define __STREAM5_SEGPOOL_H__
+
+#include "sf_types.h"
+
+#define S5_SEG_MIN_SHIFT  7    // smallest class is 128 bytes
+#define S5_SEG_MAX_SHIFT  14   // largest class is 16K
+#define S5_SEG_MAX_SIZE   (1 << S5_SEG_MAX_SHIFT)
+#define S5_SEG_CLASSES    (4 * (S5_SEG_MAX_SHIFT - S5_SEG_MIN_SHIFT) + 1)
+
+typedef struct
+{
+    uint64_t allocs;     // blocks handed out
+    uint64_t reuses;     // ... of which came from a free list
+    uint64_t releases;   // blocks returned to the heap
+} S5SegPoolStats;
+
+// block size for a request of size bytes; this is what the caller
+// charges.  sizes above S5_SEG_MAX_SIZE are returned unchanged.
+static inline unsigned s5_seg_size (unsigned size)
+{
+    unsigned s, b = S5_SEG_MIN_SHIFT;
+
+    if ( size <= (1 << S5_SEG_MIN_SHIFT) )
+        return (1 << S5_SEG_MIN_SHIFT);
+
+    if ( size > S5_SEG_MAX_SIZE )
+        return size;
+
+    s = size - 1;
+
+    while ( (s >> b) > 1 )
+        b++;
+
+    // top 3 bits of s select the step within the power of 2
+    return ((s >> (b - 2)) + 1) << (b - 2);
+}
+
+// get a block of s5_seg_size(size) bytes; the contents are undefined
+void* s5_seg_alloc(unsigned size);
+
+// put a block back on its free list (keep != 0) or return it to the heap
+void s5_seg_free(void*, unsigned size, int keep);
+
+// bytes held on the free lists
+unsigned s5_seg_cached(void);
+
+// true if a block for this size can be had without growing the heap
+int s5_seg_available(unsigned size);
+
+// return free list blocks to the heap until no more than keep bytes
+// are cached; returns the number of bytes released
+unsigned s5_seg_trim(unsigned keep);
+
+const S5SegPoolStats* s5_seg_stats(void);
+
+#endif
+
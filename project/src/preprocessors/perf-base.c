@@ -63,6 +63,7 @@
 #include "stream_api.h"
 #include "sf_types.h"
 #include "snort_bounds.h"
+#include "perf-export.h"
 
 static void GetPktDropStats(SFBASE *, SFBASE_STATS *);
 static void DisplayBasePerfStatsConsole(SFBASE_STATS *, int);
@@ -368,6 +369,7 @@ void UpdateStreamReassStats(SFBASE *sfBase, int len)
 {
     sfBase->total_rebuilt_bytes += len;
     sfBase->total_rebuilt_packets++;
+    PerfExport_FlushBytes(len);
 }
 
 /**API to update stats for packets discarded due to
@@ -0,0 +1,412 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    perf-export.c
+//
+// There are two sets of histograms.  The packet thread updates the active
+// one through perf_export_packet, perf_export_flush and the hist pointer
+// of each profiled preprocessor.  At each sample the active set becomes
+// pending and the pointers are switched to the other set.  The writer
+// thread formats the pending set, clears it and gives it back.  If the
+// writer hasn't finished with the last one the packet thread just keeps
+// accumulating and the next record covers both intervals.
+//
+// Records are one JSON object per line:
+//
+// {"time":<end>,"start":<start>,"pid":<pid>,"worker":<id>,"merged":<n>,
+//  "packet_ns":{<hist>},"flush_bytes":{<hist>},
+//  "preproc_ns":{"<name>":{<hist>},...}}
+//
+// where <hist> is count, mean, max, p50, p90, p99, p999 and a sparse list
+// of [<bucket upper bound>, <count>] pairs.  Times are in nanoseconds.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "perf.h"
+#include "perf-export.h"
+#include "profiler.h"
+#include "snort.h"
+#include "util.h"
+#include "workers.h"
+
+ProfileHist* perf_export_packet = NULL;
+ProfileHist* perf_export_flush = NULL;
+
+#ifndef WIN32
+
+typedef struct _PerfExportSet
+{
+    time_t start;
+    time_t end;
+    unsigned merged;
+    ProfileHist packet;
+    ProfileHist flush;
+    ProfileHist* preproc;
+} PerfExportSet;
+
+typedef struct _PerfExportPreproc
+{
+    PreprocStats* stats;
+    const char* name;
+} PerfExportPreproc;
+
+static PerfExportSet sets[2];
+static PerfExportSet* active = NULL;
+static PerfExportSet* pending = NULL;
+
+static PerfExportPreproc* preprocs = NULL;
+static unsigned num_preprocs = 0;
+
+static FILE* export_fh = NULL;
+static pthread_t writer_id;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t export_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t export_idle = PTHREAD_COND_INITIALIZER;
+static int export_stop = 0;
+
+//-------------------------------------------------------------------------
+// packet thread
+//-------------------------------------------------------------------------
+
+static time_t PerfExportTime(SFPERF* sfPerf)
+{
+    if ( ScReadMode() )
+        return sfBase.time ? sfBase.time : sfPerf->sample_time;
+
+    return time(NULL);
+}
+
+static void PerfExportActivate(PerfExportSet* set)
+{
+    unsigned i;
+
+    perf_export_packet = set ? &set->packet : NULL;
+    perf_export_flush = set ? &set->flush : NULL;
+
+    for ( i = 0; i < num_preprocs; i++ )
+        preprocs[i].stats->hist = set ? set->preproc + i : NULL;
+}
+
+static void PerfExportGetPreprocs(void)
+{
+#ifdef PERF_PROFILING
+    PreprocStatsNode* node;
+    unsigned i = 0;
+
+    if ( !ScProfilePreprocs() )
+        return;
+
+    for ( node = GetPreprocStatsNodeList(); node; node = node->next )
+        num_preprocs++;
+
+    if ( !num_preprocs )
+        return;
+
+    preprocs = (PerfExportPreproc*)SnortAlloc(num_preprocs * sizeof(*preprocs));
+
+    for ( node = GetPreprocStatsNodeList(); node; node = node->next, i++ )
+    {
+        preprocs[i].stats = node->stats;
+        preprocs[i].name = node->name;
+    }
+#endif
+}
+
+static void* PerfExportWriter(void*);
+
+void PerfExport_Start(SFPERF* sfPerf)
+{
+    char file[PATH_MAX];
+    sigset_t mask, old_mask;
+    mode_t old_umask;
+    unsigned i;
+    int rval;
+
+    if ( active || (sfPerf->export_file == NULL) )
+        return;
+
+    // workers share the configured name so give each its own file
+    if ( Workers_IsWorker() )
+        SnortSnprintf(file, sizeof(file), "%s.%d", sfPerf->export_file, worker_id);
+    else
+        SnortSnprintf(file, sizeof(file), "%s", sfPerf->export_file);
+
+    // This file needs to be readable by everyone
+    old_umask = umask(022);
+    export_fh = fopen(file, "a");
+    umask(old_umask);
+
+    if ( export_fh == NULL )
+    {
+        ErrorMessage("Perfmonitor: Cannot open export file \"%s\": %s.\n",
+            file, strerror(errno));
+        return;
+    }
+
+    export_stop = 0;
+
+    // the writer must not handle any signals meant for the packet thread
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+    rval = pthread_create(&writer_id, NULL, PerfExportWriter, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if ( rval )
+    {
+        ErrorMessage("Perfmonitor: Could not start the export thread: %s.\n",
+            strerror(rval));
+        fclose(export_fh);
+        export_fh = NULL;
+        return;
+    }
+
+    // the writer only looks at these once there is something pending
+    PerfExportGetPreprocs();
+
+    for ( i = 0; i < 2; i++ )
+    {
+        memset(sets + i, 0, sizeof(sets[i]));
+
+        if ( num_preprocs )
+            sets[i].preproc = (ProfileHist*)SnortAlloc(num_preprocs * sizeof(ProfileHist));
+    }
+
+    active = sets;
+    active->start = sfPerf->sample_time;
+    PerfExportActivate(active);
+    LogMessage("Perfmonitor: exporting histograms to %s\n", file);
+}
+
+void PerfExport_Sample(SFPERF* sfPerf)
+{
+    time_t now;
+
+    if ( !active )
+        return;
+
+    now = PerfExportTime(sfPerf);
+
+    pthread_mutex_lock(&export_lock);
+
+    if ( pending )
+    {
+        // writer is behind; roll this interval into the next
+        active->merged++;
+        pthread_mutex_unlock(&export_lock);
+        return;
+    }
+    active->end = now;
+    pending = active;
+
+    active = (active == sets) ? sets + 1 : sets;
+    active->start = now;
+    PerfExportActivate(active);
+
+    pthread_cond_signal(&export_wake);
+    pthread_mutex_unlock(&export_lock);
+}
+
+void PerfExport_Stop(SFPERF* sfPerf)
+{
+    unsigned i;
+
+    if ( !active )
+        return;
+
+    pthread_mutex_lock(&export_lock);
+    while ( pending )
+        pthread_cond_wait(&export_idle, &export_lock);
+    pthread_mutex_unlock(&export_lock);
+
+    if ( active->packet.count || active->flush.count )
+        PerfExport_Sample(sfPerf);
+
+    pthread_mutex_lock(&export_lock);
+    export_stop = 1;
+    pthread_cond_signal(&export_wake);
+    pthread_mutex_unlock(&export_lock);
+
+    pthread_join(writer_id, NULL);
+
+    PerfExportActivate(NULL);
+    active = NULL;
+
+    for ( i = 0; i < 2; i++ )
+    {
+        if ( sets[i].preproc )
+            free(sets[i].preproc);
+        sets[i].preproc = NULL;
+    }
+    if ( preprocs )
+        free(preprocs);
+
+    preprocs = NULL;
+    num_preprocs = 0;
+
+    fclose(export_fh);
+    export_fh = NULL;
+}
+
+//-------------------------------------------------------------------------
+// writer thread
+//-------------------------------------------------------------------------
+
+static void PerfExportHist(
+    FILE* fh, const char* name, const ProfileHist* h, double scale)
+{
+    static const double pct[] = { 0.50, 0.90, 0.99, 0.999 };
+    static const char* pct_name[] = { "p50", "p90", "p99", "p999" };
+
+    uint64_t sum = 0;
+    unsigned b, p = 0;
+    int first = 1;
+
+    fprintf(fh, "\"%s\":{\"count\":" STDu64 ",\"mean\":%.0f,\"max\":%.0f",
+        name, h->count, h->count ? (h->sum * scale) / h->count : 0.0,
+        h->max * scale);
+
+    for ( b = 0; b < PROFILE_HIST_BUCKETS && p < 4; b++ )
+    {
+        sum += h->bucket[b];
+
+        while ( (p < 4) && sum && ((double)sum >= pct[p] * h->count) )
+        {
+            uint64_t v = ProfileHistValue(b);
+
+            if ( v > h->max )
+                v = h->max;
+
+            fprintf(fh, ",\"%s\":%.0f", pct_name[p++], v * scale);
+        }
+    }
+    for ( ; p < 4; p++ )
+        fprintf(fh, ",\"%s\":0", pct_name[p]);
+
+    fprintf(fh, ",\"hist\":[");
+
+    for ( b = 0; b < PROFILE_HIST_BUCKETS; b++ )
+    {
+        if ( !h->bucket[b] )
+            continue;
+
+        fprintf(fh, "%s[%.0f,%u]", first ? "" : ",",
+            ProfileHistValue(b) * scale, h->bucket[b]);
+        first = 0;
+    }
+    fprintf(fh, "]}");
+}
+
+static void PerfExportWrite(PerfExportSet* set, double tick_ns)
+{
+    unsigned i;
+    int first = 1;
+
+    fprintf(export_fh,
+        "{\"time\":%lu,\"start\":%lu,\"pid\":%u,\"worker\":%d,\"merged\":%u,",
+        (unsigned long)set->end, (unsigned long)set->start,
+        (unsigned)getpid(), worker_id, set->merged);
+
+    PerfExportHist(export_fh, "packet_ns", &set->packet, tick_ns);
+    fputc(',', export_fh);
+    PerfExportHist(export_fh, "flush_bytes", &set->flush, 1.0);
+    fprintf(export_fh, ",\"preproc_ns\":{");
+
+    for ( i = 0; i < num_preprocs; i++ )
+    {
+        if ( !set->preproc[i].count )
+            continue;
+
+        if ( !first )
+            fputc(',', export_fh);
+
+        PerfExportHist(export_fh, preprocs[i].name, set->preproc + i, tick_ns);
+        first = 0;
+    }
+    fprintf(export_fh, "}}\n");
+    fflush(export_fh);
+}
+
+static void PerfExportClear(PerfExportSet* set)
+{
+    memset(&set->packet, 0, sizeof(set->packet));
+    memset(&set->flush, 0, sizeof(set->flush));
+
+    if ( num_preprocs )
+        memset(set->preproc, 0, num_preprocs * sizeof(*set->preproc));
+
+    set->merged = 0;
+}
+
+static void* PerfExportWriter(void* arg)
+{
+    // calibrating takes a second so do it here rather than at startup
+    double ticks_per_usec = get_ticks_per_usec();
+    double tick_ns = (ticks_per_usec > 0.0) ? 1000.0 / ticks_per_usec : 0.0;
+
+    while ( 1 )
+    {
+        PerfExportSet* set;
+
+        pthread_mutex_lock(&export_lock);
+
+        while ( !pending && !export_stop )
+            pthread_cond_wait(&export_wake, &export_lock);
+
+        set = pending;
+        pthread_mutex_unlock(&export_lock);
+
+        if ( !set )
+            break;
+
+        PerfExportWrite(set, tick_ns);
+        PerfExportClear(set);
+
+        pthread_mutex_lock(&export_lock);
+        pending = NULL;
+        pthread_cond_broadcast(&export_idle);
+        pthread_mutex_unlock(&export_lock);
+    }
+    return NULL;
+}
+
+#else   /* WIN32 */
+
+void PerfExport_Start(SFPERF* sfPerf) { }
+void PerfExport_Sample(SFPERF* sfPerf) { }
+void PerfExport_Stop(SFPERF* sfPerf) { }
+
+#endif
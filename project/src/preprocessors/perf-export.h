@@ -0,0 +1,75 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    perf-export.h
+//
+// JSON lines export of latency and size histograms for perfmonitor.
+// The packet thread only ever updates the active set of histograms; at
+// each sample the set is handed to a writer thread and a clean one takes
+// its place so formatting and file i/o stay off the packet path.  In
+// worker mode each worker process has its own sets and its own file.
+
+#ifndef _PERF_EXPORT_H
+#define _PERF_EXPORT_H
+
+#include "sf_types.h"
+#include "profiler.h"
+#include "cpuclock.h"
+
+struct _SFPERF;
+
+// NULL unless exporting
+extern ProfileHist* perf_export_packet;   // ticks per packet
+extern ProfileHist* perf_export_flush;    // bytes per stream5 flush
+
+// start the writer on the first packet (after any fork)
+void PerfExport_Start(struct _SFPERF*);
+
+// hand the current interval to the writer; packet thread only
+void PerfExport_Sample(struct _SFPERF*);
+
+// write the last interval and join the writer
+void PerfExport_Stop(struct _SFPERF*);
+
+static inline void PerfExport_PacketStart(uint64_t* ticks)
+{
+    if ( perf_export_packet )
+        get_clockticks(*ticks);
+}
+
+static inline void PerfExport_PacketEnd(uint64_t ticks)
+{
+    if ( ticks && perf_export_packet )
+    {
+        uint64_t now = 0;
+        get_clockticks(now);
+        ProfileHistAdd(perf_export_packet, now - ticks);
+    }
+}
+
+static inline void PerfExport_FlushBytes(int len)
+{
+    if ( perf_export_flush && (len > 0) )
+        ProfileHistAdd(perf_export_flush, (uint64_t)len);
+}
+
+#endif
+
@@ -46,6 +46,7 @@
 
 #include "util.h"
 #include "perf.h"
+#include "perf-export.h"
 #include "sf_types.h"
 #include "decode.h"
 #include "snort.h"
@@ -507,6 +508,9 @@ void sfPerformanceStats(SFPERF *sfPerf, Packet *p)
                     InitEventStats(&sfEvent);
                 }
 
+                if (sfPerf->perf_flags & SFPERF_EXPORT)
+                    PerfExport_Sample(sfPerf);
+
                 SetSampleTime(sfPerf, p);
             }
         }
@@ -67,6 +67,7 @@
 #define SFPERF_FLOWIP           0x00000040
 #define SFPERF_TIME_COUNT       0x00000080
 #define SFPERF_MAX_BASE_STATS   0x00000100
+#define SFPERF_EXPORT           0x00000200
 
 #define SFPERF_SUMMARY_BASE     0x00001000
 #define SFPERF_SUMMARY_FLOW     0x00002000
@@ -96,6 +97,7 @@ typedef struct _SFPERF
     char *flowip_file;
     FILE *flowip_fh;
     uint32_t flowip_memcap;
+    char *export_file;
 } SFPERF;
 
 
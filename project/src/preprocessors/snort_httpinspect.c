@@ -4080,7 +4080,7 @@ void FreeHttpSessionData(void *data)
 #ifdef ZLIB
     if (hsd->decomp_state != NULL)
     {
-        inflateEnd(&(hsd->decomp_state->d_stream));
+        SFInflate_Free(hsd->decomp_state->inflater);
         mempool_free(hi_gzip_mempool, hsd->decomp_state->bkt);
     }
 #endif
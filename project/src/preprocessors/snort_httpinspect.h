@@ -32,7 +32,7 @@
 #include "util_jsnorm.h"
 
 #ifdef ZLIB
-#include <zlib.h>
+#include "sf_inflate.h"
 #endif
 
 extern MemPool *http_mempool;
@@ -73,10 +73,6 @@ extern DataBuffer HttpDecodeBuf;
 #define DEFAULT_COMP_DEPTH 1460
 #define DEFAULT_DECOMP_DEPTH 2920
 
-#define DEFLATE_RAW_WBITS -15
-#define DEFLATE_WBITS   15
-#define GZIP_WBITS      31
-
 
 typedef enum _HttpRespCompressType
 {
@@ -87,16 +83,14 @@ typedef enum _HttpRespCompressType
 
 typedef struct s_DECOMPRESS_STATE
 {
-    uint8_t inflate_init;
     int compr_bytes_read;
     int decompr_bytes_read;
     int compr_depth;
     int decompr_depth;
     uint16_t compress_fmt;
     uint8_t decompress_data;
-    z_stream d_stream;
+    SFInflate *inflater;    /* allocated at the first compressed data */
     MemBucket *bkt;
-    bool deflate_initialized;
 
 } DECOMPRESS_STATE;
 #endif
@@ -238,9 +232,9 @@ static inline void ResetGzipState(DECOMPRESS_STATE *ds)
     if (ds == NULL)
         return;
 
-    inflateEnd(&(ds->d_stream));
+    SFInflate_Free(ds->inflater);
 
-    ds->inflate_init = 0;
+    ds->inflater = NULL;
     ds->compr_bytes_read = 0;
     ds->decompr_bytes_read = 0;
     ds->compress_fmt = 0;
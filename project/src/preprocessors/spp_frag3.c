@@ -329,6 +329,8 @@ typedef struct _FragTracker
     tSfPolicyId policy_id;
     tSfPolicyUserContextId config;
 
+    SFTW_TIMER timer;   /* removes the tracker once it times out */
+
 } FragTracker;
 
 /* statistics tracking struct */
@@ -426,6 +428,7 @@ static int Frag3Prune(FragTracker *);
 static struct timeval *pkttime;    /* packet timestamp */
 static void Frag3DeleteFrag(Frag3Frag *);
 static void Frag3RemoveTracker(void *, void *);
+static void Frag3TrackerExpire(SFTW_TIMER *, uint32_t);
 static void Frag3DeleteTracker(FragTracker *);
 static int Frag3AutoFree(void *, void *);
 static int Frag3UserFree(void *, void *);
@@ -2494,6 +2497,10 @@ static int Frag3NewTracker(Packet *p, FRAGKEY *fkey, Frag3Context *f3context)
 
     tmp = (FragTracker *)hnode->data;
     memset(tmp, 0, sizeof(FragTracker));
+
+    sftw_init_timer(&tmp->timer, Frag3TrackerExpire, hnode);
+    sftw_schedule(&snort_timers, &tmp->timer,
+        (uint32_t)p->pkth->ts.tv_sec + f3context->frag_timeout + 1);
     
     /*
      * setup the frag tracker
@@ -4099,6 +4106,40 @@ static void Frag3RemoveTracker(void *key, void *data)
     return;
 }
 
+/**
+ * Timer wheel callback for a FragTracker.  A tracker is only checked
+ * for timeout when another fragment for it arrives or the cache is
+ * pruned, so this removes the ones whose fragments stop coming.  The
+ * timer is armed when the tracker is created and pushed out here if
+ * fragments have arrived since.
+ *
+ * @param t the tracker's timer, data is its sfxhash node
+ * @param now current time in seconds
+ *
+ * @return none
+ */
+static void Frag3TrackerExpire(SFTW_TIMER *t, uint32_t now)
+{
+    SFXHASH_NODE *hnode = (SFXHASH_NODE *)t->data;
+    FragTracker *ft = (FragTracker *)hnode->data;
+    uint32_t expires = (uint32_t)ft->frag_time.tv_sec +
+        ft->context->frag_timeout + 1;
+
+    if ((int32_t)(expires - now) > 0)
+    {
+        sftw_schedule(&snort_timers, t, expires);
+        return;
+    }
+
+    DEBUG_WRAP(DebugMessage(DEBUG_FRAG,
+                "[FRAG3] Removing timed out FragTracker\n"););
+
+    f3stats.timeouts++;
+    sfBase.iFragTimeouts++;
+
+    Frag3RemoveTracker(hnode->key, ft);
+}
+
 /**
  * This is the auto-node-release function that gets handed to the sfxhash table
  * at initialization.  Handles deletion of sfxhash table data members.
@@ -4125,6 +4166,7 @@ static int Frag3AutoFree(void *key, void *data)
     DEBUG_WRAP(DebugMessage(DEBUG_FRAG,
                 "Calling Frag3DeleteTracker()\n"););
 
+    sftw_cancel(&snort_timers, &ft->timer);
     Frag3DeleteTracker(ft);
 
     sfBase.iFragDeletes++;
@@ -4176,6 +4218,7 @@ static int Frag3UserFree(void *key, void *data)
     DEBUG_WRAP(DebugMessage(DEBUG_FRAG,
                 "Calling Frag3DeleteTracker()\n"););
 
+    sftw_cancel(&snort_timers, &ft->timer);
     Frag3DeleteTracker(ft);
 
     sfBase.iFragDeletes++;
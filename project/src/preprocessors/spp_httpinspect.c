@@ -280,6 +280,8 @@ static void HttpInspectDropStats(int exiting)
     LogMessage("    Self-referencing paths (\"./\"):        %-10I64u\n", hi_stats.self_ref);
 #ifdef ZLIB
     LogMessage("    HTTP Response Gzip packets extracted: %-10I64u\n", hi_stats.gzip_pkts);
+    LogMessage("    Gzip sessions over max_gzip_mem:      %-10I64u\n", hi_stats.gzip_no_state);
+    LogMessage("    Gzip sessions over decompress_memcap: %-10I64u\n", hi_stats.gzip_no_mem);
     if (hi_stats.gzip_pkts == 0)
     {
     LogMessage("    Gzip Compressed Data Processed:       %-10s\n", "n/a");
@@ -332,6 +334,8 @@ static void HttpInspectDropStats(int exiting)
     LogMessage("    Self-referencing paths (\"./\"):        "FMTu64("-10")"\n", hi_stats.self_ref);
 #ifdef ZLIB
     LogMessage("    HTTP Response Gzip packets extracted: "FMTu64("-10")"\n", hi_stats.gzip_pkts);
+    LogMessage("    Gzip sessions over max_gzip_mem:      "FMTu64("-10")"\n", hi_stats.gzip_no_state);
+    LogMessage("    Gzip sessions over decompress_memcap: "FMTu64("-10")"\n", hi_stats.gzip_no_mem);
     if (hi_stats.gzip_pkts == 0)
     {
     LogMessage("    Gzip Compressed Data Processed:       %-10s\n", "n/a");
@@ -779,6 +783,7 @@ static int HttpInspectVerifyPolicy(struct _SnortConfig *sc, tSfPolicyUserContext
 #endif
     updateConfigFromFileProcessing(pPolicyConfig);
     HttpInspectAddPortsOfInterest(sc, pPolicyConfig, policyId);
+    hi_ui_server_lookup_compile(pPolicyConfig->server_lookup);
     return 0;
 }
 
@@ -44,6 +44,7 @@
 #include "snort.h"
 #include "perf.h"
 #include "perf-base.h"
+#include "perf-export.h"
 #include "profiler.h"
 
 #ifndef WIN32
@@ -64,6 +65,7 @@
 #define PERFMON_ARG__FLOW_IP_FILE   "flow-ip-file"
 #define PERFMON_ARG__CONSOLE        "console"
 #define PERFMON_ARG__MAX_FILE_SIZE  "max_file_size"
+#define PERFMON_ARG__EXPORT         "export"
 
 // When to log
 #define PERFMON_ARG__TIME             "time"
@@ -421,6 +423,25 @@ static void ParsePerfMonitorArgs(struct _SnortConfig *sc, SFPERF *pconfig, char
 
             base_stats_file = ProcessFileOption(sc, toks[++i]);
         }
+        else if (strcasecmp(toks[i], PERFMON_ARG__EXPORT) == 0)
+        {
+#ifdef WIN32
+            ParseError("Perfmonitor:  \"%s\" is not supported on this "
+                    "platform.", PERFMON_ARG__EXPORT);
+#endif
+            if (pconfig->export_file != NULL)
+                free(pconfig->export_file);
+
+            // Requires a file name/path argument
+            if (i == (num_toks - 1))
+            {
+                ParseError("Perfmonitor:  Missing file name/path argument "
+                        "to \"%s\".", PERFMON_ARG__EXPORT);
+            }
+
+            pconfig->perf_flags |= SFPERF_EXPORT;
+            pconfig->export_file = ProcessFileOption(sc, toks[++i]);
+        }
         else if (strcasecmp(toks[i], PERFMON_ARG__MAX_FILE_SIZE) == 0)
         {
             uint32_t value = 0;
@@ -555,6 +576,8 @@ static void ParsePerfMonitorArgs(struct _SnortConfig *sc, SFPERF *pconfig, char
         LogMessage("    Flow IP File:     %s\n",
                 (pconfig->flowip_file != NULL) ? pconfig->flowip_file : "INACTIVE");
     }
+    LogMessage("  Export:           %s\n",
+            (pconfig->export_file != NULL) ? pconfig->export_file : "INACTIVE");
     LogMessage("  Console Mode:     %s\n",
             (pconfig->perf_flags & SFPERF_CONSOLE) ? "ACTIVE" : "INACTIVE");
 }
@@ -594,6 +617,9 @@ static void ProcessPerfMonitor(Packet *p, void *context)
 
         SetSampleTime(perfmon_config, p);
 
+        if (perfmon_config->perf_flags & SFPERF_EXPORT)
+            PerfExport_Start(perfmon_config);
+
         first = false;
     }
 
@@ -618,6 +644,8 @@ static void PerfMonitorCleanExit(int signal, void *foo)
     if (perfmon_config->perf_flags & SFPERF_SUMMARY)
         sfPerfStatsSummary(perfmon_config);
 
+    PerfExport_Stop(perfmon_config);
+
     /* Close the performance stats file */
     sfCloseBaseStatsFile(perfmon_config);
     sfCloseFlowStatsFile(perfmon_config);
@@ -645,6 +673,9 @@ static void PerfMonitorFreeConfig(SFPERF *config)
     if (config->flowip_file != NULL)
         free(config->flowip_file);
 
+    if (config->export_file != NULL)
+        free(config->export_file);
+
     free(config);
 }
 
@@ -868,6 +899,20 @@ static int PerfmonReloadVerify(struct _SnortConfig *sc, void *swap_config)
         return -1;
     }
 
+    if ((perfmon_config->export_file != NULL) && (perfmon_swap_config->export_file != NULL))
+    {
+        if (strcmp(perfmon_config->export_file, perfmon_swap_config->export_file) != 0)
+        {
+            ErrorMessage("Perfmonitor Reload: Changing the export file requires a restart.\n");
+            return -1;
+        }
+    }
+    else if (perfmon_config->export_file != perfmon_swap_config->export_file)
+    {
+        ErrorMessage("Perfmonitor Reload: Changing the export file requires a restart.\n");
+        return -1;
+    }
+
     return 0;
 }
 
@@ -50,6 +50,7 @@
 #include "spp_stream5.h"
 #include "stream_api.h"
 #include "stream5_paf.h"
+#include "stream5_segpool.h"
 #include "stream5_common.h"
 #include "snort_stream5_session.h"
 #include "snort_stream5_tcp.h"
@@ -1567,6 +1568,7 @@ static void Stream5PrintStats(int exiting)
     LogMessage("              TCP Overlaps: %u\n", s5stats.tcp_overlaps);
     LogMessage("       TCP Segments Queued: %u\n", s5stats.tcp_streamsegs_created);
     LogMessage("     TCP Segments Released: %u\n", s5stats.tcp_streamsegs_released);
+    LogMessage("       TCP Segments Reused: " STDu64 "\n", s5_seg_stats()->reuses);
     LogMessage("       TCP Rebuilt Packets: %u\n", s5stats.tcp_rebuilt_packets);
     LogMessage("         TCP Segments Used: %u\n", s5stats.tcp_rebuilt_seqs_used);
     LogMessage("              TCP Discards: %u\n", s5stats.tcp_discards);
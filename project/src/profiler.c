@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <unistd.h>
 
 #ifdef HAVE_CONFIG_H
@@ -46,6 +47,19 @@
 #include "sf_types.h"
 #include "sf_textlog.h"
 #include "detection_options.h"
+#include "sp_pcre.h"
+#include "packet_time.h"
+#include "sftimerwheel.h"
+#include "workers.h"
+
+#if defined(CONTROL_SOCKET) && !defined(WIN32)
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "sfcontrol.h"
+#include "sfcontrol_funcs.h"
+#endif
 
 #ifdef PERF_PROFILING
 
@@ -72,6 +86,17 @@ typedef struct _Preproc_WorstPerformer
     double pct_of_total;
 } Preproc_WorstPerformer;
 
+/* Where a report goes: the configured file, LogMessage() or, for a live
+ * report, a buffer that is sent back over the control socket */
+typedef struct _ProfileLog
+{
+    TextLog *log;
+    int live;
+    char *buf;
+    unsigned len;
+    unsigned size;
+} ProfileLog;
+
 
 /* Globals ********************************************************************/
 double ticks_per_microsec = 0.0;
@@ -82,6 +107,7 @@ PreprocStats totalPerfStats;
 PreprocStats metaPerfStats;
 static PreprocStatsNode * PreprocStatsNodeList = NULL;
 int max_layers = 0;
+ProfileLive profile_live;
 
 
 /* Externs ********************************************************************/
@@ -96,17 +122,16 @@ void getTicksPerMicrosec(void)
     }
 }
 
-void ResetRuleProfiling(void)
+static void ResetRuleStats(SnortConfig *sc)
 {
     /* Cycle through all Rules, print ticks & check count for each */
     RuleTreeNode *rtn;
     SFGHASH_NODE *hashNode;
     OptTreeNode *otn  = NULL;
     tSfPolicyId policyId = 0;
-    SnortConfig *sc = snort_conf;
 
-    if ((sc == NULL) || (sc->profile_rules.num == 0))
-        return;
+    /* The otn stats are summed from the option trees when printed */
+    detection_option_tree_reset_otn_stats(sc->detection_option_tree_hash_table);
 
     for (hashNode = sfghash_findfirst(sc->otn_map);
             hashNode;
@@ -139,169 +164,161 @@ void ResetRuleProfiling(void)
     }
 }
 
-void PrintWorstRules(int numToPrint)
+void ResetRuleProfiling(void)
 {
-    OptTreeNode *otn;
-    OTN_WorstPerformer *node, *tmp;
-    int num = 0;
-    TextLog *log = NULL;
-    time_t cur_time;
-    char fullname[STD_BUF];
-    int ret;
     SnortConfig *sc = snort_conf;
 
-    if (sc == NULL)
+    if ((sc == NULL) || (sc->profile_rules.num == 0))
         return;
 
-    getTicksPerMicrosec();
+    ResetRuleStats(sc);
+}
 
-    cur_time = time(NULL);
+static void ProfilePrint(ProfileLog *out, const char *format, ...)
+{
+    char line[STD_BUF];
+    va_list ap;
+    int len;
 
-    if (sc->profile_rules.filename != NULL)
-    {
-        if (sc->profile_rules.append)
-        {
-            log = TextLog_Init(sc->profile_rules.filename, 512*1024, 512*1024);
+    va_start(ap, format);
+    len = vsnprintf(line, sizeof(line), format, ap);
+    va_end(ap);
 
-            if (log != NULL)
-                TextLog_Print(log, "\ntimestamp: %u\n", cur_time);
-        }
-        else
-        {
-            ret = SnortSnprintf(fullname, STD_BUF, "%s.%u", sc->profile_rules.filename, (uint32_t)cur_time);
-            if(ret != SNORT_SNPRINTF_SUCCESS)
-                FatalError("profiler: file path+name too long\n");
-            log = TextLog_Init(fullname, 512*1024, 512*1024);
-        }
-    }
+    if (len < 0)
+        return;
 
-    if (numToPrint != -1)
+    if ((unsigned)len >= sizeof(line))
+        len = sizeof(line) - 1;
+
+    if (out->log)
     {
-        if(log)
-        {
-            TextLog_Print(log, "Rule Profile Statistics (worst %d rules)\n", numToPrint);
-        } else {
-            LogMessage("Rule Profile Statistics (worst %d rules)\n", numToPrint);
-        }
+        TextLog_Print(out->log, "%s", line);
     }
-    else
+    else if (out->live)
     {
-        if(log)
+        if (out->len + len + 1 > out->size)
         {
-            TextLog_Print(log, "Rule Profile Statistics (all rules)\n");
-        } else {
-            LogMessage("Rule Profile Statistics (all rules)\n");
+            unsigned size = out->size ? out->size : STD_BUF * 4;
+            char *buf;
+
+            while (out->len + len + 1 > size)
+                size *= 2;
+
+            buf = (char *)realloc(out->buf, size);
+
+            if (buf == NULL)
+                FatalError("profiler: unable to allocate %u bytes for a live report\n", size);
+
+            out->buf = buf;
+            out->size = size;
         }
+        memcpy(out->buf + out->len, line, len + 1);
+        out->len += len;
     }
-
-    if(log)
+    else
     {
-        TextLog_Print(log, "==========================================================\n");
-    } else {
-        LogMessage("==========================================================\n");
+        LogMessage("%s", line);
     }
+}
 
-    if (!worstPerformers)
-    {
-        if(log)
-        {
-            TextLog_Print(log, "No rules were profiled\n");
-            TextLog_Term(log);
-        } else {
-            LogMessage("No rules were profiled\n");
-        }
+static void ProfileLogOpen(ProfileLog *out, const ProfileConfig *config)
+{
+    time_t cur_time;
+    char fullname[STD_BUF];
+    int ret;
+
+    memset(out, 0, sizeof(*out));
+
+    if (config->filename == NULL)
         return;
-    }
 
-    if(log)
+    cur_time = time(NULL);
+
+    if (config->append)
     {
-        TextLog_Print(log,
-#ifdef PPM_MGR
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-#else
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-#endif
-             6, "Num",
-             9, "SID", 4, "GID", 4, "Rev",
-            11, "Checks",
-            10, "Matches",
-            10, "Alerts",
-            20, "Microsecs",
-            11, "Avg/Check",
-            11, "Avg/Match",
-            13, "Avg/Nonmatch"
-#ifdef PPM_MGR
-            , 11, "Disabled"
-#endif
-            );
+        out->log = TextLog_Init(config->filename, 512*1024, 512*1024);
+
+        if (out->log != NULL)
+            TextLog_Print(out->log, "\ntimestamp: %u\n", cur_time);
     }
     else
     {
-        LogMessage(
-#ifdef PPM_MGR
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-#else
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-#endif
-             6, "Num",
-             9, "SID", 4, "GID", 4, "Rev",
-            11, "Checks",
-            10, "Matches",
-            10, "Alerts",
-            20, "Microsecs",
-            11, "Avg/Check",
-            11, "Avg/Match",
-            13, "Avg/Nonmatch"
-#ifdef PPM_MGR
-            , 11, "Disabled"
-#endif
-            );
+        ret = SnortSnprintf(fullname, STD_BUF, "%s.%u", config->filename, (uint32_t)cur_time);
+        if(ret != SNORT_SNPRINTF_SUCCESS)
+            FatalError("profiler: file path+name too long\n");
+        out->log = TextLog_Init(fullname, 512*1024, 512*1024);
     }
+}
+
+static void ProfileLogClose(ProfileLog *out)
+{
+    if (out->log)
+        TextLog_Term(out->log);
+    out->log = NULL;
+}
 
-    if(log)
+static void PrintWorstRules(ProfileLog *out, int numToPrint)
+{
+    OptTreeNode *otn;
+    OTN_WorstPerformer *node, *tmp;
+    int num = 0;
+
+    getTicksPerMicrosec();
+
+    if (numToPrint != -1)
+        ProfilePrint(out, "Rule Profile Statistics (worst %d rules)\n", numToPrint);
+    else
+        ProfilePrint(out, "Rule Profile Statistics (all rules)\n");
+
+    ProfilePrint(out, "==========================================================\n");
+
+    if (!worstPerformers)
     {
-        TextLog_Print(log,
+        ProfilePrint(out, "No rules were profiled\n");
+        return;
+    }
+
+    ProfilePrint(out,
 #ifdef PPM_MGR
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
+        "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
 #else
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
+        "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
 #endif
-            6, "===",
-            9, "===", 4, "===", 4, "===",
-            11, "======",
-            10, "=======",
-            10, "======",
-            20, "=========",
-            11, "=========",
-            11, "=========",
-            13, "============"
+         6, "Num",
+         9, "SID", 4, "GID", 4, "Rev",
+        11, "Checks",
+        10, "Matches",
+        10, "Alerts",
+        20, "Microsecs",
+        11, "Avg/Check",
+        11, "Avg/Match",
+        13, "Avg/Nonmatch"
 #ifdef PPM_MGR
-            , 11, "========"
+        , 11, "Disabled"
 #endif
-            );
-    }
-    else
-    {
-        LogMessage(
+        , 6, "JIT"
+        );
+
+    ProfilePrint(out,
 #ifdef PPM_MGR
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
+        "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
 #else
-            "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
+        "%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
 #endif
-            6, "===",
-            9, "===", 4, "===", 4, "===",
-            11, "======",
-            10, "=======",
-            10, "======",
-            20, "=========",
-            11, "=========",
-            11, "=========",
-            13, "============"
+        6, "===",
+        9, "===", 4, "===", 4, "===",
+        11, "======",
+        10, "=======",
+        10, "======",
+        20, "=========",
+        11, "=========",
+        11, "=========",
+        13, "============"
 #ifdef PPM_MGR
-            , 11, "========"
+        , 11, "========"
 #endif
-            );
-    }
+        , 6, "==="
+        );
 
     for (node = worstPerformers, num=1;
          node && ((numToPrint < 0) ? 1 : (num <= numToPrint));
@@ -311,48 +328,25 @@ void PrintWorstRules(int numToPrint)
         //    break;
         otn = node->otn;
 
-        if(log)
-        {
-            TextLog_Print(log,
+        ProfilePrint(out,
 #ifdef PPM_MGR
-                "%*d%*d%*d%*d" FMTu64("*") FMTu64("*") FMTu64("*") FMTu64("*") "%*.1f%*.1f%*.1f" FMTu64("*") "\n",
+            "%*d%*d%*d%*d" FMTu64("*") FMTu64("*") FMTu64("*") FMTu64("*") "%*.1f%*.1f%*.1f" FMTu64("*") "%*s\n",
 #else
-                "%*d%*d%*d%*d" FMTu64("*") FMTu64("*") FMTu64("*") FMTu64("*") "%*.1f%*.1f%*.1f" "\n",
+            "%*d%*d%*d%*d" FMTu64("*") FMTu64("*") FMTu64("*") FMTu64("*") "%*.1f%*.1f%*.1f" "%*s\n",
 #endif
-                6, num, 9, otn->sigInfo.id, 4, otn->sigInfo.generator, 4, otn->sigInfo.rev,
-                11, otn->checks,
-                10, otn->matches,
-                10, otn->alerts,
-                20, (uint64_t)(otn->ticks/ticks_per_microsec),
-                11, node->ticks_per_check/ticks_per_microsec,
-                11, node->ticks_per_match/ticks_per_microsec,
-                13, node->ticks_per_nomatch/ticks_per_microsec
+            6, num, 9, otn->sigInfo.id, 4, otn->sigInfo.generator, 4, otn->sigInfo.rev,
+            11, otn->checks,
+            10, otn->matches,
+            10, otn->alerts,
+            20, (uint64_t)(otn->ticks/ticks_per_microsec),
+            11, node->ticks_per_check/ticks_per_microsec,
+            11, node->ticks_per_match/ticks_per_microsec,
+            13, node->ticks_per_nomatch/ticks_per_microsec
 #ifdef PPM_MGR
-                , 11, otn->ppm_disable_cnt
+            , 11, otn->ppm_disable_cnt
 #endif
-                );
-        }
-        else
-        {
-            LogMessage(
-#ifdef PPM_MGR
-                "%*d%*d%*d%*d" FMTu64("*") FMTu64("*") FMTu64("*") FMTu64("*") "%*.1f%*.1f%*.1f" FMTu64("*") "\n",
-#else
-                "%*d%*d%*d%*d" FMTu64("*") FMTu64("*") FMTu64("*") FMTu64("*") "%*.1f%*.1f%*.1f" "\n",
-#endif
-                6, num, 9, otn->sigInfo.id, 4, otn->sigInfo.generator, 4, otn->sigInfo.rev,
-                11, otn->checks,
-                10, otn->matches,
-                10, otn->alerts,
-                20, (uint64_t)(otn->ticks/ticks_per_microsec),
-                11, node->ticks_per_check/ticks_per_microsec,
-                11, node->ticks_per_match/ticks_per_microsec,
-                13, node->ticks_per_nomatch/ticks_per_microsec
-#ifdef PPM_MGR
-                , 11, otn->ppm_disable_cnt
-#endif
-                );
-        }
+            , 6, PcreRuleJitStatus(otn)
+            );
     }
 
     /* Do some cleanup */
@@ -363,22 +357,16 @@ void PrintWorstRules(int numToPrint)
         node = tmp;
     }
 
-    if(log)
-        TextLog_Term(log);
     worstPerformers = NULL;
 }
 
-void CollectRTNProfile(void)
+static void CollectRTNProfile(SnortConfig *sc, int sort)
 {
     OptTreeNode *otn;
     OTN_WorstPerformer *new, *node, *last = NULL;
     char got_position;
     SFGHASH_NODE *hashNode;
     tSfPolicyId policyId = 0;
-    SnortConfig *sc = snort_conf;
-
-    if (sc == NULL)
-        return;
 
     for (hashNode = sfghash_findfirst(sc->otn_map);
             hashNode;
@@ -424,7 +412,7 @@ void CollectRTNProfile(void)
                 for (node = worstPerformers; node && !got_position; node = node->next)
                 {
                     last = node;
-                    switch (sc->profile_rules.sort)
+                    switch (sort)
                     {
                         case PROFILE_SORT_CHECKS:
                             if (otn->checks >= node->otn->checks)
@@ -508,16 +496,19 @@ void ShowRuleProfiles(void)
 {
     /* Cycle through all Rules, print ticks & check count for each */
     SnortConfig *sc = snort_conf;
+    ProfileLog out;
 
     if ((sc == NULL) || (sc->profile_rules.num == 0))
         return;
 
     detection_option_tree_update_otn_stats(sc->detection_option_tree_hash_table);
 
-    CollectRTNProfile();
+    CollectRTNProfile(sc, sc->profile_rules.sort);
 
     /* Specifically call out a top xxx or something? */
-    PrintWorstRules(sc->profile_rules.num);
+    ProfileLogOpen(&out, &sc->profile_rules);
+    PrintWorstRules(&out, sc->profile_rules.num);
+    ProfileLogClose(&out);
     return;
 }
 
@@ -584,7 +575,7 @@ void FreePreprocPerformance(Preproc_WorstPerformer *idx)
     }
 }
 
-void PrintPreprocPerformance(TextLog *log, int num, Preproc_WorstPerformer *idx)
+static void PrintPreprocPerformance(ProfileLog *out, int num, Preproc_WorstPerformer *idx)
 {
     Preproc_WorstPerformer *child;
     int i;
@@ -594,60 +585,30 @@ void PrintPreprocPerformance(TextLog *log, int num, Preproc_WorstPerformer *idx)
     if (num != 0)
     {
         indent += 2;
-        if(log)
-        {
-            TextLog_Print(log, "%*d%*s%*d" FMTu64("*") FMTu64("*") FMTu64("*") "%*.2f%*.2f%*.2f\n",
-                   indent, num,
-                   28 - indent, idx->node->name, 6, idx->node->layer,
-                   11, idx->node->stats->checks,
-                   11, idx->node->stats->exits,
-                   20, (uint64_t)(idx->node->stats->ticks/ticks_per_microsec),
-                   11, idx->ticks_per_check/ticks_per_microsec,
-                   14, idx->pct_of_parent,
-                   13, idx->pct_of_total);
-        }
-        else
-        {
-            LogMessage("%*d%*s%*d" FMTu64("*") FMTu64("*") FMTu64("*") "%*.2f%*.2f%*.2f\n",
-        	                   indent, num,
-        	                   28 - indent, idx->node->name, 6, idx->node->layer,
-        	                   11, idx->node->stats->checks,
-        	                   11, idx->node->stats->exits,
-        	                   20, (uint64_t)(idx->node->stats->ticks/ticks_per_microsec),
-        	                   11, idx->ticks_per_check/ticks_per_microsec,
-        	                   14, idx->pct_of_parent,
-        	                   13, idx->pct_of_total);
-        }
+        ProfilePrint(out, "%*d%*s%*d" FMTu64("*") FMTu64("*") FMTu64("*") "%*.2f%*.2f%*.2f\n",
+               indent, num,
+               28 - indent, idx->node->name, 6, idx->node->layer,
+               11, idx->node->stats->checks,
+               11, idx->node->stats->exits,
+               20, (uint64_t)(idx->node->stats->ticks/ticks_per_microsec),
+               11, idx->ticks_per_check/ticks_per_microsec,
+               14, idx->pct_of_parent,
+               13, idx->pct_of_total);
     }
     else
     {
         /* The totals */
         indent += strlen(idx->node->name);
 
-        if(log)
-        {
-            TextLog_Print(log, "%*s%*s%*d" FMTu64("*") FMTu64("*") FMTu64("*") "%*.2f%*.2f%*.2f\n",
-                   indent, idx->node->name,
-                   28 - indent, idx->node->name, 6, idx->node->layer,
-                   11, idx->node->stats->checks,
-                   11, idx->node->stats->exits,
-                   20, (uint64_t)(idx->node->stats->ticks/ticks_per_microsec),
-                   11, idx->ticks_per_check/ticks_per_microsec,
-                   14, idx->pct_of_parent,
-                   13, idx->pct_of_parent);
-        }
-        else
-        {
-            LogMessage("%*s%*s%*d" FMTu64("*") FMTu64("*") FMTu64("*") "%*.2f%*.2f%*.2f\n",
-        	                   indent, idx->node->name,
-        	                   28 - indent, idx->node->name, 6, idx->node->layer,
-        	                   11, idx->node->stats->checks,
-        	                   11, idx->node->stats->exits,
-        	                   20, (uint64_t)(idx->node->stats->ticks/ticks_per_microsec),
-        	                   11, idx->ticks_per_check/ticks_per_microsec,
-        	                   14, idx->pct_of_parent,
-        	                   13, idx->pct_of_parent);
-        }
+        ProfilePrint(out, "%*s%*s%*d" FMTu64("*") FMTu64("*") FMTu64("*") "%*.2f%*.2f%*.2f\n",
+               indent, idx->node->name,
+               28 - indent, idx->node->name, 6, idx->node->layer,
+               11, idx->node->stats->checks,
+               11, idx->node->stats->exits,
+               20, (uint64_t)(idx->node->stats->ticks/ticks_per_microsec),
+               11, idx->ticks_per_check/ticks_per_microsec,
+               14, idx->pct_of_parent,
+               13, idx->pct_of_parent);
     }
 
     child = idx->children;
@@ -655,11 +616,16 @@ void PrintPreprocPerformance(TextLog *log, int num, Preproc_WorstPerformer *idx)
     i = 1;
     while (child)
     {
-        PrintPreprocPerformance(log, i++, child);
+        PrintPreprocPerformance(out, i++, child);
         child = child->next;
     }
 }
 
+PreprocStatsNode *GetPreprocStatsNodeList(void)
+{
+    return PreprocStatsNodeList;
+}
+
 void CleanupPreprocStatsNodeList(void)
 {
     PreprocStatsNode *node, *nxt;
@@ -691,139 +657,50 @@ void CleanupPreprocPerformance(Preproc_WorstPerformer *worst)
     }
 }
 
-void PrintWorstPreprocs(int numToPrint)
+static void PrintWorstPreprocs(ProfileLog *out, int numToPrint)
 {
     Preproc_WorstPerformer *idx;
     Preproc_WorstPerformer *total = NULL;
     int num = 0;
-    TextLog *log = NULL;
-    time_t cur_time;
-    char fullname[STD_BUF];
-    int ret;
-    SnortConfig *sc = snort_conf;
 
     getTicksPerMicrosec();
 
-    cur_time = time(NULL);
-    if (sc->profile_preprocs.filename != NULL)
-    {
-        if (sc->profile_preprocs.append)
-        {
-            log = TextLog_Init(sc->profile_preprocs.filename, 512*1024, 512*1024);
-
-            if (log != NULL)
-                TextLog_Print(log, "\ntimestamp: %u\n", cur_time);
-        }
-        else
-        {
-            ret = SnortSnprintf(fullname, STD_BUF, "%s.%u", sc->profile_preprocs.filename, (uint32_t)cur_time);
-            if(ret != SNORT_SNPRINTF_SUCCESS)
-                FatalError("profiler: file path+name too long\n");
-            log = TextLog_Init(fullname, 512*1024, 512*1024);
-        }
-    }
-
     if (numToPrint != -1)
-    {
-        if(log)
-        {
-            TextLog_Print(log, "Preprocessor Profile Statistics (worst %d)\n", numToPrint);
-        }
-        else
-        {
-            LogMessage("Preprocessor Profile Statistics (worst %d)\n", numToPrint);
-        }
-    }
+        ProfilePrint(out, "Preprocessor Profile Statistics (worst %d)\n", numToPrint);
     else
-    {
-        if(log)
-        {
-            TextLog_Print(log, "Preprocessor Profile Statistics (all)\n");
-        }
-        else
-        {
-            LogMessage("Preprocessor Profile Statistics (all)\n");
-        }
-    }
+        ProfilePrint(out, "Preprocessor Profile Statistics (all)\n");
 
-    if(log)
-    {
-        TextLog_Print(log, "==========================================================\n");
-    }
-    else
-    {
-        LogMessage("==========================================================\n");
-    }
+    ProfilePrint(out, "==========================================================\n");
 
     if (!worstPreprocPerformers)
     {
-        if(log)
-        {
-            TextLog_Print(log, "No Preprocessors were profiled\n");
-            TextLog_Term(log);
-        }
-        else
-        {
-            LogMessage("No Preprocessors were profiled\n");
-        }
+        ProfilePrint(out, "No Preprocessors were profiled\n");
         CleanupPreprocPerformance(worstPreprocPerformers);
         worstPreprocPerformers = NULL;
         return;
     }
 
-    if(log)
-    {
-        TextLog_Print(log, "%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-            4, "Num",
-            24, "Preprocessor",
-            6, "Layer",
-            11, "Checks",
-            11, "Exits",
-            20, "Microsecs",
-            11, "Avg/Check",
-            14, "Pct of Caller",
-            13, "Pct of Total");
-    }
-    else
-    {
-        LogMessage("%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-    	            4, "Num",
-    	            24, "Preprocessor",
-    	            6, "Layer",
-    	            11, "Checks",
-    	            11, "Exits",
-    	            20, "Microsecs",
-    	            11, "Avg/Check",
-    	            14, "Pct of Caller",
-    	            13, "Pct of Total");
-    }
-
-    if(log)
-    {
-        TextLog_Print(log, "%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-            4, "===",
-            24, "============",
-            6, "=====",
-            11, "======",
-            11, "=====",
-            20, "=========",
-            11, "=========",
-            14, "=============",
-            13, "============");
-    }
-    else
-    {
-        LogMessage("%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
-    	            4, "===",
-    	            24, "============",
-    	            6, "=====",
-    	            11, "======",
-    	            11, "=====",
-    	            20, "=========",
-    	            11, "=========",
-    	            14, "=============",
-    	            13, "============");
-    }
+    ProfilePrint(out, "%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
+        4, "Num",
+        24, "Preprocessor",
+        6, "Layer",
+        11, "Checks",
+        11, "Exits",
+        20, "Microsecs",
+        11, "Avg/Check",
+        14, "Pct of Caller",
+        13, "Pct of Total");
+
+    ProfilePrint(out, "%*s%*s%*s%*s%*s%*s%*s%*s%*s\n",
+        4, "===",
+        24, "============",
+        6, "=====",
+        11, "======",
+        11, "=====",
+        20, "=========",
+        11, "=========",
+        14, "=============",
+        13, "============");
 
     for (idx = worstPreprocPerformers, num=1;
          idx && ((numToPrint < 0) ? 1 : (num <= numToPrint));
@@ -838,7 +715,7 @@ void PrintWorstPreprocs(int numToPrint)
         }
         //if (!idx)
         //    break;
-        PrintPreprocPerformance(log, num, idx);
+        PrintPreprocPerformance(out, num, idx);
         //LogMessage("%*d%*s%*d%*d" FMTu64("*") "%*.1f%*.1f\n",
         //    6, num, 20, idx->node->name, 6, idx->node->layer,
         //    11, idx->node->stats->checks,
@@ -849,10 +726,8 @@ void PrintWorstPreprocs(int numToPrint)
         //    14, idx->pct_of_total);
     }
     if (total)
-        PrintPreprocPerformance(log, 0, total);
+        PrintPreprocPerformance(out, 0, total);
 
-    if(log)
-        TextLog_Term(log);
     CleanupPreprocPerformance(worstPreprocPerformers);
     worstPreprocPerformers = NULL;
 }
@@ -888,13 +763,9 @@ Preproc_WorstPerformer *findPerfParent(PreprocStatsNode *node,
     return NULL;
 }
 
-void ResetPreprocProfiling(void)
+static void ResetPreprocStats(void)
 {
     PreprocStatsNode *idx = NULL;
-    SnortConfig *sc = snort_conf;
-
-    if ((sc == NULL) || (sc->profile_preprocs.num == 0))
-        return;
 
     for (idx = PreprocStatsNodeList; idx != NULL; idx = idx->next)
     {
@@ -905,19 +776,24 @@ void ResetPreprocProfiling(void)
     }
 }
 
-void ShowPreprocProfiles(void)
+void ResetPreprocProfiling(void)
+{
+    SnortConfig *sc = snort_conf;
+
+    if ((sc == NULL) || (sc->profile_preprocs.num == 0))
+        return;
+
+    ResetPreprocStats();
+}
+
+static void CollectPreprocProfile(int sort)
 {
-    /* Cycle through all Rules, print ticks & check count for each */
     PreprocStatsNode *idx;
     int layer;
     Preproc_WorstPerformer *parent, *new, *this = NULL, *last = NULL;
     char got_position;
     Preproc_WorstPerformer *listhead;
     double ticks_per_check;
-    SnortConfig *sc = snort_conf;
-
-    if ((sc == NULL) || (sc->profile_preprocs.num == 0))
-        return;
 
     /* Adjust mpse stats to not include rule evaluation */
     mpsePerfStats.ticks -= rulePerfStats.ticks;
@@ -972,7 +848,7 @@ void ShowPreprocProfiles(void)
             for (this = listhead; this && !got_position; this = this->next)
             {
                 last = this;
-                switch (sc->profile_preprocs.sort)
+                switch (sort)
                 {
                     case PROFILE_SORT_CHECKS:
                         if (new->node->stats->checks >= this->node->stats->checks)
@@ -1038,8 +914,474 @@ void ShowPreprocProfiles(void)
             }
         }
     }
-    PrintWorstPreprocs(sc->profile_preprocs.num);
+}
+
+void ShowPreprocProfiles(void)
+{
+    /* Cycle through all Rules, print ticks & check count for each */
+    SnortConfig *sc = snort_conf;
+    ProfileLog out;
+
+    if ((sc == NULL) || (sc->profile_preprocs.num == 0))
+        return;
+
+    CollectPreprocProfile(sc->profile_preprocs.sort);
+
+    ProfileLogOpen(&out, &sc->profile_preprocs);
+    PrintWorstPreprocs(&out, sc->profile_preprocs.num);
+    ProfileLogClose(&out);
+
     CleanupPreprocStatsNodeList();
 }
 
+/* Live profiling ************************************************************
+ *
+ * snort_control <log dir> 4 "[seconds <n>] [rules <n>|all] [preprocs <n>|all]
+ *     [sort <sort_option>] [sample <n>]"
+ *
+ * The command is checked and the clock calibrated in the control socket
+ * thread.  The packet thread then resets the counters, turns on sampling
+ * and schedules a timer on snort_timers.  When that fires the packet
+ * thread turns sampling back off and formats the report into a buffer
+ * that the control socket thread is waiting to send back.  Nothing is
+ * measured unless a session is running.
+ */
+#if defined(CONTROL_SOCKET) && !defined(WIN32)
+
+#define PROFILE_LIVE_SECONDS   10
+#define PROFILE_LIVE_MAX_SECS  3600
+#define PROFILE_LIVE_NUM       10
+#define PROFILE_LIVE_GRACE     30       /* seconds to wait past the end */
+#define PROFILE_LIVE_CHUNK     4000     /* snort_control reads up to 4K */
+
+typedef struct _ProfileLiveSession
+{
+    unsigned seconds;
+    unsigned sample;
+    int rules;              /* number to print, -1 for all */
+    int preprocs;
+    int rule_sort;
+    int preproc_sort;
+
+    time_t start;
+    SFTW_TIMER timer;
+    ProfileLog out;
+
+    int started;            /* these are under live_mutex */
+    int done;
+    int abandoned;
+} ProfileLiveSession;
+
+static const struct
+{
+    const char *name;
+    int sort;
+    int preprocs;           /* also applies to preprocessors */
+} live_sorts[] =
+{
+    { "checks", PROFILE_SORT_CHECKS, 1 },
+    { "matches", PROFILE_SORT_MATCHES, 0 },
+    { "nomatches", PROFILE_SORT_NOMATCHES, 0 },
+    { "avg_ticks", PROFILE_SORT_AVG_TICKS, 1 },
+    { "avg_ticks_per_match", PROFILE_SORT_AVG_TICKS_PER_MATCH, 0 },
+    { "avg_ticks_per_nomatch", PROFILE_SORT_AVG_TICKS_PER_NOMATCH, 0 },
+    { "total_ticks", PROFILE_SORT_TOTAL_TICKS, 1 },
+    { NULL, 0, 0 }
+};
+
+static pthread_mutex_t live_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t live_cond = PTHREAD_COND_INITIALIZER;
+static ProfileLiveSession *live_session = NULL;
+
+static void ProfileLiveFree(ProfileLiveSession *s)
+{
+    if (s->out.buf)
+        free(s->out.buf);
+    free(s);
+}
+
+static int ProfileLiveNum(const char *arg, int *num)
+{
+    char *endptr;
+    long val;
+
+    if (strcasecmp(arg, "all") == 0)
+    {
+        *num = -1;
+        return 0;
+    }
+    errno = 0;
+    val = strtol(arg, &endptr, 10);
+
+    if (errno || (*endptr != '\0') || (val < 0) || (val > INT_MAX))
+        return -1;
+
+    *num = (int)val;
+    return 0;
+}
+
+static int ProfileLiveParse(ProfileLiveSession *s, char *args,
+    char *statusBuf, int statusBuf_len)
+{
+    char *opt, *arg, *save = NULL;
+    int i, num;
+
+    for (opt = strtok_r(args, " \t\n", &save); opt;
+         opt = strtok_r(NULL, " \t\n", &save))
+    {
+        arg = strtok_r(NULL, " \t\n", &save);
+
+        if (arg == NULL)
+        {
+            snprintf(statusBuf, statusBuf_len, "Live profile: %s needs an argument.", opt);
+            return -1;
+        }
+
+        if (strcasecmp(opt, "sort") == 0)
+        {
+            for (i = 0; live_sorts[i].name; i++)
+            {
+                if (strcasecmp(arg, live_sorts[i].name) == 0)
+                    break;
+            }
+            if (live_sorts[i].name == NULL)
+            {
+                snprintf(statusBuf, statusBuf_len, "Live profile: invalid sort option (%s).", arg);
+                return -1;
+            }
+            s->rule_sort = live_sorts[i].sort;
+
+            if (live_sorts[i].preprocs)
+                s->preproc_sort = live_sorts[i].sort;
+
+            continue;
+        }
+
+        if (ProfileLiveNum(arg, &num))
+        {
+            snprintf(statusBuf, statusBuf_len, "Live profile: invalid argument to %s (%s).", opt, arg);
+            return -1;
+        }
+
+        if (strcasecmp(opt, "rules") == 0)
+        {
+            s->rules = num;
+        }
+        else if (strcasecmp(opt, "preprocs") == 0)
+        {
+            s->preprocs = num;
+        }
+        else if (strcasecmp(opt, "seconds") == 0)
+        {
+            if ((num < 1) || (num > PROFILE_LIVE_MAX_SECS))
+            {
+                snprintf(statusBuf, statusBuf_len, "Live profile: seconds must be 1-%d.",
+                    PROFILE_LIVE_MAX_SECS);
+                return -1;
+            }
+            s->seconds = (unsigned)num;
+        }
+        else if (strcasecmp(opt, "sample") == 0)
+        {
+            if (num < 1)
+            {
+                snprintf(statusBuf, statusBuf_len, "Live profile: sample must be at least 1.");
+                return -1;
+            }
+            s->sample = (unsigned)num;
+        }
+        else
+        {
+            snprintf(statusBuf, statusBuf_len, "Live profile: invalid option (%s).", opt);
+            return -1;
+        }
+    }
+
+    if (!s->rules && !s->preprocs)
+    {
+        snprintf(statusBuf, statusBuf_len, "Live profile: nothing to profile.");
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs in the control socket thread */
+static int ProfileLivePre(uint16_t type, const uint8_t *data, uint32_t length,
+    void **new_context, char *statusBuf, int statusBuf_len)
+{
+    const CSMessageDataHeader *msg_hdr = (const CSMessageDataHeader *)data;
+    ProfileLiveSession *s;
+    char *args = NULL;
+
+    if (ScProfileRules() || ScProfilePreprocs())
+    {
+        snprintf(statusBuf, statusBuf_len,
+            "Live profile: profile_rules or profile_preprocs is configured.");
+        return -1;
+    }
+
+    if (Workers_IsDispatcher())
+    {
+        snprintf(statusBuf, statusBuf_len,
+            "Live profile: not available with worker processes.");
+        return -1;
+    }
+
+    if (length > sizeof(*msg_hdr))
+    {
+        length -= sizeof(*msg_hdr);
+
+        if (length != (uint32_t)ntohs(msg_hdr->length))
+            return -1;
+
+        if ((args = (char *)malloc(length + 1)) == NULL)
+            return -1;
+
+        memcpy(args, data + sizeof(*msg_hdr), length);
+        args[length] = '\0';
+    }
+
+    if ((s = (ProfileLiveSession *)calloc(1, sizeof(*s))) == NULL)
+    {
+        if (args)
+            free(args);
+        return -1;
+    }
+
+    s->seconds = PROFILE_LIVE_SECONDS;
+    s->sample = 1;
+    s->rules = PROFILE_LIVE_NUM;
+    s->preprocs = PROFILE_LIVE_NUM;
+    s->rule_sort = PROFILE_SORT_AVG_TICKS;
+    s->preproc_sort = PROFILE_SORT_AVG_TICKS;
+    s->out.live = 1;
+
+    if (args && ProfileLiveParse(s, args, statusBuf, statusBuf_len))
+    {
+        free(args);
+        ProfileLiveFree(s);
+        return -1;
+    }
+    if (args)
+        free(args);
+
+    pthread_mutex_lock(&live_mutex);
+
+    if (live_session)
+    {
+        pthread_mutex_unlock(&live_mutex);
+        snprintf(statusBuf, statusBuf_len,
+            "Live profile: a session is already running.");
+        ProfileLiveFree(s);
+        return -1;
+    }
+    live_session = s;
+    pthread_mutex_unlock(&live_mutex);
+
+    /* this takes a second so keep it off the packet thread */
+    getTicksPerMicrosec();
+
+    snprintf(statusBuf, statusBuf_len,
+        "Live profile: profiling 1 in %u packets for %u seconds.",
+        s->sample, s->seconds);
+
+    *new_context = s;
+    return 0;
+}
+
+/* Runs in the packet thread, from the timer or at exit */
+static void ProfileLiveStop(ProfileLiveSession *s)
+{
+    SnortConfig *sc = snort_conf;
+    ProfileLog *out = &s->out;
+
+    /* anything started on this packet still ends; the flags are left */
+    profile_live.rate = 0;
+
+    ProfilePrint(out, "Live profile over %u seconds, 1 in %u packets, "
+        STDu64 " packets profiled\n\n", (unsigned)(time(NULL) - s->start),
+        s->sample, profile_live.packets);
+
+    if (s->rules)
+    {
+        detection_option_tree_update_otn_stats(sc->detection_option_tree_hash_table);
+        CollectRTNProfile(sc, s->rule_sort);
+        PrintWorstRules(out, s->rules);
+    }
+
+    if (s->preprocs)
+    {
+        if (s->rules)
+            ProfilePrint(out, "\n");
+
+        CollectPreprocProfile(s->preproc_sort);
+        PrintWorstPreprocs(out, s->preprocs);
+    }
+
+    pthread_mutex_lock(&live_mutex);
+    s->done = 1;
+
+    if (s->abandoned)
+    {
+        live_session = NULL;
+        ProfileLiveFree(s);
+    }
+    else
+    {
+        pthread_cond_signal(&live_cond);
+    }
+    pthread_mutex_unlock(&live_mutex);
+}
+
+static void ProfileLiveExpire(SFTW_TIMER *t, uint32_t now)
+{
+    ProfileLiveStop((ProfileLiveSession *)t->data);
+}
+
+/* Runs in the packet thread */
+static int ProfileLiveStart(uint16_t type, void *new_context, void **old_context)
+{
+    ProfileLiveSession *s = (ProfileLiveSession *)new_context;
+    time_t now = ScReadMode() ? packet_time() : time(NULL);
+
+    if (s->rules)
+        ResetRuleStats(snort_conf);
+
+    if (s->preprocs)
+        ResetPreprocStats();
+
+    profile_live.what = (s->rules ? PROFILE_LIVE_RULES : 0) |
+        (s->preprocs ? PROFILE_LIVE_PREPROCS : 0);
+    profile_live.count = 0;
+    profile_live.packets = 0;
+    profile_live.rate = s->sample;
+
+    s->start = time(NULL);
+    sftw_init_timer(&s->timer, ProfileLiveExpire, s);
+    sftw_schedule(&snort_timers, &s->timer, (uint32_t)now + s->seconds);
+
+    pthread_mutex_lock(&live_mutex);
+    s->started = 1;
+    pthread_mutex_unlock(&live_mutex);
+
+    *old_context = s;
+    return 0;
+}
+
+static void ProfileLiveSend(ProfileLiveSession *s, struct _THREAD_ELEMENT *te,
+    ControlDataSendFunc f)
+{
+    char chunk[PROFILE_LIVE_CHUNK];
+    unsigned off = 0;
+
+    while (off < s->out.len)
+    {
+        unsigned len = s->out.len - off;
+
+        if (len > sizeof(chunk) - 1)
+        {
+            unsigned n;
+
+            /* break after a line if there is one */
+            len = sizeof(chunk) - 1;
+
+            for (n = len; n && (s->out.buf[off + n - 1] != '\n'); n--);
+
+            if (n)
+                len = n;
+        }
+        memcpy(chunk, s->out.buf + off, len);
+        chunk[len] = '\0';
+
+        if (f(te, (const uint8_t *)chunk, (uint16_t)(len + 1)))
+            break;
+
+        off += len;
+    }
+}
+
+/* Runs in the control socket thread */
+static void ProfileLiveReport(uint16_t type, void *old_context,
+    struct _THREAD_ELEMENT *te, ControlDataSendFunc f)
+{
+    static const char timed_out[] = "Live profile: no report; is snort processing packets?";
+    ProfileLiveSession *s = (ProfileLiveSession *)old_context;
+    struct timespec deadline;
+    struct timeval now;
+    int rval = 0;
+
+    if (s == NULL)
+        return;
+
+    pthread_mutex_lock(&live_mutex);
+
+    if (s->started)
+    {
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + s->seconds + PROFILE_LIVE_GRACE;
+        deadline.tv_nsec = now.tv_usec * 1000;
+
+        while (!s->done && (rval != ETIMEDOUT))
+            rval = pthread_cond_timedwait(&live_cond, &live_mutex, &deadline);
+
+        if (!s->done)
+        {
+            /* the packet thread frees it when the timer fires */
+            s->abandoned = 1;
+            pthread_mutex_unlock(&live_mutex);
+            f(te, (const uint8_t *)timed_out, sizeof(timed_out));
+            return;
+        }
+    }
+    live_session = NULL;
+    pthread_mutex_unlock(&live_mutex);
+
+    if (s->done)
+        ProfileLiveSend(s, te, f);
+
+    ProfileLiveFree(s);
+}
+
+void ProfileLiveInit(void)
+{
+    memset(&profile_live, 0, sizeof(profile_live));
+
+    if (ControlSocketRegisterHandler(CS_TYPE_PROFILE, &ProfileLivePre,
+        &ProfileLiveStart, &ProfileLiveReport))
+    {
+        LogMessage("Failed to register the live profile control handler.\n");
+    }
+}
+
+/* Called from the packet thread at exit so a waiting session gets what
+ * was collected before the control socket is shut down */
+void ProfileLiveTerm(void)
+{
+    ProfileLiveSession *s;
+    int running;
+
+    pthread_mutex_lock(&live_mutex);
+    s = live_session;
+    running = s && s->started && !s->done;
+    pthread_mutex_unlock(&live_mutex);
+
+    if (!running)
+        return;
+
+    sftw_cancel(&snort_timers, &s->timer);
+    ProfileLiveStop(s);
+}
+
+#else
+
+void ProfileLiveInit(void)
+{
+}
+
+void ProfileLiveTerm(void)
+{
+}
+
+#endif  /* CONTROL_SOCKET */
+
 #endif
@@ -23,6 +23,66 @@
 #ifndef __PROFILER_H__
 #define __PROFILER_H__
 
+#include "sf_types.h"
+
+/* Log-linear (HDR style) histogram of 64 bit values.  Values below
+ * PROFILE_HIST_SUB are counted exactly; above that each power of two is
+ * split into PROFILE_HIST_SUB buckets for a worst case relative error of
+ * 1 / PROFILE_HIST_SUB.  Adding a value is a handful of instructions so
+ * these can be updated on the packet path. */
+#define PROFILE_HIST_SUB_BITS 4
+#define PROFILE_HIST_SUB      (1 << PROFILE_HIST_SUB_BITS)
+#define PROFILE_HIST_BUCKETS  ((64 - PROFILE_HIST_SUB_BITS + 1) * PROFILE_HIST_SUB)
+
+typedef struct _ProfileHist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint32_t bucket[PROFILE_HIST_BUCKETS];
+} ProfileHist;
+
+static inline unsigned ProfileHistBucket(uint64_t v)
+{
+    unsigned e;
+
+    if ( v < PROFILE_HIST_SUB )
+        return (unsigned)v;
+
+#if defined(__GNUC__)
+    e = 63 - __builtin_clzll(v);
+#else
+    for ( e = PROFILE_HIST_SUB_BITS; (v >> e) > 1; e++ );
+#endif
+    return (e - PROFILE_HIST_SUB_BITS + 1) * PROFILE_HIST_SUB +
+        (unsigned)((v >> (e - PROFILE_HIST_SUB_BITS)) - PROFILE_HIST_SUB);
+}
+
+/* largest value counted in bucket b */
+static inline uint64_t ProfileHistValue(unsigned b)
+{
+    unsigned e;
+    uint64_t w;
+
+    if ( b < PROFILE_HIST_SUB )
+        return b;
+
+    e = b / PROFILE_HIST_SUB + PROFILE_HIST_SUB_BITS - 1;
+    w = (uint64_t)1 << (e - PROFILE_HIST_SUB_BITS);
+
+    return ((PROFILE_HIST_SUB + (uint64_t)(b % PROFILE_HIST_SUB)) * w) + (w - 1);
+}
+
+static inline void ProfileHistAdd(ProfileHist* h, uint64_t v)
+{
+    h->bucket[ProfileHistBucket(v)]++;
+    h->count++;
+    h->sum += v;
+
+    if ( v > h->max )
+        h->max = v;
+}
+
 #ifdef PERF_PROFILING
 
 #include "cpuclock.h"
@@ -50,8 +110,39 @@
     PROFILE_END_NAMED(node); \
     node_ticks_delta = node_ticks_end - node_ticks_start
 
+/* Live profiling over the control socket (see ProfileLiveInit).  While a
+ * session runs one packet in rate is profiled as if profile_rules and /
+ * or profile_preprocs were configured.  The per packet flags are only
+ * latched at the start of a packet so each start sees the same setting
+ * as its end. */
+#define PROFILE_LIVE_RULES    0x01
+#define PROFILE_LIVE_PREPROCS 0x02
+
+typedef struct _ProfileLive
+{
+    unsigned rate;      /* 0 unless a session is running */
+    unsigned count;
+    int what;           /* PROFILE_LIVE_* */
+    int rules;          /* profiling this packet */
+    int preprocs;
+    uint64_t packets;   /* profiled this session */
+} ProfileLive;
+
+extern ProfileLive profile_live;
+
+#define PROFILE_LIVE_PACKET_START \
+    if (profile_live.rate && (++profile_live.count >= profile_live.rate)) { \
+        profile_live.count = 0; \
+        profile_live.packets++; \
+        profile_live.rules = profile_live.what & PROFILE_LIVE_RULES; \
+        profile_live.preprocs = profile_live.what & PROFILE_LIVE_PREPROCS; \
+    }
+
+#define PROFILE_LIVE_PACKET_END \
+    profile_live.rules = profile_live.preprocs = 0
+
 #ifndef PROFILING_RULES
-#define PROFILING_RULES ScProfileRules()
+#define PROFILING_RULES (ScProfileRules() || profile_live.rules)
 #endif
 
 #define NODE_PROFILE_VARS uint64_t node_ticks_start, node_ticks_end, node_ticks_delta, node_deltas = 0
@@ -90,7 +181,7 @@
 #define OTN_PROFILE_ALERT(otn) otn->alerts++;
 
 #ifndef PROFILING_PREPROCS
-#define PROFILING_PREPROCS ScProfilePreprocs()
+#define PROFILING_PREPROCS (ScProfilePreprocs() || profile_live.preprocs)
 #endif
 
 #define PREPROC_PROFILE_START_NAMED(name, ppstat) \
@@ -98,6 +189,7 @@
         ppstat.checks++; \
         PROFILE_START_NAMED(name); \
         ppstat.ticks_start = name##_ticks_start; \
+        ppstat.ticks_entry = ppstat.ticks; \
     }
 #define PREPROC_PROFILE_START(ppstat) PREPROC_PROFILE_START_NAMED(snort, ppstat)
 
@@ -120,6 +212,8 @@
         PROFILE_END_NAMED(name); \
         ppstat.exits++; \
         ppstat.ticks += name##_ticks_end - ppstat.ticks_start; \
+        if (ppstat.hist) \
+            ProfileHistAdd(ppstat.hist, ppstat.ticks - ppstat.ticks_entry); \
     }
 #define PREPROC_PROFILE_END(ppstat) PREPROC_PROFILE_END_NAMED(snort, ppstat)
 
@@ -146,6 +240,8 @@ typedef struct _PreprocStats
     uint64_t ticks, ticks_start;
     uint64_t checks;
     uint64_t exits;
+    uint64_t ticks_entry;   /* ticks at start; for hist */
+    ProfileHist *hist;      /* ticks per call if perfmonitor is exporting */
 } PreprocStats;
 
 typedef struct _PreprocStatsNode
@@ -171,8 +267,13 @@ void ShowPreprocProfiles(void);
 void ResetRuleProfiling(void);
 void ResetPreprocProfiling(void);
 void CleanupPreprocStatsNodeList(void);
+PreprocStatsNode *GetPreprocStatsNodeList(void);
+void ProfileLiveInit(void);
+void ProfileLiveTerm(void);
 extern PreprocStats totalPerfStats;
 #else
+#define PROFILE_LIVE_PACKET_START
+#define PROFILE_LIVE_PACKET_END
 #define PROFILE_VARS
 #define PROFILE_VARS_NAMED(name)
 #define NODE_PROFILE_VARS
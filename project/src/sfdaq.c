@@ -34,6 +34,7 @@
 #include "util.h"
 #include "sfutil/strvec.h"
 #include "sfcontrol_funcs.h"
+#include "workers.h"
 
 #define PKT_SNAPLEN  1514
 
@@ -376,6 +377,19 @@ int DAQ_SetFilter(const char* bpf)
 
 //--------------------------------------------------------------------
 
+// a worker with its own instance gets its id in place of the first %d
+// of the interface and daq_var values, eg -i eth%d or a queue number
+static const char* DAQ_Expand (const char* s, char* buf, size_t n)
+{
+    const char* p;
+
+    if ( !s || !Workers_IsWorker() || !(p = strstr(s, "%d")) )
+        return s;
+
+    SnortSnprintf(buf, n, "%.*s%d%s", (int)(p - s), s, worker_id, p + 2);
+    return buf;
+}
+
 static void DAQ_LoadVars (DAQ_Config_t* cfg, const SnortConfig* sc)
 {
     unsigned i = 0;
@@ -384,6 +398,7 @@ static void DAQ_LoadVars (DAQ_Config_t* cfg, const SnortConfig* sc)
     {
         char* key = StringVector_Get(sc->daq_vars, i++);
         char* val = NULL;
+        char buf[256];
 
         if ( !key )
             break;
@@ -393,7 +408,7 @@ static void DAQ_LoadVars (DAQ_Config_t* cfg, const SnortConfig* sc)
         if ( val )
             *val++ = '\0';
 
-        daq_config_set_value(cfg, key, val);
+        daq_config_set_value(cfg, key, DAQ_Expand(val, buf, sizeof(buf)));
 
         if ( val )
             *--val = '=';
@@ -425,6 +440,7 @@ static int DAQ_Config (DAQ_Config_t* cfg)
 int DAQ_New (const SnortConfig* sc, const char* intf)
 {
     DAQ_Config_t cfg;
+    char spec[256];
 
     if ( !daq_mod )
         FatalError("DAQ_Init not called!\n");
@@ -433,6 +449,12 @@ int DAQ_New (const SnortConfig* sc, const char* intf)
         interface_spec = SnortStrdup(intf);
     intf = DAQ_GetInterfaceSpec();
 
+    // each worker calls this again after the fork
+    if ( Workers_IsSupervisor() )
+        return 0;
+
+    intf = DAQ_Expand(intf, spec, sizeof(spec));
+
     memset(&cfg, 0, sizeof(cfg));
     cfg.name = (char*)intf;
     cfg.snaplen = snap;
@@ -470,6 +492,10 @@ int DAQ_New (const SnortConfig* sc, const char* intf)
 
 int DAQ_Delete(void)
 {
+    // the daq instance belongs to the dispatcher
+    if ( Workers_IsRingWorker() )
+        daq_hand = NULL;
+
     if ( daq_hand )
     {
         DAQ_Accumulate();
@@ -504,7 +530,7 @@ int DAQ_WasStarted (void)
 {
     DAQ_State s;
 
-    if ( !daq_mod || !daq_hand )
+    if ( !daq_mod || !daq_hand || Workers_IsRingWorker() )
         return 0;
 
     s = daq_check_status(daq_mod, daq_hand);
@@ -535,11 +561,23 @@ void DAQ_Set_MetaCallback(DAQ_Meta_Func_t meta_callback)
 
 int DAQ_Acquire (int max, DAQ_Analysis_Func_t callback, uint8_t* user)
 {
+    int err;
+
+    // workers get their packets from the dispatcher instead
+    if ( Workers_IsRingWorker() )
+        err = Workers_Acquire(max, callback, user);
+
+    else if ( Workers_IsSupervisor() )
+        err = Workers_Supervise();
+
+    else
+    {
 #if HAVE_DAQ_ACQUIRE_WITH_META
-    int err = daq_acquire_with_meta(daq_mod, daq_hand, max, callback, daq_meta_callback, user);
+        err = daq_acquire_with_meta(daq_mod, daq_hand, max, callback, daq_meta_callback, user);
 #else
-    int err = daq_acquire(daq_mod, daq_hand, max, callback, user);
+        err = daq_acquire(daq_mod, daq_hand, max, callback, user);
 #endif
+    }
 
     if ( err && err != DAQ_READFILE_EOF )
         LogMessage("Can't acquire (%d) - %s!\n",
@@ -567,6 +605,12 @@ int DAQ_Inject(const DAQ_PktHdr_t* h, int rev, const uint8_t* buf, uint32_t len)
 int DAQ_BreakLoop (int error)
 {
     s_error = error;
+
+    if ( Workers_IsRingWorker() || Workers_IsSupervisor() )
+    {
+        Workers_BreakLoop();
+        return 1;
+    }
     return ( daq_breakloop(daq_mod, daq_hand) == DAQ_SUCCESS );
 }
 
@@ -592,6 +636,9 @@ const DAQ_Stats_t* DAQ_GetStats (void)
 {
     int err = 0;
 
+    if ( Workers_IsRingWorker() || Workers_IsSupervisor() )
+        return Workers_GetStats();
+
     if ( !daq_hand && !ScPcapReset() )
         return &tot_stats;
 
@@ -611,6 +658,9 @@ const DAQ_Stats_t* DAQ_GetStats (void)
         daq_stats.hw_packets_received =
             daq_stats.packets_received + daq_stats.packets_filtered;
 
+    if ( Workers_IsWorker() )
+        Workers_SetStats(&daq_stats);
+
     return &daq_stats;
 }
 
@@ -0,0 +1,379 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    ac_prefilter.c
+//
+// For each of the 3 prefix positions there is a pair of 16 byte tables
+// indexed by the low and high nibble of the input byte.  Each table
+// entry is a bit mask of the buckets that accept a byte with that nibble
+// so a position is a candidate if
+//
+//   AND over pos of (lo[pos][b[pos] & 0xf] & hi[pos][b[pos] >> 4]) != 0
+//
+// which is 2 pshufb per position for 16 (ssse3) or 32 (avx2) positions.
+// The kernels are compiled with function level target attributes and
+// selected at runtime so the same binary runs on older cpus.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ac_prefilter.h"
+#include "util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define AC_PREFILTER_SIMD
+#include <immintrin.h>
+#endif
+
+#define PF_WIDTH    3
+#define PF_BUCKETS  8
+
+// the expected fraction of candidate positions above which the dfa alone
+// is faster.  payloads are mostly text so the estimate assumes printable
+// ascii rather than uniform bytes, which would make nearly any filter
+// look selective.
+#define PF_MAX_PASS 0.10
+#define PF_TEXT_LO  0x20
+#define PF_TEXT_HI  0x7e
+
+typedef const uint8_t* (*SkipFunc)(const AcPrefilter*, const uint8_t*, const uint8_t*);
+
+struct _AcPrefilter
+{
+    uint8_t lo[PF_WIDTH][16] __attribute__((aligned(16)));
+    uint8_t hi[PF_WIDTH][16] __attribute__((aligned(16)));
+
+    SkipFunc skip;
+
+    // build time only
+    uint32_t* prefix;
+    unsigned num;
+    unsigned max;
+};
+
+//-------------------------------------------------------------------------
+// kernels
+//-------------------------------------------------------------------------
+
+static inline unsigned Test(const AcPrefilter* pf, const uint8_t* p)
+{
+    unsigned m = pf->lo[0][p[0] & 0xf] & pf->hi[0][p[0] >> 4];
+    m &= pf->lo[1][p[1] & 0xf] & pf->hi[1][p[1] >> 4];
+    m &= pf->lo[2][p[2] & 0xf] & pf->hi[2][p[2] >> 4];
+    return m;
+}
+
+static const uint8_t* SkipTail(
+    const AcPrefilter* pf, const uint8_t* T, const uint8_t* end)
+{
+    while ( T + PF_WIDTH <= end )
+    {
+        if ( Test(pf, T) )
+            return T;
+        T++;
+    }
+    return T;
+}
+
+#ifdef AC_PREFILTER_SIMD
+
+#define PF_MATCH_128(v, lo, hi) \
+    _mm_and_si128( \
+        _mm_shuffle_epi8(lo, _mm_and_si128(v, nib)), \
+        _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nib)))
+
+__attribute__((target("ssse3")))
+static const uint8_t* SkipSsse3(
+    const AcPrefilter* pf, const uint8_t* T, const uint8_t* end)
+{
+    const __m128i nib = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    const __m128i lo0 = _mm_load_si128((const __m128i*)pf->lo[0]);
+    const __m128i hi0 = _mm_load_si128((const __m128i*)pf->hi[0]);
+    const __m128i lo1 = _mm_load_si128((const __m128i*)pf->lo[1]);
+    const __m128i hi1 = _mm_load_si128((const __m128i*)pf->hi[1]);
+    const __m128i lo2 = _mm_load_si128((const __m128i*)pf->lo[2]);
+    const __m128i hi2 = _mm_load_si128((const __m128i*)pf->hi[2]);
+
+    while ( T + 16 + PF_WIDTH - 1 <= end )
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)T);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(T + 1));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(T + 2));
+
+        __m128i m = PF_MATCH_128(v0, lo0, hi0);
+        m = _mm_and_si128(m, PF_MATCH_128(v1, lo1, hi1));
+        m = _mm_and_si128(m, PF_MATCH_128(v2, lo2, hi2));
+
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) & 0xffff;
+
+        if ( mask )
+            return T + __builtin_ctz(mask);
+
+        T += 16;
+    }
+    return SkipTail(pf, T, end);
+}
+
+#define PF_MATCH_256(v, lo, hi) \
+    _mm256_and_si256( \
+        _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nib)), \
+        _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)))
+
+__attribute__((target("avx2")))
+static const uint8_t* SkipAvx2(
+    const AcPrefilter* pf, const uint8_t* T, const uint8_t* end)
+{
+    const __m256i nib = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    // vpshufb works within 128 bit lanes so both lanes get the table
+    const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)pf->lo[0]));
+    const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)pf->hi[0]));
+    const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)pf->lo[1]));
+    const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)pf->hi[1]));
+    const __m256i lo2 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)pf->lo[2]));
+    const __m256i hi2 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)pf->hi[2]));
+
+    while ( T + 32 + PF_WIDTH - 1 <= end )
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)T);
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(T + 1));
+        __m256i v2 = _mm256_loadu_si256((const __m256i*)(T + 2));
+
+        __m256i m = PF_MATCH_256(v0, lo0, hi0);
+        m = _mm256_and_si256(m, PF_MATCH_256(v1, lo1, hi1));
+        m = _mm256_and_si256(m, PF_MATCH_256(v2, lo2, hi2));
+
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(m, zero));
+
+        if ( mask )
+            return T + __builtin_ctz(mask);
+
+        T += 32;
+    }
+    return SkipSsse3(pf, T, end);
+}
+
+static SkipFunc SelectKernel(const char** name)
+{
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports("avx2") )
+    {
+        *name = "avx2";
+        return SkipAvx2;
+    }
+    if ( __builtin_cpu_supports("ssse3") )
+    {
+        *name = "ssse3";
+        return SkipSsse3;
+    }
+    *name = "none";
+    return NULL;
+}
+
+#else
+
+static SkipFunc SelectKernel(const char** name)
+{
+    *name = "none";
+    return NULL;
+}
+
+#endif
+
+//-------------------------------------------------------------------------
+// build
+//-------------------------------------------------------------------------
+
+static const char* s_kernel = NULL;
+static SkipFunc s_skip = NULL;
+
+const char* acPrefilterKernel(void)
+{
+    if ( !s_kernel )
+        s_skip = SelectKernel(&s_kernel);
+
+    return s_kernel;
+}
+
+AcPrefilter* acPrefilterNew(void)
+{
+    AcPrefilter* pf;
+
+    acPrefilterKernel();
+
+    if ( !s_skip )
+        return NULL;
+
+    pf = (AcPrefilter*)SnortAlloc(sizeof(*pf));
+    pf->skip = s_skip;
+    return pf;
+}
+
+void acPrefilterFree(AcPrefilter* pf)
+{
+    if ( pf->prefix )
+        free(pf->prefix);
+
+    free(pf);
+}
+
+// prefix is packed as length and up to 3 bytes so that sorting groups
+// prefixes with the same leading bytes into the same bucket
+void acPrefilterAddPattern(AcPrefilter* pf, const uint8_t* pat, int n)
+{
+    uint32_t p = 0;
+    int i;
+
+    if ( n <= 0 )
+        return;
+
+    if ( n > PF_WIDTH )
+        n = PF_WIDTH;
+
+    for ( i = 0; i < PF_WIDTH; i++ )
+        p = (p << 8) | (i < n ? pat[i] : 0);
+
+    p |= (uint32_t)n << 24;
+
+    if ( pf->num == pf->max )
+    {
+        unsigned max = pf->max ? 2 * pf->max : 256;
+        uint32_t* tmp = (uint32_t*)SnortAlloc(max * sizeof(*tmp));
+
+        if ( pf->prefix )
+        {
+            memcpy(tmp, pf->prefix, pf->num * sizeof(*tmp));
+            free(pf->prefix);
+        }
+        pf->prefix = tmp;
+        pf->max = max;
+    }
+    pf->prefix[pf->num++] = p;
+}
+
+static int PrefixCmp(const void* pa, const void* pb)
+{
+    uint32_t a = *(const uint32_t*)pa & 0xffffff;
+    uint32_t b = *(const uint32_t*)pb & 0xffffff;
+
+    if ( a != b )
+        return (a < b) ? -1 : 1;
+
+    a = *(const uint32_t*)pa >> 24;
+    b = *(const uint32_t*)pb >> 24;
+
+    return (int)a - (int)b;
+}
+
+static void AddByte(AcPrefilter* pf, int pos, uint8_t c, uint8_t bit)
+{
+    pf->lo[pos][c & 0xf] |= bit;
+    pf->hi[pos][c >> 4] |= bit;
+
+    // the dfa folds input to upper case
+    if ( c >= 'A' && c <= 'Z' )
+    {
+        c += 'a' - 'A';
+        pf->lo[pos][c & 0xf] |= bit;
+        pf->hi[pos][c >> 4] |= bit;
+    }
+}
+
+int acPrefilterCompile(AcPrefilter* pf)
+{
+    unsigned i, j, num = 0, b;
+    double pass = 0.0;
+
+    if ( !pf->num )
+        return -1;
+
+    qsort(pf->prefix, pf->num, sizeof(*pf->prefix), PrefixCmp);
+
+    for ( i = 0; i < pf->num; i++ )
+    {
+        if ( !num || pf->prefix[i] != pf->prefix[num-1] )
+            pf->prefix[num++] = pf->prefix[i];
+    }
+
+    // contiguous runs of the sorted prefixes share leading bytes
+    // which keeps the union of each bucket tight
+    for ( i = 0; i < num; i++ )
+    {
+        uint8_t bit = (uint8_t)(1 << (i * PF_BUCKETS / num));
+        unsigned len = pf->prefix[i] >> 24;
+        int pos;
+
+        for ( pos = 0; pos < PF_WIDTH; pos++ )
+        {
+            if ( (unsigned)pos < len )
+            {
+                AddByte(pf, pos, (pf->prefix[i] >> (8 * (PF_WIDTH - 1 - pos))) & 0xff, bit);
+            }
+            else
+            {
+                for ( j = 0; j < 16; j++ )
+                {
+                    pf->lo[pos][j] |= bit;
+                    pf->hi[pos][j] |= bit;
+                }
+            }
+        }
+    }
+    free(pf->prefix);
+    pf->prefix = NULL;
+    pf->num = pf->max = 0;
+
+    for ( b = 0; b < PF_BUCKETS; b++ )
+    {
+        double p = 1.0;
+        int pos;
+
+        for ( pos = 0; pos < PF_WIDTH; pos++ )
+        {
+            unsigned n = 0;
+
+            for ( j = PF_TEXT_LO; j <= PF_TEXT_HI; j++ )
+            {
+                if ( pf->lo[pos][j & 0xf] & pf->hi[pos][j >> 4] & (1 << b) )
+                    n++;
+            }
+            p *= (double)n / (PF_TEXT_HI - PF_TEXT_LO + 1);
+        }
+        pass += p;
+    }
+    return (pass > PF_MAX_PASS) ? -1 : 0;
+}
+
+const uint8_t* acPrefilterSkip(
+    const AcPrefilter* pf, const uint8_t* T, const uint8_t* end)
+{
+    return pf->skip(pf, T, end);
+}
+
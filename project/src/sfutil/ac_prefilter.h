@@ -0,0 +1,61 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    ac_prefilter.h
+//
+// SIMD prefix filter for the Aho-Corasick DFA.  While the DFA sits in the
+// root state the next state depends only on the input, so any position
+// that can't begin a pattern can be skipped without changing the result.
+// The filter finds the next position whose first 3 bytes could begin a
+// pattern using nibble shuffle lookups into 8 buckets of prefixes (the
+// "Teddy" technique), 16 or 32 positions at a time.
+//
+// Prefixes are in the case folded (upper case) space the DFA uses; both
+// cases of a letter are accepted.  The filter is a superset: a candidate
+// may not begin a pattern, but no skipped position can.
+
+#ifndef _AC_PREFILTER_H_
+#define _AC_PREFILTER_H_
+
+#include <stdint.h>
+
+typedef struct _AcPrefilter AcPrefilter;
+
+// returns NULL if there is no SIMD kernel for this cpu
+AcPrefilter* acPrefilterNew(void);
+void acPrefilterFree(AcPrefilter*);
+
+// pat is the upper case pattern; only the first 3 bytes are used
+void acPrefilterAddPattern(AcPrefilter*, const uint8_t* pat, int n);
+
+// returns -1 if the filter would pass too many positions to pay off,
+// in which case it should be freed and the plain DFA used
+int acPrefilterCompile(AcPrefilter*);
+
+// returns the first position in [T, end) that may begin a pattern.  the
+// last 2 positions can't be decided and are always returned.
+const uint8_t* acPrefilterSkip(const AcPrefilter*, const uint8_t* T, const uint8_t* end);
+
+// name of the kernel selected at runtime: "avx2", "ssse3" or "none"
+const char* acPrefilterKernel(void);
+
+#endif
+
@@ -85,8 +85,15 @@ AC_MALLOC (int n)
   void *p;
   p = calloc (1,n);
 #ifdef DEBUG_AC
+  /* tries may be compiled concurrently (see mpseCompile) */
   if (p)
+  {
+#ifndef WIN32
+    __sync_fetch_and_add(&max_memory, n);
+#else
     max_memory += n;
+#endif
+  }
 #endif
   return p;
 }
@@ -535,7 +542,7 @@ static int acsmBuildMatchStateTrees( ACSM_STRUCT * acsm,
     return cnt;
 }
 
-static int acsmBuildMatchStateTreesWithSnortConf( struct _SnortConfig *sc, ACSM_STRUCT * acsm,
+int acsmBuildMatchStateTreesWithSnortConf( struct _SnortConfig *sc, ACSM_STRUCT * acsm,
                                                   int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                                                   int (*neg_list_func)(void *id, void **list) )
 {
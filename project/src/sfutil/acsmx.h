@@ -124,6 +124,10 @@ struct _SnortConfig;
 int acsmCompileWithSnortConf ( struct _SnortConfig *, ACSM_STRUCT * acsm,
                                int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                                int (*neg_list_func)(void *id, void **list));
+/* for matchers compiled without trees */
+int acsmBuildMatchStateTreesWithSnortConf ( struct _SnortConfig *, ACSM_STRUCT * acsm,
+                               int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
+                               int (*neg_list_func)(void *id, void **list));
 
 int acsmSearch ( ACSM_STRUCT * acsm,unsigned char * T, int n,
                  int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
@@ -143,6 +143,8 @@
 #endif
 
 #include "acsmx2.h"
+#include "mpse_cache.h"
+#include "ac_prefilter.h"
 #include "util.h"
 #include "snort_debug.h"
 
@@ -161,6 +163,18 @@ static int acsm2_dfa4_memory = 0;
 static int acsm2_failstate_memory = 0;
 static int s_verbose=0;
 
+/*
+*  Matchers may be compiled concurrently (see mpseCompile) so the memory
+*  and summary counters shared by all instances are updated atomically.
+*/
+#ifndef WIN32
+#define ACSM2_ADD(v, n) ((void)__sync_fetch_and_add(&(v), (n)))
+#define ACSM2_FIRST(v) __sync_bool_compare_and_swap(&(v), 0, 1)
+#else
+#define ACSM2_ADD(v, n) ((v) += (n))
+#define ACSM2_FIRST(v) (!(v) && ((v) = 1))
+#endif
+
 typedef struct acsm_summary_s
 {
       unsigned num_states;
@@ -172,6 +186,8 @@ typedef struct acsm_summary_s
       unsigned num_1byte_instances;
       unsigned num_2byte_instances;
       unsigned num_4byte_instances;
+      unsigned num_prefilter_instances;
+      unsigned have_acsm;
       ACSM_STRUCT2 acsm;
 
 } acsm_summary_t;
@@ -189,6 +205,8 @@ void acsm_init_summary(void)
     summary.num_1byte_instances = 0;
     summary.num_2byte_instances = 0;
     summary.num_4byte_instances = 0;
+    summary.num_prefilter_instances = 0;
+    summary.have_acsm = 0;
     memset(&summary.acsm, 0, sizeof(ACSM_STRUCT2));
     acsm2_total_memory = 0;
     acsm2_pattern_memory = 0;
@@ -287,16 +305,16 @@ AC_MALLOC(
         switch (type)
         {
             case ACSM2_MEMORY_TYPE__PATTERN:
-                acsm2_pattern_memory += n;
+                ACSM2_ADD(acsm2_pattern_memory, n);
                 break;
             case ACSM2_MEMORY_TYPE__MATCHLIST:
-                acsm2_matchlist_memory += n;
+                ACSM2_ADD(acsm2_matchlist_memory, n);
                 break;
             case ACSM2_MEMORY_TYPE__TRANSTABLE:
-                acsm2_transtable_memory += n;
+                ACSM2_ADD(acsm2_transtable_memory, n);
                 break;
             case ACSM2_MEMORY_TYPE__FAILSTATE:
-                acsm2_failstate_memory += n;
+                ACSM2_ADD(acsm2_failstate_memory, n);
                 break;
             case ACSM2_MEMORY_TYPE__NONE:
                 break;
@@ -305,7 +323,7 @@ AC_MALLOC(
                 break;
         }
 
-        acsm2_total_memory += n;
+        ACSM2_ADD(acsm2_total_memory, n);
     }
 
     return p;
@@ -324,19 +342,19 @@ AC_MALLOC_DFA(
         switch (sizeofstate)
         {
             case 1:
-                acsm2_dfa1_memory += n;
+                ACSM2_ADD(acsm2_dfa1_memory, n);
                 break;
             case 2:
-                acsm2_dfa2_memory += n;
+                ACSM2_ADD(acsm2_dfa2_memory, n);
                 break;
             case 4:
             default:
-                acsm2_dfa4_memory += n;
+                ACSM2_ADD(acsm2_dfa4_memory, n);
                 break;
         }
 
-        acsm2_dfa_memory += n;
-        acsm2_total_memory += n;
+        ACSM2_ADD(acsm2_dfa_memory, n);
+        ACSM2_ADD(acsm2_total_memory, n);
     }
 
     return p;
@@ -358,23 +376,23 @@ AC_FREE(
         switch (type)
         {
             case ACSM2_MEMORY_TYPE__PATTERN:
-                acsm2_pattern_memory -= n;
+                ACSM2_ADD(acsm2_pattern_memory, -n);
                 break;
             case ACSM2_MEMORY_TYPE__MATCHLIST:
-                acsm2_matchlist_memory -= n;
+                ACSM2_ADD(acsm2_matchlist_memory, -n);
                 break;
             case ACSM2_MEMORY_TYPE__TRANSTABLE:
-                acsm2_transtable_memory -= n;
+                ACSM2_ADD(acsm2_transtable_memory, -n);
                 break;
             case ACSM2_MEMORY_TYPE__FAILSTATE:
-                acsm2_failstate_memory -= n;
+                ACSM2_ADD(acsm2_failstate_memory, -n);
                 break;
             case ACSM2_MEMORY_TYPE__NONE:
             default:
                 break;
         }
 
-        acsm2_total_memory -= n;
+        ACSM2_ADD(acsm2_total_memory, -n);
         free(p);
     }
 }
@@ -391,19 +409,19 @@ AC_FREE_DFA(
         switch (sizeofstate)
         {
             case 1:
-                acsm2_dfa1_memory -= n;
+                ACSM2_ADD(acsm2_dfa1_memory, -n);
                 break;
             case 2:
-                acsm2_dfa2_memory -= n;
+                ACSM2_ADD(acsm2_dfa2_memory, -n);
                 break;
             case 4:
             default:
-                acsm2_dfa4_memory -= n;
+                ACSM2_ADD(acsm2_dfa4_memory, -n);
                 break;
         }
 
-        acsm2_dfa_memory -= n;
-        acsm2_total_memory -= n;
+        ACSM2_ADD(acsm2_dfa_memory, -n);
+        ACSM2_ADD(acsm2_total_memory, -n);
         free(p);
     }
 }
@@ -1775,7 +1793,7 @@ acsmUpdateMatchStates(
                     break;
             }
 
-            summary.num_match_states++;
+            ACSM2_ADD(summary.num_match_states, 1);
         }
     }
 }
@@ -1820,7 +1838,7 @@ static int acsmBuildMatchStateTrees2( ACSM_STRUCT2 * acsm,
     return cnt;
 }
 
-static int acsmBuildMatchStateTrees2WithSnortConf( struct _SnortConfig *sc, ACSM_STRUCT2 * acsm,
+int acsmBuildMatchStateTrees2WithSnortConf( struct _SnortConfig *sc, ACSM_STRUCT2 * acsm,
                                                    int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                                                    int (*neg_list_func)(void *id, void **list) )
 {
@@ -1870,6 +1888,428 @@ void acsmCompressStates(
     acsm->compress_states = flag;
 }
 
+void acsmSetCache2(
+        ACSM_STRUCT2 *acsm,
+        MpseCache *cache
+        )
+{
+    if (acsm == NULL)
+        return;
+    acsm->acsmCache = cache;
+}
+
+void acsmEnablePrefilter2(
+        ACSM_STRUCT2 *acsm,
+        int flag
+        )
+{
+    if (acsm == NULL)
+        return;
+    acsm->acsmUsePrefilter = flag;
+
+    /* pick the kernel now rather than in a (possibly concurrent) compile */
+    if (flag)
+        acPrefilterKernel();
+}
+
+/*
+*   Build the root skip filter from the (upper case) pattern prefixes.
+*   This is done after compiling so it applies to cached tables as well.
+*   Without a simd kernel, or if the prefixes are too common for the
+*   filter to skip much, the plain Full-Q search is used.
+*/
+static void
+acsmBuildPrefilter(
+        ACSM_STRUCT2 *acsm
+        )
+{
+    ACSM_PATTERN2 *plist;
+    AcPrefilter *pf;
+
+    if (!acsm->acsmUsePrefilter || (acsm->acsmFSA != FSA_DFA) ||
+        (acsm->acsmFormat != ACF_FULLQ))
+        return;
+
+    if ((pf = acPrefilterNew()) == NULL)
+        return;
+
+    for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
+        acPrefilterAddPattern(pf, plist->patrn, plist->n);
+
+    if (acPrefilterCompile(pf))
+    {
+        acPrefilterFree(pf);
+        return;
+    }
+    acsm->acsmPrefilter = pf;
+    ACSM2_ADD(summary.num_prefilter_instances, 1);
+}
+
+/*
+*   Compiled state cache
+*
+*   The rows of the final transition table are stored back to back and
+*   used in place when loaded.  Match lists are stored as indices into
+*   the pattern list and rebuilt in the same order.  The blob starts with
+*   an array of uint32_t words:
+*
+*     header[ACSM2_CACHE_HDR]
+*     row offsets[NumStates]          (bytes from start of rows)
+*     fail states[NumStates]          (if has_fail)
+*     match list offsets[NumStates+1]
+*     match list pattern indices[nmatch]
+*     padding to 16 bytes
+*     rows[row_bytes]                 (each row 4 byte aligned)
+*/
+#define ACSM2_CACHE_MAGIC   0x41434632  /* 'ACF2' */
+#define ACSM2_CACHE_VERSION 1
+
+enum {
+    ACSM2_CACHE_MAGIC_IDX,
+    ACSM2_CACHE_VERSION_IDX,
+    ACSM2_CACHE_STATES,
+    ACSM2_CACHE_TRANS,
+    ACSM2_CACHE_SIZEOFSTATE,
+    ACSM2_CACHE_HAS_FAIL,
+    ACSM2_CACHE_NMATCH,
+    ACSM2_CACHE_PATTERNS,
+    ACSM2_CACHE_ROW_BYTES,
+    ACSM2_CACHE_HDR
+};
+
+static void
+acsmCacheKey(
+        ACSM_STRUCT2 *acsm,
+        MpseCacheKey *key
+        )
+{
+    ACSM_PATTERN2 *plist;
+
+    mpseCacheKeyInit(key);
+    mpseCacheKeyUpdateInt(key, ACSM2_CACHE_MAGIC);
+    mpseCacheKeyUpdateInt(key, ACSM2_CACHE_VERSION);
+    mpseCacheKeyUpdateInt(key, sizeof(acstate_t));
+    mpseCacheKeyUpdateInt(key, acsm->acsmFormat);
+    mpseCacheKeyUpdateInt(key, acsm->acsmFSA);
+    mpseCacheKeyUpdateInt(key, acsm->acsmAlphabetSize);
+    mpseCacheKeyUpdateInt(key, acsm->acsmSparseMaxRowNodes);
+    mpseCacheKeyUpdateInt(key, acsm->acsmSparseMaxZcnt);
+    mpseCacheKeyUpdateInt(key, acsm->compress_states);
+
+    for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
+    {
+        mpseCacheKeyUpdateInt(key, plist->n);
+        mpseCacheKeyUpdateInt(key, plist->nocase);
+        mpseCacheKeyUpdateInt(key, plist->negative);
+        mpseCacheKeyUpdate(key, plist->casepatrn, plist->n);
+    }
+}
+
+/*
+*   Size of a final format row in bytes, 0 if it can't be cached
+*/
+static unsigned
+acsmRowSize(
+        ACSM_STRUCT2 *acsm,
+        const acstate_t *p,
+        unsigned max
+        )
+{
+    unsigned m, nb, i;
+
+    if ((acsm->acsmFormat == ACF_FULL) || (acsm->acsmFormat == ACF_FULLQ))
+        return acsm->sizeofstate * (acsm->acsmAlphabetSize + 2);
+
+    /* the other formats always use full size states */
+    if ((acsm->sizeofstate != sizeof(acstate_t)) || (max < 3))
+        return 0;
+
+    switch (p[0])
+    {
+        case ACF_FULL:
+            return sizeof(acstate_t) * (acsm->acsmAlphabetSize + 2);
+
+        case ACF_SPARSE:
+            return sizeof(acstate_t) * (3 + 2 * p[2]);
+
+        case ACF_BANDED:
+            return sizeof(acstate_t) * (4 + p[2]);
+
+        case ACF_SPARSEBANDS:
+            for (m = 3, nb = p[2], i = 0; i < nb; i++)
+            {
+                if (m + 2 > max)
+                    return 0;
+                m += 2 + p[m];
+            }
+            return sizeof(acstate_t) * m;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+#define ACSM2_ROW_ALIGN(n) (((n) + 3) & ~3u)
+
+static void
+acsmCacheStore(
+        ACSM_STRUCT2 *acsm,
+        MpseCacheKey *key
+        )
+{
+    MpseCachePtrMap *pm;
+    ACSM_PATTERN2 *plist, *mlist;
+    uint32_t *hdr, *roff, *fail, *moff, *mpat;
+    unsigned nstates = acsm->acsmNumStates, npats = 0, nmatch = 0;
+    unsigned words, row_bytes = 0, k, n;
+    uint8_t *blob, *rows;
+    size_t len;
+
+    if (sizeof(acstate_t) != sizeof(uint32_t))
+        return;
+
+    for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
+        npats++;
+
+    for (k = 0; k < nstates; k++)
+    {
+        unsigned size = acsmRowSize(acsm, acsm->acsmNextState[k], ~0u);
+
+        if (!size)
+            return;
+
+        row_bytes += ACSM2_ROW_ALIGN(size);
+
+        for (mlist = acsm->acsmMatchList[k]; mlist; mlist = mlist->next)
+            nmatch++;
+    }
+
+    words = ACSM2_CACHE_HDR + nstates + (acsm->acsmFailState ? nstates : 0) +
+        nstates + 1 + nmatch;
+    words = (words + 3) & ~3u;
+
+    len = words * sizeof(uint32_t) + row_bytes;
+    blob = (uint8_t *)SnortAlloc(len);
+
+    hdr  = (uint32_t *)blob;
+    roff = hdr + ACSM2_CACHE_HDR;
+    fail = roff + nstates;
+    moff = fail + (acsm->acsmFailState ? nstates : 0);
+    mpat = moff + nstates + 1;
+    rows = blob + words * sizeof(uint32_t);
+
+    hdr[ACSM2_CACHE_MAGIC_IDX]   = ACSM2_CACHE_MAGIC;
+    hdr[ACSM2_CACHE_VERSION_IDX] = ACSM2_CACHE_VERSION;
+    hdr[ACSM2_CACHE_STATES]      = nstates;
+    hdr[ACSM2_CACHE_TRANS]       = acsm->acsmNumTrans;
+    hdr[ACSM2_CACHE_SIZEOFSTATE] = acsm->sizeofstate;
+    hdr[ACSM2_CACHE_HAS_FAIL]    = acsm->acsmFailState ? 1 : 0;
+    hdr[ACSM2_CACHE_NMATCH]      = nmatch;
+    hdr[ACSM2_CACHE_PATTERNS]    = npats;
+    hdr[ACSM2_CACHE_ROW_BYTES]   = row_bytes;
+
+    pm = mpseCachePtrMapNew(npats);
+
+    for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
+        mpseCachePtrMapAdd(pm, plist->patrn);
+
+    for (n = 0, row_bytes = 0, k = 0; k < nstates; k++)
+    {
+        unsigned size = acsmRowSize(acsm, acsm->acsmNextState[k], ~0u);
+
+        roff[k] = row_bytes;
+        memcpy(rows + row_bytes, acsm->acsmNextState[k], size);
+        row_bytes += ACSM2_ROW_ALIGN(size);
+
+        if (acsm->acsmFailState)
+            fail[k] = acsm->acsmFailState[k];
+
+        moff[k] = n;
+
+        /* match list entries are copies that share the pattern buffer */
+        for (mlist = acsm->acsmMatchList[k]; mlist; mlist = mlist->next)
+        {
+            int idx = mpseCachePtrMapFind(pm, mlist->patrn);
+
+            if (idx < 0)
+            {
+                mpseCachePtrMapFree(pm);
+                free(blob);
+                return;
+            }
+            mpat[n++] = (uint32_t)idx;
+        }
+    }
+    moff[k] = n;
+    mpseCachePtrMapFree(pm);
+
+    mpseCacheStore(acsm->acsmCache, key, blob, len);
+}
+
+/*
+*   Returns 0 if the machine was loaded from the cache
+*/
+static int
+acsmCacheLoad(
+        ACSM_STRUCT2 *acsm,
+        MpseCacheKey *key
+        )
+{
+    const uint32_t *hdr, *roff, *fail, *moff, *mpat;
+    const uint8_t *rows;
+    ACSM_PATTERN2 **pats, *plist;
+    unsigned nstates, nmatch, npats = 0, row_bytes, words, k, m;
+    size_t len;
+
+    if (sizeof(acstate_t) != sizeof(uint32_t))
+        return -1;
+
+    hdr = (const uint32_t *)mpseCacheFind(acsm->acsmCache, key, &len);
+
+    if (!hdr || (len < ACSM2_CACHE_HDR * sizeof(uint32_t)))
+        return -1;
+
+    for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
+        npats++;
+
+    nstates   = hdr[ACSM2_CACHE_STATES];
+    nmatch    = hdr[ACSM2_CACHE_NMATCH];
+    row_bytes = hdr[ACSM2_CACHE_ROW_BYTES];
+
+    if ((hdr[ACSM2_CACHE_MAGIC_IDX] != ACSM2_CACHE_MAGIC) ||
+        (hdr[ACSM2_CACHE_VERSION_IDX] != ACSM2_CACHE_VERSION) ||
+        (hdr[ACSM2_CACHE_PATTERNS] != npats) || !nstates ||
+        (nstates > len / sizeof(uint32_t)) || (nmatch > len / sizeof(uint32_t)))
+        return -1;
+
+    switch (hdr[ACSM2_CACHE_SIZEOFSTATE])
+    {
+        case 1: case 2: case 4:
+            break;
+        default:
+            return -1;
+    }
+
+    words = ACSM2_CACHE_HDR + nstates + (hdr[ACSM2_CACHE_HAS_FAIL] ? nstates : 0) +
+        nstates + 1 + nmatch;
+    words = (words + 3) & ~3u;
+
+    if (len != words * sizeof(uint32_t) + (size_t)row_bytes)
+        return -1;
+
+    roff = hdr + ACSM2_CACHE_HDR;
+    fail = roff + nstates;
+    moff = fail + (hdr[ACSM2_CACHE_HAS_FAIL] ? nstates : 0);
+    mpat = moff + nstates + 1;
+    rows = (const uint8_t *)hdr + words * sizeof(uint32_t);
+
+    acsm->sizeofstate = hdr[ACSM2_CACHE_SIZEOFSTATE];
+
+    /* validate everything before touching the struct */
+    if (moff[nstates] != nmatch)
+        return -1;
+
+    for (k = 0; k < nstates; k++)
+    {
+        unsigned size;
+
+        if ((roff[k] % 4) || (roff[k] >= row_bytes) || (moff[k] > moff[k+1]))
+            return -1;
+
+        size = acsmRowSize(acsm, (const acstate_t *)(rows + roff[k]),
+            (row_bytes - roff[k]) / sizeof(acstate_t));
+
+        if (!size || (size > row_bytes - roff[k]))
+            return -1;
+    }
+    for (m = 0; m < nmatch; m++)
+    {
+        if (mpat[m] >= npats)
+            return -1;
+    }
+
+    pats = (ACSM_PATTERN2 **)SnortAlloc((npats ? npats : 1) * sizeof(*pats));
+
+    for (m = 0, plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
+    {
+        pats[m++] = plist;
+        acsm->acsmMaxStates += plist->n;
+        ACSM2_ADD(summary.num_patterns, 1);
+        ACSM2_ADD(summary.num_characters, plist->n);
+    }
+    acsm->acsmMaxStates++;
+
+    acsm->acsmNumStates = nstates;
+    acsm->acsmNumTrans = hdr[ACSM2_CACHE_TRANS];
+
+    acsm->acsmMatchList =
+        (ACSM_PATTERN2 **)AC_MALLOC(sizeof(ACSM_PATTERN2*) * nstates,
+                ACSM2_MEMORY_TYPE__MATCHLIST);
+    MEMASSERT(acsm->acsmMatchList, "acsmCacheLoad");
+
+    acsm->acsmNextState =
+        (acstate_t**)AC_MALLOC_DFA(nstates * sizeof(acstate_t*),
+                acsm->sizeofstate);
+    MEMASSERT(acsm->acsmNextState, "acsmCacheLoad");
+
+    if (hdr[ACSM2_CACHE_HAS_FAIL])
+    {
+        acsm->acsmFailState =
+            (acstate_t*)AC_MALLOC(sizeof(acstate_t) * nstates,
+                    ACSM2_MEMORY_TYPE__FAILSTATE);
+        MEMASSERT(acsm->acsmFailState, "acsmCacheLoad");
+        memcpy(acsm->acsmFailState, fail, sizeof(acstate_t) * nstates);
+    }
+
+    for (k = 0; k < nstates; k++)
+    {
+        ACSM_PATTERN2 **tail = &acsm->acsmMatchList[k];
+
+        acsm->acsmNextState[k] = (acstate_t *)(rows + roff[k]);
+
+        for (m = moff[k]; m < moff[k+1]; m++)
+        {
+            *tail = CopyMatchListEntry(pats[mpat[m]]);
+            tail = &(*tail)->next;
+        }
+        if (acsm->acsmMatchList[k])
+            ACSM2_ADD(summary.num_match_states, 1);
+    }
+    free(pats);
+
+    acsm->acsmCacheRef = mpseCacheRef(acsm->acsmCache);
+
+    switch (acsm->sizeofstate)
+    {
+        case 1: ACSM2_ADD(acsm2_dfa1_memory, row_bytes); break;
+        case 2: ACSM2_ADD(acsm2_dfa2_memory, row_bytes); break;
+        default: ACSM2_ADD(acsm2_dfa4_memory, row_bytes); break;
+    }
+    ACSM2_ADD(acsm2_dfa_memory, row_bytes);
+    ACSM2_ADD(acsm2_total_memory, row_bytes);
+
+    if (acsm->compress_states)
+    {
+        if (acsm->sizeofstate == 1)
+            ACSM2_ADD(summary.num_1byte_instances, 1);
+        else if (acsm->sizeofstate == 2)
+            ACSM2_ADD(summary.num_2byte_instances, 1);
+        else
+            ACSM2_ADD(summary.num_4byte_instances, 1);
+    }
+
+    ACSM2_ADD(summary.num_states, acsm->acsmNumStates);
+    ACSM2_ADD(summary.num_transitions, acsm->acsmNumTrans);
+    ACSM2_ADD(summary.num_instances, 1);
+
+    /* only the (common) configuration is shown from this */
+    if (ACSM2_FIRST(summary.have_acsm))
+        memcpy(&summary.acsm, acsm, sizeof(ACSM_STRUCT2));
+
+    return 0;
+}
+
 /*
 *   Compile State Machine - NFA or DFA and Full or Banded or Sparse or SparseBands
 */
@@ -1879,6 +2319,15 @@ _acsmCompile2(
         )
 {
     ACSM_PATTERN2* plist;
+    MpseCacheKey key;
+
+    if (acsm->acsmCache)
+    {
+        acsmCacheKey(acsm, &key);
+
+        if (!acsmCacheLoad(acsm, &key))
+            return 0;
+    }
 
     /* Count number of possible states */
     for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
@@ -1920,8 +2369,8 @@ _acsmCompile2(
     /* Add each Pattern to the State Table - This forms a keywords state table  */
     for (plist = acsm->acsmPatterns; plist != NULL; plist = plist->next)
     {
-        summary.num_patterns++;
-        summary.num_characters += plist->n;
+        ACSM2_ADD(summary.num_patterns, 1);
+        ACSM2_ADD(summary.num_characters, plist->n);
         AddPatternStates(acsm, plist);
     }
 
@@ -1933,17 +2382,17 @@ _acsmCompile2(
         if (acsm->acsmNumStates < UINT8_MAX)
         {
             acsm->sizeofstate = 1;
-            summary.num_1byte_instances++;
+            ACSM2_ADD(summary.num_1byte_instances, 1);
         }
         else if (acsm->acsmNumStates < UINT16_MAX)
         {
             acsm->sizeofstate = 2;
-            summary.num_2byte_instances++;
+            ACSM2_ADD(summary.num_2byte_instances, 1);
         }
         else
         {
             acsm->sizeofstate = 4;
-            summary.num_4byte_instances++;
+            ACSM2_ADD(summary.num_4byte_instances, 1);
         }
     }
     else
@@ -2093,11 +2542,16 @@ _acsmCompile2(
       acsmPrintInfo2(acsm);
 
     /* Accrue Summary State Stats */
-    summary.num_states += acsm->acsmNumStates;
-    summary.num_transitions += acsm->acsmNumTrans;
-    summary.num_instances++;
+    ACSM2_ADD(summary.num_states, acsm->acsmNumStates);
+    ACSM2_ADD(summary.num_transitions, acsm->acsmNumTrans);
+    ACSM2_ADD(summary.num_instances, 1);
+
+    /* only the (common) configuration is shown from this */
+    if (ACSM2_FIRST(summary.have_acsm))
+        memcpy(&summary.acsm, acsm, sizeof(ACSM_STRUCT2));
 
-    memcpy(&summary.acsm, acsm, sizeof(ACSM_STRUCT2));
+    if (acsm->acsmCache)
+        acsmCacheStore(acsm, &key);
 
     return 0;
 }
@@ -2119,6 +2573,8 @@ acsmCompile2(
         acsmBuildMatchStateTrees2(acsm, build_tree, neg_list_func);
     }
 
+    acsmBuildPrefilter(acsm);
+
     return 0;
 }
 
@@ -2140,6 +2596,8 @@ acsmCompile2WithSnortConf(
         acsmBuildMatchStateTrees2WithSnortConf(sc, acsm, build_tree, neg_list_func);
     }
 
+    acsmBuildPrefilter(acsm);
+
     return 0;
 }
 
@@ -2601,6 +3059,196 @@ acsmSearchSparseDFA_Full_q(
     return 0;
 }
 
+/*
+ *  Same as AC_SEARCH_Q but whenever the machine is back in the root
+ *  state the prefilter skips ahead to the next position that could
+ *  begin a pattern.  The root state never matches and nothing that
+ *  starts at a skipped position can match, so the result is the same.
+ */
+#define AC_SEARCH_Q_SKIP \
+    while (T < Tend) \
+    { \
+        if (state == 0) \
+        { \
+            T = (unsigned char *)acPrefilterSkip(pf, T, Tend); \
+            if (T == Tend) \
+                break; \
+        } \
+        ps = NextState[state]; \
+        sindex = xlatcase[T[0]]; \
+        if (ps[1]) \
+        { \
+            if (MatchList[state]) \
+            { \
+                if (_add_queue(&acsm->q,MatchList[state])) \
+                { \
+                    if (_process_queue(&acsm->q, Match,data)) \
+                    { \
+                        *current_state = state; \
+                        return 1; \
+                    } \
+                } \
+            } \
+        } \
+        state = ps[2 + sindex]; \
+        T++; \
+    }
+
+static inline int
+acsmSearchSparseDFA_Full_q_skip(
+        ACSM_STRUCT2 *acsm,
+        unsigned char *T,
+        int n,
+        int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
+        void *data,
+        int *current_state
+        )
+{
+    unsigned char *Tend;
+    int sindex;
+    acstate_t state;
+    ACSM_PATTERN2 **MatchList = acsm->acsmMatchList;
+    const AcPrefilter *pf = acsm->acsmPrefilter;
+
+    Tend = T + n;
+
+    if (current_state == NULL)
+        return 0;
+
+    _init_queue(&acsm->q);
+
+    state = *current_state;
+
+    switch (acsm->sizeofstate)
+    {
+        case 1:
+            {
+                uint8_t *ps;
+                uint8_t **NextState = (uint8_t **)acsm->acsmNextState;
+                AC_SEARCH_Q_SKIP;
+            }
+            break;
+        case 2:
+            {
+                uint16_t *ps;
+                uint16_t **NextState = (uint16_t **)acsm->acsmNextState;
+                AC_SEARCH_Q_SKIP;
+            }
+            break;
+        default:
+            {
+                acstate_t *ps;
+                acstate_t **NextState = acsm->acsmNextState;
+                AC_SEARCH_Q_SKIP;
+            }
+            break;
+    }
+
+    *current_state = state;
+
+    if (MatchList[state])
+        _add_queue(&acsm->q,MatchList[state]);
+
+    _process_queue(&acsm->q,Match,data);
+
+    return 0;
+}
+
+/*
+ *  Batched AC_SEARCH_Q: walks several buffers, each through its own
+ *  machine, one byte of each lane per round.  The next state loads of
+ *  the lanes are independent, so their cache misses overlap instead of
+ *  being taken one after the other.  All lanes share one match queue,
+ *  which is only flushed when full and once at the end of the batch.
+ *  Each round runs as many steps as the shortest remaining lane, then
+ *  the exhausted lanes are retired.
+ */
+typedef struct
+{
+    void           ** NextState;
+    ACSM_PATTERN2  ** MatchList;
+    unsigned char   * T;
+    unsigned char   * Tend;
+    acstate_t         state;
+    int             * current_state;
+
+} acsm_lane_t;
+
+#define AC_SEARCH_Q_BATCH(type) \
+    while (nl > 0) \
+    { \
+        step = lane[0].Tend - lane[0].T; \
+        for (i = 1; i < nl; i++) \
+            if (lane[i].Tend - lane[i].T < step) \
+                step = lane[i].Tend - lane[i].T; \
+        for (k = 0; k < step; k++) \
+        { \
+            for (i = 0; i < nl; i++) \
+            { \
+                type * ps = ((type **)lane[i].NextState)[lane[i].state]; \
+                if (ps[1] && lane[i].MatchList[lane[i].state]) \
+                { \
+                    if (_add_queue(q, lane[i].MatchList[lane[i].state])) \
+                    { \
+                        if (_process_queue(q, Match, data)) \
+                        { \
+                            for (i = 0; i < nl; i++) \
+                                *lane[i].current_state = lane[i].state; \
+                            return 1; \
+                        } \
+                    } \
+                } \
+                lane[i].state = ps[2 + xlatcase[*lane[i].T++]]; \
+            } \
+        } \
+        for (i = 0; i < nl; ) \
+        { \
+            if (lane[i].T < lane[i].Tend) \
+            { \
+                i++; \
+                continue; \
+            } \
+            *lane[i].current_state = lane[i].state; \
+            if (lane[i].MatchList[lane[i].state] && \
+                _add_queue(q, lane[i].MatchList[lane[i].state]) && \
+                _process_queue(q, Match, data)) \
+            { \
+                for (i = 0; i < nl; i++) \
+                    *lane[i].current_state = lane[i].state; \
+                return 1; \
+            } \
+            lane[i] = lane[--nl]; \
+        } \
+    }
+
+static inline int
+acsmSearchSparseDFA_Full_q_batch(
+        acsm_lane_t *lane,
+        int nl,
+        int sizeofstate,
+        PMQ *q,
+        int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
+        void *data
+        )
+{
+    int i, k, step;
+
+    switch (sizeofstate)
+    {
+        case 1:
+            AC_SEARCH_Q_BATCH(uint8_t);
+            break;
+        case 2:
+            AC_SEARCH_Q_BATCH(uint16_t);
+            break;
+        default:
+            AC_SEARCH_Q_BATCH(acstate_t);
+            break;
+    }
+
+    return 0;
+}
+
 /*
 *   Full format DFA search
 *   Do not change anything here without testing, caching and prefetching
@@ -2865,6 +3513,10 @@ acsmSearch2(ACSM_STRUCT2 * acsm, unsigned char *Tx, int n,
         }
         else if( acsm->acsmFormat == ACF_FULLQ )
         {
+            if ( acsm->acsmPrefilter )
+                return acsmSearchSparseDFA_Full_q_skip( acsm, Tx, n, Match,
+                        data, current_state );
+
             return acsmSearchSparseDFA_Full_q( acsm, Tx, n, Match, data,
                     current_state );
         }
@@ -2892,6 +3544,78 @@ acsmSearch2(ACSM_STRUCT2 * acsm, unsigned char *Tx, int n,
 }
 
 
+/*
+*   Batched Search Function
+*
+*   Searches Tx[i] with acsm[i] for each of the nb buffers, which must
+*   not exceed ACSM_MAX_BATCH.  Full-q machines without a prefilter are
+*   walked together and share a match queue, grouped by state size
+*   since the walk is specialized on it; anything else is searched on
+*   its own.  Returns 1 if Match stopped the queued search, 0 otherwise,
+*   and the end state of each buffer in current_state[i].
+*/
+int
+acsmSearchBatch2(ACSM_STRUCT2 ** acsm, unsigned char ** Tx, int * n, int nb,
+           int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
+           void *data, int * current_state )
+{
+    acsm_lane_t lane[ACSM_MAX_BATCH];
+    PMQ q;
+    int i, nl, sz, last = -1, queued = 0;
+
+    for( i = 0; i < nb; i++ )
+    {
+        if( acsm[i]->acsmFSA == FSA_DFA && acsm[i]->acsmFormat == ACF_FULLQ &&
+            !acsm[i]->acsmPrefilter )
+        {
+            last = i;
+            queued++;
+            continue;
+        }
+
+        /* these return a match count, they stop on their own */
+        acsmSearch2(acsm[i], Tx[i], n[i], Match, data, &current_state[i]);
+    }
+
+    if( queued < 2 )
+    {
+        if( queued )
+            return acsmSearch2(acsm[last], Tx[last], n[last], Match, data,
+                    &current_state[last]);
+        return 0;
+    }
+
+    _init_queue(&q);
+
+    for( sz = 1; sz <= 4; sz <<= 1 )
+    {
+        nl = 0;
+
+        for( i = 0; i < nb; i++ )
+        {
+            if( acsm[i]->acsmFSA != FSA_DFA || acsm[i]->acsmFormat != ACF_FULLQ ||
+                acsm[i]->acsmPrefilter )
+                continue;
+
+            if( acsm[i]->sizeofstate != sz )
+                continue;
+
+            lane[nl].NextState = (void **)acsm[i]->acsmNextState;
+            lane[nl].MatchList = acsm[i]->acsmMatchList;
+            lane[nl].T = Tx[i];
+            lane[nl].Tend = Tx[i] + n[i];
+            lane[nl].state = current_state[i];
+            lane[nl].current_state = &current_state[i];
+            nl++;
+        }
+
+        if( nl && acsmSearchSparseDFA_Full_q_batch(lane, nl, sz, &q, Match, data) )
+            return 1;
+    }
+
+    return _process_queue(&q, Match, data);
+}
+
 /*
 *   Free all memory
 */
@@ -2923,7 +3647,9 @@ acsmFree2(
             AC_FREE(ilist, 0, ACSM2_MEMORY_TYPE__NONE);
         }
 
-        AC_FREE_DFA(acsm->acsmNextState[i], 0, 0);
+        /* cached rows belong to the cache mapping */
+        if (!acsm->acsmCacheRef)
+            AC_FREE_DFA(acsm->acsmNextState[i], 0, 0);
     }
 
     for (plist = acsm->acsmPatterns; plist; )
@@ -2943,6 +3669,13 @@ acsmFree2(
     AC_FREE_DFA(acsm->acsmNextState, 0, 0);
     AC_FREE(acsm->acsmFailState, 0, ACSM2_MEMORY_TYPE__NONE);
     AC_FREE(acsm->acsmMatchList, 0, ACSM2_MEMORY_TYPE__NONE);
+
+    if (acsm->acsmCacheRef)
+        mpseCacheRelease(acsm->acsmCacheRef);
+
+    if (acsm->acsmPrefilter)
+        acPrefilterFree(acsm->acsmPrefilter);
+
     AC_FREE(acsm, 0, ACSM2_MEMORY_TYPE__NONE);
 }
 
@@ -3048,6 +3781,10 @@ int acsmPrintSummaryInfo2(void)
         LogMessage("|     4 byte states : %u\n", summary.num_4byte_instances);
     }
 
+    if (summary.acsm.acsmUsePrefilter)
+        LogMessage("| SIMD Prefilter    : %u (%s)\n",
+            summary.num_prefilter_instances, acPrefilterKernel());
+
     LogMessage("| Characters        : %u\n",summary.num_characters);
     LogMessage("| States            : %d\n",summary.num_states);
     LogMessage("| Transitions       : %d\n",summary.num_transitions);
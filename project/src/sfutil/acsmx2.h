@@ -162,6 +162,12 @@ typedef struct {
     int sizeofstate;
     int compress_states;
 
+    struct _MpseCache * acsmCache;     /* compiled state cache, if any */
+    void * acsmCacheRef;               /* set if rows are mapped */
+
+    int acsmUsePrefilter;                 /* build a simd root skip filter */
+    struct _AcPrefilter * acsmPrefilter;  /* set if it pays off */
+
 }ACSM_STRUCT2;
 
 /*
@@ -179,13 +185,25 @@ struct _SnortConfig;
 int acsmCompile2WithSnortConf ( struct _SnortConfig *, ACSM_STRUCT2 * acsm,
                                 int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                                 int (*neg_list_func)(void *id, void **list));
+/* for matchers compiled without trees */
+int acsmBuildMatchStateTrees2WithSnortConf ( struct _SnortConfig *, ACSM_STRUCT2 * acsm,
+                                int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
+                                int (*neg_list_func)(void *id, void **list));
 int acsmSearch2 ( ACSM_STRUCT2 * acsm,unsigned char * T, int n,
                   int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
                   void * data, int* current_state );
+/* at most ACSM_MAX_BATCH buffers per call */
+#define ACSM_MAX_BATCH 8
+int acsmSearchBatch2 ( ACSM_STRUCT2 ** acsm, unsigned char ** Tx, int * n, int nb,
+                       int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
+                       void * data, int * current_state );
 void acsmFree2 ( ACSM_STRUCT2 * acsm );
 int acsmPatternCount2 ( ACSM_STRUCT2 * acsm );
 
 void acsmCompressStates(ACSM_STRUCT2 *, int);
+struct _MpseCache;
+void acsmSetCache2(ACSM_STRUCT2 *, struct _MpseCache *);
+void acsmEnablePrefilter2(ACSM_STRUCT2 *, int);
 
 int  acsmSelectFormat2( ACSM_STRUCT2 * acsm, int format );
 int  acsmSelectFSA2( ACSM_STRUCT2 * acsm, int fsa );
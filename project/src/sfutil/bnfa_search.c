@@ -151,6 +151,10 @@
 #include "config.h"
 #endif
 
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
 #include "sf_types.h"
 
 #define BNFA_TRACK_Q
@@ -160,6 +164,7 @@
 #endif
 
 #include "bnfa_search.h"
+#include "mpse_cache.h"
 #include "snort_debug.h"
 #include "util.h"
 
@@ -221,13 +226,34 @@ void bnfa_free( void *p, int n, int * m )
        }
    }
 }
+/*
+*  The transition list is cache line aligned so the compact layout's
+*  line packing holds in memory; it is released with bnfa_free.
+*/
+static
+void * bnfa_alloc_aligned( int n, int * m )
+{
+#ifndef WIN32
+   void * p;
+
+   if( posix_memalign(&p, BNFA_LINE_SIZE, n) )
+       return NULL;
+
+   memset(p, 0, n);
+
+   if(m)
+   {
+       m[0] += n;
+   }
+   return p;
+#else
+   return bnfa_alloc(n, m);
+#endif
+}
 #define BNFA_MALLOC(n,memory) bnfa_alloc(n,&(memory))
 #define BNFA_FREE(p,n,memory) bnfa_free(p,n,&(memory))
 
 
-/* queue memory traker */
-static int queue_memory=0;
-
 /*
 *    simple queue node
 */
@@ -245,6 +271,7 @@ typedef struct _queue
   QNODE * head, *tail;
   int count;
   int maxcnt;
+  int memory;   /* queue memory tracker */
 }
 QUEUE;
 /*
@@ -256,6 +283,7 @@ void queue_init (QUEUE * s)
   s->head = s->tail = 0;
   s->count= 0;
   s->maxcnt=0;
+  s->memory=0;
 }
 /*
 *  Add items to tail of queue (fifo)
@@ -266,14 +294,14 @@ int queue_add (QUEUE * s, int state)
   QNODE * q;
   if (!s->head)
   {
-      q = s->tail = s->head = (QNODE *) BNFA_MALLOC (sizeof(QNODE),queue_memory);
+      q = s->tail = s->head = (QNODE *) BNFA_MALLOC (sizeof(QNODE),s->memory);
       if(!q) return -1;
       q->state = state;
       q->next = 0;
   }
   else
   {
-      q = (QNODE *) BNFA_MALLOC (sizeof(QNODE),queue_memory);
+      q = (QNODE *) BNFA_MALLOC (sizeof(QNODE),s->memory);
       q->state = state;
       q->next = 0;
       s->tail->next = q;
@@ -306,7 +334,7 @@ int queue_remove (QUEUE * s)
         s->tail = 0;
         s->count = 0;
       }
-      BNFA_FREE (q,sizeof(QNODE),queue_memory);
+      BNFA_FREE (q,sizeof(QNODE),s->memory);
   }
   return state;
 }
@@ -513,7 +541,6 @@ int bnfaBuildMatchStateTrees(bnfa_struct_t *bnfa,
     return cnt;
 }
 
-static
 int bnfaBuildMatchStateTreesWithSnortConf(struct _SnortConfig *sc, bnfa_struct_t *bnfa,
                                           int (*build_tree)(struct _SnortConfig *, void *id, void **existing_tree),
                                           int (*neg_list_func)(void *id, void **list))
@@ -992,6 +1019,102 @@ int _bnfa_conv_list_to_full(bnfa_struct_t * bnfa)
 }
 #endif
 
+/*
+*  Layout order of the states in the transition list.  The default is
+*  state order.  The compact layout uses breadth first (depth) order so
+*  the root and the shallow states, which nearly every byte of payload
+*  touches, are packed together at the front of the list.
+*/
+static
+int _bnfa_layout_order(bnfa_struct_t * bnfa, bnfa_state_t * order)
+{
+  QUEUE           q, *queue = &q;
+  unsigned char * seen;
+  bnfa_state_t    full[BNFA_MAX_ALPHABET_SIZE];
+  int             k, i, n = 0;
+
+  if( !bnfa->bnfaCompact )
+  {
+    for(k=0;k<bnfa->bnfaNumStates;k++)
+        order[k] = k;
+    return 0;
+  }
+
+  seen = (unsigned char*)calloc(bnfa->bnfaNumStates, 1);
+  if( !seen )
+      return -1;
+
+  queue_init (queue);
+
+  order[n++] = 0;
+  seen[0] = 1;
+
+  if( queue_add (queue, 0) )
+  {
+      free(seen);
+      return -1;
+  }
+
+  while (queue_count (queue) > 0)
+  {
+    k = queue_remove (queue);
+
+    _bnfa_list_conv_row_to_full(bnfa, (bnfa_state_t)k, full );
+
+    for( i=0; i<bnfa->bnfaAlphabetSize; i++ )
+    {
+       bnfa_state_t state = full[i] & BNFA_SPARSE_MAX_STATE;
+
+       if( state == 0 || (int)state >= bnfa->bnfaNumStates || seen[state] )
+           continue;
+
+       seen[state] = 1;
+       order[n++] = state;
+
+       if( queue_add (queue, state) )
+       {
+           queue_free (queue);
+           free(seen);
+           return -1;
+       }
+    }
+  }
+  queue_free (queue);
+
+  /* every state is reachable from the root, but be safe */
+  for(k=0;k<bnfa->bnfaNumStates;k++)
+  {
+    if( !seen[k] )
+        order[n++] = k;
+  }
+  free(seen);
+
+  return 0;
+}
+
+/*
+*  Start index for a state with 'nw' words at 'ps_index'.  In the compact
+*  layout a state that fits in a cache line never straddles two and a
+*  larger one starts on a line boundary; the skipped words are set to
+*  BNFA_SPARSE_PAD.
+*/
+static
+inline
+unsigned _bnfa_layout_index(bnfa_struct_t * bnfa, unsigned ps_index, unsigned nw)
+{
+  unsigned off;
+
+  if( !bnfa->bnfaCompact )
+      return ps_index;
+
+  off = ps_index % BNFA_LINE_WORDS;
+
+  if( off && (nw > BNFA_LINE_WORDS || off + nw > BNFA_LINE_WORDS) )
+      ps_index += BNFA_LINE_WORDS - off;
+
+  return ps_index;
+}
+
 /*
 *  Convert state machine to csparse format
 *
@@ -1007,26 +1130,50 @@ int _bnfa_conv_list_to_full(bnfa_struct_t * bnfa)
 *  The compaction of multiple arays into a single array reduces the total
 *  number of states that can be handled since the max index is 2^24-1,
 *  whereas without compaction we had 2^24-1 states.
+*
+*  With the compact layout the states are stored in depth order and
+*  aligned so that small states sit within one cache line.  Each state
+*  still carries its transitions, fail index and match bit in one record
+*  so the search code is the same for both layouts.
 */
 static
 int _bnfa_conv_list_to_csparse_array(bnfa_struct_t * bnfa)
 {
-  int            m, k, i, nc;
+  int            m, k, i, j, nc;
   bnfa_state_t      state;
   bnfa_state_t    * FailState = (bnfa_state_t  *)bnfa->bnfaFailState;
   bnfa_state_t    * ps; /* transition list */
   bnfa_state_t    * pi; /* state indexes into ps */
+  bnfa_state_t    * po; /* layout order of the states */
   bnfa_state_t      ps_index=0;
-  unsigned       nps;
+  unsigned       nps, nw;
   bnfa_state_t      full[BNFA_MAX_ALPHABET_SIZE];
 
+  /*
+     State Index list for pi - we need an array of bnfa_state_t items of size 'NumStates'
+  */
+  pi = BNFA_MALLOC( bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+  if( !pi )
+  {
+      /* Fatal */
+      return -1;
+  }
+
+  po = BNFA_MALLOC( bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+  if( !po || _bnfa_layout_order(bnfa, po) )
+  {
+      /* Fatal */
+      BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+      BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+      return -1;
+  }
 
   /* count total state transitions, account for state and control words  */
   nps = 0;
-  for(k=0;k<bnfa->bnfaNumStates;k++)
+  for(j=0;j<bnfa->bnfaNumStates;j++)
   {
-    nps++; /* state word */
-    nps++; /* control word */
+    k = po[j];
+    nw = 2; /* state word, control word */
 
     /* count transitions */
     nc = 0;
@@ -1041,57 +1188,50 @@ int _bnfa_conv_list_to_csparse_array(bnfa_struct_t * bnfa)
     }
 
     /* add in transition count */
-       if( (k == 0 && bnfa->bnfaForceFullZeroState) || nc > BNFA_SPARSE_MAX_ROW_TRANSITIONS )
-    {
-        nps += BNFA_MAX_ALPHABET_SIZE;
-    }
+    if( (k == 0 && bnfa->bnfaForceFullZeroState) || nc > BNFA_SPARSE_MAX_ROW_TRANSITIONS )
+        nw += BNFA_MAX_ALPHABET_SIZE;
     else
-    {
-           for( i=0; i<bnfa->bnfaAlphabetSize; i++ )
-        {
-           state = full[i] & BNFA_SPARSE_MAX_STATE;
-           if( state != 0 )
-           {
-               nps++;
-           }
-        }
-    }
+        nw += nc;
+
+    /* save index of start of state 'k' */
+    nps = _bnfa_layout_index(bnfa, nps, nw);
+    pi[k] = nps;
+    nps += nw;
   }
 
   /* check if we have too many states + transitions */
   if( nps > BNFA_SPARSE_MAX_STATE )
   {
       /* Fatal */
+      BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+      BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
       return -1;
   }
 
   /*
     Alloc The Transition List - we need an array of bnfa_state_t items of size 'nps'
   */
-  ps = BNFA_MALLOC( nps*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+  ps = bnfa_alloc_aligned( nps*sizeof(bnfa_state_t),&bnfa->nextstate_memory);
   if( !ps )
   {
       /* Fatal */
+      BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+      BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
       return -1;
   }
   bnfa->bnfaTransList = ps;
-
-  /*
-     State Index list for pi - we need an array of bnfa_state_t items of size 'NumStates'
-  */
-  pi = BNFA_MALLOC( bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
-  if( !pi )
-  {
-      /* Fatal */
-      return -1;
-  }
+  bnfa->bnfaTransListSize = nps;
 
   /*
       Build the Transition List Array
   */
-  for(k=0;k<bnfa->bnfaNumStates;k++)
+  for(j=0;j<bnfa->bnfaNumStates;j++)
   {
-    pi[k] = ps_index; /* save index of start of state 'k' */
+    k = po[j];
+
+    /* fill any gap left by the layout */
+    while( ps_index < pi[k] )
+        ps[ ps_index++ ] = BNFA_SPARSE_PAD;
 
     ps[ ps_index ] = k; /* save the state were in as the 1st word */
 
@@ -1158,6 +1298,8 @@ int _bnfa_conv_list_to_csparse_array(bnfa_struct_t * bnfa)
   if( ps_index > nps )
   {
       /* Fatal */
+      BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+      BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
       return -1;
   }
 
@@ -1168,16 +1310,17 @@ int _bnfa_conv_list_to_csparse_array(bnfa_struct_t * bnfa)
   we have now converted next-state fields to next-index fields in this array,
   and we have merged the next-state and state arrays.
   */
-  ps_index=0;
   for(k=0; k< bnfa->bnfaNumStates; k++ )
   {
      if( pi[k] >= nps )
      {
          /* Fatal */
+         BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+         BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
          return -1;
      }
 
-     //ps_index = pi[k];  /* get index of next state */
+     ps_index = pi[k];  /* get index of next state */
      ps_index++;        /* skip state id */
 
      /* Full Format */
@@ -1220,12 +1363,15 @@ int _bnfa_conv_list_to_csparse_array(bnfa_struct_t * bnfa)
       if( ps_index > nps )
      {
          /* Fatal */
+         BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+         BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
          return -1;
      }
 
   }
 
   BNFA_FREE(pi,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
+  BNFA_FREE(po,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->nextstate_memory);
 
   return 0;
 }
@@ -1273,6 +1419,9 @@ void bnfaPrint(bnfa_struct_t * bnfa)
     {
        unsigned i,cw,fs,nt,fb,mb;
 
+       while( ps[ps_index] == BNFA_SPARSE_PAD )
+           ps_index++; /* skip layout padding */
+
        ps_index++; /* skip state number */
 
        cw = ps[ps_index]; /* control word  */
@@ -1389,7 +1538,6 @@ bnfa_struct_t * bnfaNew(void (*userfree)(void *p),
      p->neg_list_free          = neg_list_free;
   }
 
-  queue_memory = 0;
   return p;
 }
 
@@ -1405,6 +1553,16 @@ void bnfaSetCase(bnfa_struct_t  * p, int flag)
    if( flag == BNFA_NOCASE  ) p->bnfaCaseMode = flag;
 }
 
+void bnfaSetCache(bnfa_struct_t  * p, MpseCache * cache)
+{
+   p->bnfaCache = cache;
+}
+
+void bnfaSetCompact(bnfa_struct_t  * p, int flag)
+{
+   p->bnfaCompact = flag;
+}
+
 /*
 *   Fee all memory
 */
@@ -1465,7 +1623,12 @@ void bnfaFree (bnfa_struct_t * bnfa)
   BNFA_FREE(bnfa->bnfaFailState,bnfa->bnfaNumStates*sizeof(bnfa_state_t),bnfa->failstate_memory);
   BNFA_FREE(bnfa->bnfaMatchList,bnfa->bnfaNumStates*sizeof(bnfa_pattern_t*),bnfa->matchlist_memory);
   BNFA_FREE(bnfa->bnfaNextState,bnfa->bnfaNumStates*sizeof(bnfa_state_t*),bnfa->nextstate_memory);
-  BNFA_FREE(bnfa->bnfaTransList,(2*bnfa->bnfaNumStates+bnfa->bnfaNumTrans)*sizeof(bnfa_state_t*),bnfa->nextstate_memory);
+
+  /* a cached transition list belongs to the cache mapping */
+  if( bnfa->bnfaCacheRef )
+    mpseCacheRelease(bnfa->bnfaCacheRef);
+  else
+    BNFA_FREE(bnfa->bnfaTransList,bnfa->bnfaTransListSize*sizeof(bnfa_state_t),bnfa->nextstate_memory);
   free( bnfa ); /* cannot update memory tracker when deleting bnfa so just 'free' it !*/
 }
 
@@ -1507,6 +1670,232 @@ bnfaAddPattern (bnfa_struct_t * p,
   return 0;
 }
 
+/*
+*   Compiled state cache
+*
+*   A cached machine is the csparse transition list plus the match lists
+*   stored as indices into the pattern list.  The blob is an array of
+*   bnfa_state_t words:
+*
+*     header[BNFA_CACHE_HDR]
+*     transition list[nps]
+*     match list offsets[NumStates+1]
+*     match list pattern indices[nmatch]
+*
+*   Anything that changes the compiled result must go into the key.
+*/
+#define BNFA_CACHE_MAGIC   0x424e4641  /* 'BNFA' */
+#define BNFA_CACHE_VERSION 2
+
+enum {
+  BNFA_CACHE_MAGIC_IDX,
+  BNFA_CACHE_VERSION_IDX,
+  BNFA_CACHE_STATES,
+  BNFA_CACHE_TRANS,
+  BNFA_CACHE_NPS,
+  BNFA_CACHE_MATCH_STATES,
+  BNFA_CACHE_NMATCH,
+  BNFA_CACHE_PATTERNS,
+  BNFA_CACHE_FIELDS
+};
+
+/* header is padded to a cache line so the mapped list stays aligned */
+#define BNFA_CACHE_HDR  BNFA_LINE_WORDS
+
+static
+void _bnfa_cache_key (bnfa_struct_t * bnfa, MpseCacheKey * key)
+{
+    bnfa_pattern_t * plist;
+
+    mpseCacheKeyInit(key);
+    mpseCacheKeyUpdateInt(key, BNFA_CACHE_MAGIC);
+    mpseCacheKeyUpdateInt(key, BNFA_CACHE_VERSION);
+    mpseCacheKeyUpdateInt(key, sizeof(bnfa_state_t));
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaCaseMode);
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaFormat);
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaAlphabetSize);
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaOpt);
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaForceFullZeroState);
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaCompact);
+    mpseCacheKeyUpdateInt(key, bnfa->bnfaPatternCnt);
+
+    for(plist = bnfa->bnfaPatterns; plist != NULL; plist = plist->next)
+    {
+        mpseCacheKeyUpdateInt(key, plist->n);
+        mpseCacheKeyUpdateInt(key, plist->nocase);
+        mpseCacheKeyUpdateInt(key, plist->negative);
+        mpseCacheKeyUpdate(key, plist->casepatrn, plist->n);
+    }
+}
+
+static
+void _bnfa_cache_store (bnfa_struct_t * bnfa, MpseCacheKey * key)
+{
+    MpseCachePtrMap * pm;
+    bnfa_pattern_t * plist;
+    bnfa_match_node_t * mlist;
+    bnfa_state_t * blob, * moff, * mpat;
+    unsigned nps, nmatch = 0, n;
+    int k;
+
+    if( bnfa->bnfaFormat != BNFA_SPARSE )
+        return;
+
+    nps = bnfa->bnfaTransListSize;
+
+    for(k=0;k<bnfa->bnfaNumStates;k++)
+    {
+        for(mlist = bnfa->bnfaMatchList[k]; mlist; mlist = mlist->next)
+            nmatch++;
+    }
+
+    n = BNFA_CACHE_HDR + nps + bnfa->bnfaNumStates + 1 + nmatch;
+    blob = (bnfa_state_t*)SnortAlloc(n * sizeof(bnfa_state_t));
+
+    blob[BNFA_CACHE_MAGIC_IDX]   = BNFA_CACHE_MAGIC;
+    blob[BNFA_CACHE_VERSION_IDX] = BNFA_CACHE_VERSION;
+    blob[BNFA_CACHE_STATES]      = bnfa->bnfaNumStates;
+    blob[BNFA_CACHE_TRANS]       = bnfa->bnfaNumTrans;
+    blob[BNFA_CACHE_NPS]         = nps;
+    blob[BNFA_CACHE_MATCH_STATES]= bnfa->bnfaMatchStates;
+    blob[BNFA_CACHE_NMATCH]      = nmatch;
+    blob[BNFA_CACHE_PATTERNS]    = bnfa->bnfaPatternCnt;
+
+    memcpy(blob + BNFA_CACHE_HDR, bnfa->bnfaTransList, nps * sizeof(bnfa_state_t));
+
+    moff = blob + BNFA_CACHE_HDR + nps;
+    mpat = moff + bnfa->bnfaNumStates + 1;
+
+    pm = mpseCachePtrMapNew(bnfa->bnfaPatternCnt);
+
+    for(plist = bnfa->bnfaPatterns; plist != NULL; plist = plist->next)
+        mpseCachePtrMapAdd(pm, plist);
+
+    for(n=0, k=0; k<bnfa->bnfaNumStates; k++)
+    {
+        moff[k] = n;
+
+        for(mlist = bnfa->bnfaMatchList[k]; mlist; mlist = mlist->next)
+        {
+            int idx = mpseCachePtrMapFind(pm, mlist->data);
+
+            if( idx < 0 )
+            {
+                mpseCachePtrMapFree(pm);
+                free(blob);
+                return;
+            }
+            mpat[n++] = (bnfa_state_t)idx;
+        }
+    }
+    moff[k] = n;
+    mpseCachePtrMapFree(pm);
+
+    mpseCacheStore(bnfa->bnfaCache, key, blob,
+        (BNFA_CACHE_HDR + nps + bnfa->bnfaNumStates + 1 + nmatch) * sizeof(bnfa_state_t));
+}
+
+/*
+*  Returns 0 if the machine was loaded from the cache; the transition
+*  list is used in place and the match lists are rebuilt in stored order
+*  so that the rule option trees come out the same as a fresh compile.
+*/
+static
+int _bnfa_cache_load (bnfa_struct_t * bnfa, MpseCacheKey * key)
+{
+    const bnfa_state_t * blob, * moff, * mpat;
+    bnfa_pattern_t ** pats, * plist;
+    unsigned nstates, nps, nmatch, npats, i;
+    size_t len;
+
+    if( bnfa->bnfaFormat != BNFA_SPARSE )
+        return -1;
+
+    blob = (const bnfa_state_t*)mpseCacheFind(bnfa->bnfaCache, key, &len);
+
+    if( !blob || len < BNFA_CACHE_HDR * sizeof(bnfa_state_t) )
+        return -1;
+
+    nstates = blob[BNFA_CACHE_STATES];
+    nps     = blob[BNFA_CACHE_NPS];
+    nmatch  = blob[BNFA_CACHE_NMATCH];
+    npats   = blob[BNFA_CACHE_PATTERNS];
+
+    if( blob[BNFA_CACHE_MAGIC_IDX] != BNFA_CACHE_MAGIC ||
+        blob[BNFA_CACHE_VERSION_IDX] != BNFA_CACHE_VERSION ||
+        npats != bnfa->bnfaPatternCnt || !nstates ||
+        nstates > BNFA_SPARSE_MAX_STATE || nps > BNFA_SPARSE_MAX_STATE ||
+        len != (BNFA_CACHE_HDR + nps + nstates + 1 + (size_t)nmatch) * sizeof(bnfa_state_t) )
+        return -1;
+
+    moff = blob + BNFA_CACHE_HDR + nps;
+    mpat = moff + nstates + 1;
+
+    if( moff[nstates] != nmatch )
+        return -1;
+
+    for(i=0;i<nstates;i++)
+    {
+        if( moff[i] > moff[i+1] )
+            return -1;
+    }
+    for(i=0;i<nmatch;i++)
+    {
+        if( mpat[i] >= npats )
+            return -1;
+    }
+
+    pats = (bnfa_pattern_t**)SnortAlloc((npats ? npats : 1) * sizeof(*pats));
+
+    for(i = 0, plist = bnfa->bnfaPatterns; plist != NULL; plist = plist->next)
+        pats[i++] = plist;
+
+    bnfa->bnfaMatchList=(bnfa_match_node_t**)BNFA_MALLOC(sizeof(void*) * nstates,bnfa->matchlist_memory);
+    if(!bnfa->bnfaMatchList)
+    {
+        free(pats);
+        return -1;
+    }
+
+    for(i=0;i<nstates;i++)
+    {
+        bnfa_match_node_t ** tail = &bnfa->bnfaMatchList[i];
+        unsigned m;
+
+        for(m=moff[i];m<moff[i+1];m++)
+        {
+            bnfa_match_node_t * pmn = (bnfa_match_node_t*)
+                BNFA_MALLOC(sizeof(bnfa_match_node_t),bnfa->matchlist_memory);
+
+            if( !pmn )
+            {
+                free(pats);
+                return -1;  /* bnfaFree cleans up */
+            }
+            pmn->data = pats[mpat[m]];
+            *tail = pmn;
+            tail = &pmn->next;
+        }
+    }
+    free(pats);
+
+    for(plist = bnfa->bnfaPatterns; plist != NULL; plist = plist->next)
+        bnfa->bnfaMaxStates += plist->n;
+    bnfa->bnfaMaxStates++;
+
+    bnfa->bnfaNumStates    = nstates;
+    bnfa->bnfaNumTrans     = blob[BNFA_CACHE_TRANS];
+    bnfa->bnfaMatchStates  = blob[BNFA_CACHE_MATCH_STATES];
+    bnfa->bnfaTransList    = (bnfa_state_t*)(blob + BNFA_CACHE_HDR);
+    bnfa->bnfaTransListSize= nps;
+    bnfa->bnfaCacheRef     = mpseCacheRef(bnfa->bnfaCache);
+    bnfa->nextstate_memory += nps * sizeof(bnfa_state_t);
+
+    bnfaAccumInfo( bnfa );
+
+    return 0;
+}
+
 /*
 *   Compile the patterns into an nfa state machine
 */
@@ -1517,8 +1906,18 @@ _bnfaCompile (bnfa_struct_t * bnfa)
     bnfa_match_node_t   ** tmpMatchList;
     unsigned          cntMatchStates;
     int               i;
+    MpseCacheKey      key;
+
+    if( bnfa->bnfaCache )
+    {
+        _bnfa_cache_key(bnfa, &key);
 
-    queue_memory =0;
+        if( !_bnfa_cache_load(bnfa, &key) )
+            return 0;
+
+        if( bnfa->bnfaMatchList )
+            return -1;  /* partially loaded; bnfaFree cleans up */
+    }
 
     /* Count number of states */
     for(plist = bnfa->bnfaPatterns; plist != NULL; plist = plist->next)
@@ -1635,10 +2034,12 @@ _bnfaCompile (bnfa_struct_t * bnfa)
     }
 
     bnfa->bnfaMatchStates = cntMatchStates;
-    bnfa->queue_memory    = queue_memory;
 
     bnfaAccumInfo( bnfa  );
 
+    if( bnfa->bnfaCache )
+        _bnfa_cache_store(bnfa, &key);
+
     return 0;
 }
 
@@ -2307,6 +2708,85 @@ _bnfa_search_csparse_nfa_q(   bnfa_struct_t * bnfa, unsigned char *T, int n,
     return _process_queue( bnfa, Match, data );
 }
 
+/*
+ *  Batched version of the above: walks several buffers, each through
+ *  its own machine, one byte of each lane per round, so the transition
+ *  list misses of the lanes overlap.  The lanes share the queue of the
+ *  first machine, which is flushed when full and at the end of the
+ *  batch.  Each round runs as many steps as the shortest remaining
+ *  lane, then the exhausted lanes are retired.
+ */
+typedef struct
+{
+    bnfa_state_t       * transList;
+    bnfa_match_node_t ** MatchList;
+    unsigned char      * T;
+    unsigned char      * Tend;
+    unsigned             sindex;
+    int                * current_state;
+
+} bnfa_lane_t;
+
+static
+inline
+unsigned
+_bnfa_search_csparse_nfa_q_batch( bnfa_lane_t * lane, int nl, bnfa_struct_t * qb,
+                 int (*Match)(bnfa_pattern_t * id, void *tree, int index, void *data, void *neg_list),
+                 void *data )
+{
+    bnfa_match_node_t  * mlist;
+    unsigned             last_sindex;
+    unsigned             sindex;
+    int                  i, k, step;
+
+    while( nl > 0 )
+    {
+        step = lane[0].Tend - lane[0].T;
+        for( i=1; i<nl; i++ )
+            if( lane[i].Tend - lane[i].T < step )
+                step = lane[i].Tend - lane[i].T;
+
+        for( k=0; k<step; k++ )
+        {
+            for( i=0; i<nl; i++ )
+            {
+                last_sindex = lane[i].sindex;
+
+                /* Transition to next state index */
+                sindex = _bnfa_get_next_state_csparse_nfa(lane[i].transList,
+                                last_sindex, xlatcase[*lane[i].T++]);
+                lane[i].sindex = sindex;
+
+                /* Log matches in this state - if any */
+                if( !sindex || sindex == last_sindex ||
+                    !(lane[i].transList[sindex+1] & BNFA_SPARSE_MATCH_BIT) )
+                    continue;
+
+                mlist = lane[i].MatchList[ lane[i].transList[sindex] ];
+                if( mlist && _add_queue(qb,mlist) && _process_queue(qb,Match,data) )
+                {
+                    for( i=0; i<nl; i++ )
+                        *lane[i].current_state = lane[i].sindex;
+                    return 1;
+                }
+            }
+        }
+
+        for( i=0; i<nl; )
+        {
+            if( lane[i].T < lane[i].Tend )
+            {
+                i++;
+                continue;
+            }
+            *lane[i].current_state = lane[i].sindex;
+            lane[i] = lane[--nl];
+        }
+    }
+
+    return _process_queue( qb, Match, data );
+}
+
 /*
  *  Per Pattern case search, case is on per pattern basis
  *  standard snort search
@@ -2653,6 +3133,61 @@ bnfaSearch( bnfa_struct_t * bnfa, unsigned char *Tx, int n,
     return ret;
 }
 
+/*
+*  Search nb buffers, T[i] with bnfa[i], nb at most BNFA_MAX_BATCH.
+*  Per pattern case machines using the match queue are walked together;
+*  anything else is searched on its own.  Returns 1 if Match stopped the
+*  queued search, 0 otherwise, and the end state of each buffer in
+*  current_state[i].
+*/
+unsigned
+bnfaSearchBatch( bnfa_struct_t ** bnfa, unsigned char ** Tx, int * n, int nb,
+            int (*Match)(void * id, void *tree, int index, void *data, void *neg_list),
+            void *data, int * current_state )
+{
+    bnfa_lane_t lane[BNFA_MAX_BATCH];
+    bnfa_struct_t * qb = NULL;
+    int i, nl = 0;
+
+    for( i=0; i<nb; i++ )
+    {
+        if( bnfa[i]->bnfaCaseMode == BNFA_PER_PAT_CASE && !bnfa[i]->bnfaMethod
+#ifdef ALLOW_NFA_FULL
+            && bnfa[i]->bnfaFormat == BNFA_SPARSE
+#endif
+          )
+        {
+            if( !qb )
+                qb = bnfa[i];
+
+            lane[nl].transList = bnfa[i]->bnfaTransList;
+            lane[nl].MatchList = bnfa[i]->bnfaMatchList;
+            lane[nl].T = Tx[i];
+            lane[nl].Tend = Tx[i] + n[i];
+            lane[nl].sindex = 0;
+            lane[nl].current_state = &current_state[i];
+            nl++;
+            continue;
+        }
+
+        bnfaSearch(bnfa[i], Tx[i], n[i], Match, data, 0, &current_state[i]);
+    }
+
+    if( !nl )
+        return 0;
+
+    if( nl == 1 )
+        return _bnfa_search_csparse_nfa_q( qb, lane[0].T, lane[0].Tend - lane[0].T,
+            (int (*)(bnfa_pattern_t * id, void *tree, int index, void *data, void *neg_list))
+            Match, data, 0, lane[0].current_state );
+
+    _init_queue(qb);
+
+    return _bnfa_search_csparse_nfa_q_batch( lane, nl, qb,
+        (int (*)(bnfa_pattern_t * id, void *tree, int index, void *data, void *neg_list))
+        Match, data );
+}
+
 int bnfaPatternCount( bnfa_struct_t * p)
 {
     return p->bnfaPatternCnt;
@@ -2664,6 +3199,11 @@ int bnfaPatternCount( bnfa_struct_t * p)
 static bnfa_struct_t summary;
 static int summary_cnt=0;
 
+#ifndef WIN32
+/* matchers may be compiled concurrently (see mpseCompile) */
+static pthread_mutex_t summary_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /*
 *  Info: Print info a particular state machine.
 */
@@ -2707,6 +3247,86 @@ void bnfaPrintInfoEx( bnfa_struct_t * p, char * text )
     }
     LogMessage("+-------------------------------------------------\n");
 }
+/*
+*  Walk the transition list from the root in depth order and mark the
+*  cache lines each state's record spans.  This works on the final list
+*  so it covers cached machines and either layout.
+*/
+void bnfaGetFootprint( bnfa_struct_t * p, int depth, unsigned * bytes,
+                       unsigned * lines, unsigned * hot_lines )
+{
+    bnfa_state_t * ps = p->bnfaTransList;
+    unsigned nps = p->bnfaTransListSize;
+    uintptr_t first, last;
+    unsigned nlines, i, head = 0, tail = 0;
+    unsigned char * line, * seen;
+    unsigned * queue, * level;
+
+    *bytes = *lines = *hot_lines = 0;
+
+    if( !ps || !nps || p->bnfaFormat != BNFA_SPARSE )
+        return;
+
+    first = (uintptr_t)ps / BNFA_LINE_SIZE;
+    last  = ((uintptr_t)(ps + nps) - 1) / BNFA_LINE_SIZE;
+    nlines = (unsigned)(last - first + 1);
+
+    line  = (unsigned char*)SnortAlloc(nlines);
+    seen  = (unsigned char*)SnortAlloc(nps);
+    queue = (unsigned*)SnortAlloc(p->bnfaNumStates * sizeof(*queue));
+    level = (unsigned*)SnortAlloc(p->bnfaNumStates * sizeof(*level));
+
+    queue[tail++] = 0;
+    seen[0] = 1;
+
+    while( head < tail )
+    {
+        unsigned sindex = queue[head];
+        unsigned d = level[head++];
+        bnfa_state_t cw = ps[sindex+1];
+        unsigned nt, nw;
+        uintptr_t a, b;
+
+        if( cw & BNFA_SPARSE_FULL_BIT )
+            nt = BNFA_MAX_ALPHABET_SIZE;
+        else
+            nt = (cw & BNFA_SPARSE_COUNT_BITS) >> BNFA_SPARSE_COUNT_SHIFT;
+
+        nw = 2 + nt;
+        a = (uintptr_t)(ps + sindex) / BNFA_LINE_SIZE - first;
+        b = ((uintptr_t)(ps + sindex + nw) - 1) / BNFA_LINE_SIZE - first;
+
+        for( ; a <= b; a++ )
+            line[a] |= ((int)d <= depth) ? 2 : 1;
+
+        for( i = 0; i < nt; i++ )
+        {
+            unsigned next = ps[sindex+2+i] & BNFA_SPARSE_MAX_STATE;
+
+            if( next >= nps || seen[next] || tail >= (unsigned)p->bnfaNumStates )
+                continue;
+
+            seen[next] = 1;
+            level[tail] = d + 1;
+            queue[tail++] = next;
+        }
+    }
+
+    for( i = 0; i < nlines; i++ )
+    {
+        if( line[i] )
+            (*lines)++;
+        if( line[i] & 2 )
+            (*hot_lines)++;
+    }
+    *bytes = nps * sizeof(bnfa_state_t);
+
+    free(line);
+    free(seen);
+    free(queue);
+    free(level);
+}
+
 void bnfaPrintInfo( bnfa_struct_t * p )
 {
      bnfaPrintInfoEx( p, 0 );
@@ -2725,6 +3345,9 @@ void bnfaAccumInfo( bnfa_struct_t * p )
 {
     bnfa_struct_t * px = &summary;
 
+#ifndef WIN32
+    pthread_mutex_lock(&summary_lock);
+#endif
     summary_cnt++;
 
     px->bnfaAlphabetSize  = p->bnfaAlphabetSize;
@@ -2739,6 +3362,9 @@ void bnfaAccumInfo( bnfa_struct_t * p )
     px->matchlist_memory += p->matchlist_memory;
     px->nextstate_memory += p->nextstate_memory;
     px->failstate_memory += p->failstate_memory;
+#ifndef WIN32
+    pthread_mutex_unlock(&summary_lock);
+#endif
 }
 
 #ifdef MATCH_LIST_CNT
@@ -60,6 +60,11 @@ k**
 #define BNFA_SPARSE_COUNT_BITS          0x3f000000
 #define BNFA_SPARSE_MAX_ROW_TRANSITIONS 0x3f
 
+/* compact layout: gap filler and words per 64 byte cache line */
+#define BNFA_SPARSE_PAD                 0xffffffff
+#define BNFA_LINE_SIZE                  64
+#define BNFA_LINE_WORDS                 (BNFA_LINE_SIZE/sizeof(bnfa_state_t))
+
 typedef  unsigned int   bnfa_state_t;
 
 
@@ -140,7 +145,9 @@ typedef struct {
 	bnfa_state_t       * bnfaFailState;
 
 	bnfa_state_t       * bnfaTransList;
+	unsigned           bnfaTransListSize;  /* words, including any padding */
    	int                bnfaForceFullZeroState;
+	int                bnfaCompact;        /* depth ordered, line aligned layout */
 
 	int 			   bnfa_memory;
 	int 			   pat_memory;
@@ -154,6 +161,9 @@ typedef struct {
     void               (*optiontreefree)(void **);
     void               (*neg_list_free)(void **);
 
+    struct _MpseCache  * bnfaCache;     /* compiled state cache, if any */
+    void               * bnfaCacheRef;  /* set if bnfaTransList is mapped */
+
 #define MAX_INQ 32
     unsigned inq;
     unsigned inq_flush;
@@ -168,6 +178,9 @@ bnfa_struct_t * bnfaNew ( void (*userfree)(void *p),
                           void (*neg_list_free)(void **p));
 void bnfaSetOpt(bnfa_struct_t  * p, int flag);
 void bnfaSetCase(bnfa_struct_t  * p, int flag);
+struct _MpseCache;
+void bnfaSetCache(bnfa_struct_t  * p, struct _MpseCache * cache);
+void bnfaSetCompact(bnfa_struct_t  * p, int flag);
 void bnfaFree( bnfa_struct_t  * pstruct );
 
 int bnfaAddPattern( bnfa_struct_t * pstruct,
@@ -181,6 +194,10 @@ struct _SnortConfig;
 int bnfaCompileWithSnortConf( struct _SnortConfig *, bnfa_struct_t * pstruct,
 			     int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                  int (*neg_list_func)(void *id, void **list));
+/* for matchers compiled without trees */
+int bnfaBuildMatchStateTreesWithSnortConf( struct _SnortConfig *, bnfa_struct_t * pstruct,
+			     int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
+                 int (*neg_list_func)(void *id, void **list));
 
 unsigned bnfaSearch( bnfa_struct_t * pstruct, unsigned char * t, int tlen,
         		    int (*match)(void * id, void *tree, int index, void *data, void *neg_list),
@@ -188,11 +205,26 @@ unsigned bnfaSearch( bnfa_struct_t * pstruct, unsigned char * t, int tlen,
 					unsigned sindex,
                     int* current_state );
 
+/* at most BNFA_MAX_BATCH buffers per call */
+#define BNFA_MAX_BATCH 8
+unsigned bnfaSearchBatch( bnfa_struct_t ** pstruct, unsigned char ** t, int * tlen, int nb,
+        		    int (*match)(void * id, void *tree, int index, void *data, void *neg_list),
+					void * sdata,
+                    int * current_state );
+
 int bnfaPatternCount( bnfa_struct_t * p);
 
 void bnfaPrint(	bnfa_struct_t * pstruct); /* prints the nfa states-verbose!! */
 void bnfaPrintInfo( bnfa_struct_t  * pstruct); /* print info on this search engine */
 
+/*
+ * Footprint of the compiled transition list: total bytes, cache lines
+ * spanned, and lines holding the root and states up to 'depth' - the
+ * working set for typical (mostly non matching) traffic.
+ */
+void bnfaGetFootprint( bnfa_struct_t * p, int depth, unsigned * bytes,
+                       unsigned * lines, unsigned * hot_lines );
+
 /*
  * Summary - this tracks search engine information accross multiple instances of
  * search engines.  It helps in snort where we have many search engines, each using
@@ -61,6 +61,7 @@ typedef struct _mpse_struct {
     int    verbose;
     uint64_t bcnt;
     char   inc_global_counter;
+    char   compiled;        /* by mpseCompile, trees still to do */
 
 } MPSE;
 
@@ -103,6 +104,11 @@ void * mpseNew( int method, int use_global_counter_flag,
             p->obj = acsmNew2(userfree, optiontreefree, neg_list_free);
             if(p->obj)acsmSelectFormat2((ACSM_STRUCT2*)p->obj,ACF_FULLQ  );
             break;
+        case MPSE_ACF_Q_SIMD:
+            p->obj = acsmNew2(userfree, optiontreefree, neg_list_free);
+            if(p->obj)acsmSelectFormat2((ACSM_STRUCT2*)p->obj,ACF_FULLQ  );
+            if(p->obj)acsmEnablePrefilter2((ACSM_STRUCT2*)p->obj, 1);
+            break;
         case MPSE_ACS:
             p->obj = acsmNew2(userfree, optiontreefree, neg_list_free);
             if(p->obj)acsmSelectFormat2((ACSM_STRUCT2*)p->obj,ACF_SPARSE  );
@@ -175,6 +181,11 @@ void * mpseNewWithSnortConfig( struct _SnortConfig *sc,
             p->obj = acsmNew2(userfree, optiontreefree, neg_list_free);
             if(p->obj)acsmSelectFormat2((ACSM_STRUCT2*)p->obj,ACF_FULLQ  );
             break;
+        case MPSE_ACF_Q_SIMD:
+            p->obj = acsmNew2(userfree, optiontreefree, neg_list_free);
+            if(p->obj)acsmSelectFormat2((ACSM_STRUCT2*)p->obj,ACF_FULLQ  );
+            if(p->obj)acsmEnablePrefilter2((ACSM_STRUCT2*)p->obj, 1);
+            break;
         case MPSE_ACS:
             p->obj = acsmNew2(userfree, optiontreefree, neg_list_free);
             if(p->obj)acsmSelectFormat2((ACSM_STRUCT2*)p->obj,ACF_SPARSE  );
@@ -233,6 +244,7 @@ void   mpseSetOpt( void * pvoid, int flag )
             break;
         case MPSE_ACF:
         case MPSE_ACF_Q:
+        case MPSE_ACF_Q_SIMD:
             if (p->obj)
                 acsmCompressStates((ACSM_STRUCT2*)p->obj, flag);
             break;
@@ -241,6 +253,48 @@ void   mpseSetOpt( void * pvoid, int flag )
     }
 }
 
+void   mpseSetCache( void * pvoid, struct _MpseCache * cache )
+{
+    MPSE * p = (MPSE*)pvoid;
+
+    if (p == NULL || p->obj == NULL)
+        return;
+    switch( p->method )
+    {
+        case MPSE_AC_BNFA_Q:
+        case MPSE_AC_BNFA:
+            bnfaSetCache((bnfa_struct_t*)p->obj, cache);
+            break;
+        case MPSE_ACF:
+        case MPSE_ACF_Q:
+        case MPSE_ACF_Q_SIMD:
+        case MPSE_ACS:
+        case MPSE_ACB:
+        case MPSE_ACSB:
+            acsmSetCache2((ACSM_STRUCT2*)p->obj, cache);
+            break;
+        default:
+            break;
+    }
+}
+
+void   mpseSetCompact( void * pvoid, int flag )
+{
+    MPSE * p = (MPSE*)pvoid;
+
+    if (p == NULL || p->obj == NULL)
+        return;
+    switch( p->method )
+    {
+        case MPSE_AC_BNFA_Q:
+        case MPSE_AC_BNFA:
+            bnfaSetCompact((bnfa_struct_t*)p->obj, flag);
+            break;
+        default:
+            break;
+    }
+}
+
 void   mpseFree( void * pvoid )
 {
     MPSE * p = (MPSE*)pvoid;
@@ -265,6 +319,7 @@ void   mpseFree( void * pvoid )
 
         case MPSE_ACF:
         case MPSE_ACF_Q:
+        case MPSE_ACF_Q_SIMD:
         case MPSE_ACS:
         case MPSE_ACB:
         case MPSE_ACSB:
@@ -312,6 +367,7 @@ int  mpseAddPattern ( void * pvoid, void * P, int m,
 
      case MPSE_ACF:
      case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
      case MPSE_ACS:
      case MPSE_ACB:
      case MPSE_ACSB:
@@ -346,6 +402,7 @@ int  mpseAddPatternWithSnortConfig ( SnortConfig *sc, void * pvoid, void * P, in
 
      case MPSE_ACF:
      case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
      case MPSE_ACS:
      case MPSE_ACB:
      case MPSE_ACSB:
@@ -397,6 +454,7 @@ int  mpsePrepPatterns  ( void * pvoid,
 
      case MPSE_ACF:
      case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
      case MPSE_ACS:
      case MPSE_ACB:
      case MPSE_ACSB:
@@ -415,6 +473,96 @@ int  mpsePrepPatterns  ( void * pvoid,
   return retv;
 }
 
+/*
+*  Compile the state machine without building the detection option trees.
+*  This only touches the matcher itself (and the compile cache) so distinct
+*  matchers may be compiled concurrently.  mpsePrepPatternsWithSnortConf()
+*  must still be called to build the trees; it skips the compile if this
+*  succeeded.  Returns 0 if compiled, -1 on error or 1 if the method
+*  can't be compiled separately.
+*/
+int mpseCompile ( void * pvoid )
+{
+  int retv;
+  MPSE * p = (MPSE*)pvoid;
+
+  switch( p->method )
+   {
+     case MPSE_AC_BNFA:
+     case MPSE_AC_BNFA_Q:
+       retv = bnfaCompile( (bnfa_struct_t*) p->obj, NULL, NULL );
+     break;
+
+     case MPSE_AC:
+       retv = acsmCompile( (ACSM_STRUCT*) p->obj, NULL, NULL );
+     break;
+
+     case MPSE_ACF:
+     case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
+     case MPSE_ACS:
+     case MPSE_ACB:
+     case MPSE_ACSB:
+       retv = acsmCompile2( (ACSM_STRUCT2*) p->obj, NULL, NULL );
+     break;
+
+     case MPSE_LOWMEM:
+     case MPSE_LOWMEM_Q:
+       retv = KTrieCompile( (KTRIE_STRUCT *)p->obj, NULL, NULL );
+     break;
+
+     default:
+       return 1;
+   }
+
+  if( retv )
+      return -1;
+
+  p->compiled = 1;
+  return 0;
+}
+
+static int mpseBuildTreesWithSnortConf ( struct _SnortConfig *sc, MPSE * p,
+                         int ( *build_tree )(struct _SnortConfig *, void *id, void **existing_tree),
+                         int ( *neg_list_func )(void *id, void **list) )
+{
+  p->compiled = 0;
+
+  if( !build_tree || !neg_list_func )
+      return 0;
+
+  switch( p->method )
+   {
+     case MPSE_AC_BNFA:
+     case MPSE_AC_BNFA_Q:
+       bnfaBuildMatchStateTreesWithSnortConf( sc, (bnfa_struct_t*) p->obj, build_tree, neg_list_func );
+     break;
+
+     case MPSE_AC:
+       acsmBuildMatchStateTreesWithSnortConf( sc, (ACSM_STRUCT*) p->obj, build_tree, neg_list_func );
+     break;
+
+     case MPSE_ACF:
+     case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
+     case MPSE_ACS:
+     case MPSE_ACB:
+     case MPSE_ACSB:
+       acsmBuildMatchStateTrees2WithSnortConf( sc, (ACSM_STRUCT2*) p->obj, build_tree, neg_list_func );
+     break;
+
+     case MPSE_LOWMEM:
+     case MPSE_LOWMEM_Q:
+       KTrieBuildMatchStateTreesWithSnortConf( sc, (KTRIE_STRUCT *)p->obj, build_tree, neg_list_func );
+     break;
+
+     default:
+     break;
+   }
+
+  return 0;
+}
+
 int  mpsePrepPatternsWithSnortConf  ( struct _SnortConfig *sc, void * pvoid,
                          int ( *build_tree )(struct _SnortConfig *, void *id, void **existing_tree),
                          int ( *neg_list_func )(void *id, void **list) )
@@ -422,6 +570,9 @@ int  mpsePrepPatternsWithSnortConf  ( struct _SnortConfig *sc, void * pvoid,
   int retv;
   MPSE * p = (MPSE*)pvoid;
 
+  if( p->compiled )
+      return mpseBuildTreesWithSnortConf( sc, p, build_tree, neg_list_func );
+
   switch( p->method )
    {
      case MPSE_AC_BNFA:
@@ -435,6 +586,7 @@ int  mpsePrepPatternsWithSnortConf  ( struct _SnortConfig *sc, void * pvoid,
 
      case MPSE_ACF:
      case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
      case MPSE_ACS:
      case MPSE_ACB:
      case MPSE_ACSB:
@@ -486,6 +638,7 @@ int mpsePrintInfo( void *pvoid )
       return acsmPrintDetailInfo( (ACSM_STRUCT*) p->obj );
      case MPSE_ACF:
      case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
      case MPSE_ACS:
      case MPSE_ACB:
      case MPSE_ACSB:
@@ -513,6 +666,7 @@ int mpsePrintSummary(int method)
             break;
         case MPSE_ACF:
         case MPSE_ACF_Q:
+        case MPSE_ACF_Q_SIMD:
         case MPSE_ACS:
         case MPSE_ACB:
         case MPSE_ACSB:
@@ -550,6 +704,7 @@ int mpsePrintSummaryWithSnortConfig(SnortConfig *sc, int method)
             break;
         case MPSE_ACF:
         case MPSE_ACF_Q:
+        case MPSE_ACF_Q_SIMD:
         case MPSE_ACS:
         case MPSE_ACB:
         case MPSE_ACSB:
@@ -617,6 +772,7 @@ int mpseSearch( void *pvoid, const unsigned char * T, int n,
 
      case MPSE_ACF:
      case MPSE_ACF_Q:
+     case MPSE_ACF_Q_SIMD:
      case MPSE_ACS:
      case MPSE_ACB:
      case MPSE_ACSB:
@@ -646,6 +802,96 @@ int mpseSearch( void *pvoid, const unsigned char * T, int n,
 
 }
 
+/*
+ * The ac full-q and ac-bnfa queued searches walk all of their buffers in
+ * a batch together, one byte of each buffer at a time, and only process
+ * the matches once for the whole batch.  Other methods just search each
+ * buffer in turn.
+ */
+int mpseSearchBatch( MpseBatchItem * b, int nb,
+                     int ( *action )(void* id, void * tree, int index, void *data, void *neg_list),
+                     void * data )
+{
+    ACSM_STRUCT2 * acsm[MPSE_MAX_BATCH];
+    bnfa_struct_t * bnfa[MPSE_MAX_BATCH];
+    unsigned char * acsmT[MPSE_MAX_BATCH], * bnfaT[MPSE_MAX_BATCH];
+    int acsmN[MPSE_MAX_BATCH], bnfaN[MPSE_MAX_BATCH];
+    int acsmState[MPSE_MAX_BATCH], bnfaState[MPSE_MAX_BATCH];
+    MpseBatchItem * acsmItem[MPSE_MAX_BATCH], * bnfaItem[MPSE_MAX_BATCH];
+    int i, na, nf, ret = 0;
+    PROFILE_VARS;
+
+    while ( nb > MPSE_MAX_BATCH )
+    {
+        if ( mpseSearchBatch(b, MPSE_MAX_BATCH, action, data) )
+            return 1;
+
+        b += MPSE_MAX_BATCH;
+        nb -= MPSE_MAX_BATCH;
+    }
+
+    na = nf = 0;
+
+    for ( i = 0; i < nb; i++ )
+    {
+        MPSE * p = (MPSE*)b[i].so;
+
+        b[i].state = 0;
+
+        switch( p->method )
+        {
+            case MPSE_AC_BNFA:
+            case MPSE_AC_BNFA_Q:
+                bnfa[nf] = (bnfa_struct_t*)p->obj;
+                bnfaT[nf] = (unsigned char *)b[i].T;
+                bnfaN[nf] = b[i].n;
+                bnfaState[nf] = 0;
+                bnfaItem[nf++] = &b[i];
+                break;
+
+            case MPSE_ACF:
+            case MPSE_ACF_Q:
+            case MPSE_ACF_Q_SIMD:
+            case MPSE_ACS:
+            case MPSE_ACB:
+            case MPSE_ACSB:
+                acsm[na] = (ACSM_STRUCT2*)p->obj;
+                acsmT[na] = (unsigned char *)b[i].T;
+                acsmN[na] = b[i].n;
+                acsmState[na] = 0;
+                acsmItem[na++] = &b[i];
+                break;
+
+            default:
+                mpseSearch(p, b[i].T, b[i].n, action, data, &b[i].state);
+                continue;
+        }
+
+        p->bcnt += b[i].n;
+
+        if(p->inc_global_counter)
+            s_bcnt += b[i].n;
+    }
+
+    PREPROC_PROFILE_START(mpsePerfStats);
+
+    if ( na )
+        ret = acsmSearchBatch2(acsm, acsmT, acsmN, na, action, data, acsmState);
+
+    if ( nf && !ret )
+        ret = bnfaSearchBatch(bnfa, bnfaT, bnfaN, nf, action, data, bnfaState);
+
+    PREPROC_PROFILE_END(mpsePerfStats);
+
+    for ( i = 0; i < na; i++ )
+        acsmItem[i]->state = acsmState[i];
+
+    for ( i = 0; i < nf; i++ )
+        bnfaItem[i]->state = bnfaState[i];
+
+    return ret;
+}
+
 int mpseGetPatternCount(void *pvoid)
 {
     MPSE * p = (MPSE*)pvoid;
@@ -662,6 +908,7 @@ int mpseGetPatternCount(void *pvoid)
             return acsmPatternCount((ACSM_STRUCT*)p->obj);
         case MPSE_ACF:
         case MPSE_ACF_Q:
+        case MPSE_ACF_Q_SIMD:
         case MPSE_ACS:
         case MPSE_ACB:
         case MPSE_ACSB:
@@ -677,6 +924,31 @@ int mpseGetPatternCount(void *pvoid)
     return 0;
 }
 
+/* states at this depth or less are touched by most of the traffic */
+#define MPSE_HOT_DEPTH 2
+
+int mpseGetFootprint( void * pvoid, MpseFootprint * fp )
+{
+    MPSE * p = (MPSE*)pvoid;
+
+    memset(fp, 0, sizeof(*fp));
+
+    if (p == NULL || p->obj == NULL)
+        return -1;
+
+    switch( p->method )
+    {
+        case MPSE_AC_BNFA:
+        case MPSE_AC_BNFA_Q:
+            bnfaGetFootprint((bnfa_struct_t *)p->obj, MPSE_HOT_DEPTH,
+                &fp->bytes, &fp->lines, &fp->hot_lines);
+            return 0;
+        default:
+            break;
+    }
+    return -1;
+}
+
 uint64_t mpseGetPatByteCount(void)
 {
     return s_bcnt;
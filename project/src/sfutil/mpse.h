@@ -72,6 +72,8 @@
 #define MPSE_INTEL_CPM 14
 #endif /* INTEL_SOFT_CPM */
 
+#define MPSE_ACF_Q_SIMD 15
+
 #define MPSE_INCREMENT_GLOBAL_CNT 1
 #define MPSE_DONT_INCREMENT_GLOBAL_COUNT 0
 
@@ -107,12 +109,33 @@ int  mpsePrepPatternsWithSnortConf  ( struct _SnortConfig *, void * pvoid,
                                       int ( *build_tree )(struct _SnortConfig *, void *id, void **existing_tree),
                                       int ( *neg_list_func )(void *id, void **list) );
 
+/* thread safe for distinct matchers; trees are still built by PrepPatterns */
+int  mpseCompile ( void * pvoid );
+
 void mpseSetRuleMask   ( void *pv, BITOP * rm );
 
 int  mpseSearch( void *pv, const unsigned char * T, int n,
                  int ( *action )(void* id, void * tree, int index, void *data, void *neg_list),
                  void * data, int* current_state );
 
+/* one buffer of a batched search; state is the end state on return */
+typedef struct _MpseBatchItem
+{
+    void * so;
+    const unsigned char * T;
+    int n;
+    int state;
+
+} MpseBatchItem;
+
+#define MPSE_MAX_BATCH 8
+
+/* search b[i].T with b[i].so for each item; returns nonzero if the
+   action stopped a queued search */
+int  mpseSearchBatch( MpseBatchItem * b, int nb,
+                      int ( *action )(void* id, void * tree, int index, void *data, void *neg_list),
+                      void * data );
+
 int mpseGetPatternCount(void *pv);
 
 uint64_t mpseGetPatByteCount(void);
@@ -125,6 +148,24 @@ int mpsePrintSummaryWithSnortConfig(struct _SnortConfig *, int);
 void   mpseVerbose( void * pvoid );
 void   mpseSetOpt( void * pvoid,int flag);
 
+/* compiled matcher cache, see mpse_cache.h; ignored by methods that
+   don't support it */
+struct _MpseCache;
+void   mpseSetCache( void * pvoid, struct _MpseCache * cache );
+
+/* depth ordered, cache line aligned state layout; ac-bnfa only */
+void   mpseSetCompact( void * pvoid, int flag );
+
+/* compiled state footprint; returns -1 if the method doesn't report it */
+typedef struct _MpseFootprint
+{
+    unsigned bytes;      /* state table size */
+    unsigned lines;      /* 64 byte cache lines spanned */
+    unsigned hot_lines;  /* lines holding the root and shallow states */
+} MpseFootprint;
+
+int    mpseGetFootprint( void * pvoid, MpseFootprint * fp );
+
 void mpse_print_qinfo(void);
 void mpseInitSummary(void);
 
@@ -0,0 +1,695 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    mpse_cache.c
+//
+// File layout (native byte order, all offsets from start of file):
+//
+//   header | blob | blob | ... | index
+//
+// Blobs are cache line (64 byte) aligned.  The index is an array of
+// entries sorted by key so lookups are a binary search.  The file is
+// never updated in place; a new one is written to a temporary name and
+// renamed over the old so that a running instance keeps its (unlinked)
+// mapping.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+#include "mpse_cache.h"
+#include "util.h"
+
+#define CACHE_MAGIC     "SFMPSEC"
+#define CACHE_VERSION   2
+#define CACHE_ORDER     0x01020304
+#define CACHE_ALIGN     64
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t entries;
+    uint32_t entry_size;
+    uint64_t index_off;
+    uint64_t file_size;
+    uint64_t index_sum;
+} CacheHeader;
+
+typedef struct
+{
+    MpseCacheKey key;
+    uint64_t off;
+    uint64_t len;
+    uint64_t sum;
+} CacheEntry;
+
+typedef struct
+{
+    uint8_t* base;
+    size_t size;
+    int refs;
+    int mapped;
+#ifndef WIN32
+    // matchers drop their refs after the cache is closed
+    pthread_mutex_t lock;
+#endif
+} CacheMap;
+
+typedef struct
+{
+    MpseCacheKey key;
+    const void* blob;
+    size_t len;
+} CacheBlob;
+
+enum { BLOB_UNUSED, BLOB_USED, BLOB_BAD };
+
+struct _MpseCache
+{
+    char* path;
+
+    CacheMap* map;
+    const CacheEntry* index;
+    unsigned entries;
+    uint8_t* state;         // BLOB_* per index entry
+
+    CacheBlob* added;
+    unsigned num_added;
+    unsigned max_added;
+
+    unsigned hits;
+    unsigned misses;
+    int keep;               // keep unused entries
+
+#ifndef WIN32
+    // matchers may be compiled concurrently (see mpseCompile)
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifndef WIN32
+#define CacheLock(mc) pthread_mutex_lock(&(mc)->lock)
+#define CacheUnlock(mc) pthread_mutex_unlock(&(mc)->lock)
+#define MapLock(map) pthread_mutex_lock(&(map)->lock)
+#define MapUnlock(map) pthread_mutex_unlock(&(map)->lock)
+#else
+#define CacheLock(mc)
+#define CacheUnlock(mc)
+#define MapLock(map)
+#define MapUnlock(map)
+#endif
+
+//-------------------------------------------------------------------------
+// digests
+//-------------------------------------------------------------------------
+
+#define FNV_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#define MIX_BASIS 0x9e3779b97f4a7c15ULL
+#define MIX_PRIME 0xff51afd7ed558ccdULL
+
+void mpseCacheKeyInit(MpseCacheKey* k)
+{
+    k->h1 = FNV_BASIS;
+    k->h2 = MIX_BASIS;
+}
+
+// two unrelated hashes so a collision must happen in both
+void mpseCacheKeyUpdate(MpseCacheKey* k, const void* pv, size_t n)
+{
+    const uint8_t* p = (const uint8_t*)pv;
+    uint64_t h1 = k->h1, h2 = k->h2;
+
+    while ( n-- )
+    {
+        h1 = (h1 ^ *p) * FNV_PRIME;
+        h2 = ((h2 << 23) | (h2 >> 41)) ^ *p++;
+        h2 *= MIX_PRIME;
+    }
+    k->h1 = h1;
+    k->h2 = h2;
+}
+
+static uint64_t CacheSum(const void* pv, size_t n)
+{
+    const uint8_t* p = (const uint8_t*)pv;
+    uint64_t h = FNV_BASIS;
+
+    while ( n >= sizeof(uint64_t) )
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h = (h ^ w) * FNV_PRIME;
+        p += sizeof(w);
+        n -= sizeof(w);
+    }
+    while ( n-- )
+        h = (h ^ *p++) * FNV_PRIME;
+
+    return h;
+}
+
+static int KeyCmp(const MpseCacheKey* a, const MpseCacheKey* b)
+{
+    if ( a->h1 != b->h1 )
+        return (a->h1 < b->h1) ? -1 : 1;
+
+    if ( a->h2 != b->h2 )
+        return (a->h2 < b->h2) ? -1 : 1;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+// mapping
+//-------------------------------------------------------------------------
+
+static CacheMap* MapFile(const char* path)
+{
+    struct stat st;
+    CacheMap* map;
+    int fd = open(path, O_RDONLY);
+
+    if ( fd < 0 )
+        return NULL;
+
+    if ( fstat(fd, &st) || (size_t)st.st_size < sizeof(CacheHeader) )
+    {
+        close(fd);
+        return NULL;
+    }
+    map = (CacheMap*)SnortAlloc(sizeof(*map));
+    map->size = (size_t)st.st_size;
+
+#ifndef WIN32
+    map->base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if ( map->base == MAP_FAILED )
+        map->base = NULL;
+    else
+        map->mapped = 1;
+#endif
+
+    if ( !map->base )
+    {
+        size_t off = 0;
+        map->base = (uint8_t*)SnortAlloc(map->size);
+
+        while ( off < map->size )
+        {
+            ssize_t n = read(fd, map->base + off, map->size - off);
+
+            if ( n <= 0 )
+            {
+                free(map->base);
+                free(map);
+                close(fd);
+                return NULL;
+            }
+            off += (size_t)n;
+        }
+    }
+    close(fd);
+    map->refs = 1;
+#ifndef WIN32
+    pthread_mutex_init(&map->lock, NULL);
+#endif
+    return map;
+}
+
+static void UnmapFile(CacheMap* map)
+{
+#ifndef WIN32
+    if ( map->mapped )
+        munmap(map->base, map->size);
+    else
+#endif
+        free(map->base);
+
+#ifndef WIN32
+    pthread_mutex_destroy(&map->lock);
+#endif
+    free(map);
+}
+
+static int CacheLoadIndex(MpseCache* mc)
+{
+    const CacheHeader* hdr = (const CacheHeader*)mc->map->base;
+    uint64_t size = mc->map->size;
+    const CacheEntry* ce;
+    unsigned i;
+
+    if ( memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) ||
+         hdr->version != CACHE_VERSION || hdr->byte_order != CACHE_ORDER ||
+         hdr->entry_size != sizeof(CacheEntry) || hdr->file_size != size )
+        return -1;
+
+    if ( hdr->index_off > size || hdr->index_off % sizeof(uint64_t) ||
+         (size - hdr->index_off) / sizeof(CacheEntry) < hdr->entries )
+        return -1;
+
+    ce = (const CacheEntry*)(mc->map->base + hdr->index_off);
+
+    if ( CacheSum(ce, hdr->entries * sizeof(*ce)) != hdr->index_sum )
+        return -1;
+
+    for ( i = 0; i < hdr->entries; i++ )
+    {
+        if ( ce[i].off % CACHE_ALIGN || ce[i].off > hdr->index_off ||
+             ce[i].len > hdr->index_off - ce[i].off )
+            return -1;
+
+        if ( i && KeyCmp(&ce[i-1].key, &ce[i].key) >= 0 )
+            return -1;
+    }
+    mc->index = ce;
+    mc->entries = hdr->entries;
+    mc->state = (uint8_t*)SnortAlloc(mc->entries ? mc->entries : 1);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+// writing
+//-------------------------------------------------------------------------
+
+static int BlobCmp(const void* pa, const void* pb)
+{
+    return KeyCmp(&((const CacheBlob*)pa)->key, &((const CacheBlob*)pb)->key);
+}
+
+static int WriteAll(int fd, const void* pv, size_t n)
+{
+    const uint8_t* p = (const uint8_t*)pv;
+
+    while ( n )
+    {
+        ssize_t w = write(fd, p, n);
+
+        if ( w < 0 && errno == EINTR )
+            continue;
+
+        if ( w <= 0 )
+            return -1;
+
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int WritePad(int fd, uint64_t* off, unsigned align)
+{
+    static const uint8_t zero[CACHE_ALIGN];
+    unsigned pad = (unsigned)((align - (*off % align)) % align);
+
+    if ( pad && WriteAll(fd, zero, pad) )
+        return -1;
+
+    *off += pad;
+    return 0;
+}
+
+static int CacheWrite(MpseCache* mc)
+{
+    unsigned i, n = 0, max = mc->num_added + mc->entries;
+    CacheBlob* all = (CacheBlob*)SnortAlloc((max ? max : 1) * sizeof(*all));
+    CacheEntry* index;
+    CacheHeader hdr;
+    char tmp[PATH_MAX];
+    uint64_t off;
+    int fd, err = 0;
+
+    // keep what this configuration used plus what it compiled
+    for ( i = 0; i < mc->entries; i++ )
+    {
+        const CacheEntry* ce = mc->index + i;
+
+        if ( mc->keep && (mc->state[i] == BLOB_UNUSED) )
+        {
+            // carried over matchers don't look up their blobs
+            if ( CacheSum(mc->map->base + ce->off, ce->len) != ce->sum )
+                continue;
+        }
+        else if ( mc->state[i] != BLOB_USED )
+            continue;
+
+        all[n].key = mc->index[i].key;
+        all[n].blob = mc->map->base + mc->index[i].off;
+        all[n++].len = (size_t)mc->index[i].len;
+    }
+    for ( i = 0; i < mc->num_added; i++ )
+        all[n++] = mc->added[i];
+
+    if ( n )
+        qsort(all, n, sizeof(*all), BlobCmp);
+
+    // identical pattern groups compile to identical blobs
+    for ( i = 1, max = n ? 1 : 0; i < n; i++ )
+    {
+        if ( KeyCmp(&all[max-1].key, &all[i].key) )
+            all[max++] = all[i];
+    }
+    n = max;
+    index = (CacheEntry*)SnortAlloc((n ? n : 1) * sizeof(*index));
+
+    SnortSnprintf(tmp, sizeof(tmp), "%s.%d.tmp", mc->path, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if ( fd < 0 )
+    {
+        ErrorMessage("mpse-cache: can't create %s: %s\n", tmp, strerror(errno));
+        free(index);
+        free(all);
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    off = sizeof(hdr);
+
+    if ( WriteAll(fd, &hdr, sizeof(hdr)) )
+        err = 1;
+
+    for ( i = 0; i < n && !err; i++ )
+    {
+        if ( WritePad(fd, &off, CACHE_ALIGN) || WriteAll(fd, all[i].blob, all[i].len) )
+        {
+            err = 1;
+            break;
+        }
+        index[i].key = all[i].key;
+        index[i].off = off;
+        index[i].len = all[i].len;
+        index[i].sum = CacheSum(all[i].blob, all[i].len);
+        off += all[i].len;
+    }
+
+    if ( !err && WritePad(fd, &off, CACHE_ALIGN) )
+        err = 1;
+
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CACHE_VERSION;
+    hdr.byte_order = CACHE_ORDER;
+    hdr.entries = n;
+    hdr.entry_size = sizeof(CacheEntry);
+    hdr.index_off = off;
+    hdr.file_size = off + n * sizeof(*index);
+    hdr.index_sum = CacheSum(index, n * sizeof(*index));
+
+    if ( !err && WriteAll(fd, index, n * sizeof(*index)) )
+        err = 1;
+
+    if ( !err && (lseek(fd, 0, SEEK_SET) || WriteAll(fd, &hdr, sizeof(hdr))) )
+        err = 1;
+
+    if ( close(fd) )
+        err = 1;
+
+    if ( !err && rename(tmp, mc->path) )
+        err = 1;
+
+    if ( err )
+    {
+        ErrorMessage("mpse-cache: can't write %s: %s\n", mc->path, strerror(errno));
+        unlink(tmp);
+    }
+    free(index);
+    free(all);
+    return err ? -1 : (int)n;
+}
+
+//-------------------------------------------------------------------------
+// api
+//-------------------------------------------------------------------------
+
+MpseCache* mpseCacheOpen(const char* path)
+{
+    MpseCache* mc = (MpseCache*)SnortAlloc(sizeof(*mc));
+    mc->path = SnortStrdup(path);
+    mc->map = MapFile(path);
+#ifndef WIN32
+    pthread_mutex_init(&mc->lock, NULL);
+#endif
+
+    if ( mc->map && CacheLoadIndex(mc) )
+    {
+        LogMessage("mpse-cache: ignoring invalid or stale cache file %s\n", path);
+        mpseCacheRelease(mc->map);
+        mc->map = NULL;
+    }
+    return mc;
+}
+
+void mpseCacheClose(MpseCache* mc)
+{
+    unsigned i, dirty = mc->num_added;
+    int n = 0;
+
+    for ( i = 0; i < mc->entries && !dirty; i++ )
+    {
+        if ( mc->state[i] == BLOB_BAD || (!mc->keep && mc->state[i] != BLOB_USED) )
+            dirty = 1;
+    }
+
+    if ( dirty )
+        n = CacheWrite(mc);
+
+    LogMessage("mpse-cache: %u matchers loaded, %u compiled", mc->hits, mc->misses);
+
+    if ( n > 0 )
+        LogMessage(", %d written to %s\n", n, mc->path);
+    else
+        LogMessage("\n");
+
+    for ( i = 0; i < mc->num_added; i++ )
+        free((void*)mc->added[i].blob);
+
+    if ( mc->map )
+        mpseCacheRelease(mc->map);
+
+    free(mc->added);
+    free(mc->state);
+    free(mc->path);
+#ifndef WIN32
+    pthread_mutex_destroy(&mc->lock);
+#endif
+    free(mc);
+}
+
+void mpseCacheKeep(MpseCache* mc)
+{
+    mc->keep = 1;
+}
+
+const void* mpseCacheFind(MpseCache* mc, const MpseCacheKey* key, size_t* len)
+{
+    const CacheEntry* ce;
+    unsigned lo = 0, hi = mc->entries;
+
+    // the index and mapping don't change until close
+    while ( lo < hi )
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+        int c = KeyCmp(key, &mc->index[mid].key);
+
+        if ( !c )
+        {
+            uint8_t state;
+            ce = mc->index + mid;
+
+            CacheLock(mc);
+            state = mc->state[mid];
+            CacheUnlock(mc);
+
+            // verify outside the lock; a duplicate check is harmless
+            if ( state == BLOB_UNUSED )
+            {
+                if ( CacheSum(mc->map->base + ce->off, ce->len) != ce->sum )
+                {
+                    ErrorMessage("mpse-cache: checksum mismatch in %s\n", mc->path);
+                    state = BLOB_BAD;
+                }
+                else
+                    state = BLOB_USED;
+
+                CacheLock(mc);
+                mc->state[mid] = state;
+                CacheUnlock(mc);
+            }
+            if ( state != BLOB_USED )
+                break;
+
+            CacheLock(mc);
+            mc->hits++;
+            CacheUnlock(mc);
+
+            *len = (size_t)ce->len;
+            return mc->map->base + ce->off;
+        }
+        if ( c < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    CacheLock(mc);
+    mc->misses++;
+    CacheUnlock(mc);
+    return NULL;
+}
+
+void mpseCacheStore(MpseCache* mc, const MpseCacheKey* key, void* blob, size_t len)
+{
+    CacheLock(mc);
+
+    if ( mc->num_added == mc->max_added )
+    {
+        unsigned max = mc->max_added ? 2 * mc->max_added : 64;
+        CacheBlob* tmp = (CacheBlob*)SnortAlloc(max * sizeof(*tmp));
+
+        if ( mc->added )
+        {
+            memcpy(tmp, mc->added, mc->num_added * sizeof(*tmp));
+            free(mc->added);
+        }
+        mc->added = tmp;
+        mc->max_added = max;
+    }
+    mc->added[mc->num_added].key = *key;
+    mc->added[mc->num_added].blob = blob;
+    mc->added[mc->num_added++].len = len;
+
+    CacheUnlock(mc);
+}
+
+void* mpseCacheRef(MpseCache* mc)
+{
+    if ( !mc->map )
+        return NULL;
+
+    MapLock(mc->map);
+    mc->map->refs++;
+    MapUnlock(mc->map);
+
+    return mc->map;
+}
+
+void mpseCacheRelease(void* ref)
+{
+    CacheMap* map = (CacheMap*)ref;
+    int refs;
+
+    if ( !map )
+        return;
+
+    MapLock(map);
+    refs = --map->refs;
+    MapUnlock(map);
+
+    // no other holder can take a ref once it drops to zero
+    if ( !refs )
+        UnmapFile(map);
+}
+
+//-------------------------------------------------------------------------
+// pointer to index map
+//-------------------------------------------------------------------------
+
+typedef struct
+{
+    const void* ptr;
+    unsigned idx;
+} PtrIdx;
+
+struct _MpseCachePtrMap
+{
+    PtrIdx* map;
+    unsigned num;
+    unsigned max;
+    int sorted;
+};
+
+static int PtrCmp(const void* pa, const void* pb)
+{
+    const void* a = ((const PtrIdx*)pa)->ptr;
+    const void* b = ((const PtrIdx*)pb)->ptr;
+
+    if ( a == b )
+        return 0;
+
+    return (a < b) ? -1 : 1;
+}
+
+MpseCachePtrMap* mpseCachePtrMapNew(unsigned max)
+{
+    MpseCachePtrMap* pm = (MpseCachePtrMap*)SnortAlloc(sizeof(*pm));
+    pm->map = (PtrIdx*)SnortAlloc((max ? max : 1) * sizeof(*pm->map));
+    pm->max = max;
+    return pm;
+}
+
+void mpseCachePtrMapAdd(MpseCachePtrMap* pm, const void* p)
+{
+    if ( pm->num == pm->max )
+        return;
+
+    pm->map[pm->num].ptr = p;
+    pm->map[pm->num].idx = pm->num;
+    pm->num++;
+    pm->sorted = 0;
+}
+
+int mpseCachePtrMapFind(MpseCachePtrMap* pm, const void* p)
+{
+    PtrIdx k, *pi;
+
+    if ( !pm->sorted )
+    {
+        qsort(pm->map, pm->num, sizeof(*pm->map), PtrCmp);
+        pm->sorted = 1;
+    }
+    k.ptr = p;
+    pi = (PtrIdx*)bsearch(&k, pm->map, pm->num, sizeof(*pm->map), PtrCmp);
+
+    return pi ? (int)pi->idx : -1;
+}
+
+void mpseCachePtrMapFree(MpseCachePtrMap* pm)
+{
+    free(pm->map);
+    free(pm);
+}
+
@@ -0,0 +1,94 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    mpse_cache.h
+//
+// Persistent cache of compiled pattern matchers.  The cache is a single
+// file of opaque blobs, each keyed by a 128 bit digest of everything that
+// goes into a compile (engine, engine options and the ordered pattern
+// list).  The file is mapped read only and the search engines point their
+// state tables straight into the mapping, so an unchanged rule set loads
+// without building any automata.
+//
+// The engines own their blob formats; this module only stores, finds and
+// rewrites them.  Match lists can't be stored (they point to rule data) so
+// the engines persist them as pattern indices and relink on load.
+
+#ifndef _MPSE_CACHE_H_
+#define _MPSE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _MpseCacheKey
+{
+    uint64_t h1;
+    uint64_t h2;
+} MpseCacheKey;
+
+typedef struct _MpseCache MpseCache;
+
+// key digest; feed it everything that affects the compiled result
+void mpseCacheKeyInit(MpseCacheKey*);
+void mpseCacheKeyUpdate(MpseCacheKey*, const void*, size_t);
+
+static inline void mpseCacheKeyUpdateInt(MpseCacheKey* k, uint32_t u)
+{
+    mpseCacheKeyUpdate(k, &u, sizeof(u));
+}
+
+// returns NULL only if out of memory; a missing or invalid file just
+// starts an empty cache which is written out on close
+MpseCache* mpseCacheOpen(const char* path);
+
+// writes the cache file if anything changed and releases the cache's
+// reference on the mapping.  blobs in use by live matchers stay mapped
+// until they are released.
+void mpseCacheClose(MpseCache*);
+
+// keep the entries this build doesn't look up when the file is rewritten;
+// used when some matchers were carried over from a running configuration
+void mpseCacheKeep(MpseCache*);
+
+// find, store and ref may be called from concurrent compiles; the rest
+// only from the thread building the configuration
+
+// returns the blob for key (64 byte aligned) or NULL on a miss
+const void* mpseCacheFind(MpseCache*, const MpseCacheKey*, size_t* len);
+
+// adds a new blob; the cache takes ownership of the malloc'd buffer
+void mpseCacheStore(MpseCache*, const MpseCacheKey*, void* blob, size_t len);
+
+// a matcher that points into a found blob must hold a reference
+void* mpseCacheRef(MpseCache*);
+void mpseCacheRelease(void* ref);
+
+// maps pointers (eg patterns) to their list position for storing
+// match lists as indices
+typedef struct _MpseCachePtrMap MpseCachePtrMap;
+
+MpseCachePtrMap* mpseCachePtrMapNew(unsigned max);
+void mpseCachePtrMapAdd(MpseCachePtrMap*, const void*);
+int mpseCachePtrMapFind(MpseCachePtrMap*, const void*);  // -1 if not found
+void mpseCachePtrMapFree(MpseCachePtrMap*);
+
+#endif
+
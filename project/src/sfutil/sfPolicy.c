@@ -69,7 +69,7 @@ tSfPolicyConfig * sfPolicyInit(void)
     }
 
     //initialize net bindings
-    new->netBindTable = sfrt_new(DIR_16x7_4x4, IPv6, SF_NETWORK_BINDING_MAX, 20);
+    new->netBindTable = sfrt_new(POPTRIE, IPv6, SF_NETWORK_BINDING_MAX, 20);
 
     return new;
 }
@@ -498,6 +498,20 @@ void sfNetworkDeleteBinding(
     sfPolicyDelete(config, *policyId);
 }
 
+/**Compile the binding table for lookup.  Called once all the config
+ * lines are parsed.  If it can't be compiled the lookups just use the
+ * table as built.
+ */
+void sfNetworkCompileBindings(
+        tSfPolicyConfig *config
+        )
+{
+    if (config == NULL || config->netBindTable == NULL)
+        return;
+
+    sfrt_compile(config->netBindTable);
+}
+
 //Move to sfDynArray.c/h
 /**Dynamic array bound checks. If index is greater than maxElement then realloc like operation
  * is performed.
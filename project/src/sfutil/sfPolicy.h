@@ -140,6 +140,9 @@ void sfNetworkDeleteBinding(
     tSfPolicyConfig *,
     snort_ip_p
     );
+void sfNetworkCompileBindings(
+    tSfPolicyConfig *
+    );
 
 static inline tSfPolicyId sfGetDefaultPolicy(
     tSfPolicyConfig *config
@@ -25,6 +25,12 @@
 
 #include "sf_base64decode.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SF_BASE64_SIMD
+#include <immintrin.h>
+#endif
+
 uint8_t sf_decode64tab[256] = {
         100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,
         100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,
@@ -43,6 +49,159 @@ uint8_t sf_decode64tab[256] = {
         100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,
         100,100,100,100,100,100,100,100,100,100,100,100,100,100,100,100};
 
+#ifdef SF_BASE64_SIMD
+/* Vector decoding of whole 32 byte blocks (24 bytes out) after Mula and
+ * Lemire.  Each byte is checked against the alphabet with two nibble
+ * lookups and translated to its 6 bit value with a third, then groups of
+ * four are packed into three bytes with two multiply-adds and a shuffle.
+ * A block with anything else in it ('=', CRLF, junk) is left to the
+ * scalar loop so the result is exactly what the table driven decoder
+ * produces.  Each block stores a full 32 bytes so the caller must leave
+ * 8 bytes of slack past the last block's output. */
+
+#define B64_BLOCK_IN  32
+#define B64_BLOCK_OUT 24
+
+typedef uint32_t (*B64DecodeFunc)(const uint8_t *, uint32_t, uint8_t *);
+
+#define B64_LUT_LO \
+   0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+   0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define B64_LUT_HI \
+   0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+   0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define B64_LUT_ROLL \
+   0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+#define B64_PACK \
+   2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+/* translates v in place and returns non-zero if any byte is not in the
+ * alphabet */
+__attribute__((target("ssse3")))
+static inline int B64Translate128(__m128i *v)
+{
+   const __m128i lut_lo = _mm_setr_epi8(B64_LUT_LO);
+   const __m128i lut_hi = _mm_setr_epi8(B64_LUT_HI);
+   const __m128i lut_roll = _mm_setr_epi8(B64_LUT_ROLL);
+   const __m128i nib = _mm_set1_epi8(0x0f);
+
+   __m128i hi_nib = _mm_and_si128(_mm_srli_epi32(*v, 4), nib);
+   __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(*v, nib));
+   __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nib);
+   __m128i slash = _mm_cmpeq_epi8(*v, _mm_set1_epi8('/'));
+
+   if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff)
+      return 1;
+
+   *v = _mm_add_epi8(*v, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(slash, hi_nib)));
+   return 0;
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i B64Pack128(__m128i v)
+{
+   v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+   v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+   return _mm_shuffle_epi8(v, _mm_setr_epi8(B64_PACK));
+}
+
+__attribute__((target("ssse3")))
+static uint32_t B64DecodeSsse3(const uint8_t *in, uint32_t blocks, uint8_t *out)
+{
+   uint32_t i;
+
+   for(i = 0; i < blocks; i++)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i *)in);
+      __m128i b = _mm_loadu_si128((const __m128i *)(in + 16));
+
+      if(B64Translate128(&a) || B64Translate128(&b))
+         break;
+
+      _mm_storeu_si128((__m128i *)out, B64Pack128(a));
+      _mm_storeu_si128((__m128i *)(out + 12), B64Pack128(b));
+
+      in += B64_BLOCK_IN;
+      out += B64_BLOCK_OUT;
+   }
+   return i;
+}
+
+__attribute__((target("avx2")))
+static uint32_t B64DecodeAvx2(const uint8_t *in, uint32_t blocks, uint8_t *out)
+{
+   const __m256i lut_lo = _mm256_setr_epi8(B64_LUT_LO, B64_LUT_LO);
+   const __m256i lut_hi = _mm256_setr_epi8(B64_LUT_HI, B64_LUT_HI);
+   const __m256i lut_roll = _mm256_setr_epi8(B64_LUT_ROLL, B64_LUT_ROLL);
+   const __m256i pack = _mm256_setr_epi8(B64_PACK, B64_PACK);
+   const __m256i nib = _mm256_set1_epi8(0x0f);
+   const __m256i slash = _mm256_set1_epi8('/');
+   const __m256i zero = _mm256_setzero_si256();
+   uint32_t i;
+
+   for(i = 0; i < blocks; i++)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i *)in);
+      __m256i hi_nib = _mm256_and_si256(_mm256_srli_epi32(v, 4), nib);
+      __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(v, nib));
+      __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nib);
+      __m256i roll;
+
+      if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero)) != -1)
+         break;
+
+      roll = _mm256_shuffle_epi8(lut_roll,
+         _mm256_add_epi8(_mm256_cmpeq_epi8(v, slash), hi_nib));
+      v = _mm256_add_epi8(v, roll);
+
+      v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+      v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+      v = _mm256_shuffle_epi8(v, pack);
+      v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+      _mm256_storeu_si256((__m256i *)out, v);
+
+      in += B64_BLOCK_IN;
+      out += B64_BLOCK_OUT;
+   }
+   return i;
+}
+
+static B64DecodeFunc B64SelectKernel(void)
+{
+   __builtin_cpu_init();
+
+   if(__builtin_cpu_supports("avx2"))
+      return B64DecodeAvx2;
+
+   if(__builtin_cpu_supports("ssse3"))
+      return B64DecodeSsse3;
+
+   return NULL;
+}
+
+static int b64_kernel_init = 0;
+static B64DecodeFunc b64_kernel = NULL;
+
+/* Returns the number of whole blocks that fit the remaining input, the
+ * remaining base64 char budget and the output space with slack. */
+static inline uint32_t B64Blocks(uint32_t in_left, uint32_t chars_left, uint32_t out_left)
+{
+   uint32_t blocks = in_left / B64_BLOCK_IN;
+
+   if(chars_left / B64_BLOCK_IN < blocks)
+      blocks = chars_left / B64_BLOCK_IN;
+
+   if(out_left < B64_BLOCK_IN)
+      return 0;
+
+   if((out_left - (B64_BLOCK_IN - B64_BLOCK_OUT)) / B64_BLOCK_OUT < blocks)
+      blocks = (out_left - (B64_BLOCK_IN - B64_BLOCK_OUT)) / B64_BLOCK_OUT;
+
+   return blocks;
+}
+#endif
+
 /* base64decode assumes the input data terminates with '=' and/or at the end of the input buffer
  * at inbuf_size.  If extra characters exist within inbuf before inbuf_size is reached, it will
  * happily decode what it can and skip over what it can't.  This is consistent with other decoders
@@ -62,6 +221,16 @@ int sf_base64decode(uint8_t *inbuf, uint32_t inbuf_size, uint8_t *outbuf, uint32
 
    int error = 0;
 
+#ifdef SF_BASE64_SIMD
+   uint8_t *retry;  /* don't try the kernel again before here */
+
+   if(!b64_kernel_init)
+   {
+      b64_kernel = B64SelectKernel();
+      b64_kernel_init = 1;
+   }
+#endif
+
    /* This algorithm will waste up to 4 bytes but we really don't care.
       At the end we're going to copy the exact number of bytes requested. */
    max_base64_chars = (outbuf_size / 3) * 4 + 4; /* 4 base64 bytes gives 3 data bytes, plus
@@ -75,7 +244,31 @@ int sf_base64decode(uint8_t *inbuf, uint32_t inbuf_size, uint8_t *outbuf, uint32
    *bytes_written = 0;
    cursor = inbuf;
    outbuf_ptr = outbuf;
+#ifdef SF_BASE64_SIMD
+   retry = cursor;
+#endif
    while((cursor < endofinbuf) && (n < max_base64_chars)) {
+#ifdef SF_BASE64_SIMD
+      /* Hand whole blocks to the kernel when between groups of four.
+         A block it rejects is decoded here before it is tried again. */
+      if(b64_kernel && (base64data_ptr == base64data) && (cursor >= retry)) {
+         uint32_t blocks = B64Blocks(endofinbuf - cursor, max_base64_chars - n,
+                                     outbuf_size - *bytes_written);
+         if(blocks) {
+            uint32_t done = b64_kernel(cursor, blocks, outbuf_ptr);
+
+            cursor += done * B64_BLOCK_IN;
+            n += done * B64_BLOCK_IN;
+            outbuf_ptr += done * B64_BLOCK_OUT;
+            *bytes_written += done * B64_BLOCK_OUT;
+
+            if(done < blocks)
+               retry = cursor + B64_BLOCK_IN;
+
+            continue;
+         }
+      }
+#endif
       if(sf_decode64tab[*cursor] != 100) {
          *base64data_ptr++ = *cursor;
          n++;  /* Number of base64 bytes we've stored */
@@ -23,6 +23,8 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include "sf_types.h"
 /*SharedObjectAddStarts
 #include "sf_dynamic_preprocessor.h"
@@ -32,6 +34,39 @@ SharedObjectAddEnds */
 
 #define UU_DECODE_CHAR(c) (((c) - 0x20) & 0x3f)
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SF_UU_SIMD
+#include <immintrin.h>
+
+/* Decodes 16 uuencoded chars into 12 bytes.  The 6 bit values are
+ * packed the same way as base64.  16 bytes are stored. */
+__attribute__((target("ssse3")))
+static void UUDecode16(const uint8_t *src, uint8_t *dst)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+    v = _mm_and_si128(_mm_sub_epi8(v, _mm_set1_epi8(0x20)), _mm_set1_epi8(0x3f));
+    v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+    v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+    _mm_storeu_si128((__m128i *)dst, v);
+}
+
+static int uu_simd = -1;
+
+static inline int UUHaveSimd(void)
+{
+    if(uu_simd < 0)
+    {
+        __builtin_cpu_init();
+        uu_simd = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return uu_simd;
+}
+#endif
+
 int sf_qpdecode(char *src, uint32_t slen, char *dst, uint32_t dlen, uint32_t *bytes_read, uint32_t *bytes_copied )
 {
     char ch;
@@ -98,9 +133,24 @@ int sf_qpdecode(char *src, uint32_t slen, char *dst, uint32_t dlen, uint32_t *by
         }
         else
         {
-            dst[*bytes_copied] = ch;
-            *bytes_copied +=1;
+            /* Everything up to the next '=' is copied as is so find it
+             * with memchr, which is vectorized in libc, and copy the run
+             * at once */
+            const char *run_start = src + *bytes_read - 1;
+            uint32_t run = slen - *bytes_read + 1;
+            const char *eq;
+
+            if( run > (dlen - *bytes_copied) )
+                run = dlen - *bytes_copied;
 
+            eq = (const char *)memchr(run_start, '=', run);
+
+            if( eq )
+                run = eq - run_start;
+
+            memcpy(dst + *bytes_copied, run_start, run);
+            *bytes_read += run - 1;
+            *bytes_copied += run;
         }
     }
 
@@ -197,7 +247,22 @@ int sf_uudecode(uint8_t *src, uint32_t slen, uint8_t *dst, uint32_t dlen, uint32
             }
 
             ptr++;
-            
+
+#ifdef SF_UU_SIMD
+            /* whole groups of 16 chars, as long as there is room for the
+             * 16 byte store */
+            if( UUHaveSimd() )
+            {
+                while( (length >= 16) && ((dend - dptr) >= 16) )
+                {
+                    UUDecode16(ptr, dptr);
+                    ptr += 16;
+                    dptr += 12;
+                    length -= 16;
+                }
+            }
+#endif
+
             while( length > 0 )
             {
                 *dptr++ = (UU_DECODE_CHAR(ptr[0]) << 2) | (UU_DECODE_CHAR(ptr[1]) >> 4);
@@ -0,0 +1,525 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    sf_inflate.c
+//
+// The arena keeps a free list per size class and never returns a block
+// to malloc unless the memcap needs the room, largest blocks first.  Each
+// block starts with a small header holding its class since zfree() isn't
+// given the size.  Requests larger than the largest class (which zlib
+// doesn't make) go straight to malloc and back.
+//
+// Headers are gathered a byte at a time so they can be split across any
+// number of calls.  A deflate stream that doesn't start with a valid zlib
+// header is taken to be raw deflate, as browsers do.  Trailers are not
+// checked.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef ZLIB
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "sf_inflate.h"
+
+//-------------------------------------------------------------------------
+// arena
+//-------------------------------------------------------------------------
+
+// 256 bytes to 64K; the largest zlib allocation is a 32K window
+#define MIN_SHIFT 8
+#define MAX_SHIFT 16
+#define NUM_CLASSES (MAX_SHIFT - MIN_SHIFT + 1)
+
+typedef union _Block
+{
+    struct
+    {
+        union _Block* next;  // when on a free list
+        uint32_t cls;        // NUM_CLASSES if not from a class
+        uint32_t size;       // including the header
+    } h;
+    uint64_t align[2];
+} Block;
+
+static Block* free_list[NUM_CLASSES];
+static uint64_t held = 0;    // in use or on a free list
+static uint64_t memcap = 0;
+
+static SFInflateStats stats;
+
+static inline uint32_t ClassSize (unsigned cls)
+{
+    return sizeof(Block) + (1 << (cls + MIN_SHIFT));
+}
+
+// release free blocks, largest first, until need more bytes fit
+static int MakeRoom (uint64_t need)
+{
+    int cls = NUM_CLASSES - 1;
+
+    while ( held + need > memcap )
+    {
+        Block* b;
+
+        while ( cls >= 0 && !free_list[cls] )
+            cls--;
+
+        if ( cls < 0 )
+            return 0;
+
+        b = free_list[cls];
+        free_list[cls] = b->h.next;
+        held -= b->h.size;
+        free(b);
+    }
+    return 1;
+}
+
+static void* ArenaAlloc (size_t n)
+{
+    unsigned cls = 0;
+    uint32_t size;
+    Block* b;
+
+    while ( cls < NUM_CLASSES && ((size_t)1 << (cls + MIN_SHIFT)) < n )
+        cls++;
+
+    if ( cls < NUM_CLASSES && free_list[cls] )
+    {
+        b = free_list[cls];
+        free_list[cls] = b->h.next;
+        stats.allocs++;
+        stats.reuses++;
+        return b + 1;
+    }
+
+    if ( cls < NUM_CLASSES )
+        size = ClassSize(cls);
+
+    else if ( n <= UINT32_MAX - sizeof(Block) )
+        size = sizeof(Block) + n;
+
+    else
+    {
+        stats.failures++;
+        return NULL;
+    }
+
+    if ( (memcap && !MakeRoom(size)) || !(b = (Block*)malloc(size)) )
+    {
+        stats.failures++;
+        return NULL;
+    }
+    b->h.cls = cls;
+    b->h.size = size;
+    held += size;
+
+    if ( held > stats.peak )
+        stats.peak = held;
+
+    stats.allocs++;
+    return b + 1;
+}
+
+static void ArenaFree (void* p)
+{
+    Block* b;
+
+    if ( !p )
+        return;
+
+    b = (Block*)p - 1;
+
+    if ( b->h.cls >= NUM_CLASSES )
+    {
+        held -= b->h.size;
+        free(b);
+        return;
+    }
+    b->h.next = free_list[b->h.cls];
+    free_list[b->h.cls] = b;
+
+    // the memcap may have been lowered since this was allocated
+    if ( memcap && held > memcap )
+        MakeRoom(0);
+}
+
+static voidpf ZAlloc (voidpf opaque, uInt items, uInt size)
+{
+    if ( size && items > (uInt)-1 / size )
+        return Z_NULL;
+
+    return ArenaAlloc((size_t)items * size);
+}
+
+static void ZFree (voidpf opaque, voidpf p)
+{
+    ArenaFree(p);
+}
+
+void SFInflate_SetMemcap (uint32_t n)
+{
+    memcap = n;
+
+    if ( memcap && held > memcap )
+        MakeRoom(0);
+}
+
+void SFInflate_Term (void)
+{
+    unsigned cls;
+
+    for ( cls = 0; cls < NUM_CLASSES; cls++ )
+    {
+        while ( free_list[cls] )
+        {
+            Block* b = free_list[cls];
+            free_list[cls] = b->h.next;
+            held -= b->h.size;
+            free(b);
+        }
+    }
+}
+
+const SFInflateStats* SFInflate_GetStats (void)
+{
+    return &stats;
+}
+
+//-------------------------------------------------------------------------
+// headers
+//-------------------------------------------------------------------------
+
+typedef enum
+{
+    ST_ZLIB, ST_GZIP, ST_GZIP_XLEN, ST_GZIP_EXTRA,
+    ST_GZIP_NAME, ST_GZIP_COMMENT, ST_GZIP_HCRC,
+    ST_BODY, ST_DONE
+} InflateState;
+
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+
+struct _SFInflate
+{
+    z_stream zs;
+    uint32_t depth;      // 0 for no limit
+    uint32_t left;       // output left before depth
+    uint16_t count;      // header bytes seen or left to skip
+    uint8_t state;
+    uint8_t flags;       // gzip FLG
+    uint8_t first;       // first byte of a raw deflate stream
+    uint8_t pending;     // first hasn't been inflated yet
+    uint8_t wbits;
+    uint8_t init;        // inflateInit2() was done
+    int done;            // return once in ST_DONE
+};
+
+// the state of a gzip header after the fixed part or an optional field
+static inline uint8_t GzipNext (const SFInflate* s, uint8_t after)
+{
+    if ( after < ST_GZIP_XLEN && (s->flags & GZ_FEXTRA) )
+        return ST_GZIP_XLEN;
+
+    if ( after < ST_GZIP_NAME && (s->flags & GZ_FNAME) )
+        return ST_GZIP_NAME;
+
+    if ( after < ST_GZIP_COMMENT && (s->flags & GZ_FCOMMENT) )
+        return ST_GZIP_COMMENT;
+
+    if ( after < ST_GZIP_HCRC && (s->flags & GZ_FHCRC) )
+        return ST_GZIP_HCRC;
+
+    return ST_BODY;
+}
+
+static inline int IsZlibHeader (uint8_t cmf, uint8_t flg)
+{
+    // deflate, window <= 32K, check bits ok, no preset dictionary
+    return (cmf & 0x0f) == 8 && (cmf >> 4) <= 7 &&
+        !(((cmf << 8) | flg) % 31) && !(flg & 0x20);
+}
+
+// returns 1 when the body is next, 0 for more input, -1 on bad data
+static int ParseHeader (SFInflate* s)
+{
+    z_stream* zs = &s->zs;
+
+    while ( s->state < ST_BODY )
+    {
+        uint8_t c;
+
+        if ( !zs->avail_in )
+            return 0;
+
+        c = *zs->next_in;
+
+        switch ( s->state )
+        {
+        case ST_ZLIB:
+            if ( !s->count )
+            {
+                s->first = c;
+                s->count = 1;
+
+                // can't be zlib so don't wait for another byte
+                if ( (c & 0x0f) != 8 || (c >> 4) > 7 )
+                {
+                    s->pending = 1;
+                    s->state = ST_BODY;
+                }
+                break;
+            }
+            if ( !IsZlibHeader(s->first, c) )
+            {
+                s->pending = 1;
+                s->state = ST_BODY;
+                continue;  // c is body
+            }
+            // no need for more window than the encoder used
+            if ( (s->first >> 4) + 8 < s->wbits )
+                s->wbits = ((s->first >> 4) + 8 > 9) ? (s->first >> 4) + 8 : 9;
+
+            s->state = ST_BODY;
+            break;
+
+        case ST_GZIP:
+            if ( (s->count == 0 && c != 0x1f) || (s->count == 1 && c != 0x8b) ||
+                 (s->count == 2 && c != 8) )
+                return -1;
+
+            if ( s->count == 3 )
+                s->flags = c;
+
+            if ( ++s->count == 10 )
+            {
+                s->count = 0;
+                s->state = GzipNext(s, ST_GZIP);
+            }
+            break;
+
+        case ST_GZIP_XLEN:
+            // first holds the low byte
+            if ( !s->count )
+                s->first = c;
+
+            if ( ++s->count == 2 )
+            {
+                s->count = s->first | (c << 8);
+                s->state = s->count ? ST_GZIP_EXTRA : GzipNext(s, ST_GZIP_EXTRA);
+            }
+            break;
+
+        case ST_GZIP_EXTRA:
+        {
+            uint32_t n = (zs->avail_in < s->count) ? zs->avail_in : s->count;
+
+            zs->next_in += n;
+            zs->avail_in -= n;
+            s->count -= n;
+
+            if ( !s->count )
+                s->state = GzipNext(s, ST_GZIP_EXTRA);
+
+            continue;
+        }
+
+        case ST_GZIP_NAME:
+        case ST_GZIP_COMMENT:
+            if ( !c )
+                s->state = GzipNext(s, s->state);
+            break;
+
+        case ST_GZIP_HCRC:
+            if ( ++s->count == 2 )
+            {
+                s->count = 0;
+                s->state = ST_BODY;
+            }
+            break;
+        }
+        zs->next_in++;
+        zs->avail_in--;
+    }
+    return 1;
+}
+
+//-------------------------------------------------------------------------
+// streams
+//-------------------------------------------------------------------------
+
+SFInflate* SFInflate_New (SFInflateFormat fmt, uint32_t depth)
+{
+    SFInflate* s = (SFInflate*)ArenaAlloc(sizeof(*s));
+
+    if ( !s )
+        return NULL;
+
+    memset(s, 0, sizeof(*s));
+    s->state = (fmt == SF_INFLATE_GZIP) ? ST_GZIP : ST_ZLIB;
+    s->depth = s->left = depth;
+
+    // output never goes further back than depth
+    s->wbits = MAX_WBITS;
+
+    if ( depth && depth < (1u << MAX_WBITS) )
+    {
+        s->wbits = 9;  // smallest raw inflate allows
+
+        while ( (1u << s->wbits) < depth )
+            s->wbits++;
+    }
+    stats.streams++;
+    return s;
+}
+
+static int Done (SFInflate* s, int ret)
+{
+    if ( s->init )
+        inflateEnd(&s->zs);
+
+    if ( ret == SF_INFLATE_ERROR )
+        stats.errors++;
+
+    s->init = 0;
+    s->state = ST_DONE;
+    s->done = ret;
+    return ret;
+}
+
+void SFInflate_Free (SFInflate* s)
+{
+    if ( !s )
+        return;
+
+    if ( s->init )
+        inflateEnd(&s->zs);
+
+    ArenaFree(s);
+}
+
+int SFInflate_Run (
+    SFInflate* s, const uint8_t* in, uint32_t in_len,
+    uint8_t* out, uint32_t out_len, uint32_t* produced)
+{
+    z_stream* zs = &s->zs;
+    uint32_t avail = out_len;
+    int ret;
+
+    *produced = 0;
+
+    if ( in )
+    {
+        zs->next_in = (Bytef*)in;
+        zs->avail_in = in_len;
+    }
+
+    if ( s->state == ST_DONE )
+        return s->done;
+
+    if ( s->state < ST_BODY )
+    {
+        if ( (ret = ParseHeader(s)) <= 0 )
+            return ret ? Done(s, SF_INFLATE_ERROR) : SF_INFLATE_OK;
+    }
+
+    if ( s->depth && avail > s->left )
+        avail = s->left;
+
+    if ( !avail )
+        return zs->avail_in ? SF_INFLATE_FULL : SF_INFLATE_OK;
+
+    if ( !s->init )
+    {
+        zs->zalloc = ZAlloc;
+        zs->zfree = ZFree;
+        zs->opaque = Z_NULL;
+
+        ret = inflateInit2(zs, -s->wbits);
+
+        if ( ret == Z_MEM_ERROR )
+            return Done(s, SF_INFLATE_NOMEM);
+
+        if ( ret != Z_OK )
+            return Done(s, SF_INFLATE_ERROR);
+
+        s->init = 1;
+    }
+
+    zs->next_out = out;
+    zs->avail_out = avail;
+
+    if ( s->pending )
+    {
+        // one byte of deflate can't produce output
+        Bytef* next = zs->next_in;
+        uInt left = zs->avail_in;
+
+        zs->next_in = &s->first;
+        zs->avail_in = 1;
+        ret = inflate(zs, Z_SYNC_FLUSH);
+
+        zs->next_in = next;
+        zs->avail_in = left;
+        s->pending = 0;
+
+        if ( ret != Z_OK && ret != Z_BUF_ERROR )
+            return Done(s, (ret == Z_MEM_ERROR) ? SF_INFLATE_NOMEM : SF_INFLATE_ERROR);
+    }
+
+    ret = inflate(zs, Z_SYNC_FLUSH);
+
+    *produced = avail - zs->avail_out;
+
+    if ( s->depth )
+        s->left -= *produced;
+
+    switch ( ret )
+    {
+    case Z_OK:
+    case Z_BUF_ERROR:
+        break;
+
+    case Z_STREAM_END:
+        return Done(s, SF_INFLATE_END);
+
+    case Z_MEM_ERROR:
+        return Done(s, SF_INFLATE_NOMEM);
+
+    default:
+        return Done(s, SF_INFLATE_ERROR);
+    }
+
+    if ( s->depth && !s->left )
+        return Done(s, SF_INFLATE_END);
+
+    return zs->avail_out ? SF_INFLATE_OK : SF_INFLATE_FULL;
+}
+
+#endif  // ZLIB
+
@@ -0,0 +1,91 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    sf_inflate.h
+//
+// Streaming gzip / deflate decompression shared by everything that
+// inflates traffic (http_inspect and the dynamic engine decompression
+// API).  All zlib memory comes from one arena of power of 2 size classes
+// so the inflate state and windows of finished streams are reused by the
+// next ones instead of going back to malloc.
+//
+// Nothing is allocated until there is compressed data to inflate.  The
+// gzip and zlib headers are parsed here and the body is inflated raw, so
+// the window can be sized for the depth the caller will decompress rather
+// than the 32K the encoder may have used: a stream that will only be
+// decompressed to 4K can't refer back further than 4K.  All zlib memory
+// is released as soon as the depth or the end of the stream is reached.
+//
+// This only uses the zlib API, so a faster zlib compatible library
+// (zlib-ng built with its compat API, or another optimized zlib) is used
+// by building snort against it instead of zlib.
+
+#ifndef _SF_INFLATE_H_
+#define _SF_INFLATE_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+    SF_INFLATE_DEFLATE = 1,  // zlib wrapped or raw deflate
+    SF_INFLATE_GZIP
+} SFInflateFormat;
+
+// SFInflate_Run() return values
+#define SF_INFLATE_OK      0   // all input used
+#define SF_INFLATE_FULL    1   // output full with input left; run again with NULL
+#define SF_INFLATE_END     2   // end of stream or depth reached; memory released
+#define SF_INFLATE_ERROR (-1)  // bad data; memory released
+#define SF_INFLATE_NOMEM (-2)  // memcap reached; memory released
+
+typedef struct _SFInflateStats
+{
+    uint64_t streams;
+    uint64_t allocs;       // from the arena
+    uint64_t reuses;       // of those, satisfied by a free list
+    uint64_t failures;     // refused by the memcap
+    uint64_t errors;       // streams with bad data
+    uint64_t peak;         // most bytes held at once
+} SFInflateStats;
+
+typedef struct _SFInflate SFInflate;
+
+// 0 means no memcap.  the arena holds on to freed blocks; lowering the
+// memcap releases those that no longer fit.
+void SFInflate_SetMemcap(uint32_t);
+void SFInflate_Term(void);
+
+// depth is the most output that will be needed from the stream, 0 for
+// all of it.  returns NULL if the memcap is reached.
+SFInflate* SFInflate_New(SFInflateFormat, uint32_t depth);
+void SFInflate_Free(SFInflate*);
+
+// inflate in to out.  in == NULL continues with the input left from the
+// last call after SF_INFLATE_FULL.  *produced is set to the number of
+// bytes written to out (which may be nonzero on error).
+int SFInflate_Run(
+    SFInflate*, const uint8_t* in, uint32_t in_len,
+    uint8_t* out, uint32_t out_len, uint32_t* produced);
+
+const SFInflateStats* SFInflate_GetStats(void);
+
+#endif
+
@@ -76,8 +76,15 @@ static void * KTRIE_MALLOC(int n)
 
     p = calloc(1, n);
 
+    /* tries may be compiled concurrently (see mpseCompile) */
     if (p)
+    {
+#ifndef WIN32
+        __sync_fetch_and_add(&mtot, n);
+#else
         mtot += n;
+#endif
+    }
 
     return p;
 }
@@ -620,7 +627,7 @@ static int KTrieBuildMatchStateTrees( KTRIE_STRUCT * ts,
     return cnt;
 }
 
-static int KTrieBuildMatchStateTreesWithSnortConf( struct _SnortConfig *sc, KTRIE_STRUCT * ts,
+int KTrieBuildMatchStateTreesWithSnortConf( struct _SnortConfig *sc, KTRIE_STRUCT * ts,
                                                    int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                                                    int (*neg_list_func)(void *id, void **list))
 {
@@ -120,6 +120,10 @@ struct _SnortConfig;
 int            KTrieCompileWithSnortConf(struct _SnortConfig *, KTRIE_STRUCT * ts,
                                          int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
                                          int (*neg_list_func)(void *id, void **list));
+/* for tries compiled without trees */
+int            KTrieBuildMatchStateTreesWithSnortConf(struct _SnortConfig *, KTRIE_STRUCT * ts,
+                                         int (*build_tree)(struct _SnortConfig *, void * id, void **existing_tree),
+                                         int (*neg_list_func)(void *id, void **list));
 int            KTrieSearch( KTRIE_STRUCT * ts, unsigned char * T,  int n,
                             int(*match)(void * id, void *tree, int index, void *data, void *neg_list),
                             void *data );
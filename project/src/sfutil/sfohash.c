@@ -0,0 +1,448 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/*
+*
+*  sfohash.c
+*
+*  Fixed size open addressing hash table with clock eviction, see
+*  sfohash.h.
+*
+*  Layout:
+*
+*    buckets - cache line aligned, SFOHASH_SLOTS slots each.  An entry
+*              goes into the first bucket with a free slot starting at
+*              its home bucket (hash & mask); each full bucket passed on
+*              the way counts it in its overflow.  A search stops at the
+*              first bucket with no overflow, and a removal decrements the
+*              overflow of the buckets between home and the entry.
+*
+*    nodes   - max_nodes of [header | key | data].  The header holds the
+*              slot that points at the node and the clock reference bit.
+*              Nodes are handed out in index order and released ones are
+*              reused first, so only as much of the (calloc'd, lazily
+*              faulted) array is touched as the peak entry count needs.
+*
+*    used    - a bit per node for the clock hand and walks, so they skip
+*              free nodes without touching them.
+*
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "sf_types.h"
+#include "sfohash.h"
+#include "util.h"
+
+#define SFOHASH_NO_SLOT  0xffffffff
+#define SFOHASH_LINE     64
+
+/* at most this share of the slots is used, (num/den) */
+#define SFOHASH_LOAD_NUM 4
+#define SFOHASH_LOAD_DEN 5
+
+typedef struct _sfohash_node
+{
+    uint32_t slot;  /* bucket * SFOHASH_SLOTS + slot, SFOHASH_NO_SLOT if free */
+    uint32_t ref;   /* clock reference bit */
+
+} SFOHASH_NODE;
+
+#define SFOHASH_ALIGN8(n) (((n) + 7) & ~7)
+
+static inline SFOHASH_NODE * sfohash_node( SFOHASH * t, unsigned idx )
+{
+    return (SFOHASH_NODE *)(t->nodes + (size_t)idx * t->node_size);
+}
+
+static inline unsigned sfohash_index( SFOHASH * t, void * data )
+{
+    return (unsigned)(((unsigned char *)data - t->data_offset - t->nodes) / t->node_size);
+}
+
+static inline uint32_t sfohash_hash( SFOHASH * t, const void * key )
+{
+    uint32_t h = t->sfhashfcn->hash_fcn(t->sfhashfcn, (unsigned char *)key, t->keysize);
+
+    /* the bucket comes from the low bits and the tag from the high bits,
+       so spread whatever the key hash puts where */
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* never 0, which marks a free slot */
+static inline uint8_t sfohash_tag( uint32_t h )
+{
+    return (uint8_t)((h >> 24) | 0x80);
+}
+
+/* bit i set if slot i of the bucket has this tag */
+static inline unsigned sfohash_match( const SFOHASH_BUCKET * b, uint8_t tag )
+{
+#ifdef __SSE2__
+    /* the tags and overflow count are the first 16 bytes */
+    __m128i v = _mm_loadu_si128((const __m128i *)b->tag);
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)tag)));
+
+    return m & ((1 << SFOHASH_SLOTS) - 1);
+#else
+    unsigned m = 0;
+    int i;
+
+    for ( i = 0; i < SFOHASH_SLOTS; i++ )
+        if ( b->tag[i] == tag )
+            m |= 1 << i;
+
+    return m;
+#endif
+}
+
+static inline int sfohash_ctz64( uint64_t w )
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+
+    while ( !(w & 1) )
+    {
+        w >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Index of the first used node among the 'span' nodes starting at 'from',
+ * wrapping at next_node, or -1.
+ */
+static int sfohash_next_used( SFOHASH * t, unsigned from, unsigned span )
+{
+    unsigned pos = from;
+
+    if ( !t->next_node )
+        return -1;
+
+    if ( pos >= t->next_node )
+        pos = 0;
+
+    while ( span )
+    {
+        unsigned bit = pos & 63;
+        unsigned n = 64 - bit;
+        uint64_t w = t->used[pos >> 6] >> bit;
+
+        if ( n > t->next_node - pos )
+            n = t->next_node - pos;
+
+        if ( n > span )
+            n = span;
+
+        if ( n < 64 )
+            w &= ((uint64_t)1 << n) - 1;
+
+        if ( w )
+            return (int)(pos + sfohash_ctz64(w));
+
+        span -= n;
+        pos += n;
+
+        if ( pos >= t->next_node )
+            pos = 0;
+    }
+    return -1;
+}
+
+SFOHASH * sfohash_new( unsigned max_nodes, unsigned keysize, unsigned datasize )
+{
+    SFOHASH * t;
+    unsigned slots, nb = 1;
+
+    if ( !max_nodes || !keysize )
+        return NULL;
+
+    t = (SFOHASH *)SnortAlloc(sizeof(*t));
+
+    t->sfhashfcn = sfhashfcn_new(max_nodes);
+
+    if ( !t->sfhashfcn )
+    {
+        free(t);
+        return NULL;
+    }
+
+    t->keysize = keysize;
+    t->datasize = datasize;
+    t->max_nodes = max_nodes;
+
+    slots = (unsigned)(((uint64_t)max_nodes * SFOHASH_LOAD_DEN +
+        SFOHASH_LOAD_NUM - 1) / SFOHASH_LOAD_NUM);
+
+    while ( nb * SFOHASH_SLOTS < slots )
+        nb <<= 1;
+
+    t->bucket_mask = nb - 1;
+    t->bucket_mem = SnortAlloc((size_t)nb * sizeof(SFOHASH_BUCKET) + SFOHASH_LINE - 1);
+    t->buckets = (SFOHASH_BUCKET *)
+        (((uintptr_t)t->bucket_mem + SFOHASH_LINE - 1) & ~(uintptr_t)(SFOHASH_LINE - 1));
+
+    t->key_offset = sizeof(SFOHASH_NODE);
+    t->data_offset = t->key_offset + SFOHASH_ALIGN8(keysize);
+    t->node_size = t->data_offset + SFOHASH_ALIGN8(datasize);
+
+    t->nodes = (unsigned char *)SnortAlloc((size_t)max_nodes * t->node_size);
+    t->used = (uint64_t *)SnortAlloc(((max_nodes + 63) / 64) * sizeof(uint64_t));
+    t->free_list = (uint32_t *)SnortAlloc((size_t)max_nodes * sizeof(uint32_t));
+
+    return t;
+}
+
+void sfohash_delete( SFOHASH * t )
+{
+    if ( !t )
+        return;
+
+    if ( t->sfhashfcn )
+        sfhashfcn_free(t->sfhashfcn);
+
+    free(t->bucket_mem);
+    free(t->nodes);
+    free(t->used);
+    free(t->free_list);
+    free(t);
+}
+
+int sfohash_set_keyops( SFOHASH * t,
+                        unsigned (*hash_fcn)( SFHASHFCN * p,
+                                              unsigned char *d,
+                                              int n),
+                        int (*keycmp_fcn)( const void *s1,
+                                           const void *s2,
+                                           size_t n))
+{
+    if ( t && hash_fcn && keycmp_fcn )
+        return sfhashfcn_set_keyops(t->sfhashfcn, hash_fcn, keycmp_fcn);
+
+    return -1;
+}
+
+static inline SFOHASH_NODE * sfohash_lookup( SFOHASH * t, const void * key, uint32_t h )
+{
+    unsigned b = h & t->bucket_mask;
+    uint8_t tag = sfohash_tag(h);
+
+    for ( ;; )
+    {
+        SFOHASH_BUCKET * bk = &t->buckets[b];
+        unsigned m = sfohash_match(bk, tag);
+        int i;
+
+        for ( i = 0; m; i++, m >>= 1 )
+        {
+            SFOHASH_NODE * n;
+
+            if ( !(m & 1) )
+                continue;
+
+            n = sfohash_node(t, bk->node[i]);
+
+            if ( !t->sfhashfcn->keycmp_fcn((unsigned char *)n + t->key_offset, key, t->keysize) )
+                return n;
+        }
+
+        if ( !bk->overflow )
+            return NULL;
+
+        b = (b + 1) & t->bucket_mask;
+    }
+}
+
+void * sfohash_find( SFOHASH * t, const void * key )
+{
+    SFOHASH_NODE * n = sfohash_lookup(t, key, sfohash_hash(t, key));
+
+    if ( !n )
+    {
+        t->find_fail++;
+        return NULL;
+    }
+
+    t->find_success++;
+
+    /* don't dirty the line if it's already set */
+    if ( !n->ref )
+        n->ref = 1;
+
+    return (unsigned char *)n + t->data_offset;
+}
+
+void * sfohash_get( SFOHASH * t, const void * key, int * added )
+{
+    uint32_t h = sfohash_hash(t, key);
+    SFOHASH_NODE * n = sfohash_lookup(t, key, h);
+    SFOHASH_BUCKET * bk;
+    unsigned idx, b, m;
+    int i;
+
+    *added = 0;
+
+    if ( n )
+    {
+        n->ref = 1;
+        return (unsigned char *)n + t->data_offset;
+    }
+
+    if ( t->count >= t->max_nodes )
+        return NULL;
+
+    idx = t->free_count ? t->free_list[--t->free_count] : t->next_node++;
+
+    /* find a free slot, counting the full buckets passed as overflow */
+    for ( b = h & t->bucket_mask; ; b = (b + 1) & t->bucket_mask )
+    {
+        bk = &t->buckets[b];
+
+        if ( (m = sfohash_match(bk, 0)) )
+            break;
+
+        bk->overflow++;
+    }
+
+    for ( i = 0; !(m & 1); i++, m >>= 1 );
+
+    bk->tag[i] = sfohash_tag(h);
+    bk->node[i] = idx;
+
+    n = sfohash_node(t, idx);
+    n->slot = b * SFOHASH_SLOTS + i;
+
+    /* new entries start referenced, as if just used */
+    n->ref = 1;
+
+    memcpy((unsigned char *)n + t->key_offset, key, t->keysize);
+    memset((unsigned char *)n + t->data_offset, 0, t->datasize);
+
+    t->used[idx >> 6] |= (uint64_t)1 << (idx & 63);
+    t->count++;
+
+    *added = 1;
+    return (unsigned char *)n + t->data_offset;
+}
+
+int sfohash_remove( SFOHASH * t, void * data )
+{
+    unsigned idx = sfohash_index(t, data);
+    SFOHASH_NODE * n = sfohash_node(t, idx);
+    unsigned b, i, home;
+
+    if ( idx >= t->next_node || n->slot == SFOHASH_NO_SLOT )
+        return SFOHASH_ERR;
+
+    b = n->slot / SFOHASH_SLOTS;
+    i = n->slot % SFOHASH_SLOTS;
+
+    /* the entry overflowed the buckets from its home up to this one */
+    home = sfohash_hash(t, (unsigned char *)n + t->key_offset) & t->bucket_mask;
+
+    while ( home != b )
+    {
+        t->buckets[home].overflow--;
+        home = (home + 1) & t->bucket_mask;
+    }
+
+    t->buckets[b].tag[i] = 0;
+
+    n->slot = SFOHASH_NO_SLOT;
+    n->ref = 0;
+
+    t->used[idx >> 6] &= ~((uint64_t)1 << (idx & 63));
+    t->free_list[t->free_count++] = idx;
+    t->count--;
+
+    return SFOHASH_OK;
+}
+
+void * sfohash_key( SFOHASH * t, void * data )
+{
+    return (unsigned char *)data - t->data_offset + t->key_offset;
+}
+
+void * sfohash_clock_next( SFOHASH * t, int * ref, int clear )
+{
+    SFOHASH_NODE * n;
+    int idx;
+
+    if ( !t->count )
+        return NULL;
+
+    idx = sfohash_next_used(t, t->hand, t->next_node);
+
+    if ( idx < 0 )
+        return NULL;
+
+    t->hand = (unsigned)idx + 1;
+
+    n = sfohash_node(t, idx);
+    *ref = n->ref;
+
+    if ( clear )
+        n->ref = 0;
+
+    return (unsigned char *)n + t->data_offset;
+}
+
+void * sfohash_walk( SFOHASH * t, unsigned * cursor, unsigned span )
+{
+    int idx;
+
+    if ( !t->count || !t->next_node )
+        return NULL;
+
+    if ( *cursor >= t->next_node )
+        *cursor = 0;
+
+    idx = sfohash_next_used(t, *cursor, span);
+
+    if ( idx < 0 )
+    {
+        *cursor = (unsigned)(((uint64_t)*cursor + span) % t->next_node);
+        return NULL;
+    }
+
+    *cursor = (unsigned)idx + 1;
+
+    return (unsigned char *)sfohash_node(t, idx) + t->data_offset;
+}
@@ -0,0 +1,148 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/*
+*
+*  sfohash.h
+*
+*  fixed size open addressing hash table - stores key + data pairs
+*
+*  Entries live in a preallocated node array and are found through
+*  buckets of SFOHASH_SLOTS slots, one cache line each.  Every slot
+*  carries a one byte fingerprint of the hash so a lookup compares the
+*  key of a likely match only.  Buckets count the entries that probed
+*  past them, which ends unsuccessful searches without tombstones.
+*
+*  There is no global list to reorder on access: a lookup just sets a
+*  reference bit in the node, and eviction runs a clock (second chance)
+*  hand over the node array.  Nothing shared is written on a hit, so a
+*  table per worker needs no locking.
+*
+*/
+
+#ifndef _SFOHASH_
+#define _SFOHASH_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sf_types.h"
+#include "sfhashfcn.h"
+
+#define SFOHASH_ERR      -1
+#define SFOHASH_OK        0
+
+/* slots per bucket; with the tags and overflow count a bucket is 64 bytes */
+#define SFOHASH_SLOTS    12
+
+typedef struct _sfohash_bucket
+{
+    uint8_t  tag[SFOHASH_SLOTS];   /* hash fingerprint, 0 if the slot is free */
+    uint32_t overflow;             /* # entries that probed past this bucket */
+    uint32_t node[SFOHASH_SLOTS];  /* node array index of the slot's entry */
+
+} SFOHASH_BUCKET;
+
+typedef struct _sfohash
+{
+    SFHASHFCN      * sfhashfcn;   /* hash function */
+    unsigned         keysize;
+    unsigned         datasize;
+
+    SFOHASH_BUCKET * buckets;
+    void           * bucket_mem;  /* unaligned allocation behind buckets */
+    unsigned         bucket_mask; /* # buckets - 1 */
+
+    unsigned char  * nodes;       /* node header + key + data, max_nodes of them */
+    unsigned         node_size;
+    unsigned         key_offset;
+    unsigned         data_offset;
+    uint64_t       * used;        /* bit per node, set if in the table */
+
+    uint32_t       * free_list;   /* released node indices */
+    unsigned         free_count;
+    unsigned         next_node;   /* never used nodes start here */
+
+    unsigned         max_nodes;
+    unsigned         count;
+    unsigned         hand;        /* clock hand */
+
+    unsigned         find_fail;
+    unsigned         find_success;
+
+} SFOHASH;
+
+SFOHASH * sfohash_new( unsigned max_nodes, unsigned keysize, unsigned datasize );
+void      sfohash_delete( SFOHASH * t );
+
+int       sfohash_set_keyops( SFOHASH * t,
+                              unsigned (*hash_fcn)( SFHASHFCN * p,
+                                                    unsigned char *d,
+                                                    int n),
+                              int (*keycmp_fcn)( const void *s1,
+                                                 const void *s2,
+                                                 size_t n));
+
+/* data of the entry with this key, or NULL; marks the entry referenced */
+void    * sfohash_find( SFOHASH * t, const void * key );
+
+/* find, or add an entry with this key and zeroed data; NULL if the
+   table is full.  *added is set if the entry is new. */
+void    * sfohash_get( SFOHASH * t, const void * key, int * added );
+
+/* remove the entry holding this data */
+int       sfohash_remove( SFOHASH * t, void * data );
+
+/* the stored key of the entry holding this data */
+void    * sfohash_key( SFOHASH * t, void * data );
+
+/*
+ * Advance the clock hand to the next entry and return its data, or NULL
+ * if the table is empty.  *ref is set to the entry's reference bit,
+ * which is cleared if 'clear' is set - giving the entry its second
+ * chance.
+ */
+void    * sfohash_clock_next( SFOHASH * t, int * ref, int clear );
+
+/*
+ * Return the data of the first entry at or after node *cursor, looking
+ * at no more than 'span' nodes, and leave *cursor just past it.  The
+ * cursor wraps at the end of the node array.  Returns NULL with *cursor
+ * moved on by 'span' if there was no entry in that range.
+ */
+void    * sfohash_walk( SFOHASH * t, unsigned * cursor, unsigned span );
+
+static inline unsigned sfohash_count( SFOHASH * t )
+{
+    return t->count;
+}
+
+static inline unsigned sfohash_find_success( SFOHASH * t )
+{
+    return t->find_success;
+}
+
+static inline unsigned sfohash_find_fail( SFOHASH * t )
+{
+    return t->find_fail;
+}
+
+#endif
@@ -210,6 +210,24 @@ table_t *sfrt_new(char table_type, char ip_type, long data_size, uint32_t mem_ca
 
             break;
 
+        /* Setup Poptrie table */
+        case POPTRIE:
+            /* Leaves only have room for this many data table indexes */
+            if(data_size > POPTRIE_MAX_INDEX + 1)
+            {
+                free(table->data);
+                free(table);
+                return NULL;
+            }
+            table->insert = sfrt_poptrie_insert;
+            table->lookup = sfrt_poptrie_lookup;
+            table->free = sfrt_poptrie_free;
+            table->usage = sfrt_poptrie_usage;
+            table->print = sfrt_poptrie_print;
+            table->remove = sfrt_poptrie_remove;
+
+            break;
+
         default:
             free(table->data);
             free(table);
@@ -262,6 +280,10 @@ table_t *sfrt_new(char table_type, char ip_type, long data_size, uint32_t mem_ca
             table->rt6 = sfrt_dir_new(mem_cap, 16,
                             8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8);
             break;
+        case POPTRIE:
+            table->rt = sfrt_poptrie_new(mem_cap, 32);
+            table->rt6 = sfrt_poptrie_new(mem_cap, 128);
+            break;
     };
 
     if((!table->rt) || (!table->rt6))
@@ -658,6 +680,31 @@ uint32_t sfrt_num_entries(table_t *table)
     return table->num_ent - 1;
 }
 
+/** Prepare a loaded table for lookups.
+ * Only POPTRIE tables do anything here; they are compiled from their
+ * DIR-n-m form.  Call it after the last insert or remove, before the
+ * table is used in the packet path.  If it fails, lookups still work
+ * from the DIR-n-m table.
+ * @param table - routing table.
+ * @return RT_SUCCESS or MEM_ALLOC_FAILURE
+ */
+int sfrt_compile(table_t *table)
+{
+    int rval;
+
+    if(!table || (table->table_type != POPTRIE))
+    {
+        return RT_SUCCESS;
+    }
+
+    if((rval = sfrt_poptrie_compile(table->rt)) != RT_SUCCESS)
+    {
+        return rval;
+    }
+
+    return sfrt_poptrie_compile(table->rt6);
+}
+
 uint32_t sfrt_usage(table_t *table)
 {
     uint32_t usage;
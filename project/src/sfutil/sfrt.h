@@ -33,6 +33,10 @@
  * DIR-n-m.  Presently, the LC-trie is used for testing purposes as the
  * current implementation does not allow for fast, dynamic inserts.
  *
+ * The POPTRIE table type keeps a DIR-n-m table for inserts and removes and
+ * compiles it into a smaller, faster structure for lookups when its owner
+ * calls sfrt_compile() after loading it.  See sfrt_poptrie.h.
+ *
  * The intended use is to associate large IP blocks with specific information;
  * such as what may be written into the table by RNA.
  *
@@ -112,6 +116,7 @@ typedef struct
 
 
 #include "sfrt_dir.h"
+#include "sfrt_poptrie.h"
 //#define SUPPORT_LCTRIE
 #ifdef SUPPORT_LCTRIE
 #include "sfrt_lctrie.h"
@@ -133,6 +138,7 @@ enum types
    DIR_16x7_4x4,
    DIR_16x8,
    DIR_8x16,
+   POPTRIE,
    IPv4,
    IPv6
 };
@@ -212,6 +218,7 @@ int     sfrt_remove(void *adr, unsigned char len, GENERIC *ptr,
 uint32_t     sfrt_usage(table_t *table);
 void    sfrt_print(table_t *table);
 uint32_t     sfrt_num_entries(table_t *table);
+int     sfrt_compile(table_t *table);
 
 /* Perform a lookup on value contained in "ip"
  * For performance reason, we use this simplified version instead of sfrt_lookup
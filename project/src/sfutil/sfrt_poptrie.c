@@ -0,0 +1,522 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/*
+ * @file    sfrt_poptrie.c
+ *
+ * The compiled form is built straight from the DIR-n-m sub tables.  For
+ * each child of a node, the range of DIR-n-m entries covering it is
+ * checked; if they are all the same leaf, the child is a leaf, otherwise
+ * it is a node one stride deeper.  Leaves keep the data index and the
+ * prefix length so lookups return the same tuple the DIR-n-m table would.
+ *
+ * Addresses are taken as 128 bits, most significant bit first, from the
+ * 32 bit words of the sfip_t in the same order sfrt_dir uses them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "sf_types.h"
+#include "sfrt.h"
+#include "sfrt_poptrie.h"
+
+/* Direct pointing bits; 18 puts the end of a /24 on a node boundary so
+ * the most common IPv4 route is 3 reads instead of 4 */
+#define POPTRIE_DP_BITS_V4  18
+#define POPTRIE_DP_BITS_V6  16
+#define POPTRIE_STRIDE      6
+
+/* Leaves are the length in bits 23-30 and the data index in bits 0-22.
+ * Bit 31 marks a direct pointing entry that is a node. */
+#define POPTRIE_NODE        0x80000000
+#define POPTRIE_LEAF(index, length) \
+    ((uint32_t)(((length) << 23) | ((index) & POPTRIE_MAX_INDEX)))
+
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define POPCOUNT(x) __builtin_popcountll(x)
+#else
+static inline int POPCOUNT(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+/* Get "width" bits of the address starting at bit "offset" */
+static inline uint32_t _pop_bits(uint64_t hi, uint64_t lo, int offset, int width)
+{
+    if (!width)
+        return 0;
+
+    if (offset >= 64)
+        return (uint32_t)((lo << (offset - 64)) >> (64 - width));
+
+    if (offset + width <= 64)
+        return (uint32_t)((hi << offset) >> (64 - width));
+
+    return (uint32_t)(((hi << offset) | (lo >> (64 - offset))) >> (64 - width));
+}
+
+static inline void _pop_address(IP ip, uint64_t *hi, uint64_t *lo)
+{
+    if (ip->family == AF_INET)
+    {
+        *hi = (uint64_t)ip->ip32[0] << 32;
+        *lo = 0;
+    }
+    else
+    {
+        *hi = ((uint64_t)ip->ip32[0] << 32) | ip->ip32[1];
+        *lo = ((uint64_t)ip->ip32[2] << 32) | ip->ip32[3];
+    }
+}
+
+static inline tuple_t _pop_tuple(uint32_t leaf)
+{
+    tuple_t ret;
+    ret.index = leaf & POPTRIE_MAX_INDEX;
+    ret.length = (leaf >> 23) & 0xff;
+    return ret;
+}
+
+/*******************************************************************/
+/* Compiling */
+
+/* Free the compiled form and go back to DIR-n-m lookups */
+static void _pop_drop(poptrie_table_t *pt)
+{
+    if (pt->dp)
+        free(pt->dp);
+    if (pt->nodes)
+        free(pt->nodes);
+    if (pt->leaves)
+        free(pt->leaves);
+
+    pt->dp = NULL;
+    pt->nodes = NULL;
+    pt->leaves = NULL;
+    pt->num_nodes = pt->max_nodes = 0;
+    pt->num_leaves = pt->max_leaves = 0;
+    pt->allocated = 0;
+    pt->compiled = 0;
+}
+
+/* Make room for "count" more nodes or leaves.  Returns 0 if the
+ * memory cap would be exceeded or the allocation fails. */
+static int _pop_grow(poptrie_table_t *pt, void **array, uint32_t *max,
+                     uint32_t used, uint32_t count, size_t size)
+{
+    uint32_t n = *max ? *max : 256;
+    void *tmp;
+
+    if (used + count <= *max)
+        return 1;
+
+    while (n < used + count)
+        n <<= 1;
+
+    if (pt->rib->allocated + pt->allocated + (n - *max) * size > pt->rib->mem_cap)
+        return 0;
+
+    tmp = realloc(*array, n * size);
+
+    if (!tmp)
+        return 0;
+
+    pt->allocated += (n - *max) * size;
+    *array = tmp;
+    *max = n;
+    return 1;
+}
+
+/* Find the deepest DIR-n-m sub table that holds every address starting
+ * with the first "length" bits of hi:lo, and the bit offset it starts at.
+ * Children of a node are all checked from there instead of the root. */
+static dir_sub_table_t *_pop_start(dir_table_t *rib, uint64_t hi, uint64_t lo,
+                                   int length, int *offset)
+{
+    dir_sub_table_t *sub = rib->sub_table;
+    int start = 0;
+
+    while (start + sub->width <= length)
+    {
+        uint32_t index = _pop_bits(hi, lo, start, sub->width);
+
+        if (!sub->entries[index] || sub->lengths[index])
+            break;
+
+        start += sub->width;
+        sub = (dir_sub_table_t *)sub->entries[index];
+    }
+
+    *offset = start;
+    return sub;
+}
+
+/* Check if every address starting with the first "length" bits of hi:lo
+ * maps to the same DIR-n-m entry, looking from sub table "sub" at bit
+ * "offset".  If so, returns 1 with that entry in "leaf", otherwise
+ * returns 0. */
+static int _pop_region(dir_sub_table_t *sub, int offset, uint64_t hi,
+                       uint64_t lo, int length, uint32_t *leaf)
+{
+
+    while (1)
+    {
+        int width = sub->width;
+        uint32_t index, count, i;
+        uint32_t first;
+
+        if (offset + width <= length)
+        {
+            index = _pop_bits(hi, lo, offset, width);
+            count = 1;
+        }
+        else
+        {
+            int fixed = (length > offset) ? length - offset : 0;
+            index = _pop_bits(hi, lo, offset, fixed) << (width - fixed);
+            count = 1 << (width - fixed);
+        }
+
+        if (sub->entries[index] && !sub->lengths[index])
+        {
+            /* The region covers a sub table and maybe more */
+            if (count > 1)
+                return 0;
+
+            sub = (dir_sub_table_t *)sub->entries[index];
+            offset += width;
+            continue;
+        }
+
+        first = POPTRIE_LEAF(sub->entries[index], sub->lengths[index]);
+
+        for (i = 1; i < count; i++)
+        {
+            if (sub->entries[index + i] && !sub->lengths[index + i])
+                return 0;
+
+            if (POPTRIE_LEAF(sub->entries[index + i],
+                        sub->lengths[index + i]) != first)
+                return 0;
+        }
+
+        *leaf = first;
+        return 1;
+    }
+}
+
+/* Set bits [offset, offset + STRIDE) of hi:lo to "child" */
+static inline void _pop_extend(uint64_t *hi, uint64_t *lo, int offset, uint32_t child)
+{
+    int shift = 128 - offset - POPTRIE_STRIDE;
+
+    /* Only the last node of an IPv6 table goes past bit 128 */
+    if (shift < 0)
+    {
+        child >>= -shift;
+        shift = 0;
+    }
+
+    if (shift >= 64)
+        *hi |= (uint64_t)child << (shift - 64);
+    else
+    {
+        *lo |= (uint64_t)child << shift;
+
+        if (shift + POPTRIE_STRIDE > 64)
+            *hi |= (uint64_t)child >> (64 - shift);
+    }
+}
+
+/* Fill in node "n" for the addresses starting with the first "offset"
+ * bits of hi:lo */
+static int _pop_build(poptrie_table_t *pt, uint32_t n, uint64_t hi, uint64_t lo,
+                      int offset)
+{
+    uint32_t leaves[1 << POPTRIE_STRIDE];
+    uint64_t vector = 0, leafvec = 0;
+    uint32_t last = 0, base0, base1, num_children = 0, num_runs = 0;
+    uint32_t child;
+    int have_last = 0, start;
+    dir_sub_table_t *sub = _pop_start(pt->rib, hi, lo, offset, &start);
+
+    for (child = 0; child < (1 << POPTRIE_STRIDE); child++)
+    {
+        uint64_t h = hi, l = lo;
+        uint32_t leaf;
+
+        _pop_extend(&h, &l, offset, child);
+
+        if (!_pop_region(sub, start, h, l, offset + POPTRIE_STRIDE, &leaf))
+        {
+            vector |= (uint64_t)1 << child;
+            num_children++;
+            continue;
+        }
+
+        if (!have_last || leaf != last)
+        {
+            leafvec |= (uint64_t)1 << child;
+            leaves[num_runs++] = leaf;
+            last = leaf;
+            have_last = 1;
+        }
+    }
+
+    if (!_pop_grow(pt, (void **)&pt->leaves, &pt->max_leaves,
+                pt->num_leaves, num_runs, sizeof(*pt->leaves)) ||
+        !_pop_grow(pt, (void **)&pt->nodes, &pt->max_nodes,
+                pt->num_nodes, num_children, sizeof(*pt->nodes)))
+    {
+        return MEM_ALLOC_FAILURE;
+    }
+
+    base0 = pt->num_leaves;
+    memcpy(pt->leaves + base0, leaves, num_runs * sizeof(*leaves));
+    pt->num_leaves += num_runs;
+
+    /* Children of a node are kept together so they can be indexed */
+    base1 = pt->num_nodes;
+    pt->num_nodes += num_children;
+
+    pt->nodes[n].vector = vector;
+    pt->nodes[n].leafvec = leafvec;
+    pt->nodes[n].base0 = base0;
+    pt->nodes[n].base1 = base1;
+
+    for (child = 0; child < (1 << POPTRIE_STRIDE); child++)
+    {
+        uint64_t h = hi, l = lo;
+        int rval;
+
+        if (!(vector & ((uint64_t)1 << child)))
+            continue;
+
+        _pop_extend(&h, &l, offset, child);
+
+        rval = _pop_build(pt, base1++, h, l, offset + POPTRIE_STRIDE);
+
+        if (rval != RT_SUCCESS)
+            return rval;
+    }
+
+    return RT_SUCCESS;
+}
+
+static int _pop_compile(poptrie_table_t *pt)
+{
+    size_t dp_size = sizeof(*pt->dp) << pt->dp_bits;
+    uint32_t i;
+
+    _pop_drop(pt);
+
+    if (pt->rib->allocated + dp_size > pt->rib->mem_cap)
+        return MEM_ALLOC_FAILURE;
+
+    pt->dp = (uint32_t *)malloc(dp_size);
+
+    if (!pt->dp)
+        return MEM_ALLOC_FAILURE;
+
+    pt->allocated = dp_size;
+
+    for (i = 0; i < ((uint32_t)1 << pt->dp_bits); i++)
+    {
+        uint64_t hi = (uint64_t)i << (64 - pt->dp_bits);
+        uint32_t leaf;
+
+        if (_pop_region(pt->rib->sub_table, 0, hi, 0, pt->dp_bits, &leaf))
+        {
+            pt->dp[i] = leaf;
+            continue;
+        }
+
+        if (!_pop_grow(pt, (void **)&pt->nodes, &pt->max_nodes,
+                    pt->num_nodes, 1, sizeof(*pt->nodes)))
+        {
+            _pop_drop(pt);
+            return MEM_ALLOC_FAILURE;
+        }
+
+        pt->dp[i] = POPTRIE_NODE | pt->num_nodes;
+
+        if (_pop_build(pt, pt->num_nodes++, hi, 0, pt->dp_bits) != RT_SUCCESS)
+        {
+            _pop_drop(pt);
+            return MEM_ALLOC_FAILURE;
+        }
+    }
+
+    pt->compiled = 1;
+    return RT_SUCCESS;
+}
+
+/*******************************************************************/
+/* Table functions */
+
+/* Create a new table for IPv4 (ip_bits 32) or IPv6 (ip_bits 128) */
+poptrie_table_t *sfrt_poptrie_new(uint32_t mem_cap, int ip_bits)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)calloc(1, sizeof(*pt));
+
+    if (!pt)
+        return NULL;
+
+    pt->dp_bits = (ip_bits == 32) ? POPTRIE_DP_BITS_V4 : POPTRIE_DP_BITS_V6;
+
+    /* Lookups don't use this, so favor small over fast */
+    if (ip_bits == 32)
+        pt->rib = sfrt_dir_new(mem_cap, 4, 16,8,4,4);
+    else
+        pt->rib = sfrt_dir_new(mem_cap, 16,
+                    8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8);
+
+    if (!pt->rib)
+    {
+        free(pt);
+        return NULL;
+    }
+
+    return pt;
+}
+
+void sfrt_poptrie_free(void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+
+    if (!pt)
+        return;
+
+    _pop_drop(pt);
+    sfrt_dir_free(pt->rib);
+    free(pt);
+}
+
+int sfrt_poptrie_compile(void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+
+    if (!pt)
+        return RT_SUCCESS;
+
+    if (pt->compiled)
+        return RT_SUCCESS;
+
+    return _pop_compile(pt);
+}
+
+tuple_t sfrt_poptrie_lookup(IP ip, void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+    const poptrie_node_t *node;
+    uint64_t hi, lo, bit;
+    uint32_t entry;
+    int offset;
+
+    if (!pt->compiled)
+        return sfrt_dir_lookup(ip, pt->rib);
+
+    _pop_address(ip, &hi, &lo);
+
+    entry = pt->dp[hi >> (64 - pt->dp_bits)];
+
+    if (!(entry & POPTRIE_NODE))
+        return _pop_tuple(entry);
+
+    node = pt->nodes + (entry & ~POPTRIE_NODE);
+    offset = pt->dp_bits;
+
+    while (1)
+    {
+        bit = (uint64_t)1 << _pop_bits(hi, lo, offset, POPTRIE_STRIDE);
+
+        if (!(node->vector & bit))
+            break;
+
+        node = pt->nodes + node->base1 + POPCOUNT(node->vector & (bit - 1));
+        offset += POPTRIE_STRIDE;
+    }
+
+    /* (bit << 1) - 1 wraps to all ones for the last child */
+    return _pop_tuple(pt->leaves[node->base0 +
+        POPCOUNT(node->leafvec & ((bit << 1) - 1)) - 1]);
+}
+
+int sfrt_poptrie_insert(IP ip, int len, word data_index,
+                        int behavior, void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+    int rval;
+
+    if (data_index > POPTRIE_MAX_INDEX)
+        return DIR_INSERT_FAILURE;
+
+    rval = sfrt_dir_insert(ip, len, data_index, behavior, pt->rib);
+    _pop_drop(pt);
+
+    return rval;
+}
+
+word sfrt_poptrie_remove(IP ip, int len, int behavior, void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+    word index;
+
+    index = sfrt_dir_remove(ip, len, behavior, pt->rib);
+    _pop_drop(pt);
+
+    return index;
+}
+
+uint32_t sfrt_poptrie_usage(void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+
+    if (!pt)
+        return 0;
+
+    return sizeof(*pt) + pt->allocated + sfrt_dir_usage(pt->rib);
+}
+
+void sfrt_poptrie_print(void *tbl)
+{
+    poptrie_table_t *pt = (poptrie_table_t *)tbl;
+
+    if (!pt)
+        return;
+
+    sfrt_dir_print(pt->rib);
+
+    if (pt->compiled)
+    {
+        printf("Compiled: %u nodes, %u leaves, %u bytes\n",
+               pt->num_nodes, pt->num_leaves, pt->allocated);
+    }
+}
+
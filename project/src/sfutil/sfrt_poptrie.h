@@ -0,0 +1,90 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/*
+ * @file    sfrt_poptrie.h
+ *
+ * A compressed lookup structure similar to Asai and Ohara's Poptrie.
+ *
+ * Inserts and removes go to a DIR-n-m table built with narrow strides, so
+ * it stays small.  Once the table has stopped changing, it is compiled into
+ * a direct pointing array on the first 18 (IPv4) or 16 (IPv6) bits,
+ * followed by nodes of 64 children.
+ * Each node has a bitmap of which children are nodes and a bitmap of where
+ * runs of equal leaves start, so a child is found with a popcount instead
+ * of storing 64 pointers.
+ *
+ * Each level is a dependent read: the direct pointing entry, one node per
+ * 6 bits past it, then the leaf.  An IPv4 lookup takes 1 read for a
+ * prefix of 18 bits or less, 3 up to /24, 4 up to /30 and 5 for /31 and
+ * /32 hosts.  An IPv6 lookup takes at most 21.  Getting every IPv4 lookup
+ * down to 1 or 2 reads needs a 2^24 entry first level, as DIR_24_8 has,
+ * which is too big for these tables.
+ *
+ * The owner compiles the table with sfrt_compile() once it is loaded, so
+ * the packet path never pays for it.  Any insert or remove drops the
+ * compiled form again and lookups use the DIR-n-m table until the owner
+ * compiles it again, e.g. when idle.
+*/
+
+#ifndef SFRT_POPTRIE_H_
+#define SFRT_POPTRIE_H_
+
+/* Data indexes and lengths are packed in a 32 bit leaf */
+#define POPTRIE_MAX_INDEX   ((1 << 23) - 1)
+
+typedef struct
+{
+    uint64_t vector;    /* bit n set if child n is a node */
+    uint64_t leafvec;   /* bit n set if child n starts a new run of leaves */
+    uint32_t base0;     /* first leaf */
+    uint32_t base1;     /* first child node */
+} poptrie_node_t;
+
+typedef struct
+{
+    dir_table_t *rib;   /* where inserts and removes are done */
+
+    uint32_t *dp;       /* direct pointing on the first dp_bits bits */
+    poptrie_node_t *nodes;
+    uint32_t *leaves;
+    uint32_t num_nodes, max_nodes;
+    uint32_t num_leaves, max_leaves;
+
+    int compiled;
+    int dp_bits;        /* of the direct pointing array */
+    uint32_t allocated; /* by the compiled form */
+} poptrie_table_t;
+
+/*******************************************************************/
+/* Poptrie functions, these are not intended to be called directly */
+poptrie_table_t * sfrt_poptrie_new(uint32_t mem_cap, int ip_bits);
+void           sfrt_poptrie_free(void *);
+int            sfrt_poptrie_compile(void *);
+tuple_t        sfrt_poptrie_lookup(IP ip, void *table);
+int            sfrt_poptrie_insert(IP ip, int len, word data_index,
+                                   int behavior, void *table);
+uint32_t      sfrt_poptrie_usage(void *table);
+void          sfrt_poptrie_print(void *table);
+word sfrt_poptrie_remove(IP ip, int len, int behavior, void *table);
+
+#endif /* SFRT_POPTRIE_H_ */
+
@@ -0,0 +1,220 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/*
+*
+*  sftimerwheel.c
+*
+*  hierarchical timing wheel, see sftimerwheel.h
+*
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "sftimerwheel.h"
+
+#define SFTW_L0_MASK (SFTW_L0_SIZE - 1)
+#define SFTW_LN_MASK (SFTW_LN_SIZE - 1)
+
+/* slot index of tick at level n > 0 */
+#define SFTW_INDEX(tick, n) \
+    (((tick) >> (SFTW_L0_BITS + ((n) - 1) * SFTW_LN_BITS)) & SFTW_LN_MASK)
+
+static inline void sftw_link( SFTW_TIMER ** head, SFTW_TIMER * t )
+{
+    t->next = *head;
+
+    if ( t->next )
+        t->next->pprev = &t->next;
+
+    *head = t;
+    t->pprev = head;
+}
+
+static inline void sftw_unlink( SFTW_TIMER * t )
+{
+    *t->pprev = t->next;
+
+    if ( t->next )
+        t->next->pprev = t->pprev;
+
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/* put t on the list for its expiry relative to the clock */
+static void sftw_add( SFTW * w, SFTW_TIMER * t )
+{
+    uint32_t expires = t->expires;
+    uint32_t delta = expires - w->clk;
+    SFTW_TIMER ** head;
+
+    if ( (int32_t)delta < 0 )
+    {
+        head = &w->due;
+    }
+    else if ( delta < (1U << SFTW_L0_BITS) )
+    {
+        head = &w->l0[expires & SFTW_L0_MASK];
+    }
+    else if ( delta < (1U << (SFTW_L0_BITS + SFTW_LN_BITS)) )
+    {
+        head = &w->ln[0][SFTW_INDEX(expires, 1)];
+    }
+    else if ( delta < (1U << (SFTW_L0_BITS + 2 * SFTW_LN_BITS)) )
+    {
+        head = &w->ln[1][SFTW_INDEX(expires, 2)];
+    }
+    else
+    {
+        /* park it in the farthest slot; it is rehashed from there
+           against its real expiry */
+        if ( delta > SFTW_MAX_DELTA )
+            expires = w->clk + SFTW_MAX_DELTA;
+
+        head = &w->ln[2][SFTW_INDEX(expires, 3)];
+    }
+    sftw_link(head, t);
+}
+
+/* move the timers of one slot at level n down; returns the slot index */
+static unsigned sftw_cascade( SFTW * w, int n )
+{
+    unsigned idx = SFTW_INDEX(w->clk, n);
+    SFTW_TIMER * t = w->ln[n-1][idx];
+
+    w->ln[n-1][idx] = NULL;
+
+    while ( t )
+    {
+        SFTW_TIMER * next = t->next;
+        sftw_add(w, t);
+        w->cascaded++;
+        t = next;
+    }
+    return idx;
+}
+
+void sftw_schedule( SFTW * w, SFTW_TIMER * t, uint32_t expires )
+{
+    if ( t->pprev )
+        sftw_unlink(t);
+    else
+        w->count++;
+
+    /* a tick the sweep has already passed would put t straight back
+       on the due list and run it again in the same call */
+    if ( w->started && (int32_t)(expires - w->clk) <= 0 )
+        expires = w->clk + 1;
+
+    t->expires = expires;
+
+    /* hold timers until the clock is set; there is no tick yet to
+       place them against */
+    if ( !w->started )
+        sftw_link(&w->early, t);
+    else
+        sftw_add(w, t);
+}
+
+void sftw_cancel( SFTW * w, SFTW_TIMER * t )
+{
+    if ( !t->pprev )
+        return;
+
+    sftw_unlink(t);
+    w->count--;
+}
+
+unsigned sftw_expire( SFTW * w, uint32_t now, unsigned max )
+{
+    unsigned fired = 0;
+    unsigned ticks = 0;
+
+    if ( !w->started )
+    {
+        SFTW_TIMER * t;
+
+        w->started = 1;
+        w->clk = now;
+
+        while ( (t = w->early) )
+        {
+            sftw_unlink(t);
+            sftw_add(w, t);
+        }
+    }
+    else if ( (int32_t)(now - w->clk) < 0 )
+    {
+        /* time went back (eg out of order pcaps); hold the clock where
+           it is so the timers never see it go backwards */
+        now = w->clk - 1;
+    }
+
+    while ( fired < max )
+    {
+        unsigned idx;
+
+        if ( w->due )
+        {
+            SFTW_TIMER * t = w->due;
+
+            sftw_unlink(t);
+            w->count--;
+            w->fired++;
+            fired++;
+
+            t->fcn(t, now);
+            continue;
+        }
+
+        if ( (int32_t)(now - w->clk) < 0 || ticks >= SFTW_MAX_TICKS )
+            break;
+
+        if ( !w->count )
+        {
+            /* nothing to run between here and now */
+            w->clk = now + 1;
+            break;
+        }
+
+        idx = w->clk & SFTW_L0_MASK;
+
+        if ( !idx && !sftw_cascade(w, 1) && !sftw_cascade(w, 2) )
+            sftw_cascade(w, 3);
+
+        if ( w->l0[idx] )
+        {
+            /* the due list is empty here; take the slot whole */
+            w->due = w->l0[idx];
+            w->due->pprev = &w->due;
+            w->l0[idx] = NULL;
+        }
+        w->clk++;
+        ticks++;
+    }
+    return fired;
+}
+
@@ -0,0 +1,128 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+/*
+*
+*  sftimerwheel.h
+*
+*  hierarchical timing wheel
+*
+*  Timers are embedded in the objects they expire and are kept on
+*  lists hashed by expiry tick: 256 one tick slots, then three levels
+*  of 64 slots each covering 64 times the span of the level below.
+*  Scheduling and cancelling are O(1); a timer is moved down a level
+*  when its slot comes due, so it is touched at most once per level.
+*
+*  The wheel is advanced from the packet path with a budget.  Expired
+*  timers wait on a due list until the budget lets them run, and the
+*  clock does not move on until that list is empty, so the work done
+*  per call is bounded no matter how many timers expire together.
+*
+*  A tick is whatever unit the caller uses for expiry times; snort
+*  uses seconds of packet time.  The clock never goes back: an earlier
+*  now is taken as the last tick processed, and a timer scheduled for
+*  a tick already processed expires on the next one.
+*
+*/
+
+#ifndef _SFTIMERWHEEL_
+#define _SFTIMERWHEEL_
+
+#include "sf_types.h"
+
+#define SFTW_L0_BITS   8
+#define SFTW_LN_BITS   6
+#define SFTW_LEVELS    4
+
+#define SFTW_L0_SIZE   (1 << SFTW_L0_BITS)
+#define SFTW_LN_SIZE   (1 << SFTW_LN_BITS)
+
+/* span of the wheel; timers further out are parked at its end and
+   rehashed when they get there */
+#define SFTW_MAX_DELTA ((1U << (SFTW_L0_BITS + (SFTW_LEVELS-1)*SFTW_LN_BITS)) - 1)
+
+/* clock ticks advanced per sftw_expire() call at most */
+#define SFTW_MAX_TICKS 1024
+
+struct _SFTW_TIMER;
+
+/* called with the timer already off the wheel; it may schedule it again */
+typedef void (*SFTW_EXPIRE)(struct _SFTW_TIMER *, uint32_t now);
+
+typedef struct _SFTW_TIMER
+{
+    struct _SFTW_TIMER  *next;
+    struct _SFTW_TIMER **pprev;    /* NULL if not scheduled */
+    uint32_t             expires;
+    SFTW_EXPIRE          fcn;
+    void               * data;     /* owner's context */
+
+} SFTW_TIMER;
+
+/* a zeroed SFTW is a valid, empty wheel; its clock starts with the
+   first sftw_expire() call */
+typedef struct _SFTW
+{
+    SFTW_TIMER * l0[SFTW_L0_SIZE];
+    SFTW_TIMER * ln[SFTW_LEVELS-1][SFTW_LN_SIZE];
+    SFTW_TIMER * due;             /* expired, not yet run */
+    SFTW_TIMER * early;           /* scheduled before the clock started */
+
+    uint32_t     clk;             /* next tick to process */
+    int          started;
+    unsigned     count;           /* scheduled timers, due ones included */
+
+    uint64_t     fired;
+    uint64_t     cascaded;
+
+} SFTW;
+
+static inline void sftw_init_timer( SFTW_TIMER * t, SFTW_EXPIRE fcn, void * data )
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires = 0;
+    t->fcn = fcn;
+    t->data = data;
+}
+
+static inline int sftw_pending( const SFTW_TIMER * t )
+{
+    return t->pprev != NULL;
+}
+
+/* (re)schedule t to expire at the given tick */
+void     sftw_schedule( SFTW * w, SFTW_TIMER * t, uint32_t expires );
+
+/* take t off the wheel; harmless if it isn't scheduled */
+void     sftw_cancel( SFTW * w, SFTW_TIMER * t );
+
+/* advance the clock to now and run at most max expired timers;
+   returns the number run */
+unsigned sftw_expire( SFTW * w, uint32_t now, unsigned max );
+
+static inline unsigned sftw_count( const SFTW * w )
+{
+    return w->count;
+}
+
+#endif
+
@@ -86,6 +86,11 @@
 
 #include "decode.h"
 #include "encode.h"
+#include "checksum.h"
+#include "bypass.h"
+#ifdef ZLIB
+#include "sf_inflate.h"
+#endif
 #include "sfdaq.h"
 #include "active.h"
 #include "snort.h"
@@ -108,6 +113,7 @@
 #include "preprocessors/spp_perfmonitor.h"
 #include "preprocessors/perf-base.h"
 #include "preprocessors/perf.h"
+#include "preprocessors/perf-export.h"
 #include "mempool.h"
 #include "strlcpyu.h"
 #include "sflsq.h"
@@ -127,6 +133,7 @@
 #include "sfcontrol_funcs.h"
 #include "idle_processing_funcs.h"
 #include "file_service.h"
+#include "workers.h"
 #ifdef SIDE_CHANNEL
 # include "sidechannel.h"
 #endif
@@ -190,6 +197,10 @@
 
 #define DEFAULT_PAF_MAX  16384
 
+/* expired timers run per packet and per idle check */
+#define TIMER_BUDGET_PKT   16
+#define TIMER_BUDGET_IDLE  32768
+
 /* Data types *****************************************************************/
 
 typedef enum _GetOptArgType
@@ -221,6 +232,7 @@ extern ListHead *head_tmp;
 
 /* Globals/Public *************************************************************/
 PacketCount pc;  /* packet count information */
+SFTW snort_timers;  /* session, fragment and tag expiry */
 uint32_t *netmasks = NULL;   /* precalculated netmask array */
 char **protocol_names = NULL;
 char *snort_conf_file = NULL;   /* -c */
@@ -462,6 +474,11 @@ static struct option long_options[] =
    {"ha-out", LONGOPT_ARG_REQUIRED, NULL, ARG_HA_OUT},
    {"ha-in", LONGOPT_ARG_REQUIRED, NULL, ARG_HA_IN},
 
+#ifndef WIN32
+   {"workers", LONGOPT_ARG_REQUIRED, NULL, ARG_WORKERS},
+   {"worker-daq", LONGOPT_ARG_NONE, NULL, ARG_WORKER_DAQ},
+#endif
+
    {0, 0, 0, 0}
 };
 
@@ -523,6 +540,7 @@ static void LoadDynamicPlugins(SnortConfig *);
 static void SnortIdle(void);
 #ifndef WIN32
 static void SnortStartThreads(void);
+static void SnortWorkerInit(void);
 #endif
 
 /* Signal handler declarations ************************************************/
@@ -605,7 +623,12 @@ static int ControlSocketReloadSwap(uint16_t type, void *new_config, void **old_c
 
     *old_config = (void *)snort_conf;
     snort_conf = (SnortConfig *)new_config;
+    fpAdoptPortGroups(snort_conf);
     SwapPreprocConfigurations(snort_conf);
+    FlowBypass_Flush(snort_conf);
+#ifdef ZLIB
+    SFInflate_SetMemcap(snort_conf->decompress_memcap);
+#endif
 
     FreeSwappedPreprocConfigurations(snort_conf);
 
@@ -666,7 +689,12 @@ static inline void CheckForReload(void)
         snort_conf_old = snort_conf;
         snort_conf = snort_conf_new;
         snort_conf_new = NULL;
+        fpAdoptPortGroups(snort_conf);
         SwapPreprocConfigurations(snort_conf);
+        FlowBypass_Flush(snort_conf);
+#ifdef ZLIB
+        SFInflate_SetMemcap(snort_conf->decompress_memcap);
+#endif
 
         /* Need to do this here because there is potentially outstanding
          * state data pointing to the previous configuration.  A race
@@ -829,6 +857,7 @@ int SnortMain(int argc, char *argv[])
     if ( daqInit )
     {
         DAQ_Init(snort_conf);
+        Workers_Init(snort_conf);
         DAQ_New(snort_conf, intf);
     }
     if ( tmp_ptr )
@@ -853,7 +882,9 @@ int SnortMain(int argc, char *argv[])
 #if !defined(HAVE_LINUXTHREADS) && !defined(WIN32)
     // this could be moved to linux threads location
     // and only done there
-    SnortStartThreads();
+    // (threads don't survive fork so workers start their own)
+    if ( !worker_count )
+        SnortStartThreads();
 #endif
 
 #if defined(SNORT_RELOAD) && !defined(WIN32) && defined(CONTROL_SOCKET)
@@ -868,12 +899,46 @@ int SnortMain(int argc, char *argv[])
         LogMessage("Failed to register the is processing control handler.\n");
     }
 
+#ifdef PERF_PROFILING
+    ProfileLiveInit();
+#endif
+
     if ( ScTestMode() )
     {
         if ( daqInit && DAQ_UnprivilegedStart() )
             SetPktProcessor();
         SnortUnprivilegedInit();
     }
+    else if ( worker_count && worker_daq )
+    {
+        // each worker opens and starts its own instance; the
+        // dispatcher has none and just supervises
+#ifndef WIN32
+        if ( Workers_Spawn() >= 0 )
+        {
+            DAQ_New(snort_conf, NULL);
+            DAQ_Start();
+            SetPktProcessor();
+            SnortWorkerInit();
+        }
+#endif
+
+        SnortUnprivilegedInit();
+    }
+    else if ( worker_count )
+    {
+        // the data link type may not be known until the daq is started
+        // and the workers need it so the dispatcher starts it first
+        DAQ_Start();
+        SetPktProcessor();
+
+#ifndef WIN32
+        if ( Workers_Spawn() >= 0 )
+            SnortWorkerInit();
+#endif
+
+        SnortUnprivilegedInit();
+    }
     else if ( DAQ_UnprivilegedStart() )
     {
         SnortUnprivilegedInit();
@@ -923,6 +988,34 @@ static void SnortStartThreads(void)
     SFAT_StartReloadThread();
 # endif
 }
+
+/* Runs in each worker right after the fork.  The worker is now the main
+ * packet processing thread of its own process so it needs its own pid,
+ * threads and log directory (to keep the outputs from colliding). */
+static void SnortWorkerInit(void)
+{
+    char dir[PATH_MAX];
+
+    snort_main_thread_pid = gettid();
+    snort_main_thread_id = pthread_self();
+
+    if ( snort_conf->log_dir )
+    {
+        SnortSnprintf(dir, sizeof(dir), "%s/worker%d",
+            snort_conf->log_dir, worker_id);
+
+        if ( mkdir(dir, 0700) && (errno != EEXIST) )
+            FatalError("Can't create worker log directory %s: %s\n",
+                dir, strerror(errno));
+
+        free(snort_conf->log_dir);
+        snort_conf->log_dir = SnortStrdup(dir);
+    }
+
+#if !defined(HAVE_LINUXTHREADS)
+    SnortStartThreads();
+#endif
+}
 #else   /* WIN32 */
 //------------------------------------------------------------------------------
 // interface stuff
@@ -1307,8 +1400,8 @@ static const char* GetPacketSource (char** sptr)
 
 static void InitPidChrootAndPrivs(pid_t pid)
 {
-    /* create the PID file */
-    if ( !ScReadMode() &&
+    /* create the PID file (the dispatcher has it in worker mode) */
+    if ( !ScReadMode() && !Workers_IsWorker() &&
         (ScDaemonMode() || *snort_conf->pidfile_suffix || ScCreatePidFile()))
     {
         CreatePidFile(DAQ_GetInterfaceSpec(), pid);
@@ -1613,9 +1706,12 @@ static DAQ_Verdict PacketCallback(
 {
     int inject = 0;
     DAQ_Verdict verdict = DAQ_VERDICT_PASS;
+    uint64_t pkt_ticks = 0;
     PROFILE_VARS;
 
+    PROFILE_LIVE_PACKET_START;
     PREPROC_PROFILE_START(totalPerfStats);
+    PerfExport_PacketStart(&pkt_ticks);
 
 #ifdef SIDE_CHANNEL
     if (ScSideChannelEnabled() && !snort_process_lock_held)
@@ -1659,6 +1755,7 @@ static DAQ_Verdict PacketCallback(
     if ( snort_conf->pkt_skip && pc.total_from_daq <= snort_conf->pkt_skip )
     {
         PREPROC_PROFILE_END(totalPerfStats);
+        PROFILE_LIVE_PACKET_END;
         return verdict;
     }
 #endif
@@ -1667,10 +1764,29 @@ static DAQ_Verdict PacketCallback(
     if (ScTerminateService() || ScPauseService())
     {
         PREPROC_PROFILE_END(totalPerfStats);
+        PROFILE_LIVE_PACKET_END;
         return verdict;  // time to go
     }
 #endif
 
+    /* Pass the rest of flows we already whitelisted */
+    if ( FlowBypass_Lookup(pkthdr, pkt) )
+    {
+        verdict = DAQ_VERDICT_WHITELIST;
+
+        UpdateWireStats(&sfBase, pkthdr->caplen, 0, 0);
+        sftw_expire(&snort_timers, pkthdr->ts.tv_sec, TIMER_BUDGET_PKT);
+        ControlSocketDoWork(0);
+#ifdef SIDE_CHANNEL
+        SideChannelDrainRX(0);
+#endif
+
+        PerfExport_PacketEnd(pkt_ticks);
+        PREPROC_PROFILE_END(totalPerfStats);
+        PROFILE_LIVE_PACKET_END;
+        return verdict;
+    }
+
     /* reset the thresholding subsystem checks for this packet */
     sfthreshold_reset();
 
@@ -1701,8 +1817,12 @@ static DAQ_Verdict PacketCallback(
 
         if ( s_packet.packet_flags & PKT_MODIFIED )
         {
-            // this packet was normalized and/or has replacements
-            Encode_Update(&s_packet);
+            // this packet was normalized and/or has replacements;
+            // replacements alone are patched into the checksum as applied
+            if ( s_packet.packet_flags & PKT_CKSUM_UPDATED )
+                s_packet.packet_flags &= ~PKT_LOGGED;
+            else
+                Encode_Update(&s_packet);
             verdict = DAQ_VERDICT_REPLACE;
         }
 #ifdef NORMALIZER
@@ -1752,18 +1872,28 @@ static DAQ_Verdict PacketCallback(
         stream_api->process_ha(s_packet.ssnptr);
 #endif
 
+    /* Tunnels are whitelisted by inner flow so only the plain ones
+     * can be matched on the outer headers */
+    if ( (verdict == DAQ_VERDICT_WHITELIST) &&
+         !s_packet.encapsulated && !s_packet.GTPencapsulated )
+    {
+        FlowBypass_Add();
+    }
+
     /* Collect some "on the wire" stats about packet size, etc */
     UpdateWireStats(&sfBase, pkthdr->caplen, Active_PacketWasDropped(), inject);
     Active_Reset();
     Encode_Reset();
 
-    checkLWSessionTimeout(4, pkthdr->ts.tv_sec);
+    sftw_expire(&snort_timers, pkthdr->ts.tv_sec, TIMER_BUDGET_PKT);
     ControlSocketDoWork(0);
 #ifdef SIDE_CHANNEL
     SideChannelDrainRX(0);
 #endif
 
+    PerfExport_PacketEnd(pkt_ticks);
     PREPROC_PROFILE_END(totalPerfStats);
+    PROFILE_LIVE_PACKET_END;
     return verdict;
 }
 
@@ -2024,6 +2154,8 @@ static int ShowUsage(char *program_name)
     FPUTS_BOTH ("   --ha-peer                       Activate live high-availability state sharing with peer.\n");
     FPUTS_BOTH ("   --ha-out <file>                 Write high-availability events to this file.\n");
     FPUTS_BOTH ("   --ha-in <file>                  Read high-availability events from this file on startup (warm-start).\n");
+    FPUTS_UNIX ("   --workers <count>               Fan packets out by flow to <count> worker processes.\n");
+    FPUTS_UNIX ("   --worker-daq                    Give each worker its own DAQ instance (%d in -i and --daq-var is the worker id).\n");
 #undef FPUTS_WIN32
 #undef FPUTS_UNIX
 #undef FPUTS_BOTH
@@ -2819,6 +2951,25 @@ static void ParseCmdLine(int argc, char **argv)
                 break;
 #endif
 
+            case ARG_WORKERS:
+                {
+                    char* endPtr;
+                    unsigned long n = SnortStrtoul(optarg, &endPtr, 0);
+
+                    if ((errno == ERANGE) || (*endPtr != '\0') ||
+                        (n < 2) || (n > MAX_WORKERS))
+                    {
+                        FatalError("--workers must be between 2 and %d.\n",
+                                   MAX_WORKERS);
+                    }
+                    sc->workers = (uint16_t)n;
+                }
+                break;
+
+            case ARG_WORKER_DAQ:
+                sc->worker_daq = 1;
+                break;
+
             case '?':  /* show help and exit with 1 */
                 PrintVersion();
                 ShowUsage(argv[0]);
@@ -3149,7 +3300,11 @@ static void SnortIdle(void)
         nanosleep(&packet_sleep, NULL);
 #endif
 
-    checkLWSessionTimeout(16384, time(NULL));
+    /* the wheel runs on packet time; here it just works off whatever
+     * the packet budget left due */
+    if ( packet_time() )
+        sftw_expire(&snort_timers, packet_time(), TIMER_BUDGET_IDLE);
+    Workers_Check();
     ControlSocketDoWork(1);
 #ifdef SIDE_CHANNEL
     SideChannelDrainRX(0);
@@ -3161,12 +3316,16 @@ void PacketLoop (void)
 {
     int error;
     int pkts_to_read = (int)snort_conf->pkt_cnt;
+    DAQ_Analysis_Func_t callback = PacketCallback;
+
+    if ( Workers_IsDispatcher() )
+        callback = Workers_Dispatch;
 
     TimeStart();
 
     while ( !exit_logged )
     {
-        error = DAQ_Acquire(pkts_to_read, PacketCallback, NULL);
+        error = DAQ_Acquire(pkts_to_read, callback, NULL);
 
 #ifdef SIDE_CHANNEL
         /* If we didn't manage to lock the process lock in a DAQ acquire callback, lock it now. */
@@ -3179,7 +3338,7 @@ void PacketLoop (void)
 
         if ( error )
         {
-            if ( !ScReadMode() || !PQ_Next() )
+            if ( !ScReadMode() || Workers_IsWorker() || !PQ_Next() )
             {
                 /* If not read-mode or no next pcap, we're done */
                 break;
@@ -3370,15 +3529,25 @@ static void SigExitHandler(int signal)
 static void SigDumpStatsHandler(int signal)
 {
     dump_stats_signal = true;
+    Workers_Signal(signal);
 }
 
 static void SigRotateStatsHandler(int signal)
 {
     rotate_stats_signal = true;
+    Workers_Signal(signal);
 }
 
 static void SigReloadHandler(int signal)
 {
+    // the workers hold the detection configuration; the dispatcher
+    // has no reload thread and only passes the request along
+    if ( Workers_IsDispatcher() )
+    {
+        Workers_Signal(signal);
+        return;
+    }
+
 #if defined(SNORT_RELOAD) && !defined(WIN32)
     reload_signal++;
 #else
@@ -3505,6 +3674,12 @@ static void SnortCleanup(int exit_val)
         DAQ_Stop();
     }
 
+    // let the workers drain what was dispatched before we go
+    Workers_Stop();
+
+#ifdef PERF_PROFILING
+    ProfileLiveTerm();
+#endif
     ControlSocketCleanUp();
 #ifdef SIDE_CHANNEL
     SideChannelStopTXThread();
@@ -3604,6 +3779,10 @@ static void SnortCleanup(int exit_val)
     Active_Term();
     Encode_Term();
 #endif
+    FlowBypass_Term();
+#ifdef ZLIB
+    SFInflate_Term();
+#endif
 
 
     CleanupProtoNames();
@@ -4017,6 +4196,7 @@ SnortConfig * SnortConfNew(void)
 #ifndef REG_TEST
     sc->paf_max = DEFAULT_PAF_MAX;
 #endif
+    sc->flow_bypass_timeout = FLOW_BYPASS_TIMEOUT;
 
     return sc;
 }
@@ -4506,6 +4686,12 @@ static SnortConfig * MergeSnortConfs(SnortConfig *cmd_line, SnortConfig *config_
     if (cmd_line->pkt_cnt != 0)
         config_file->pkt_cnt = cmd_line->pkt_cnt;
 
+    if (cmd_line->workers != 0)
+        config_file->workers = cmd_line->workers;
+
+    if (cmd_line->worker_daq)
+        config_file->worker_daq = cmd_line->worker_daq;
+
 #ifdef REG_TEST
     if (cmd_line->pkt_skip != 0)
         config_file->pkt_skip = cmd_line->pkt_skip;
@@ -4762,6 +4948,7 @@ void FreeVarList(VarNode *head)
 #endif
 
     InitGlobals();
+    ChecksumInit();
 
     /* chew up the command line */
     ParseCmdLine(argc, argv);
@@ -5130,7 +5317,8 @@ static void SnortUnprivilegedInit(void)
 #ifdef ACTIVE_RESPONSE
     // this depends on instantiated daq capabilities
     // so it is done here instead of SnortInit()
-    Active_Init(snort_conf);
+    if ( !Workers_IsSupervisor() )
+        Active_Init(snort_conf);
 #endif
 
     InitPidChrootAndPrivs(snort_main_thread_pid);
@@ -5138,19 +5326,29 @@ static void SnortUnprivilegedInit(void)
 #if defined(HAVE_LINUXTHREADS) && !defined(WIN32)
     // this must be done after dropping privs for linux threads
     // to ensure that child threads can communicate with parent
-    SnortStartThreads();
+    if ( !Workers_IsDispatcher() )
+        SnortStartThreads();
 #endif
 
-    // perfmon, for one, opens a log file for writing here
-    PostConfigPreprocessors(snort_conf);
+    // the dispatcher doesn't analyze packets so it doesn't need
+    // any of the output files opened below
+    if ( !Workers_IsDispatcher() )
+    {
+        // perfmon, for one, opens a log file for writing here
+        PostConfigPreprocessors(snort_conf);
 
-    // log_tcpdump opens a log file for writing here; also ...
-    // note that things like opening log_tcpdump will fail here if the
-    // user specified -u (we dropped privileges) and the log defaults
-    // to /var/log/snort.  in this case they must override log path.
-    PostConfigInitPlugins(snort_conf, snort_conf->plugin_post_config_funcs);
+        // log_tcpdump opens a log file for writing here; also ...
+        // note that things like opening log_tcpdump will fail here if the
+        // user specified -u (we dropped privileges) and the log defaults
+        // to /var/log/snort.  in this case they must override log path.
+        PostConfigInitPlugins(snort_conf, snort_conf->plugin_post_config_funcs);
 
-    FileAPIPostInit();
+        FileAPIPostInit();
+        FlowBypass_Init(snort_conf);
+    }
+#ifdef ZLIB
+    SFInflate_SetMemcap(snort_conf->decompress_memcap);
+#endif
 
 #ifdef SIDE_CHANNEL
     SideChannelPostInit();
@@ -5170,7 +5368,17 @@ static void SnortUnprivilegedInit(void)
         CleanExit(0);
     }
 
-    LogMessage("Commencing packet processing (pid=%u)\n", snort_main_thread_pid);
+    if ( Workers_IsSupervisor() )
+        LogMessage("Commencing worker supervision (pid=%u)\n", snort_main_thread_pid);
+
+    else if ( Workers_IsDispatcher() )
+        LogMessage("Commencing packet dispatch (pid=%u)\n", snort_main_thread_pid);
+
+    else if ( Workers_IsWorker() )
+        LogMessage("Commencing packet processing (worker=%d, pid=%u)\n",
+            worker_id, snort_main_thread_pid);
+    else
+        LogMessage("Commencing packet processing (pid=%u)\n", snort_main_thread_pid);
 
     snort_initializing = false;
 }
@@ -5690,6 +5898,13 @@ static int VerifyReload(SnortConfig *sc)
         return -1;
     }
 
+    if (snort_conf->flow_bypass_entries != sc->flow_bypass_entries)
+    {
+        ErrorMessage("Snort Reload: Changing the flow_bypass entries "
+                     "requires a restart.\n");
+        return -1;
+    }
+
     if (snort_conf->asn1_mem != sc->asn1_mem)
     {
         ErrorMessage("Snort Reload: Changing the asn1 memory configuration "
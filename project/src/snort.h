@@ -55,6 +55,7 @@
 #include "ppm.h"
 #include "sfutil/sfrf.h"
 #include "sfutil/sfPolicy.h"
+#include "sfutil/sftimerwheel.h"
 #include "detection_filter.h"
 #include "generators.h"
 #include <signal.h>
@@ -288,6 +289,9 @@ typedef enum _GetOptLongIds
     ARG_HA_OUT,
     ARG_HA_IN,
 
+    ARG_WORKERS,
+    ARG_WORKER_DAQ,
+
     GET_OPT_LONG_IDS_MAX
 
 } GetOptLongIds;
@@ -661,6 +665,8 @@ typedef struct _SnortConfig
     uint32_t event_log_id;      /* -G */
     int pkt_snaplen;
     uint64_t pkt_cnt;           /* -n */
+    uint16_t workers;           /* --workers */
+    uint8_t worker_daq;         /* --worker-daq */
 #ifdef REG_TEST
     uint64_t pkt_skip;
 #endif
@@ -874,6 +880,7 @@ typedef struct _SnortConfig
 
     SFXHASH *detection_option_hash_table;
     SFXHASH *detection_option_tree_hash_table;
+    struct _PortGroupAdopt *port_group_adopt;  /* shared on reload */
 
     tSfPolicyConfig *policy_config;
     SnortPolicy **targeted_policies;
@@ -891,7 +898,10 @@ typedef struct _SnortConfig
     uint8_t tunnel_mask;
 
     uint32_t so_rule_memcap;
+    uint32_t decompress_memcap;    /* config decompress_memcap */
     uint32_t paf_max;          /* config paf_max */
+    uint32_t flow_bypass_entries;  /* config flow_bypass */
+    uint32_t flow_bypass_timeout;
     char *cs_dir;
     bool ha_peer;
     char *ha_out;
@@ -1077,6 +1087,7 @@ extern SnortConfig *snort_conf;
 extern Packet *BsdPseudoPacket;
 
 extern PacketCount pc;        /* packet count information */
+extern SFTW snort_timers;     /* shared expiry wheel, ticks are seconds */
 extern char **protocol_names;
 extern grinder_t grinder;
 
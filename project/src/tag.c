@@ -105,6 +105,9 @@ typedef struct _TagNode
     /** for later expansion... */
     OptTreeNode *otn;
 
+    /** removes the node TAG_PRUNE_QUANTUM after its last match */
+    SFTW_TIMER timer;
+
 } TagNode;
 
 /*  G L O B A L S  **************************************************/
@@ -114,7 +117,6 @@ static SFXHASH *host_tag_cache_ptr;
 /**session tag cache */
 static SFXHASH *ssn_tag_cache_ptr;
 
-static uint32_t last_prune_time;
 static uint32_t tag_alloc_faults;
 static uint32_t tag_memory_usage;
 
@@ -127,6 +129,7 @@ static int TagFreeSessionNodeFunc(void *key, void *data);
 static int TagFreeHostNodeFunc(void *key, void *data);
 static int PruneTagCache(uint32_t, int);
 static int PruneTime(SFXHASH* tree, uint32_t thetime);
+static void TagExpire(SFTW_TIMER *, uint32_t);
 static void TagSession(Packet *, TagData *, uint32_t, uint16_t);
 static void TagHost(Packet *, TagData *, uint32_t, uint16_t);
 static void AddTagNode(Packet *, TagData *, int, uint32_t, uint16_t);
@@ -220,6 +223,7 @@ static void TagFree(
     if (node == NULL)
         return;
 
+    sftw_cancel(&snort_timers, &node->timer);
     free((void *)node);
     tag_memory_usage -= memory_per_node(hash);
 }
@@ -480,6 +484,10 @@ static void AddTagNode(Packet *p, TagData *tag, int mode, uint32_t now,
             return;
         }
 
+        sftw_init_timer(&idx->timer, TagExpire, idx);
+        sftw_schedule(&snort_timers, &idx->timer,
+            now + TAG_PRUNE_QUANTUM + 1);
+
         DEBUG_WRAP(PrintTagNode(idx););
     }
     else
@@ -653,14 +661,6 @@ int CheckTagList(Packet *p, Event *event)
         }
     }
 
-    if( (u_int)(p->pkth->ts.tv_sec) > last_prune_time + TAG_PRUNE_QUANTUM)
-    {
-        DEBUG_WRAP(DebugMessage(DEBUG_FLOW,
-                                "Exceeded Prune Quantum, pruning tag trees\n"););
-        PruneTagCache(p->pkth->ts.tv_sec, 0);
-        last_prune_time = p->pkth->ts.tv_sec;
-    }
-
     if((returned != NULL) && (create_event))
     {
         return 1;
@@ -739,6 +739,33 @@ static int PruneTime(SFXHASH* tree, uint32_t thetime)
     return pruned;
 }
 
+/**Timer wheel callback for a TagNode.  The node is removed once it has
+ * gone TAG_PRUNE_QUANTUM seconds without a match; the timer is pushed
+ * out here if it matched since it was armed.
+ * @param t - the node's timer
+ * @param now - current time in seconds
+ */
+static void TagExpire(SFTW_TIMER *t, uint32_t now)
+{
+    TagNode *node = (TagNode *)t->data;
+    SFXHASH *tree = (node->mode == TAG_SESSION) ?
+        ssn_tag_cache_ptr : host_tag_cache_ptr;
+    uint32_t expires = node->last_access + TAG_PRUNE_QUANTUM + 1;
+
+    if ((int32_t)(expires - now) > 0)
+    {
+        sftw_schedule(&snort_timers, t, expires);
+        return;
+    }
+
+    DEBUG_WRAP(DebugMessage(DEBUG_FLOW, "Tag node idle, removing\n"););
+
+    if (sfxhash_remove(tree, node) != SFXHASH_OK)
+    {
+        LogMessage("WARNING: failed to remove tagNode from hash.\n");
+    }
+}
+
 void SetTags(Packet *p, OptTreeNode *otn, uint16_t event_id)
 {
    DEBUG_WRAP(DebugMessage(DEBUG_FLOW, "Setting tags\n"););
@@ -57,6 +57,8 @@
 
 #include "snort_debug.h"
 #include "sfPolicy.h"
+#include "packet_time.h"
+#include "idle_processing_funcs.h"
 
 typedef struct
 {
@@ -86,6 +88,10 @@ static tTargetBasedPolicyConfig targetBasedPolicyConfig;
 static HostAttributeEntry *current_host = NULL;
 static ApplicationEntry *current_app = NULL;
 
+/* Set when a host learned at runtime drops the compiled lookup table */
+static int sfat_recompile = 0;
+static time_t sfat_last_compile = 0;
+
 //static MapData *current_map_entry = NULL;
 ServiceClient sfat_client_or_service;
 
@@ -815,7 +821,7 @@ void *SFAT_ReloadAttributeTableThread(void *arg)
                     /* Add 1 to max for table purposes
                      * We use max_hosts to limit memcap, assume 16k per entry costs*/
                     pConfig->next.lookupTable =
-                        sfrt_new(DIR_8x16, IPv6, ScMaxAttrHosts() + 1,
+                        sfrt_new(POPTRIE, IPv6, ScMaxAttrHosts() + 1,
                                 ((ScMaxAttrHosts())>>6) + 1);
                     if (!pConfig->next.lookupTable)
                     {
@@ -850,6 +856,10 @@ void *SFAT_ReloadAttributeTableThread(void *arg)
                         list_entry = list_entry->next;
                     }
 
+                    /* Compile here so the swap doesn't do it in the
+                     * packet thread */
+                    sfrt_compile(pConfig->next.lookupTable);
+
                     set_attribute_table_flag(ATTRIBUTE_TABLE_AVAILABLE_FLAG);
                 }
                 else
@@ -890,6 +900,23 @@ void *SFAT_ReloadAttributeTableThread(void *arg)
     return NULL;
 }
 
+/* Rebuild the compiled lookup table after runtime inserts while there are
+ * no packets to process; at most once a second so a burst of new hosts
+ * doesn't keep recompiling it.  Until then lookups use the DIR-n-m table,
+ * which has the DIR_8x16 strides the attribute table always had. */
+static void SFAT_IdleCompile(void)
+{
+    tTargetBasedPolicyConfig *pConfig = &targetBasedPolicyConfig;
+    time_t now = packet_time();
+
+    if (!sfat_recompile || (now == sfat_last_compile))
+        return;
+
+    sfat_recompile = 0;
+    sfat_last_compile = now;
+    sfrt_compile(pConfig->curr.lookupTable);
+}
+
 void AttributeTableReloadCheck(void)
 {
     tTargetBasedPolicyConfig *pConfig = NULL;
@@ -948,7 +975,7 @@ int SFAT_ParseAttributeTable(char *args)
         /* Add 1 to max for table purposes
          * We use max_hosts to limit memcap, assume 16k per entry costs*/
         pConfig->next.lookupTable =
-            sfrt_new(DIR_8x16, IPv6, ScMaxAttrHosts() + 1,
+            sfrt_new(POPTRIE, IPv6, ScMaxAttrHosts() + 1,
                     ((ScMaxAttrHosts())>>6)+ 1);
         if (!pConfig->next.lookupTable)
         {
@@ -981,6 +1008,7 @@ int SFAT_ParseAttributeTable(char *args)
 
     if (ret == SFAT_OK)
     {
+        sfrt_compile(pConfig->next.lookupTable);
         pConfig->curr.lookupTable = pConfig->next.lookupTable;
         pConfig->next.lookupTable = NULL;
         pConfig->curr.mapTable = pConfig->next.mapTable;
@@ -1013,6 +1041,7 @@ int SFAT_ParseAttributeTable(char *args)
             errno = 0;
     }
 #endif
+    IdleProcessingRegisterHandler(SFAT_IdleCompile);
 
     return SFAT_OK;
 }
@@ -1115,6 +1144,8 @@ void SFAT_UpdateApplicationProtocol(sfip_t *ipAddr, uint16_t port, uint16_t prot
             FreeHostEntry(host_entry);
             return;
         }
+        sfat_recompile = 1;
+
         for (list_entry = updatePolicyCallbackList; list_entry; list_entry = list_entry->next)
         {
             if (list_entry->policyCallback)
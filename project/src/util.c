@@ -79,6 +79,11 @@
 #include "ppm.h"
 #include "active.h"
 #include "packet_time.h"
+#include "workers.h"
+#include "bypass.h"
+#ifdef ZLIB
+#include "sf_inflate.h"
+#endif
 
 #ifdef TARGET_BASED
 #include "sftarget_reader.h"
@@ -1084,6 +1089,12 @@ void DropStats(int exiting)
     PPM_PRINT_SUMMARY(&snort_conf->ppm_cfg);
 #endif
 
+    if ( Workers_IsWorker() )
+    {
+        LogMessage("%s\n", STATS_SEPARATOR);
+        Workers_PrintStats();
+    }
+
     {
         uint64_t pkts_drop, pkts_out, pkts_inj;
 
@@ -1118,6 +1129,12 @@ void DropStats(int exiting)
 #endif
     }
 
+    if ( Workers_IsDispatcher() )
+    {
+        LogMessage("%s\n", STATS_SEPARATOR);
+        Workers_PrintStats();
+    }
+
     LogMessage("%s\n", STATS_SEPARATOR);
     LogMessage("Breakdown by protocol (includes rebuilt packets):\n");
 
@@ -1257,6 +1274,26 @@ void DropStats(int exiting)
         idx->func(exiting ? 1 : 0);
     }
 
+    FlowBypass_PrintStats(STATS_SEPARATOR);
+
+#ifdef ZLIB
+    {
+        const SFInflateStats *is = SFInflate_GetStats();
+
+        if (is->streams)
+        {
+            LogMessage("%s\n", STATS_SEPARATOR);
+            LogMessage("Decompression:\n");
+            LogMessage("%11s: " FMTu64("12") "\n", "Streams", is->streams);
+            LogMessage("%11s: " FMTu64("12") "\n", "Bad Data", is->errors);
+            LogMessage("%11s: " FMTu64("12") "\n", "Allocs", is->allocs);
+            LogMessage("%11s: " FMTu64("12") "\n", "Reuses", is->reuses);
+            LogMessage("%11s: " FMTu64("12") "\n", "Over Memcap", is->failures);
+            LogMessage("%11s: " FMTu64("12") "\n", "Peak Bytes", is->peak);
+        }
+    }
+#endif
+
 #ifdef SIDE_CHANNEL
     SideChannelStats(exiting, STATS_SEPARATOR);
 #endif /* SIDE_CHANNEL */
@@ -648,6 +648,10 @@ SOURCE=..\..\preprocessors\HttpInspect\include\hi_util_kmap.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\preprocessors\HttpInspect\include\hi_util_scan.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\preprocessors\HttpInspect\include\hi_util_xmalloc.h
 # End Source File
 # End Group
@@ -724,6 +728,10 @@ SOURCE=..\..\preprocessors\HttpInspect\utils\hi_util_kmap.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\preprocessors\HttpInspect\utils\hi_util_scan.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\preprocessors\HttpInspect\utils\hi_util_xmalloc.c
 # End Source File
 # End Group
@@ -787,6 +795,14 @@ SOURCE=..\..\preprocessors\Stream5\stream5_paf.c
 
 SOURCE=..\..\preprocessors\Stream5\stream5_paf.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\..\preprocessors\Stream5\stream5_segpool.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\preprocessors\Stream5\stream5_segpool.h
+# End Source File
 # End Group
 # Begin Source File
 
@@ -814,6 +830,14 @@ SOURCE="..\..\preprocessors\perf-event.h"
 # End Source File
 # Begin Source File
 
+SOURCE="..\..\preprocessors\perf-export.c"
+# End Source File
+# Begin Source File
+
+SOURCE="..\..\preprocessors\perf-export.h"
+# End Source File
+# Begin Source File
+
 SOURCE="..\..\preprocessors\perf-flow.c"
 # End Source File
 # Begin Source File
@@ -1046,6 +1070,14 @@ SOURCE=..\..\sfutil\sf_email_attach_decode.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\sfutil\sf_inflate.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\sfutil\sf_inflate.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\sfutil\sf_ip.c
 # End Source File
 # Begin Source File
@@ -1210,6 +1242,14 @@ SOURCE=..\..\sfutil\sfrt_dir.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\sfutil\sfrt_poptrie.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\sfutil\sfrt_poptrie.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\sfutil\sfrt_trie.h
 # End Source File
 # Begin Source File
@@ -1238,6 +1278,22 @@ SOURCE=..\..\sfutil\sfxhash.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\sfutil\sfohash.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\sfutil\sfohash.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\sfutil\sftimerwheel.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\sfutil\sftimerwheel.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\sfutil\strvec.c
 # End Source File
 # Begin Source File
@@ -1605,6 +1661,14 @@ SOURCE=..\..\bounds.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\bypass.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\bypass.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\byte_extract.c
 # End Source File
 # Begin Source File
@@ -1617,6 +1681,10 @@ SOURCE=..\..\cdefs.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\checksum.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\checksum.h
 # End Source File
 # Begin Source File
@@ -0,0 +1,675 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    workers.c
+//
+// Each worker has a single producer / single consumer ring in anonymous
+// shared memory.  The dispatcher is the only writer of head and the worker
+// is the only writer of tail so no locks are needed, just a full barrier
+// between filling (or draining) a slot and publishing the new index.
+//
+// Flows are assigned by a symmetric hash of the IP address pair only.
+// Ports are deliberately left out so that all fragments of a datagram and
+// the packets of the flow they belong to land on the same worker.
+//
+// With --worker-daq the rings have no slots.  Flows are assigned by
+// whatever feeds the DAQ instances (eg the RSS hash through an AF_PACKET
+// fanout group) and the ring header is only used to hand each worker's
+// DAQ stats to the supervisor.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "workers.h"
+#include "sfdaq.h"
+#include "snort.h"
+#include "util.h"
+
+#ifndef WIN32
+
+#define RING_MAX_SLOTS  4096
+#define RING_MIN_SLOTS    64
+#define RING_MEMCAP     (64 * 1024 * 1024)
+
+#define SLOT_ALIGN 64
+
+// polls before the worker starts sleeping on an empty ring
+#define SPIN_POLLS 1024
+
+int worker_id = -1;
+int worker_count = 0;
+int worker_daq = 0;
+
+typedef struct _WorkerRing
+{
+    volatile uint32_t head;         // dispatcher
+    uint8_t pad0[SLOT_ALIGN - sizeof(uint32_t)];
+
+    volatile uint32_t tail;         // worker
+    uint8_t pad1[SLOT_ALIGN - sizeof(uint32_t)];
+
+    volatile uint32_t eof;
+    volatile uint32_t alive;
+    pid_t pid;
+
+    // dispatcher counts
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t waits;
+
+    // worker counts
+    uint64_t analyzed;
+    uint64_t verdicts[MAX_DAQ_VERDICT];
+
+    // --worker-daq only
+    DAQ_Stats_t daq;
+} WorkerRing;
+
+typedef struct _WorkerSlot
+{
+    DAQ_PktHdr_t hdr;
+    // followed by hdr.caplen bytes of packet data
+} WorkerSlot;
+
+static uint8_t* shm_base = NULL;
+static size_t shm_size = 0;
+
+static uint32_t ring_slots = 0;     // power of 2
+static uint32_t slot_size = 0;      // multiple of SLOT_ALIGN
+static uint32_t slot_data = 0;      // max caplen per slot
+static size_t ring_size = 0;
+
+static int base_dlt = -1;
+static volatile int break_loop = 0;
+
+static DAQ_Stats_t worker_stats;
+
+//--------------------------------------------------------------------
+
+static inline WorkerRing* GetRing (int id)
+{
+    return (WorkerRing*)(shm_base + (size_t)id * ring_size);
+}
+
+static inline WorkerSlot* GetSlot (WorkerRing* r, uint32_t idx)
+{
+    uint8_t* slots = (uint8_t*)r + ((sizeof(*r) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1));
+    return (WorkerSlot*)(slots + (size_t)(idx & (ring_slots - 1)) * slot_size);
+}
+
+void Workers_Init (const SnortConfig* sc)
+{
+    uint32_t n;
+
+    if ( sc->workers < 2 )
+    {
+        if ( sc->worker_daq )
+            FatalError("--worker-daq requires --workers.\n");
+        return;
+    }
+
+    if ( sc->workers > MAX_WORKERS )
+        FatalError("--workers must be between 2 and %d.\n", MAX_WORKERS);
+
+    if ( sc->worker_daq )
+    {
+        // every worker would read the whole file
+        if ( ScReadMode() )
+            FatalError("--worker-daq is not supported when reading files.\n");
+    }
+    else if ( ScAdapterInlineMode() )
+        FatalError("Worker mode can't return verdicts to the DAQ and "
+            "is not supported inline.\n");
+
+#ifdef SIDE_CHANNEL
+    if ( ScSideChannelEnabled() )
+        FatalError("Worker mode is not supported with the side channel.\n");
+#endif
+
+    if ( sc->worker_daq )
+        n = 0;
+    else
+    {
+        slot_data = DAQ_GetSnapLen();
+        slot_size = (sizeof(WorkerSlot) + slot_data + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1);
+
+        for ( n = RING_MAX_SLOTS; n > RING_MIN_SLOTS; n >>= 1 )
+        {
+            if ( (size_t)n * slot_size <= RING_MEMCAP )
+                break;
+        }
+    }
+    ring_slots = n;
+
+    ring_size = ((sizeof(WorkerRing) + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1))
+        + (size_t)ring_slots * slot_size;
+
+    shm_size = ring_size * sc->workers;
+
+    shm_base = mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if ( shm_base == MAP_FAILED )
+    {
+        shm_base = NULL;
+        FatalError("Can't allocate %lu bytes for %u worker rings: %s\n",
+            (unsigned long)shm_size, sc->workers, strerror(errno));
+    }
+    worker_count = sc->workers;
+    worker_daq = sc->worker_daq;
+
+    if ( worker_daq )
+        LogMessage("Worker mode: %d workers, each with its own DAQ instance.\n",
+            worker_count);
+    else
+        LogMessage("Worker mode: %d workers, %u slots of %u bytes per ring.\n",
+            worker_count, ring_slots, slot_size);
+}
+
+int Workers_Spawn (void)
+{
+    int i;
+
+    if ( !worker_count )
+        return -1;
+
+    for ( i = 0; i < worker_count; i++ )
+    {
+        WorkerRing* r = GetRing(i);
+        pid_t pid = fork();
+
+        if ( pid < 0 )
+            FatalError("Can't fork worker %d: %s\n", i, strerror(errno));
+
+        if ( pid == 0 )
+        {
+            worker_id = i;
+            r->pid = getpid();
+            r->alive = 1;
+            return worker_id;
+        }
+        r->pid = pid;
+        r->alive = 1;
+    }
+    return -1;
+}
+
+//--------------------------------------------------------------------
+// dispatcher
+//--------------------------------------------------------------------
+
+static inline uint32_t HashWords (const uint32_t* a, int n)
+{
+    uint32_t h = 0;
+
+    while ( n-- > 0 )
+        h += a[n];
+
+    return h;
+}
+
+// returns a symmetric hash of the ip address pair or 0 if the
+// packet isn't ip (so all non-ip traffic goes to one worker)
+static uint32_t FlowHash (const uint8_t* pkt, uint32_t len)
+{
+    uint32_t off = 0, h;
+    uint16_t type;
+    uint32_t addr[8];
+
+    switch ( base_dlt )
+    {
+    case DLT_EN10MB:
+        if ( len < 14 )
+            return 0;
+
+        type = (pkt[12] << 8) | pkt[13];
+        off = 14;
+
+        while ( (type == 0x8100 || type == 0x88a8 || type == 0x9100)
+            && (off + 4 <= len) )
+        {
+            type = (pkt[off+2] << 8) | pkt[off+3];
+            off += 4;
+        }
+        break;
+
+#ifdef DLT_LINUX_SLL
+    case DLT_LINUX_SLL:
+        if ( len < 16 )
+            return 0;
+
+        type = (pkt[14] << 8) | pkt[15];
+        off = 16;
+        break;
+#endif
+
+    case DLT_RAW:
+#ifdef DLT_IPV4
+    case DLT_IPV4:
+#endif
+#ifdef DLT_IPV6
+    case DLT_IPV6:
+#endif
+        if ( len < 1 )
+            return 0;
+
+        type = ((pkt[0] >> 4) == 6) ? 0x86dd : 0x0800;
+        break;
+
+    default:
+        return 0;
+    }
+
+    if ( type == 0x0800 )
+    {
+        if ( off + 20 > len )
+            return 0;
+
+        memcpy(addr, pkt + off + 12, 8);
+        h = HashWords(addr, 2);
+    }
+    else if ( type == 0x86dd )
+    {
+        if ( off + 40 > len )
+            return 0;
+
+        memcpy(addr, pkt + off + 8, 32);
+        h = HashWords(addr, 8);
+    }
+    else
+        return 0;
+
+    // addition is commutative so src/dst order doesn't matter;
+    // mix so that the low bits used for the modulus are good
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+DAQ_Verdict Workers_Dispatch (
+    void* user, const DAQ_PktHdr_t* pkthdr, const uint8_t* pkt)
+{
+    WorkerRing* r;
+    WorkerSlot* s;
+    uint32_t len = pkthdr->caplen;
+
+    pc.total_from_daq++;
+
+    if ( base_dlt < 0 )
+        base_dlt = DAQ_GetBaseProtocol();
+
+    r = GetRing(FlowHash(pkt, len) % worker_count);
+
+    if ( !r->alive )
+    {
+        r->dropped++;
+        return DAQ_VERDICT_PASS;
+    }
+
+    while ( r->head - r->tail >= ring_slots )
+    {
+        // when reading files, wait for the worker instead of dropping
+        if ( !ScReadMode() || !r->alive )
+        {
+            r->dropped++;
+            return DAQ_VERDICT_PASS;
+        }
+        r->waits++;
+        sched_yield();
+
+        // the worker may have died with its ring full
+        Workers_Check();
+    }
+
+    if ( len > slot_data )
+        len = slot_data;
+
+    s = GetSlot(r, r->head);
+    s->hdr = *pkthdr;
+    s->hdr.caplen = len;
+    memcpy(s + 1, pkt, len);
+
+    __sync_synchronize();
+    r->head++;
+    r->queued++;
+
+    return DAQ_VERDICT_PASS;
+}
+
+static void Reap (pid_t pid, int status)
+{
+    int i;
+
+    for ( i = 0; i < worker_count; i++ )
+    {
+        WorkerRing* r = GetRing(i);
+
+        if ( r->pid != pid )
+            continue;
+
+        r->alive = 0;
+
+        if ( WIFSIGNALED(status) )
+            ErrorMessage("Worker %d (pid=%u) killed by signal %d.\n",
+                i, (unsigned)pid, WTERMSIG(status));
+
+        else if ( WIFEXITED(status) && WEXITSTATUS(status) )
+            ErrorMessage("Worker %d (pid=%u) exited with status %d.\n",
+                i, (unsigned)pid, WEXITSTATUS(status));
+    }
+}
+
+void Workers_Check (void)
+{
+    pid_t pid;
+    int status;
+
+    if ( !Workers_IsDispatcher() )
+        return;
+
+    while ( (pid = waitpid(-1, &status, WNOHANG)) > 0 )
+        Reap(pid, status);
+}
+
+void Workers_Stop (void)
+{
+    int i, live = 0;
+
+    if ( !Workers_IsDispatcher() )
+        return;
+
+    for ( i = 0; i < worker_count; i++ )
+    {
+        WorkerRing* r = GetRing(i);
+        r->eof = 1;
+
+        if ( r->alive )
+            live++;
+    }
+
+    // workers drain their rings and exit on eof; those with
+    // their own instance must be told
+    if ( worker_daq )
+        Workers_Signal(SIGTERM);
+
+    while ( live > 0 )
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if ( pid < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            break;
+        }
+        Reap(pid, status);
+        live--;
+    }
+}
+
+void Workers_Signal (int sig)
+{
+    int i;
+
+    if ( !Workers_IsDispatcher() )
+        return;
+
+    for ( i = 0; i < worker_count; i++ )
+    {
+        WorkerRing* r = GetRing(i);
+
+        if ( r->alive && r->pid > 0 )
+            kill(r->pid, sig);
+    }
+}
+
+int Workers_Supervise (void)
+{
+    struct timespec nap = { 0, 10000000 };
+    unsigned slept = 0;
+
+    while ( !break_loop && (slept * (nap.tv_nsec / 1000000) < PKT_TIMEOUT) )
+    {
+        int i, live = 0;
+
+        Workers_Check();
+
+        for ( i = 0; i < worker_count; i++ )
+        {
+            if ( GetRing(i)->alive )
+                live++;
+        }
+        if ( !live )
+            return DAQ_READFILE_EOF;
+
+        // a signal cuts this short; the caller checks for it
+        if ( nanosleep(&nap, NULL) )
+            break;
+
+        slept++;
+    }
+    break_loop = 0;
+    return 0;
+}
+
+//--------------------------------------------------------------------
+// worker
+//--------------------------------------------------------------------
+
+int Workers_Acquire (int max, DAQ_Analysis_Func_t callback, uint8_t* user)
+{
+    WorkerRing* r = GetRing(worker_id);
+    struct timespec nap = { 0, 100000 };
+    unsigned idle = 0, slept = 0;
+    int n = 0;
+
+    while ( !break_loop && ((max <= 0) || (n < max)) )
+    {
+        WorkerSlot* s;
+        DAQ_PktHdr_t hdr;
+        DAQ_Verdict v;
+
+        if ( r->tail == r->head )
+        {
+            if ( r->eof )
+                return DAQ_READFILE_EOF;
+
+            if ( ++idle < SPIN_POLLS )
+            {
+                sched_yield();
+                continue;
+            }
+            // return periodically like a daq read timeout
+            // so the caller can do its idle processing
+            if ( ++slept * (nap.tv_nsec / 1000) >= PKT_TIMEOUT * 1000 )
+                break;
+
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        idle = slept = 0;
+
+        __sync_synchronize();
+        s = GetSlot(r, r->tail);
+
+        hdr = s->hdr;
+        hdr.priv_ptr = NULL;
+
+        v = callback(user, &hdr, (const uint8_t*)(s + 1));
+
+        if ( v >= MAX_DAQ_VERDICT )
+            v = DAQ_VERDICT_PASS;
+
+        r->verdicts[v]++;
+        r->analyzed++;
+
+        __sync_synchronize();
+        r->tail++;
+        n++;
+    }
+    break_loop = 0;
+    return 0;
+}
+
+void Workers_BreakLoop (void)
+{
+    break_loop = 1;
+}
+
+void Workers_SetStats (const DAQ_Stats_t* ps)
+{
+    if ( Workers_IsWorker() )
+        GetRing(worker_id)->daq = *ps;
+}
+
+// the sum of the workers' instances in the supervisor
+static const DAQ_Stats_t* GetTotalStats (void)
+{
+    int i, j;
+
+    memset(&worker_stats, 0, sizeof(worker_stats));
+
+    for ( i = 0; i < worker_count; i++ )
+    {
+        const DAQ_Stats_t* ps = &GetRing(i)->daq;
+
+        worker_stats.hw_packets_received += ps->hw_packets_received;
+        worker_stats.hw_packets_dropped += ps->hw_packets_dropped;
+        worker_stats.packets_received += ps->packets_received;
+        worker_stats.packets_filtered += ps->packets_filtered;
+        worker_stats.packets_injected += ps->packets_injected;
+
+        for ( j = 0; j < MAX_DAQ_VERDICT; j++ )
+            worker_stats.verdicts[j] += ps->verdicts[j];
+    }
+    return &worker_stats;
+}
+
+const DAQ_Stats_t* Workers_GetStats (void)
+{
+    WorkerRing* r;
+    int i;
+
+    if ( Workers_IsSupervisor() )
+        return GetTotalStats();
+
+    r = GetRing(worker_id);
+    memset(&worker_stats, 0, sizeof(worker_stats));
+
+    worker_stats.hw_packets_received = r->queued;
+    worker_stats.packets_received = r->analyzed;
+
+    for ( i = 0; i < MAX_DAQ_VERDICT; i++ )
+        worker_stats.verdicts[i] = r->verdicts[i];
+
+    return &worker_stats;
+}
+
+void Workers_PrintStats (void)
+{
+    int i;
+
+    if ( Workers_IsWorker() )
+    {
+        LogMessage("Statistics for worker %d (pid=%u):\n",
+            worker_id, (unsigned)getpid());
+        return;
+    }
+    if ( !worker_count )
+        return;
+
+    if ( worker_daq )
+    {
+        LogMessage("Worker DAQ Instances:\n");
+
+        for ( i = 0; i < worker_count; i++ )
+        {
+            WorkerRing* r = GetRing(i);
+
+            LogMessage("%9s %2d: " FMTu64("12") " received, " FMTu64("12")
+                " analyzed, " FMTu64("12") " dropped\n", "Worker", i,
+                r->daq.hw_packets_received, r->daq.packets_received,
+                r->daq.hw_packets_dropped);
+        }
+        return;
+    }
+    LogMessage("Worker Dispatch:\n");
+
+    for ( i = 0; i < worker_count; i++ )
+    {
+        WorkerRing* r = GetRing(i);
+
+        LogMessage("%9s %2d: " FMTu64("12") " queued, " FMTu64("12")
+            " dropped, " FMTu64("12") " waits\n",
+            "Worker", i, r->queued, r->dropped, r->waits);
+    }
+}
+
+#else   // WIN32
+
+int worker_id = -1;
+int worker_count = 0;
+int worker_daq = 0;
+
+void Workers_Init (const SnortConfig* sc)
+{
+    if ( sc->workers > 1 || sc->worker_daq )
+        FatalError("Worker mode is not supported on this platform.\n");
+}
+
+int Workers_Spawn (void) { return -1; }
+
+DAQ_Verdict Workers_Dispatch (
+    void* user, const DAQ_PktHdr_t* pkthdr, const uint8_t* pkt)
+{ return DAQ_VERDICT_PASS; }
+
+int Workers_Acquire (int max, DAQ_Analysis_Func_t callback, uint8_t* user)
+{ return DAQ_READFILE_EOF; }
+
+void Workers_BreakLoop (void) { }
+int Workers_Supervise (void) { return DAQ_READFILE_EOF; }
+void Workers_SetStats (const DAQ_Stats_t* ps) { }
+void Workers_Check (void) { }
+void Workers_Stop (void) { }
+void Workers_Signal (int sig) { }
+void Workers_PrintStats (void) { }
+const DAQ_Stats_t* Workers_GetStats (void) { return NULL; }
+
+#endif  // WIN32
@@ -0,0 +1,105 @@
+/****************************************************************************
+ *
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ ****************************************************************************/
+
+// @file    workers.h
+//
+// Packet worker mode.  A single dispatcher owns the DAQ instance and fans
+// packets out by flow hash to N worker processes over shared memory rings.
+// Workers are forked after the configuration and the detection structures
+// are built so those pages are shared copy-on-write and paid for once.
+// Everything per packet (Packet, event queue, stream5 sessions, frag3
+// trackers, outputs) is private to each worker by construction.
+//
+// With --worker-daq there is no dispatching.  Each worker opens its own
+// DAQ instance after the fork (one per RX queue, fanout group member or
+// interface) so the NIC or kernel does the flow hashing and the parent
+// only supervises.  The rings then just carry each worker's DAQ stats.
+
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#include <stdint.h>
+#include <daq.h>
+
+#define MAX_WORKERS 64
+
+struct _SnortConfig;
+
+// allocates the rings; must be called after DAQ_Init(), before DAQ_New()
+// and before any threads are started.  fatal if worker mode can't be
+// supported.
+void Workers_Init(const struct _SnortConfig*);
+
+// forks the workers.  returns the worker id (0 .. N-1) in a worker
+// and -1 in the dispatcher (or if worker mode is not configured).
+int Workers_Spawn(void);
+
+// the dispatcher's DAQ callback
+DAQ_Verdict Workers_Dispatch(void*, const DAQ_PktHdr_t*, const uint8_t*);
+
+// the workers' replacement for daq_acquire(); same return conventions
+int Workers_Acquire(int max, DAQ_Analysis_Func_t, uint8_t* user);
+void Workers_BreakLoop(void);
+
+// the supervisor's replacement for daq_acquire(); waits up to the
+// daq timeout and returns DAQ_READFILE_EOF once all workers are gone
+int Workers_Supervise(void);
+
+// called by the dispatcher on idle and on exit
+void Workers_Check(void);
+void Workers_Stop(void);
+
+// forwards a signal to all live workers (async signal safe)
+void Workers_Signal(int sig);
+
+void Workers_PrintStats(void);
+const DAQ_Stats_t* Workers_GetStats(void);
+
+// a worker with its own instance publishes its stats for the supervisor
+void Workers_SetStats(const DAQ_Stats_t*);
+
+extern int worker_id;       // -1 if not a worker
+extern int worker_count;    // 0 if worker mode is off
+extern int worker_daq;      // 1 if each worker has its own DAQ instance
+
+static inline int Workers_IsDispatcher(void)
+{
+    return worker_count && (worker_id < 0);
+}
+
+static inline int Workers_IsWorker(void)
+{
+    return worker_id >= 0;
+}
+
+// a worker fed by the dispatcher
+static inline int Workers_IsRingWorker(void)
+{
+    return Workers_IsWorker() && !worker_daq;
+}
+
+// the dispatcher when the workers have their own DAQ instances
+static inline int Workers_IsSupervisor(void)
+{
+    return Workers_IsDispatcher() && worker_daq;
+}
+
+#endif // __WORKERS_H__
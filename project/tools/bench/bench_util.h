@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * bench_util.h
+ *
+ * timing and test data helpers shared by the benchmarks
+ */
+
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sf_types.h"
+
+/* wall clock seconds */
+static inline double BenchNow (void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* xorshift32; fixed seeds keep runs comparable */
+static inline uint32_t BenchRand (uint32_t* seed)
+{
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+static inline void BenchFill (uint8_t* buf, size_t len, uint32_t* seed)
+{
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        buf[i] = (uint8_t)BenchRand(seed);
+}
+
+/* MB per measurement from the command line, default 1024 */
+static inline unsigned BenchMegs (int argc, char* argv[])
+{
+    int mb = (argc > 1) ? atoi(argv[1]) : 1024;
+    return (mb > 0) ? (unsigned)mb : 1024;
+}
+
+#endif
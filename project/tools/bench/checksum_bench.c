@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * checksum_bench.c
+ *
+ * Compares the tcp checksum from checksum.c, with each implementation
+ * this cpu supports, against the 16 bit loop snort used before.  Every
+ * result is checked against the old loop before it is timed.  The last
+ * table times a replace rule's checksum fix up: a full recompute versus
+ * the incremental update sp_replace uses.
+ *
+ * usage: checksum_bench [MB per measurement]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sf_types.h"
+#include "checksum.h"
+#include "bench_util.h"
+
+/* packets per size; cycled through so the data isn't all in L1 */
+#define POOL 256
+
+/* where the tcp header sits in an ethernet frame */
+#define FRAME_OFF 34
+
+/* bytes rewritten by the replace case */
+#define REPLACE_LEN 8
+
+/* tcp header plus payload */
+static const int sizes[] = { 40, 64, 576, 1500, 9000 };
+#define NUM_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+static const char* impls[] = { "scalar", "sse2", "avx2" };
+#define NUM_IMPLS (int)(sizeof(impls) / sizeof(impls[0]))
+
+typedef unsigned short (*TcpSum)(pseudoheader*, unsigned short*, int);
+
+static volatile unsigned sink;
+
+/*
+ * in_chksum_tcp() as it was before checksum.c
+ */
+static unsigned short Legacy16 (pseudoheader* ph, unsigned short* d, int dlen)
+{
+    uint16_t* h = (uint16_t*)ph;
+    unsigned int cksum;
+    unsigned short answer = 0;
+
+    cksum  = h[0];
+    cksum += h[1];
+    cksum += h[2];
+    cksum += h[3];
+    cksum += h[4];
+    cksum += h[5];
+
+    while ( dlen >= 32 )
+    {
+        cksum += d[0];
+        cksum += d[1];
+        cksum += d[2];
+        cksum += d[3];
+        cksum += d[4];
+        cksum += d[5];
+        cksum += d[6];
+        cksum += d[7];
+        cksum += d[8];
+        cksum += d[9];
+        cksum += d[10];
+        cksum += d[11];
+        cksum += d[12];
+        cksum += d[13];
+        cksum += d[14];
+        cksum += d[15];
+        d     += 16;
+        dlen  -= 32;
+    }
+
+    while ( dlen >= 8 )
+    {
+        cksum += d[0];
+        cksum += d[1];
+        cksum += d[2];
+        cksum += d[3];
+        d     += 4;
+        dlen  -= 8;
+    }
+
+    while ( dlen > 1 )
+    {
+        cksum += *d++;
+        dlen  -= 2;
+    }
+
+    if ( dlen == 1 )
+    {
+        *(unsigned char*)(&answer) = (*(unsigned char*)d);
+        cksum += answer;
+    }
+
+    cksum  = (cksum >> 16) + (cksum & 0x0000ffff);
+    cksum += (cksum >> 16);
+
+    return (unsigned short)(~cksum);
+}
+
+static unsigned short Current (pseudoheader* ph, unsigned short* d, int dlen)
+{
+    return in_chksum_tcp(ph, d, dlen);
+}
+
+static void SetHeader (pseudoheader* ph, int len, uint32_t* seed)
+{
+    ph->sip = BenchRand(seed);
+    ph->dip = BenchRand(seed);
+    ph->zero = 0;
+    ph->protocol = 6;
+    ph->len = htons((uint16_t)len);
+}
+
+// every length the decoder can hand over, for each implementation
+static int Verify (void)
+{
+    uint8_t buf[FRAME_OFF + 3000];
+    uint32_t seed = 0x1234567;
+    pseudoheader ph;
+    int i, len;
+
+    BenchFill(buf, sizeof(buf), &seed);
+
+    for ( i = 0; i < NUM_IMPLS; i++ )
+    {
+        if ( ChecksumSelect(impls[i]) )
+            continue;
+
+        for ( len = 20; len <= 3000; len++ )
+        {
+            unsigned short* d = (unsigned short*)(buf + FRAME_OFF);
+            SetHeader(&ph, len, &seed);
+
+            if ( Legacy16(&ph, d, len) != Current(&ph, d, len) )
+            {
+                fprintf(stderr, "%s: checksum mismatch at length %d\n",
+                    impls[i], len);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static double Time (
+    TcpSum f, pseudoheader* ph, uint8_t* pool, int len, unsigned iters)
+{
+    unsigned i, sum = 0;
+    size_t stride = FRAME_OFF + len;
+    double t = BenchNow();
+
+    for ( i = 0; i < iters; i++ )
+    {
+        uint8_t* p = pool + (i % POOL) * stride + FRAME_OFF;
+        sum += f(ph, (unsigned short*)p, len);
+    }
+    t = BenchNow() - t;
+    sink += sum;
+
+    return ((double)iters * len) / t / 1e9;
+}
+
+static void RunSizes (unsigned megs)
+{
+    uint32_t seed = 0xdecade;
+    int s, i;
+
+    printf("tcp checksum throughput (GB/s)\n");
+    printf("%6s %8s", "size", "old");
+
+    for ( i = 0; i < NUM_IMPLS; i++ )
+        if ( !ChecksumSelect(impls[i]) )
+            printf(" %8s", impls[i]);
+
+    printf("\n");
+
+    for ( s = 0; s < NUM_SIZES; s++ )
+    {
+        int len = sizes[s];
+        size_t stride = FRAME_OFF + len;
+        uint8_t* pool = (uint8_t*)malloc(POOL * stride);
+        unsigned iters = (unsigned)(((uint64_t)megs << 20) / len);
+        pseudoheader ph;
+
+        if ( !pool )
+            return;
+
+        BenchFill(pool, POOL * stride, &seed);
+        SetHeader(&ph, len, &seed);
+
+        printf("%6d %8.2f", len, Time(Legacy16, &ph, pool, len, iters));
+
+        for ( i = 0; i < NUM_IMPLS; i++ )
+        {
+            if ( ChecksumSelect(impls[i]) )
+                continue;
+
+            printf(" %8.2f", Time(Current, &ph, pool, len, iters));
+        }
+        printf("\n");
+        free(pool);
+    }
+}
+
+// REPLACE_LEN bytes at a random payload offset of a 1500 byte segment;
+// returns -1 if the incremental update doesn't match a recompute
+static int RunReplace (unsigned megs)
+{
+    enum { LEN = 1500, HDR = 20 };
+    uint8_t buf[FRAME_OFF + LEN];
+    uint8_t* d = buf + FRAME_OFF;
+    uint8_t rep[REPLACE_LEN];
+    uint32_t seed = 0xfeed;
+    unsigned i, iters = (unsigned)(((uint64_t)megs << 20) / LEN);
+    unsigned short full = 0, incr;
+    pseudoheader ph;
+    double t;
+
+    ChecksumInit();
+    BenchFill(buf, sizeof(buf), &seed);
+    SetHeader(&ph, LEN, &seed);
+    incr = in_chksum_tcp(&ph, (unsigned short*)d, LEN);
+
+    for ( i = 0; i < 10000; i++ )
+    {
+        unsigned off = HDR + BenchRand(&seed) % (LEN - HDR - REPLACE_LEN);
+        uint64_t sum = cksum_add(d + off, REPLACE_LEN);
+
+        BenchFill(rep, sizeof(rep), &seed);
+        memcpy(d + off, rep, REPLACE_LEN);
+
+        incr = in_chksum_update_sum(
+            incr, sum, cksum_add(d + off, REPLACE_LEN), off & 1);
+        full = in_chksum_tcp(&ph, (unsigned short*)d, LEN);
+
+        if ( incr != full )
+        {
+            fprintf(stderr, "replace: incremental update mismatch at %u\n", off);
+            return -1;
+        }
+    }
+
+    printf("\nreplace %d bytes in a %d byte segment (%s, M/s)\n",
+        REPLACE_LEN, LEN, ChecksumImpl());
+
+    t = BenchNow();
+    for ( i = 0; i < iters; i++ )
+    {
+        unsigned off = HDR + (i * 97) % (LEN - HDR - REPLACE_LEN);
+        memcpy(d + off, rep, REPLACE_LEN);
+        full += in_chksum_tcp(&ph, (unsigned short*)d, LEN);
+    }
+    t = BenchNow() - t;
+    printf("%12s %8.2f\n", "recompute", iters / t / 1e6);
+
+    t = BenchNow();
+    for ( i = 0; i < iters; i++ )
+    {
+        unsigned off = HDR + (i * 97) % (LEN - HDR - REPLACE_LEN);
+        uint64_t sum = cksum_add(d + off, REPLACE_LEN);
+        memcpy(d + off, rep, REPLACE_LEN);
+        incr = in_chksum_update_sum(
+            incr, sum, cksum_add(d + off, REPLACE_LEN), off & 1);
+    }
+    t = BenchNow() - t;
+    printf("%12s %8.2f\n", "incremental", iters / t / 1e6);
+
+    sink += full + incr;
+    return 0;
+}
+
+int main (int argc, char* argv[])
+{
+    unsigned megs = BenchMegs(argc, argv);
+
+    if ( Verify() )
+        return 1;
+
+    RunSizes(megs);
+
+    if ( RunReplace(megs) )
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * sfrt_bench.c
+ *
+ * Compares sfrt lookups for the DIR-n-m table types snort used before
+ * POPTRIE and for POPTRIE itself.  Two prefix sets are loaded into each
+ * type: one sized and shaped like a full BGP table and one of host
+ * addresses, like an attribute table.  Every lookup result is checked
+ * against DIR_8x16 before anything is timed.
+ *
+ * usage: sfrt_bench [ipv4 prefixes] [ipv6 prefixes]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sf_types.h"
+#include "sfrt.h"
+#include "bench_util.h"
+
+/* a full table when this was written */
+#define BGP_V4 500000
+#define BGP_V6 20000
+
+/* the default max_attribute_hosts */
+#define HOSTS 10000
+
+/* addresses looked up, cycled through LOOKUP_ROUNDS times */
+#define LOOKUPS (1 << 20)
+#define LOOKUP_ROUNDS 4
+
+/* per family, in MB; the 16 bit ipv6 strides can't hold a bgp table */
+#define MEMCAP 512
+
+typedef struct
+{
+    const char* name;
+    char type;
+} TableType;
+
+static const TableType types[] =
+{
+    { "DIR_16_4x4_16x5_4x4", DIR_16_4x4_16x5_4x4 },
+    { "DIR_16x7_4x4", DIR_16x7_4x4 },
+    { "DIR_8x16", DIR_8x16 },
+    { "POPTRIE", POPTRIE },
+};
+#define NUM_TYPES (int)(sizeof(types) / sizeof(types[0]))
+
+/* the type lookups are checked against */
+#define REF_TYPE 2
+
+/* prefix length and how many per 1000 have it */
+typedef struct
+{
+    int len;
+    int weight;
+} LengthWeight;
+
+/* roughly the mix of a public bgp table */
+static const LengthWeight bgp_v4[] =
+{
+    { 12, 4 }, { 14, 3 }, { 15, 3 }, { 16, 25 }, { 17, 15 }, { 18, 25 },
+    { 19, 40 }, { 20, 50 }, { 21, 50 }, { 22, 90 }, { 23, 95 }, { 24, 600 },
+    { 0, 0 }
+};
+
+static const LengthWeight bgp_v6[] =
+{
+    { 28, 15 }, { 29, 15 }, { 32, 280 }, { 36, 30 }, { 40, 40 }, { 44, 40 },
+    { 46, 40 }, { 48, 540 }, { 0, 0 }
+};
+
+static const LengthWeight hosts_v4[] = { { 32, 1000 }, { 0, 0 } };
+static const LengthWeight hosts_v6[] = { { 128, 1000 }, { 0, 0 } };
+
+typedef struct
+{
+    const char* name;
+    sfip_t* prefixes;
+    int num_prefixes;
+    sfip_t* lookups[2];
+} PrefixSet;
+
+static volatile uintptr_t sink;
+
+static int PickLength (const LengthWeight* lw, uint32_t* seed)
+{
+    int r = BenchRand(seed) % 1000;
+
+    while ( lw[1].len && r >= lw->weight )
+    {
+        r -= lw->weight;
+        lw++;
+    }
+    return lw->len;
+}
+
+/* clear the bits of ip past len */
+static void Mask (sfip_t* ip, int len)
+{
+    int i;
+
+    for ( i = 0; i < 4; i++ )
+    {
+        int lo = i * 32;
+
+        if ( len <= lo )
+            ip->ip32[i] = 0;
+
+        else if ( len < lo + 32 )
+            ip->ip32[i] &= ~((1u << (lo + 32 - len)) - 1);
+    }
+}
+
+/* ipv4 unicast space, or the parts of ipv6 the rirs hand out; host
+ * sets are packed into 16 networks the way internal addresses are */
+static void RandomAddress (sfip_t* ip, int v6, int hosts, uint32_t* seed)
+{
+    static const uint16_t v6_blocks[] = { 0x2001, 0x2400, 0x2600, 0x2800, 0x2a00, 0x2c00 };
+    int i;
+
+    memset(ip, 0, sizeof(*ip));
+
+    if ( !v6 )
+    {
+        ip->family = AF_INET;
+        ip->bits = 32;
+        ip->ip32[0] = BenchRand(seed);
+
+        if ( hosts )
+            ip->ip32[0] = (ip->ip32[0] & 0x000fffff) | 0x0a000000;
+        else
+            ip->ip32[0] = (ip->ip32[0] & 0x00ffffff) | ((1 + BenchRand(seed) % 223) << 24);
+        return;
+    }
+    ip->family = AF_INET6;
+    ip->bits = 128;
+
+    for ( i = 0; i < 4; i++ )
+        ip->ip32[i] = BenchRand(seed);
+
+    if ( hosts )
+    {
+        ip->ip32[0] = 0xfd000000;
+        ip->ip32[1] &= 0xf;
+        return;
+    }
+    ip->ip32[0] = (ip->ip32[0] & 0xffff) | ((uint32_t)(v6_blocks[
+        BenchRand(seed) % (sizeof(v6_blocks) / sizeof(v6_blocks[0]))] +
+        (BenchRand(seed) & 0xf)) << 16);
+}
+
+static void MakeSet (
+    PrefixSet* set, const char* name, int n4, int n6,
+    const LengthWeight* lw4, const LengthWeight* lw6, uint32_t* seed)
+{
+    int i, f, hosts = (lw4[0].len == 32);
+
+    set->name = name;
+    set->num_prefixes = n4 + n6;
+    set->prefixes = (sfip_t*)calloc(n4 + n6 + 1, sizeof(sfip_t));
+
+    for ( i = 0; i < n4 + n6; i++ )
+    {
+        sfip_t* ip = set->prefixes + i;
+        int v6 = (i >= n4);
+
+        RandomAddress(ip, v6, hosts, seed);
+        ip->bits = (int16_t)PickLength(v6 ? lw6 : lw4, seed);
+        Mask(ip, ip->bits);
+    }
+
+    /* 3 in 4 lookups are under a prefix, the rest anywhere */
+    for ( f = 0; f < 2; f++ )
+    {
+        int base = f ? n4 : 0, count = f ? n6 : n4;
+
+        set->lookups[f] = (sfip_t*)calloc(LOOKUPS, sizeof(sfip_t));
+
+        for ( i = 0; i < LOOKUPS; i++ )
+        {
+            sfip_t* ip = set->lookups[f] + i;
+            RandomAddress(ip, f, hosts, seed);
+
+            if ( count && (BenchRand(seed) & 3) )
+            {
+                const sfip_t* p = set->prefixes + base + BenchRand(seed) % count;
+                int w;
+
+                for ( w = 0; w < 4; w++ )
+                {
+                    int lo = w * 32;
+
+                    if ( p->bits >= lo + 32 )
+                        ip->ip32[w] = p->ip32[w];
+
+                    else if ( p->bits > lo )
+                    {
+                        uint32_t mask = ~((1u << (lo + 32 - p->bits)) - 1);
+                        ip->ip32[w] = p->ip32[w] | (ip->ip32[w] & ~mask);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void FreeSet (PrefixSet* set)
+{
+    free(set->prefixes);
+    free(set->lookups[0]);
+    free(set->lookups[1]);
+}
+
+/* most specific first would leave stale entries; see sfrt.h */
+static int ByLength (const void* a, const void* b)
+{
+    const sfip_t* x = (const sfip_t*)a;
+    const sfip_t* y = (const sfip_t*)b;
+    return (int)x->bits - (int)y->bits;
+}
+
+/* load the prefixes of one family; returns NULL if they don't fit */
+static table_t* Load (
+    const PrefixSet* set, int v6, char type, double* load, double* compile)
+{
+    table_t* t = sfrt_new(type, IPv6, set->num_prefixes + 1, MEMCAP);
+    double start = BenchNow();
+    int i;
+
+    if ( !t )
+        return NULL;
+
+    for ( i = 0; i < set->num_prefixes; i++ )
+    {
+        sfip_t ip = set->prefixes[i];
+
+        if ( (ip.family == AF_INET6) != v6 )
+            continue;
+
+        if ( sfrt_insert(&ip, (unsigned char)ip.bits,
+                (GENERIC)(set->prefixes + i), RT_FAVOR_SPECIFIC, t) != RT_SUCCESS )
+        {
+            sfrt_free(t);
+            return NULL;
+        }
+    }
+    *load = BenchNow() - start;
+
+    start = BenchNow();
+    if ( sfrt_compile(t) != RT_SUCCESS )
+    {
+        sfrt_free(t);
+        return NULL;
+    }
+    *compile = BenchNow() - start;
+
+    return t;
+}
+
+static double Time (table_t* t, sfip_t* lookups)
+{
+    uintptr_t sum = 0;
+    double start = BenchNow();
+    int r, i;
+
+    for ( r = 0; r < LOOKUP_ROUNDS; r++ )
+        for ( i = 0; i < LOOKUPS; i++ )
+            sum += (uintptr_t)sfrt_lookup(lookups + i, t);
+
+    sink += sum;
+    return (double)LOOKUP_ROUNDS * LOOKUPS / (BenchNow() - start) / 1e6;
+}
+
+static int RunSet (PrefixSet* set, int n4, int n6)
+{
+    GENERIC* ref = (GENERIC*)calloc(LOOKUPS, sizeof(GENERIC));
+    int i, f, k;
+
+    qsort(set->prefixes, set->num_prefixes, sizeof(sfip_t), ByLength);
+
+    printf("%s: %d ipv4 and %d ipv6 prefixes\n", set->name, n4, n6);
+    printf("%-20s %6s %8s %8s %8s %10s\n",
+        "table", "family", "load ms", "comp ms", "MB", "lookup M/s");
+
+    for ( f = 0; f < 2; f++ )
+    {
+        double load, compile;
+        table_t* t = Load(set, f, types[REF_TYPE].type, &load, &compile);
+
+        if ( !t )
+        {
+            fprintf(stderr, "%s: %s doesn't fit\n", set->name, types[REF_TYPE].name);
+            free(ref);
+            return -1;
+        }
+        for ( i = 0; i < LOOKUPS; i++ )
+            ref[i] = sfrt_lookup(set->lookups[f] + i, t);
+
+        sfrt_free(t);
+
+        for ( k = 0; k < NUM_TYPES; k++ )
+        {
+            const char* family = f ? "ipv6" : "ipv4";
+            t = Load(set, f, types[k].type, &load, &compile);
+
+            if ( !t )
+            {
+                printf("%-20s %6s over the %d MB memcap\n",
+                    types[k].name, family, MEMCAP);
+                continue;
+            }
+
+            for ( i = 0; i < LOOKUPS; i++ )
+            {
+                if ( sfrt_lookup(set->lookups[f] + i, t) != ref[i] )
+                {
+                    fprintf(stderr, "%s: %s %s lookup %d differs from %s\n",
+                        set->name, types[k].name, family, i, types[REF_TYPE].name);
+                    free(ref);
+                    return -1;
+                }
+            }
+
+            printf("%-20s %6s %8.0f %8.0f %8.1f %10.2f\n", types[k].name, family,
+                load * 1e3, compile * 1e3, sfrt_usage(t) / 1048576.0,
+                Time(t, set->lookups[f]));
+
+            sfrt_free(t);
+        }
+    }
+    printf("\n");
+
+    free(ref);
+    return 0;
+}
+
+int main (int argc, char* argv[])
+{
+    int n4 = (argc > 1) ? atoi(argv[1]) : BGP_V4;
+    int n6 = (argc > 2) ? atoi(argv[2]) : BGP_V6;
+    uint32_t seed = 0xb6b6b6;
+    PrefixSet set;
+    int ret;
+
+    if ( n4 < 0 || n6 < 0 )
+    {
+        fprintf(stderr, "usage: sfrt_bench [ipv4 prefixes] [ipv6 prefixes]\n");
+        return 1;
+    }
+
+    MakeSet(&set, "bgp", n4, n6, bgp_v4, bgp_v6, &seed);
+    ret = RunSet(&set, n4, n6);
+    FreeSet(&set);
+
+    if ( ret )
+        return 1;
+
+    MakeSet(&set, "hosts", HOSTS, HOSTS, hosts_v4, hosts_v6, &seed);
+    ret = RunSet(&set, HOSTS, HOSTS);
+    FreeSet(&set);
+
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2013 Sourcefire, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License Version 2 as
+ * published by the Free Software Foundation.  You may not use, modify or
+ * distribute this program under any other version of the GNU General
+ * Public License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * sha256_bench.c
+ *
+ * Times the file SHA-256 from file_sha256.c for small and large files,
+ * with the portable code and with the x86 SHA extensions if this cpu
+ * has them.  Files are fed in segment sized pieces the way the file
+ * api sees them.  Every implementation is checked against the FIPS
+ * 180-2 test vectors and against the others before it is timed.
+ *
+ * usage: sha256_bench [MB per measurement]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sf_types.h"
+#include "file_sha256.h"
+#include "bench_util.h"
+
+/* bytes handed to SHA256UPDATE at a time, a full tcp segment */
+#define SEGMENT 1460
+
+/* small files are cycled through at least this much data */
+#define POOL_SIZE (16 << 20)
+
+#define DIGEST_SIZE 32
+
+static const unsigned sizes[] =
+{
+    64, 1024, 16 << 10, 256 << 10, 4 << 20, 64 << 20
+};
+#define NUM_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+#ifdef HAVE_OPENSSL_SHA
+static const char* impls[] = { "openssl" };
+
+static int SHA256Select (const char* impl)
+{
+    return strcmp(impl, "openssl") ? -1 : 0;
+}
+#else
+static const char* impls[] = { "c", "sha-ni" };
+#endif
+#define NUM_IMPLS (int)(sizeof(impls) / sizeof(impls[0]))
+
+static volatile unsigned sink;
+
+static void Hash (
+    const uint8_t* data, size_t len, size_t seg, unsigned char* digest)
+{
+    SHA256CONTEXT ctx;
+
+    SHA256INIT(&ctx);
+
+    while ( len )
+    {
+        size_t n = (len < seg) ? len : seg;
+        SHA256UPDATE(&ctx, data, n);
+        data += n;
+        len -= n;
+    }
+    SHA256FINAL(digest, &ctx);
+}
+
+static void ToHex (const unsigned char* digest, char* hex)
+{
+    int i;
+
+    for ( i = 0; i < DIGEST_SIZE; i++ )
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+}
+
+/* FIPS 180-2 appendix B plus the empty message */
+static int VerifyVectors (const char* impl)
+{
+    static const struct
+    {
+        const char* msg;
+        unsigned repeat;
+        const char* hash;
+    } vec[] =
+    {
+        { "", 1,
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", 1,
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "a", 1000000,
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    };
+    int v;
+
+    for ( v = 0; v < (int)(sizeof(vec) / sizeof(vec[0])); v++ )
+    {
+        size_t len = strlen(vec[v].msg);
+        size_t total = len * vec[v].repeat;
+        uint8_t* buf = (uint8_t*)malloc(total + 1);
+        unsigned char digest[SHA256_HASH_SIZE];
+        char hex[2 * DIGEST_SIZE + 1];
+        unsigned i;
+
+        if ( !buf )
+            return -1;
+
+        for ( i = 0; i < vec[v].repeat; i++ )
+            memcpy(buf + i * len, vec[v].msg, len);
+
+        Hash(buf, total, SEGMENT, digest);
+        free(buf);
+        ToHex(digest, hex);
+
+        if ( strcmp(hex, vec[v].hash) )
+        {
+            fprintf(stderr, "%s: wrong hash for test vector %d\n", impl, v);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// every length up to a few blocks, fed in random pieces, against the
+// first implementation hashing it in one piece
+static int Verify (void)
+{
+    uint8_t buf[4096];
+    uint32_t seed = 0x5a5a5a;
+    int i;
+
+    BenchFill(buf, sizeof(buf), &seed);
+
+    for ( i = 0; i < NUM_IMPLS; i++ )
+    {
+        size_t len;
+
+        if ( SHA256Select(impls[i]) )
+            continue;
+
+        if ( VerifyVectors(impls[i]) )
+            return -1;
+
+        for ( len = 0; len <= sizeof(buf); len++ )
+        {
+            unsigned char ref[SHA256_HASH_SIZE], digest[SHA256_HASH_SIZE];
+            size_t seg = 1 + BenchRand(&seed) % 200;
+
+            SHA256Select(impls[0]);
+            Hash(buf, len, len + 1, ref);
+
+            SHA256Select(impls[i]);
+            Hash(buf, len, seg, digest);
+
+            if ( memcmp(ref, digest, DIGEST_SIZE) )
+            {
+                fprintf(stderr, "%s: hash mismatch at length %u\n",
+                    impls[i], (unsigned)len);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// MB/s for files of size bytes, cycled through pool
+static double Time (const uint8_t* pool, size_t pool_size, size_t size, unsigned files)
+{
+    unsigned char digest[SHA256_HASH_SIZE];
+    unsigned i, sum = 0;
+    size_t off = 0;
+    double t = BenchNow();
+
+    for ( i = 0; i < files; i++ )
+    {
+        Hash(pool + off, size, SEGMENT, digest);
+        sum += digest[0];
+
+        off += size;
+        if ( off + size > pool_size )
+            off = 0;
+    }
+    t = BenchNow() - t;
+    sink += sum;
+
+    return ((double)files * size) / t / (1 << 20);
+}
+
+static int RunSizes (unsigned megs)
+{
+    uint32_t seed = 0xc0ffee;
+    int s, i;
+
+    printf("sha-256 throughput (MB/s), %d byte segments\n", SEGMENT);
+    printf("%10s", "file size");
+
+    for ( i = 0; i < NUM_IMPLS; i++ )
+        if ( !SHA256Select(impls[i]) )
+            printf(" %8s", impls[i]);
+
+    printf("\n");
+
+    for ( s = 0; s < NUM_SIZES; s++ )
+    {
+        size_t size = sizes[s];
+        size_t pool_size = (size < POOL_SIZE) ? POOL_SIZE : size;
+        uint8_t* pool = (uint8_t*)malloc(pool_size);
+        unsigned files = (unsigned)(((uint64_t)megs << 20) / size);
+
+        if ( !pool )
+            return -1;
+
+        if ( !files )
+            files = 1;
+
+        BenchFill(pool, pool_size, &seed);
+
+        if ( size < 1024 )
+            printf("%10u", (unsigned)size);
+        else if ( size < (1 << 20) )
+            printf("%9uK", (unsigned)(size >> 10));
+        else
+            printf("%9uM", (unsigned)(size >> 20));
+
+        for ( i = 0; i < NUM_IMPLS; i++ )
+        {
+            if ( SHA256Select(impls[i]) )
+                continue;
+
+            printf(" %8.1f", Time(pool, pool_size, size, files));
+        }
+        printf("\n");
+        free(pool);
+    }
+    return 0;
+}
+
+int main (int argc, char* argv[])
+{
+    unsigned megs = BenchMegs(argc, argv);
+
+    if ( Verify() )
+        return 1;
+
+    if ( RunSizes(megs) )
+        return 1;
+
+    return 0;
+}